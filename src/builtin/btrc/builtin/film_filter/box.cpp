@@ -1,17 +1,45 @@
+#include <fmt/format.h>
+
 #include <btrc/builtin/film_filter/box.h>
 
 BTRC_BUILTIN_BEGIN
 
-CVec2f BoxFilter::sample(Sampler &sampler) const
+void BoxFilter::set_radius(float radius)
+{
+    radius_ = radius;
+}
+
+float BoxFilter::get_radius() const
+{
+    return radius_;
+}
+
+std::string BoxFilter::get_table_key() const
+{
+    return fmt::format("box {}", radius_);
+}
+
+float BoxFilter::eval_host(float x) const
+{
+    return std::abs(x) <= radius_ ? 1.0f : 0.0f;
+}
+
+f32 BoxFilter::eval(f32 x) const
+{
+    return cstd::select(cstd::abs(x) <= radius_, f32(1), f32(0));
+}
+
+SeparableFilter::AxisSample BoxFilter::sample_axis(f32 u) const
 {
-    var x = sampler.get1d() - 0.5f;
-    var y = sampler.get1d() - 0.5f;
-    return CVec2f(x, y);
+    // the cdf is linear
+    return AxisSample{ 2 * radius_ * (u - 0.5f), f32(1) };
 }
 
 RC<FilmFilter> BoxFilterCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
-    return newRC<BoxFilter>();
+    auto result = newRC<BoxFilter>();
+    result->set_radius(node->parse_child_or("radius", 0.5f));
+    return result;
 }
 
 BTRC_BUILTIN_END
@@ -1,15 +1,31 @@
 #pragma once
 
-#include <btrc/core/film_filter.h>
+#include <btrc/builtin/film_filter/separable.h>
 #include <btrc/factory/context.h>
 
 BTRC_BUILTIN_BEGIN
 
-class BoxFilter : public FilmFilter
+class BoxFilter : public SeparableFilter
 {
 public:
 
-    CVec2f sample(Sampler &sampler) const override;
+    void set_radius(float radius);
+
+protected:
+
+    float get_radius() const override;
+
+    std::string get_table_key() const override;
+
+    float eval_host(float x) const override;
+
+    f32 eval(f32 x) const override;
+
+    AxisSample sample_axis(f32 u) const override;
+
+private:
+
+    float radius_ = 0.5f;
 };
 
 class BoxFilterCreator : public factory::Creator<FilmFilter>
@@ -1,11 +1,11 @@
 #pragma once
 
-#include <btrc/core/film_filter.h>
+#include <btrc/builtin/film_filter/separable.h>
 #include <btrc/factory/context.h>
 
 BTRC_BUILTIN_BEGIN
 
-class GaussianFilter : public FilmFilter
+class GaussianFilter : public SeparableFilter
 {
 public:
 
@@ -15,14 +15,21 @@ public:
 
     void commit() override;
 
-    CVec2f sample(Sampler &sampler) const override;
+protected:
+
+    float get_radius() const override;
+
+    std::string get_table_key() const override;
+
+    float eval_host(float x) const override;
+
+    f32 eval(f32 x) const override;
 
 private:
 
     float radius_ = 0;
     float alpha_ = 0;
     float expv_ = 0;
-    CAliasTable alias_table_;
 };
 
 class GaussianFilterCreator : public factory::Creator<FilmFilter>
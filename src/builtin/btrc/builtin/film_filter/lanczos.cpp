@@ -0,0 +1,65 @@
+#include <fmt/format.h>
+
+#include <btrc/builtin/film_filter/lanczos.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    float sinc(float x)
+    {
+        if(std::abs(x) < 1e-5f)
+            return 1;
+        return std::sin(btrc_pi * x) / (btrc_pi * x);
+    }
+
+    f32 sinc(f32 x)
+    {
+        var px = btrc_pi * x;
+        return cstd::select(cstd::abs(x) < 1e-5f, f32(1), cstd::sin(px) / px);
+    }
+
+} // namespace anonymous
+
+void LanczosFilter::set_radius(float radius)
+{
+    radius_ = radius;
+}
+
+void LanczosFilter::set_tau(float tau)
+{
+    tau_ = tau;
+}
+
+float LanczosFilter::get_radius() const
+{
+    return radius_;
+}
+
+std::string LanczosFilter::get_table_key() const
+{
+    return fmt::format("lanczos {} {}", radius_, tau_);
+}
+
+float LanczosFilter::eval_host(float x) const
+{
+    if(std::abs(x) > radius_)
+        return 0;
+    return sinc(x) * sinc(x / tau_);
+}
+
+f32 LanczosFilter::eval(f32 x) const
+{
+    return cstd::select(cstd::abs(x) > radius_, f32(0), sinc(x) * sinc(x / tau_));
+}
+
+RC<FilmFilter> LanczosFilterCreator::create(RC<const factory::Node> node, factory::Context &context)
+{
+    auto result = newRC<LanczosFilter>();
+    result->set_radius(node->parse_child_or("radius", 4.0f));
+    result->set_tau(node->parse_child_or("tau", 3.0f));
+    return result;
+}
+
+BTRC_BUILTIN_END
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <btrc/builtin/film_filter/separable.h>
+#include <btrc/factory/context.h>
+
+BTRC_BUILTIN_BEGIN
+
+// sinc(x) windowed by sinc(x / tau)
+class LanczosFilter : public SeparableFilter
+{
+public:
+
+    void set_radius(float radius);
+
+    void set_tau(float tau);
+
+protected:
+
+    float get_radius() const override;
+
+    std::string get_table_key() const override;
+
+    float eval_host(float x) const override;
+
+    f32 eval(f32 x) const override;
+
+private:
+
+    float radius_ = 4;
+    float tau_ = 3;
+};
+
+class LanczosFilterCreator : public factory::Creator<FilmFilter>
+{
+public:
+
+    std::string get_name() const override { return "lanczos"; }
+
+    RC<FilmFilter> create(RC<const factory::Node> node, factory::Context &context) override;
+};
+
+BTRC_BUILTIN_END
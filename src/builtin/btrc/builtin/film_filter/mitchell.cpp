@@ -0,0 +1,60 @@
+#include <fmt/format.h>
+
+#include <btrc/builtin/film_filter/mitchell.h>
+
+BTRC_BUILTIN_BEGIN
+
+void MitchellFilter::set_radius(float radius)
+{
+    radius_ = radius;
+}
+
+void MitchellFilter::set_b(float b)
+{
+    b_ = b;
+}
+
+void MitchellFilter::set_c(float c)
+{
+    c_ = c;
+}
+
+float MitchellFilter::get_radius() const
+{
+    return radius_;
+}
+
+std::string MitchellFilter::get_table_key() const
+{
+    return fmt::format("mitchell {} {} {}", radius_, b_, c_);
+}
+
+float MitchellFilter::eval_host(float x) const
+{
+    x = std::abs(2 * x / radius_);
+    if(x <= 1)
+        return ((12 - 9 * b_ - 6 * c_) * x * x * x + (-18 + 12 * b_ + 6 * c_) * x * x + (6 - 2 * b_)) / 6;
+    if(x <= 2)
+        return ((-b_ - 6 * c_) * x * x * x + (6 * b_ + 30 * c_) * x * x + (-12 * b_ - 48 * c_) * x + (8 * b_ + 24 * c_)) / 6;
+    return 0;
+}
+
+f32 MitchellFilter::eval(f32 x) const
+{
+    x = cstd::abs(2.0f * x / radius_);
+    var x2 = x * x, x3 = x2 * x;
+    var inner = ((12 - 9 * b_ - 6 * c_) * x3 + (-18 + 12 * b_ + 6 * c_) * x2 + (6 - 2 * b_)) / 6;
+    var outer = ((-b_ - 6 * c_) * x3 + (6 * b_ + 30 * c_) * x2 + (-12 * b_ - 48 * c_) * x + (8 * b_ + 24 * c_)) / 6;
+    return cstd::select(x <= 1.0f, inner, cstd::select(x <= 2.0f, outer, f32(0)));
+}
+
+RC<FilmFilter> MitchellFilterCreator::create(RC<const factory::Node> node, factory::Context &context)
+{
+    auto result = newRC<MitchellFilter>();
+    result->set_radius(node->parse_child_or("radius", 2.0f));
+    result->set_b(node->parse_child_or("b", 1.0f / 3));
+    result->set_c(node->parse_child_or("c", 1.0f / 3));
+    return result;
+}
+
+BTRC_BUILTIN_END
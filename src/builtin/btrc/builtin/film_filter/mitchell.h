@@ -0,0 +1,45 @@
+#pragma once
+
+#include <btrc/builtin/film_filter/separable.h>
+#include <btrc/factory/context.h>
+
+BTRC_BUILTIN_BEGIN
+
+// mitchell-netravali filter scaled to the given radius
+class MitchellFilter : public SeparableFilter
+{
+public:
+
+    void set_radius(float radius);
+
+    void set_b(float b);
+
+    void set_c(float c);
+
+protected:
+
+    float get_radius() const override;
+
+    std::string get_table_key() const override;
+
+    float eval_host(float x) const override;
+
+    f32 eval(f32 x) const override;
+
+private:
+
+    float radius_ = 2;
+    float b_ = 1.0f / 3;
+    float c_ = 1.0f / 3;
+};
+
+class MitchellFilterCreator : public factory::Creator<FilmFilter>
+{
+public:
+
+    std::string get_name() const override { return "mitchell"; }
+
+    RC<FilmFilter> create(RC<const factory::Node> node, factory::Context &context) override;
+};
+
+BTRC_BUILTIN_END
@@ -0,0 +1,114 @@
+#include <map>
+#include <mutex>
+
+#include <btrc/builtin/film_filter/separable.h>
+#include <btrc/utils/exception.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    // power of 2 for the unrolled binary search
+    constexpr int TABLE_SIZE = 64;
+
+    // evaluations of f in each table bin
+    constexpr int BIN_SAMPLES = 16;
+
+} // namespace anonymous
+
+struct SeparableFilter::Table
+{
+    std::vector<float> cdf;           // TABLE_SIZE + 1 entries
+    std::vector<float> weight_scales; // weight of a sample x in bin i is f(x) * weight_scales[i]
+};
+
+void SeparableFilter::commit()
+{
+    static std::mutex cache_mutex;
+    static std::map<std::string, RC<const Table>> cache;
+
+    const std::string key = get_table_key();
+    std::lock_guard lock(cache_mutex);
+    if(auto it = cache.find(key); it != cache.end())
+    {
+        table_ = it->second;
+        return;
+    }
+
+    const float radius = get_radius();
+    if(!(radius > 0))
+        throw BtrcException("filter radius must be positive");
+    const float bin_width = 2 * radius / TABLE_SIZE;
+
+    // bin values are the max of |f| in bins, so that the pdf is positive wherever f is not zero
+    std::vector<float> bin_values(TABLE_SIZE);
+    double integral = 0, abs_integral = 0;
+    for(int i = 0; i < TABLE_SIZE; ++i)
+    {
+        const float bin_beg = -radius + bin_width * static_cast<float>(i);
+        float max_abs = 0;
+        for(int j = 0; j <= BIN_SAMPLES; ++j)
+        {
+            const float x = bin_beg + bin_width * static_cast<float>(j) / BIN_SAMPLES;
+            max_abs = (std::max)(max_abs, std::abs(eval_host(x)));
+            if(j < BIN_SAMPLES)
+            {
+                const float mid = bin_beg + bin_width * (static_cast<float>(j) + 0.5f) / BIN_SAMPLES;
+                integral += static_cast<double>(eval_host(mid)) * bin_width / BIN_SAMPLES;
+            }
+        }
+        bin_values[i] = max_abs;
+        abs_integral += static_cast<double>(max_abs) * bin_width;
+    }
+    if(!(integral > 0))
+        throw BtrcException("filter integral must be positive");
+
+    auto table = newRC<Table>();
+    table->cdf.resize(TABLE_SIZE + 1);
+    table->weight_scales.resize(TABLE_SIZE);
+    double sum = 0;
+    for(int i = 0; i < TABLE_SIZE; ++i)
+    {
+        table->cdf[i] = static_cast<float>(sum / abs_integral);
+        sum += static_cast<double>(bin_values[i]) * bin_width;
+
+        // f(x) / (pdf(x) * integral), where pdf(x) = bin_values[i] / abs_integral
+        table->weight_scales[i] = bin_values[i] > 0 ?
+            static_cast<float>(abs_integral / (bin_values[i] * integral)) : 0.0f;
+    }
+    table->cdf[TABLE_SIZE] = 1;
+
+    cache.insert({ key, table });
+    table_ = std::move(table);
+}
+
+FilmFilter::SampleResult SeparableFilter::sample(Sampler &sampler) const
+{
+    var sam = sampler.get2d();
+    auto x = sample_axis(sam[0]);
+    auto y = sample_axis(sam[1]);
+    return SampleResult{ CVec2f(x.x, y.x), x.weight * y.weight };
+}
+
+SeparableFilter::AxisSample SeparableFilter::sample_axis(f32 u) const
+{
+    assert(table_);
+    var cdf = cuj::const_data(std::span<const float>(table_->cdf));
+    var weight_scales = cuj::const_data(std::span<const float>(table_->weight_scales));
+
+    // last bin with cdf[bin] <= u. bins with zero probability are never selected
+    var bin = i32(0);
+    for(int step = TABLE_SIZE / 2; step > 0; step /= 2)
+        bin = cstd::select(cdf[bin + step] <= u, bin + step, bin);
+
+    var cdf_beg = cdf[bin];
+    var t = cstd::clamp((u - cdf_beg) / (cdf[bin + 1] - cdf_beg), 0.0f, 1.0f);
+
+    const float radius = get_radius();
+    const float bin_width = 2 * radius / TABLE_SIZE;
+    var x = -radius + bin_width * (f32(bin) + t);
+    return AxisSample{ x, eval(x) * weight_scales[bin] };
+}
+
+BTRC_BUILTIN_END
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <btrc/core/film_filter.h>
+
+BTRC_BUILTIN_BEGIN
+
+// filter f(x) * f(y) with an even f supported on [-radius, radius].
+// each axis is sampled by inverting the cdf of a tabulated |f|, and the sample weight
+// is the exact f divided by the tabulated pdf, so f may have negative lobes.
+// tables are built once for each table key and shared by all filters with that key
+class SeparableFilter : public FilmFilter
+{
+public:
+
+    void commit() override;
+
+    SampleResult sample(Sampler &sampler) const override;
+
+protected:
+
+    struct AxisSample
+    {
+        f32 x;
+        f32 weight;
+    };
+
+    virtual float get_radius() const = 0;
+
+    // filters with the same key must have the same f
+    virtual std::string get_table_key() const = 0;
+
+    virtual float eval_host(float x) const = 0;
+
+    virtual f32 eval(f32 x) const = 0;
+
+    virtual AxisSample sample_axis(f32 u) const;
+
+private:
+
+    struct Table;
+
+    RC<const Table> table_;
+};
+
+BTRC_BUILTIN_END
@@ -6,6 +6,16 @@
 
 BTRC_BUILTIN_BEGIN
 
+namespace
+{
+
+    // spherical sampling is numerically unstable for tiny solid angles,
+    // and not worth it for small ones
+    constexpr float MIN_SPHERICAL_SAMPLING_AREA = 3e-4f;
+    constexpr float MAX_SPHERICAL_SAMPLING_AREA = 6.22f;
+
+} // namespace anonymous
+
 void TriangleMesh::set_optix_context(optix::Context &optix_ctx)
 {
     optix_ctx_ = &optix_ctx;
@@ -163,11 +173,30 @@ void TriangleMesh::commit()
     AliasTable table(triangle_areas);
     alias_table_ = CAliasTable(table);
 
+    device_triangle_areas_ = cuda::Buffer<float>(triangle_areas);
+
     total_area_ = std::accumulate(triangle_areas.begin(), triangle_areas.end(), 0.0f);
 
     bbox_ = AABB3f{};
     for(auto &p : loader.get_positions())
         bbox_ = union_aabb(bbox_, p);
+
+    // area-weighted average normal, widened to contain all normals
+    Vec3f sum_normal;
+    for(size_t i = 0; i < prim_count; ++i)
+        sum_normal = sum_normal + triangle_areas[i] * loader.get_geometry_ezs()[i];
+    if(length_square(sum_normal) > 0)
+    {
+        const Vec3f axis = normalize(sum_normal);
+        float cos_theta = 1;
+        for(size_t i = 0; i < prim_count; ++i)
+            cos_theta = (std::min)(cos_theta, dot(axis, loader.get_geometry_ezs()[i]));
+        normal_cone_ = DirectionCone(axis, cos_theta);
+    }
+    else
+        normal_cone_ = DirectionCone::entire_sphere();
+
+    triangle_areas_ = std::move(triangle_areas);
 }
 
 OptixTraversableHandle TriangleMesh::get_blas() const
@@ -185,18 +214,132 @@ AABB3f TriangleMesh::get_bounding_box() const
     return bbox_;
 }
 
+float TriangleMesh::get_area() const
+{
+    return total_area_;
+}
+
+DirectionCone TriangleMesh::get_normal_cone() const
+{
+    return normal_cone_;
+}
+
 Geometry::SampleResult TriangleMesh::sample_inline(ref<Sam3> sam) const
 {
-    using namespace cuj;
+    var prim_idx = alias_table_.sample(sam[0]);
+    var result = sample_primitive_inline(prim_idx, CVec2f(sam[1], sam[2]));
+    result.pdf = 1 / total_area_;
+    return result;
+}
+
+f32 TriangleMesh::pdf_inline(ref<CVec3f> pos) const
+{
+    return 1 / total_area_;
+}
 
+Geometry::SampleResult TriangleMesh::sample_inline(ref<CVec3f> dst_pos, ref<Sam3> sam) const
+{
     var prim_idx = alias_table_.sample(sam[0]);
-    var uv = sample_triangle_uniform(sam[1], sam[2]);
+    var triangle = load_triangle(prim_idx);
+    var solid_angle = spherical_sampling_area(dst_pos, triangle);
+
+    CVec2f uv;
+    $if(solid_angle > 0)
+    {
+        var dir = sample_spherical_triangle(
+            normalize(triangle.a - dst_pos),
+            normalize(triangle.a + triangle.ba - dst_pos),
+            normalize(triangle.a + triangle.ca - dst_pos),
+            sam[1], sam[2]);
+
+        // intersect the triangle with the sampled ray
+        var s = dst_pos - triangle.a;
+        var s1 = cross(dir, triangle.ca);
+        var inv_divisor = 1.0f / dot(s1, triangle.ba);
+        var b1 = cstd::clamp(dot(s, s1) * inv_divisor, 0.0f, 1.0f);
+        var b2 = cstd::clamp(dot(dir, cross(s, triangle.ba)) * inv_divisor, 0.0f, 1.0f);
+        var sum = b1 + b2;
+        $if(sum > 1)
+        {
+            b1 = b1 / sum;
+            b2 = b2 / sum;
+        };
+        uv = CVec2f(b1, b2);
+        $if(!cstd::isfinite(b1) | !cstd::isfinite(b2))
+        {
+            uv = CVec2f(1.0f / 3, 1.0f / 3);
+        };
+    }
+    $else
+    {
+        uv = sample_triangle_uniform(sam[1], sam[2]);
+    };
+
+    SampleResult result;
+    result.point = get_surface_point(prim_idx, uv);
+    result.pdf = pdf_inline(dst_pos, result.point.position, prim_idx);
+    return result;
+}
+
+f32 TriangleMesh::pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos, u32 prim_id) const
+{
+    var triangle = load_triangle(prim_id);
+    var solid_angle = spherical_sampling_area(dst_pos, triangle);
+    var result = 1 / total_area_;
+    $if(solid_angle > 0)
+    {
+        // probability of selecting the triangle, times its solid angle density in area measure
+        var select_pdf = cuj::import_pointer(device_triangle_areas_.get())[prim_id] / total_area_;
+        var pos_to_dst = dst_pos - pos;
+        var dist2 = length_square(pos_to_dst);
+        var abs_cos = cstd::abs(dot(normalize(cross(triangle.ba, triangle.ca)), pos_to_dst)) / cstd::sqrt(dist2);
+        result = select_pdf / solid_angle * abs_cos / dist2;
+    };
+    return result;
+}
+
+const std::vector<float> &TriangleMesh::get_primitive_areas() const
+{
+    return triangle_areas_;
+}
+
+Geometry::SampleResult TriangleMesh::sample_primitive_inline(u32 prim_id, ref<CVec2f> sam) const
+{
+    SampleResult result;
+    result.point = get_surface_point(prim_id, sample_triangle_uniform(sam.x, sam.y));
+    result.pdf = 1 / cuj::import_pointer(device_triangle_areas_.get())[prim_id];
+    return result;
+}
+
+TriangleMesh::CTriangle TriangleMesh::load_triangle(u32 prim_id) const
+{
+    using namespace cuj;
 
     var pos_ptr = bitcast<ptr<CVec3f>>(import_pointer(positions_.get()));
-    var a  = pos_ptr[prim_idx * 3 + 0];
-    var ba = pos_ptr[prim_idx * 3 + 1];
-    var ca = pos_ptr[prim_idx * 3 + 2];
-    var pos = a + ba * uv.x + ca * uv.y;
+    CTriangle result;
+    result.a  = pos_ptr[prim_id * 3 + 0];
+    result.ba = pos_ptr[prim_id * 3 + 1];
+    result.ca = pos_ptr[prim_id * 3 + 2];
+    return result;
+}
+
+f32 TriangleMesh::spherical_sampling_area(ref<CVec3f> dst_pos, ref<CTriangle> triangle) const
+{
+    var area = spherical_triangle_area(
+        normalize(triangle.a - dst_pos),
+        normalize(triangle.a + triangle.ba - dst_pos),
+        normalize(triangle.a + triangle.ca - dst_pos));
+    var use_spherical = area >= MIN_SPHERICAL_SAMPLING_AREA & area <= MAX_SPHERICAL_SAMPLING_AREA;
+    return cstd::select(use_spherical & cstd::isfinite(area), area, f32(0));
+}
+
+SurfacePoint TriangleMesh::get_surface_point(u32 prim_id, ref<CVec2f> uv) const
+{
+    using namespace cuj;
+
+    var prim_idx = prim_id;
+    var triangle = load_triangle(prim_idx);
+    var pos = triangle.a + triangle.ba * uv.x + triangle.ca * uv.y;
 
     var ex_u_a  = load_aligned(import_pointer(geo_info_.geometry_ex_tex_coord_u_a)  + prim_idx);
     var ey_u_ba = load_aligned(import_pointer(geo_info_.geometry_ey_tex_coord_u_ba) + prim_idx);
@@ -217,31 +360,16 @@ Geometry::SampleResult TriangleMesh::sample_inline(ref<Sam3> sam) const
     var tex_coord = tex_coord_a + tex_coord_ba * uv.x + tex_coord_ca * uv.y;
     var interp_z = normalize(sz_v_a.xyz() + sz_v_ba.xyz() * uv.x + sz_v_ca.xyz() * uv.y);
 
-    SampleResult result;
-    result.point.position  = pos;
-    result.point.uv        = uv;
-    result.point.tex_coord = tex_coord;
-    result.point.frame     = CFrame(ex, ey, ez);
-    result.point.interp_z  = interp_z;
-    result.pdf             = 1 / total_area_;
+    SurfacePoint result;
+    result.position  = pos;
+    result.uv        = uv;
+    result.tex_coord = tex_coord;
+    result.frame     = CFrame(ex, ey, ez);
+    result.interp_z  = interp_z;
+    result.prim_id   = prim_idx;
     return result;
 }
 
-f32 TriangleMesh::pdf_inline(ref<CVec3f> pos) const
-{
-    return 1 / total_area_;
-}
-
-Geometry::SampleResult TriangleMesh::sample_inline(ref<CVec3f> dst_pos, ref<Sam3> sam) const
-{
-    return sample_inline(sam);
-}
-
-f32 TriangleMesh::pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos) const
-{
-    return pdf_inline(pos);
-}
-
 RC<Geometry> TriangleMeshCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
     const auto filename = context.resolve_path(node->parse_child<std::string>("filename")).string();
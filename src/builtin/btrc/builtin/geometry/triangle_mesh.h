@@ -24,16 +24,37 @@ public:
 
     AABB3f get_bounding_box() const override;
 
+    float get_area() const override;
+
+    DirectionCone get_normal_cone() const override;
+
     SampleResult sample_inline(ref<Sam3> sam) const override;
 
     f32 pdf_inline(ref<CVec3f> pos) const override;
 
     SampleResult sample_inline(ref<CVec3f> dst_pos, ref<Sam3> sam) const override;
 
-    f32 pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos) const override;
+    f32 pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos, u32 prim_id) const override;
+
+    const std::vector<float> &get_primitive_areas() const override;
+
+    SampleResult sample_primitive_inline(u32 prim_id, ref<CVec2f> sam) const override;
 
 private:
 
+    CUJ_CLASS_BEGIN(CTriangle)
+        CUJ_MEMBER_VARIABLE(CVec3f, a)
+        CUJ_MEMBER_VARIABLE(CVec3f, ba)
+        CUJ_MEMBER_VARIABLE(CVec3f, ca)
+    CUJ_CLASS_END
+
+    CTriangle load_triangle(u32 prim_id) const;
+
+    // solid angle subtended by the triangle. 0 when area sampling should be used instead
+    f32 spherical_sampling_area(ref<CVec3f> dst_pos, ref<CTriangle> triangle) const;
+
+    SurfacePoint get_surface_point(u32 prim_id, ref<CVec2f> uv) const;
+
     optix::Context *optix_ctx_ = nullptr;
     std::string filename_;
     bool transform_to_unit_cube_ = false;
@@ -45,9 +66,14 @@ private:
     // { ax, ay, az, bax, bay, baz, cax, cay, caz } * triangle_count
     cuda::Buffer<float> positions_;
 
+    std::vector<float>  triangle_areas_;
+    cuda::Buffer<float> device_triangle_areas_;
+
     CAliasTable alias_table_;
     float       total_area_ = 0;
     AABB3f      bbox_;
+
+    DirectionCone normal_cone_;
 };
 
 class TriangleMeshCreator : public factory::Creator<Geometry>
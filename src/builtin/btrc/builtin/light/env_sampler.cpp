@@ -1,17 +1,50 @@
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BTRC_ENV_SAMPLER_HOST_SSE
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BTRC_ENV_SAMPLER_HOST_NEON
+#include <arm_neon.h>
+#endif
+
+#include <cmath>
+#include <execution>
+#include <fstream>
 #include <numeric>
 #include <span>
 
+#include <fmt/format.h>
+
 #include <btrc/builtin/light/env_sampler.h>
+#include <btrc/builtin/texture2d/array2d.h>
 #include <btrc/utils/cuda/module.h>
+#include <btrc/utils/file.h>
 #include <btrc/utils/local_angle.h>
 #include <btrc/utils/math/hammersley.h>
+#include <btrc/utils/unreachable.h>
 
 BTRC_BUILTIN_BEGIN
 
 namespace
 {
 
-    const char KERNEL[] = "generate_lum_sum_table";
+    const char KERNEL[] = "generate_lum_table";
+
+    const char LUM_TABLE_CACHE_DIR[] = "./.btrc_cache/envir_lum";
+
+    // per tile, when tiles are texels
+    constexpr int TEXEL_TILE_SAMPLES = 16;
+
+    // samples cover a slightly larger area than the tile, so that
+    // tiles next to small bright spots are not assigned zero probability
+    constexpr float LOCAL_SAMPLE_MARGIN = 0.1f;
+
+    Vec2f get_local_sample(int i, int n_samples)
+    {
+        return (1 + 2 * LOCAL_SAMPLE_MARGIN) * hammersley2d(i, n_samples) - Vec2f(LOCAL_SAMPLE_MARGIN);
+    }
 
     std::string generate_sample_texture_kernel(
         const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
@@ -19,7 +52,7 @@ namespace
         CompileContext cc;
         cuj::ScopedModule cuj_module;
 
-        cuj::kernel(KERNEL, [&cc, &tex, lut_res, n_samples](ptr<f32> lum_table, ptr<f32> area_table)
+        cuj::kernel(KERNEL, [&cc, &tex, lut_res, n_samples](ptr<f32> lum_table)
         {
             var xi = cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x();
             var yi = cstd::block_dim_y() * cstd::block_idx_y() + cstd::thread_idx_y();
@@ -32,14 +65,14 @@ namespace
 
                 std::vector<Vec2f> local_samples_data(n_samples);
                 for(int i = 0; i < n_samples; ++i)
-                    local_samples_data[i] = hammersley2d(i, n_samples);
+                    local_samples_data[i] = get_local_sample(i, n_samples);
                 var local_samples = cuj::const_data(std::span<const Vec2f>{ local_samples_data });
 
                 var i = 0;
                 var lum_sum = 0.0f;
                 $while(i < n_samples)
                 {
-                    var local_sample = 1.2f * local_samples[i] - CVec2f(0.1f);
+                    var local_sample = local_samples[i];
                     i = i + 1;
                     var x = lerp(x0, x1, local_sample.x);
                     var y = lerp(y0, y1, local_sample.y);
@@ -47,12 +80,7 @@ namespace
                     lum_sum = lum_sum + value.get_lum();
                 };
 
-                var lum = lum_sum / n_samples;
-                lum_table[yi * lut_res.x + xi] = lum;
-
-                var delta_area = cstd::abs(
-                    2 * btrc_pi * (x1 - x0) * (cstd::cos(btrc_pi * y1) - cstd::cos(btrc_pi * y0)));
-                area_table[yi * lut_res.x + xi] = delta_area;
+                lum_table[yi * lut_res.x + xi] = lum_sum / n_samples;
             };
         });
         
@@ -67,43 +95,389 @@ namespace
         return gen.get_ptx();
     }
 
-} // namespace anonymous
+    std::vector<float> compute_lum_table_on_device(
+        const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
+    {
+        const std::string ptx = generate_sample_texture_kernel(tex, lut_res, n_samples);
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+
+        cuda::Buffer<float> device_lum(lut_res.x * lut_res.y);
+
+        constexpr int BLOCK_SIZE = 8;
+        const int block_cnt_x = up_align(lut_res.x, BLOCK_SIZE) / BLOCK_SIZE;
+        const int block_cnt_y = up_align(lut_res.y, BLOCK_SIZE) / BLOCK_SIZE;
+        cuda_module.launch(
+            KERNEL,
+            { block_cnt_x, block_cnt_y, 1 },
+            { BLOCK_SIZE, BLOCK_SIZE, 1 },
+            device_lum.get());
+        throw_on_error(cudaStreamSynchronize(nullptr));
+
+        std::vector<float> lum(device_lum.get_size());
+        device_lum.to_cpu(lum.data());
+        return lum;
+    }
 
-void EnvirLightSampler::preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
-{
-    const std::string ptx = generate_sample_texture_kernel(tex, lut_res, n_samples);
+    // returns -1 for border texels
+    int apply_address_mode(int i, int size, cuda::Texture::AddressMode mode)
+    {
+        switch(mode)
+        {
+        case cuda::Texture::AddressMode::Wrap:
+            return (i % size + size) % size;
+        case cuda::Texture::AddressMode::Clamp:
+            return (std::clamp)(i, 0, size - 1);
+        case cuda::Texture::AddressMode::Mirror:
+        {
+            const int j = (i % (2 * size) + 2 * size) % (2 * size);
+            return j < size ? j : 2 * size - 1 - j;
+        }
+        case cuda::Texture::AddressMode::Border:
+            return 0 <= i && i < size ? i : -1;
+        }
+        unreachable();
+    }
+
+    // luminance of the texels of an Array2D, with a margin resolved by the address modes around them.
+    // lookups are the same as fetching its cuda texture with normalized coordinates, as long as they
+    // stay within the margin, and need no address mode handling or clamping
+    class HostLumTexture
+    {
+    public:
+
+        HostLumTexture(const Image<Vec3f> &image, const cuda::Texture::Description &desc, const Vec2i &margin)
+        {
+            const int width = image.width(), height = image.height();
+            padded_width_ = width + 2 * margin.x;
+            const int padded_height = height + 2 * margin.y;
+            const Vec3f border(desc.border_value[0], desc.border_value[1], desc.border_value[2]);
+
+            std::vector<int> xs(padded_width_);
+            for(int px = 0; px < padded_width_; ++px)
+                xs[px] = apply_address_mode(px - margin.x, width, desc.address_modes[0]);
+
+            lum_.resize(static_cast<size_t>(padded_width_) * padded_height);
+            std::vector<int> rows(padded_height);
+            std::iota(rows.begin(), rows.end(), 0);
+            std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int py)
+            {
+                const int y = apply_address_mode(py - margin.y, height, desc.address_modes[1]);
+                float *output = &lum_[static_cast<size_t>(py) * padded_width_];
+                for(int px = 0; px < padded_width_; ++px)
+                    output[px] = xs[px] < 0 || y < 0 ? lum(border) : lum(image(xs[px], y));
+            });
+
+            // texel coordinates in the padded image, where bilinear lookups start half a texel earlier
+            linear_ = desc.filter_mode != cuda::Texture::FilterMode::Point;
+            scale_ = Vec2f(static_cast<float>(width), static_cast<float>(height));
+            offset_ = Vec2f(static_cast<float>(margin.x), static_cast<float>(margin.y)) - Vec2f(linear_ ? 0.5f : 0.0f);
+        }
+
+        float sample_lum(const Vec2f &uv) const
+        {
+            // coordinates are non-negative in the margin, so truncation is floor
+            const float x = uv.x * scale_.x + offset_.x;
+            const float y = uv.y * scale_.y + offset_.y;
+            const int ix = static_cast<int>(x), iy = static_cast<int>(y);
+            const float *row = &lum_[static_cast<size_t>(iy) * padded_width_ + ix];
+            if(!linear_)
+                return row[0];
+            const float tx = x - static_cast<float>(ix), ty = y - static_cast<float>(iy);
+            const float l0 = row[0] + tx * (row[1] - row[0]);
+            const float l1 = row[padded_width_] + tx * (row[padded_width_ + 1] - row[padded_width_]);
+            return l0 + ty * (l1 - l0);
+        }
+
+        // sum of luminance at n points given by u[i] and v[i]. four points are looked up at a time
+        float sum_lum(const float *u, const float *v, int n) const
+        {
+            float result = 0;
+            int i = 0;
+#if defined(BTRC_ENV_SAMPLER_HOST_SSE)
+            const __m128 scale_x = _mm_set1_ps(scale_.x), scale_y = _mm_set1_ps(scale_.y);
+            const __m128 offset_x = _mm_set1_ps(offset_.x), offset_y = _mm_set1_ps(offset_.y);
+            __m128 sum = _mm_setzero_ps();
+            for(; i + 4 <= n; i += 4)
+            {
+                const __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(u + i), scale_x), offset_x);
+                const __m128 y = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(v + i), scale_y), offset_y);
+                const __m128i ix = _mm_cvttps_epi32(x), iy = _mm_cvttps_epi32(y);
+                alignas(16) int32_t xs[4], ys[4];
+                _mm_store_si128(reinterpret_cast<__m128i *>(xs), ix);
+                _mm_store_si128(reinterpret_cast<__m128i *>(ys), iy);
+                const float *rows[4];
+                for(int j = 0; j < 4; ++j)
+                    rows[j] = &lum_[static_cast<size_t>(ys[j]) * padded_width_ + xs[j]];
+
+                const __m128 l00 = _mm_setr_ps(rows[0][0], rows[1][0], rows[2][0], rows[3][0]);
+                if(!linear_)
+                {
+                    sum = _mm_add_ps(sum, l00);
+                    continue;
+                }
+                const int w = padded_width_;
+                const __m128 l10 = _mm_setr_ps(rows[0][1], rows[1][1], rows[2][1], rows[3][1]);
+                const __m128 l01 = _mm_setr_ps(rows[0][w], rows[1][w], rows[2][w], rows[3][w]);
+                const __m128 l11 = _mm_setr_ps(rows[0][w + 1], rows[1][w + 1], rows[2][w + 1], rows[3][w + 1]);
+                const __m128 tx = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+                const __m128 ty = _mm_sub_ps(y, _mm_cvtepi32_ps(iy));
+                const __m128 l0 = _mm_add_ps(l00, _mm_mul_ps(tx, _mm_sub_ps(l10, l00)));
+                const __m128 l1 = _mm_add_ps(l01, _mm_mul_ps(tx, _mm_sub_ps(l11, l01)));
+                sum = _mm_add_ps(sum, _mm_add_ps(l0, _mm_mul_ps(ty, _mm_sub_ps(l1, l0))));
+            }
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, sum);
+            result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(BTRC_ENV_SAMPLER_HOST_NEON)
+            const float32x4_t scale_x = vdupq_n_f32(scale_.x), scale_y = vdupq_n_f32(scale_.y);
+            const float32x4_t offset_x = vdupq_n_f32(offset_.x), offset_y = vdupq_n_f32(offset_.y);
+            float32x4_t sum = vdupq_n_f32(0);
+            for(; i + 4 <= n; i += 4)
+            {
+                const float32x4_t x = vmlaq_f32(offset_x, vld1q_f32(u + i), scale_x);
+                const float32x4_t y = vmlaq_f32(offset_y, vld1q_f32(v + i), scale_y);
+                const int32x4_t ix = vcvtq_s32_f32(x), iy = vcvtq_s32_f32(y);
+                alignas(16) int32_t xs[4], ys[4];
+                vst1q_s32(xs, ix);
+                vst1q_s32(ys, iy);
+                const float *rows[4];
+                for(int j = 0; j < 4; ++j)
+                    rows[j] = &lum_[static_cast<size_t>(ys[j]) * padded_width_ + xs[j]];
+
+                auto gather = [&](int offset)
+                {
+                    alignas(16) const float values[4] = {
+                        rows[0][offset], rows[1][offset], rows[2][offset], rows[3][offset]
+                    };
+                    return vld1q_f32(values);
+                };
+                const float32x4_t l00 = gather(0);
+                if(!linear_)
+                {
+                    sum = vaddq_f32(sum, l00);
+                    continue;
+                }
+                const int w = padded_width_;
+                const float32x4_t l10 = gather(1), l01 = gather(w), l11 = gather(w + 1);
+                const float32x4_t tx = vsubq_f32(x, vcvtq_f32_s32(ix));
+                const float32x4_t ty = vsubq_f32(y, vcvtq_f32_s32(iy));
+                const float32x4_t l0 = vmlaq_f32(l00, tx, vsubq_f32(l10, l00));
+                const float32x4_t l1 = vmlaq_f32(l01, tx, vsubq_f32(l11, l01));
+                sum = vaddq_f32(sum, vmlaq_f32(l0, ty, vsubq_f32(l1, l0)));
+            }
+            result = vaddvq_f32(sum);
+#endif
+            for(; i < n; ++i)
+                result += sample_lum(Vec2f(u[i], v[i]));
+            return result;
+        }
+
+    private:
+
+        static float lum(const Vec3f &rgb)
+        {
+            return 0.2126f * rgb.x + 0.7152f * rgb.y + 0.0722f * rgb.z;
+        }
+
+        int                padded_width_ = 0;
+        std::vector<float> lum_;
+        bool               linear_ = true;
+        Vec2f              scale_;
+        Vec2f              offset_;
+    };
+
+    std::vector<float> compute_lum_table_on_host(
+        const Image<Vec3f> &image, const cuda::Texture::Description &desc, const Vec2i &lut_res, int n_samples)
+    {
+        // local samples reach LOCAL_SAMPLE_MARGIN tiles outside the tile. the extra texels cover
+        // the bilinear footprint and rounding
+        const Vec2i margin(
+            static_cast<int>(std::ceil(LOCAL_SAMPLE_MARGIN * image.width() / lut_res.x)) + 2,
+            static_cast<int>(std::ceil(LOCAL_SAMPLE_MARGIN * image.height() / lut_res.y)) + 2);
+        const HostLumTexture lum_tex(image, desc, margin);
+
+        std::vector<Vec2f> local_samples(n_samples);
+        for(int i = 0; i < n_samples; ++i)
+            local_samples[i] = get_local_sample(i, n_samples);
+
+        std::vector<float> lum(lut_res.x * lut_res.y);
+        std::vector<int> rows(lut_res.y);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int yi)
+        {
+            // sample positions of a tile, as separate u and v arrays for the vectorized lookups
+            std::vector<float> us(n_samples), vs(n_samples);
 
-    cuda::Module cuda_module;
-    cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
-    cuda_module.link();
+            const float y0 = static_cast<float>(yi) / lut_res.y;
+            const float y1 = static_cast<float>(yi + 1) / lut_res.y;
+            for(int i = 0; i < n_samples; ++i)
+                vs[i] = y0 + (y1 - y0) * local_samples[i].y;
 
-    cuda::Buffer<float> device_lum(lut_res.x * lut_res.y);
-    cuda::Buffer<float> device_area(lut_res.x * lut_res.y);
+            for(int xi = 0; xi < lut_res.x; ++xi)
+            {
+                const float x0 = static_cast<float>(xi) / lut_res.x;
+                const float x1 = static_cast<float>(xi + 1) / lut_res.x;
+                for(int i = 0; i < n_samples; ++i)
+                    us[i] = x0 + (x1 - x0) * local_samples[i].x;
+                lum[yi * lut_res.x + xi] = lum_tex.sum_lum(us.data(), vs.data(), n_samples) / n_samples;
+            }
+        });
+        return lum;
+    }
 
-    constexpr int BLOCK_SIZE = 8;
-    const int block_cnt_x = up_align(lut_res.x, BLOCK_SIZE) / BLOCK_SIZE;
-    const int block_cnt_y = up_align(lut_res.y, BLOCK_SIZE) / BLOCK_SIZE;
-    cuda_module.launch(
-        KERNEL,
-        { block_cnt_x, block_cnt_y, 1 },
-        { BLOCK_SIZE, BLOCK_SIZE, 1 },
-        device_lum.get(),
-        device_area.get());
-    throw_on_error(cudaStreamSynchronize(nullptr));
+    std::string get_lum_table_cache_filename(uint64_t tex_hash, const Vec2i &lut_res, int n_samples)
+    {
+        const std::string name = fmt::format("{:016x}_{}x{}_{}.bin", tex_hash, lut_res.x, lut_res.y, n_samples);
+        return (get_executable_filename().parent_path() / LUM_TABLE_CACHE_DIR / name).string();
+    }
 
-    std::vector<float> lum(device_lum.get_size());
-    device_lum.to_cpu(lum.data());
+    // returns an empty table when the cache is missing or invalid
+    std::vector<float> load_lum_table_cache(const std::string &filename, size_t size)
+    {
+        std::ifstream fin(filename, std::ifstream::in | std::ifstream::binary);
+        if(!fin)
+            return {};
+        std::vector<float> result(size);
+        fin.read(reinterpret_cast<char *>(result.data()), static_cast<std::streamsize>(sizeof(float) * size));
+        if(!fin || fin.peek() != std::ifstream::traits_type::eof())
+            return {};
+        return result;
+    }
 
-    std::vector<float> area(device_area.get_size());
-    device_area.to_cpu(area.data());
+    // failing to write the cache only makes the next commit slower
+    void create_lum_table_cache(const std::string &filename, const std::vector<float> &lum)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
+        std::ofstream fout(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+        if(fout)
+            fout.write(reinterpret_cast<const char *>(lum.data()), static_cast<std::streamsize>(sizeof(float) * lum.size()));
+    }
 
-    float lum_area_sum = 0.0f, area_sum = 0.0f;
-    for(size_t i = 0; i < lum.size(); ++i)
+    std::vector<float> compute_lum_table(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
+    {
+        // array textures with host images are hashed when loaded, so the file is only re-read on a cache miss
+        auto array2d = std::dynamic_pointer_cast<const Array2D>(tex);
+        const uint64_t content_hash = array2d ? array2d->get_content_hash() : 0;
+        if(!content_hash)
+            return compute_lum_table_on_device(tex, lut_res, n_samples);
+
+        const std::string cache_filename = get_lum_table_cache_filename(content_hash, lut_res, n_samples);
+        auto lum = load_lum_table_cache(cache_filename, lut_res.x * lut_res.y);
+        if(lum.empty())
+        {
+            // texels are re-read here and released with the table built, instead of being kept by the texture
+            const Image<Vec3f> host_image = array2d->load_host_image();
+            lum = compute_lum_table_on_host(host_image, array2d->get_description(), lut_res, n_samples);
+            create_lum_table_cache(cache_filename, lum);
+        }
+        return lum;
+    }
+
+    // per-tile average luminance and solid angle
+    void compute_tile_tables(
+        const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples,
+        std::vector<float> &lum, std::vector<float> &area)
+    {
+        lum = compute_lum_table(tex, lut_res, n_samples);
+
+        area.resize(lum.size());
+        for(int yi = 0; yi < lut_res.y; ++yi)
+        {
+            const float y0 = static_cast<float>(yi) / lut_res.y;
+            const float y1 = static_cast<float>(yi + 1) / lut_res.y;
+            const float delta_area = std::abs(
+                2 * btrc_pi / lut_res.x * (std::cos(btrc_pi * y1) - std::cos(btrc_pi * y0)));
+            std::fill_n(area.begin() + yi * lut_res.x, lut_res.x, delta_area);
+        }
+    }
+
+    float compute_average_luminance(const std::vector<float> &lum, const std::vector<float> &area)
+    {
+        float lum_area_sum = 0.0f, area_sum = 0.0f;
+        for(size_t i = 0; i < lum.size(); ++i)
+        {
+            lum_area_sum += lum[i] * area[i];
+            area_sum += area[i];
+        }
+        return lum_area_sum / area_sum;
+    }
+
+    CVec3f sample_in_tile(i32 tile_x, i32 tile_y, const Vec2i &lut_res, f32 u, f32 v, f32 &pdf)
+    {
+        var u0 = f32(tile_x)     / lut_res.x;
+        var u1 = f32(tile_x + 1) / lut_res.x;
+        var v0 = f32(tile_y)     / lut_res.y;
+        var v1 = f32(tile_y + 1) / lut_res.y;
+
+        var cv0 = cstd::cos(btrc_pi * v0);
+        var cv1 = cstd::cos(btrc_pi * v1);
+        $if(cv0 > cv1)
+        {
+            var t = cv0;
+            cv0 = cv1;
+            cv1 = t;
+        };
+
+        var cos_theta = cv0 + v * (cv1 - cv0);
+        var sin_theta = local_angle::cos2sin(cos_theta);
+        var phi = 2 * btrc_pi * lerp(u0, u1, u);
+
+        pdf = 1.0f / (2 * btrc_pi * (u1 - u0) * (cv1 - cv0));
+        return CVec3f(sin_theta * cstd::cos(phi), sin_theta * cstd::sin(phi), cos_theta);
+    }
+
+    // returns in-tile pdf
+    f32 find_tile(ref<CVec3f> to_light, const Vec2i &lut_res, i32 &tile_x, i32 &tile_y)
+    {
+        var dir = normalize(to_light);
+        var cos_theta = local_angle::cos_theta(dir);
+        var theta = cstd::acos(cos_theta);
+        var phi = local_angle::phi(dir);
+
+        var u = phi / (2 * btrc_pi);
+        var v = theta / btrc_pi;
+
+        tile_x = cstd::clamp(i32(cstd::floor(u * lut_res.x)), 0, lut_res.x - 1);
+        tile_y = cstd::clamp(i32(cstd::floor(v * lut_res.y)), 0, lut_res.y - 1);
+
+        var u0 = f32(tile_x)     / lut_res.x;
+        var u1 = f32(tile_x + 1) / lut_res.x;
+        var v0 = f32(tile_y)     / lut_res.y;
+        var v1 = f32(tile_y + 1) / lut_res.y;
+        var c0 = cstd::cos(btrc_pi * v0);
+        var c1 = cstd::cos(btrc_pi * v1);
+        return 1.0f / cstd::abs(2 * btrc_pi * (u1 - u0) * (c1 - c0));
+    }
+
+    // remap u in [0, 1) after choosing between [0, p) and [p, 1)
+    i32 choose(f32 &u, f32 p)
     {
-        lum_area_sum += lum[i] * area[i];
-        area_sum += area[i];
+        constexpr float ONE_MINUS_EPS = 0x1.fffffep-1f;
+        i32 result;
+        $if(u < p)
+        {
+            u = cstd::min(u / p, ONE_MINUS_EPS);
+            result = 0;
+        }
+        $else
+        {
+            u = cstd::min((u - p) / (1.0f - p), ONE_MINUS_EPS);
+            result = 1;
+        };
+        return result;
     }
-    const float avg_lum = lum_area_sum / area_sum;
+
+} // namespace anonymous
+
+void TileEnvirLightSampler::preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
+{
+    std::vector<float> lum, area;
+    compute_tile_tables(tex, lut_res, n_samples, lum, area);
+    const float avg_lum = compute_average_luminance(lum, area);
 
     for(size_t i = 0; i < lum.size(); ++i)
         lum[i] = (std::max)(0.0f, area[i] * (lum[i] - avg_lum));
@@ -117,11 +491,12 @@ void EnvirLightSampler::preprocess(const RC<const Texture2D> &tex, const Vec2i &
     }
 
     lut_res_ = lut_res;
+    avg_lum_ = avg_lum;
     tile_probs_ = cuda::Buffer<float>(lum);
     tile_alias_ = CAliasTable(AliasTable(lum));
 }
 
-EnvirLightSampler::SampleResult EnvirLightSampler::sample(ref<Sam3> sam) const
+TileEnvirLightSampler::SampleResult TileEnvirLightSampler::sample(ref<Sam3> sam) const
 {
     var tile_idx = tile_alias_.sample(sam[0]);
     var tile_y = tile_idx / lut_res_.x;
@@ -131,26 +506,8 @@ EnvirLightSampler::SampleResult EnvirLightSampler::sample(ref<Sam3> sam) const
     var tile_pdf_table = cuj::import_pointer(tile_probs_.get());
     var tile_pdf = tile_pdf_table[tile_idx];
 
-    var u0 = f32(tile_x)     / lut_res_.x;
-    var u1 = f32(tile_x + 1) / lut_res_.x;
-    var v0 = f32(tile_y)     / lut_res_.y;
-    var v1 = f32(tile_y + 1) / lut_res_.y;
-
-    var cv0 = cstd::cos(btrc_pi * v0);
-    var cv1 = cstd::cos(btrc_pi * v1);
-    $if(cv0 > cv1)
-    {
-        var t = cv0;
-        cv0 = cv1;
-        cv1 = t;
-    };
-
-    var cos_theta = cv0 + sam[2] * (cv1 - cv0);
-    var sin_theta = local_angle::cos2sin(cos_theta);
-    var phi = 2 * btrc_pi * lerp(u0, u1, sam[1]);
-
-    var dir = CVec3f(sin_theta * cstd::cos(phi), sin_theta * cstd::sin(phi), cos_theta);
-    var in_tile_pdf = 1.0f / (2 * btrc_pi * (u1 - u0) * (cv1 - cv0));
+    f32 in_tile_pdf;
+    var dir = sample_in_tile(i32(tile_x), i32(tile_y), lut_res_, sam[1], sam[2], in_tile_pdf);
 
     SampleResult result;
     result.to_light = dir;
@@ -158,32 +515,169 @@ EnvirLightSampler::SampleResult EnvirLightSampler::sample(ref<Sam3> sam) const
     return result;
 }
 
-f32 EnvirLightSampler::pdf(ref<CVec3f> to_light) const
+f32 TileEnvirLightSampler::pdf(ref<CVec3f> to_light) const
 {
-    var dir = normalize(to_light);
-    var cos_theta = local_angle::cos_theta(dir);
-    var theta = cstd::acos(cos_theta);
-    var phi = local_angle::phi(dir);
-
-    var u = phi / (2 * btrc_pi);
-    var v = theta / btrc_pi;
-
-    var tile_x = cstd::clamp(i32(cstd::floor(u * lut_res_.x)), 0, lut_res_.x - 1);
-    var tile_y = cstd::clamp(i32(cstd::floor(v * lut_res_.y)), 0, lut_res_.y - 1);
+    i32 tile_x, tile_y;
+    var in_tile_pdf = find_tile(to_light, lut_res_, tile_x, tile_y);
     var tile_idx = tile_y * lut_res_.x + tile_x;
 
     var tile_pdf_table = cuj::import_pointer(tile_probs_.get());
     var tile_pdf = tile_pdf_table[tile_idx];
 
-    var u0 = f32(tile_x)     / lut_res_.x;
-    var u1 = f32(tile_x + 1) / lut_res_.x;
-    var v0 = f32(tile_y)     / lut_res_.y;
-    var v1 = f32(tile_y + 1) / lut_res_.y;
-    var c0 = cstd::cos(btrc_pi * v0);
-    var c1 = cstd::cos(btrc_pi * v1);
-    var in_tile_pdf = 1.0f / cstd::abs(2 * btrc_pi * (u1 - u0) * (c1 - c0));
+    return tile_pdf * in_tile_pdf;
+}
+
+float TileEnvirLightSampler::get_average_luminance() const
+{
+    return avg_lum_;
+}
+
+void HierarchicalEnvirLightSampler::set_compensation(bool compensation)
+{
+    compensation_ = compensation;
+}
+
+void HierarchicalEnvirLightSampler::preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples)
+{
+    // the finest level is at texel resolution for array textures, so that features smaller than
+    // a lut tile are resolved. a few samples per texel are enough there to average the filtering
+    Vec2i tile_res = lut_res;
+    if(auto array2d = std::dynamic_pointer_cast<const Array2D>(tex))
+    {
+        tile_res = array2d->get_resolution();
+        n_samples = (std::min)(n_samples, TEXEL_TILE_SAMPLES);
+    }
+    const Vec2i res(
+        static_cast<int>(std::bit_ceil(static_cast<uint32_t>((std::max)(tile_res.x, 1)))),
+        static_cast<int>(std::bit_ceil(static_cast<uint32_t>((std::max)(tile_res.y, 1)))));
+
+    std::vector<float> lum, area;
+    compute_tile_tables(tex, res, n_samples, lum, area);
+    const float avg_lum = compute_average_luminance(lum, area);
+
+    // fall back to luminance without compensation, and then to solid angle,
+    // so that every direction with nonzero radiance can be sampled when possible
+    std::vector<float> finest(lum.size());
+    auto fill_finest = [&](auto get_weight)
+    {
+        for(size_t i = 0; i < lum.size(); ++i)
+            finest[i] = (std::max)(0.0f, get_weight(i));
+        return std::accumulate(finest.begin(), finest.end(), 0.0f);
+    };
+    float sum = 0;
+    if(compensation_)
+        sum = fill_finest([&](size_t i) { return area[i] * (lum[i] - avg_lum); });
+    if(!(sum > 0))
+        sum = fill_finest([&](size_t i) { return area[i] * lum[i]; });
+    if(!(sum > 0) || !std::isfinite(sum))
+        sum = fill_finest([&](size_t i) { return area[i]; });
+    for(auto &w : finest)
+        w /= sum;
+
+    // build the pyramid from fine to coarse
+    std::vector<std::vector<float>> pyramid = { std::move(finest) };
+    std::vector<Vec2i> pyramid_res = { res };
+    while(pyramid_res.back().x > 1 || pyramid_res.back().y > 1)
+    {
+        const Vec2i &fine_res = pyramid_res.back();
+        const std::vector<float> &fine = pyramid.back();
+        const Vec2i coarse_res((std::max)(fine_res.x / 2, 1), (std::max)(fine_res.y / 2, 1));
+        const int sx = fine_res.x / coarse_res.x, sy = fine_res.y / coarse_res.y;
+
+        std::vector<float> coarse(coarse_res.x * coarse_res.y, 0.0f);
+        for(int y = 0; y < fine_res.y; ++y)
+        {
+            for(int x = 0; x < fine_res.x; ++x)
+                coarse[(y / sy) * coarse_res.x + x / sx] += fine[y * fine_res.x + x];
+        }
+        pyramid.push_back(std::move(coarse));
+        pyramid_res.push_back(coarse_res);
+    }
+
+    levels_.clear();
+    std::vector<float> weights;
+    for(int i = static_cast<int>(pyramid.size()) - 1; i >= 0; --i)
+    {
+        levels_.push_back({ pyramid_res[i], weights.size() });
+        weights.insert(weights.end(), pyramid[i].begin(), pyramid[i].end());
+    }
+
+    avg_lum_ = avg_lum;
+    weights_ = cuda::Buffer<float>(weights);
+}
+
+HierarchicalEnvirLightSampler::SampleResult HierarchicalEnvirLightSampler::sample(ref<Sam3> sam) const
+{
+    var weights = cuj::import_pointer(weights_.get());
+    f32 u = sam[1], v = sam[2];
+    var x = 0, y = 0;
 
+    // the number of levels is known when generating code, so the traversal is unrolled
+    for(size_t l = 1; l < levels_.size(); ++l)
+    {
+        const Level &parent = levels_[l - 1];
+        const Level &level = levels_[l];
+        const bool split_x = level.res.x > parent.res.x;
+        const bool split_y = level.res.y > parent.res.y;
+        const int w = level.res.x;
+        const size_t offset = level.offset;
+
+        if(split_x)
+            x = 2 * x;
+        if(split_y)
+            y = 2 * y;
+
+        if(split_x && split_y)
+        {
+            var w00 = weights[offset + u64(y * w + x)];
+            var w10 = weights[offset + u64(y * w + x + 1)];
+            var w01 = weights[offset + u64((y + 1) * w + x)];
+            var w11 = weights[offset + u64((y + 1) * w + x + 1)];
+            var qx = choose(u, (w00 + w01) / (w00 + w10 + w01 + w11));
+            var low = cstd::select(qx == 0, w00, w10);
+            var high = cstd::select(qx == 0, w01, w11);
+            var qy = choose(v, low / (low + high));
+            x = x + qx;
+            y = y + qy;
+        }
+        else if(split_x)
+        {
+            var w0 = weights[offset + u64(y * w + x)];
+            var w1 = weights[offset + u64(y * w + x + 1)];
+            x = x + choose(u, w0 / (w0 + w1));
+        }
+        else
+        {
+            var w0 = weights[offset + u64(y * w + x)];
+            var w1 = weights[offset + u64((y + 1) * w + x)];
+            y = y + choose(v, w0 / (w0 + w1));
+        }
+    }
+
+    const Level &finest = levels_.back();
+    var tile_pdf = weights[finest.offset + u64(y * finest.res.x + x)];
+
+    f32 in_tile_pdf;
+    var dir = sample_in_tile(x, y, finest.res, u, sam[0], in_tile_pdf);
+
+    SampleResult result;
+    result.to_light = dir;
+    result.pdf = tile_pdf * in_tile_pdf;
+    return result;
+}
+
+f32 HierarchicalEnvirLightSampler::pdf(ref<CVec3f> to_light) const
+{
+    const Level &finest = levels_.back();
+    i32 tile_x, tile_y;
+    var in_tile_pdf = find_tile(to_light, finest.res, tile_x, tile_y);
+    var tile_pdf = cuj::import_pointer(weights_.get())[finest.offset + u64(tile_y * finest.res.x + tile_x)];
     return tile_pdf * in_tile_pdf;
 }
 
+float HierarchicalEnvirLightSampler::get_average_luminance() const
+{
+    return avg_lum_;
+}
+
 BTRC_BUILTIN_END
@@ -5,6 +5,8 @@
 
 BTRC_BUILTIN_BEGIN
 
+// importance sampling of directions by luminance of an environment texture.
+// the texture is divided into tiles in (phi, theta), in which directions are uniform in solid angle
 class EnvirLightSampler
 {
 public:
@@ -14,17 +16,73 @@ public:
         CUJ_MEMBER_VARIABLE(f32, pdf)
     CUJ_CLASS_END
 
-    void preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples);
+    virtual ~EnvirLightSampler() = default;
 
-    SampleResult sample(ref<Sam3> sam) const;
+    virtual void preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples) = 0;
 
-    f32 pdf(ref<CVec3f> to_light) const;
+    virtual SampleResult sample(ref<Sam3> sam) const = 0;
+
+    virtual f32 pdf(ref<CVec3f> to_light) const = 0;
+
+    virtual float get_average_luminance() const = 0;
+};
+
+// selects a tile with an alias table. tile probabilities are compensated
+// by subtracting the average luminance
+class TileEnvirLightSampler : public EnvirLightSampler
+{
+public:
+
+    void preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples) override;
+
+    SampleResult sample(ref<Sam3> sam) const override;
+
+    f32 pdf(ref<CVec3f> to_light) const override;
+
+    float get_average_luminance() const override;
 
 private:
 
     Vec2i               lut_res_;
+    float               avg_lum_ = 0;
     cuda::Buffer<float> tile_probs_;
     CAliasTable         tile_alias_;
 };
 
+// hierarchical sample warping (Clarberg et al. 2005) over a mip pyramid of tile weights.
+// tiles are texels for array textures and lut_res tiles otherwise, rounded up to powers of 2.
+// a 2x2 (or 2x1 after one axis is exhausted) choice is made per level with sam[1] and sam[2].
+// each choice uses up about one bit of the remapped sample, so for an 8k map only 11 of 24 bits
+// are left after the 13 levels. the remapped sam[1] still gives phi in the tile to 1 / 2048 of it,
+// and theta in the tile is taken from the unused sam[0]
+class HierarchicalEnvirLightSampler : public EnvirLightSampler
+{
+public:
+
+    // subtract the average luminance from tile weights (mis compensation)
+    void set_compensation(bool compensation);
+
+    void preprocess(const RC<const Texture2D> &tex, const Vec2i &lut_res, int n_samples) override;
+
+    SampleResult sample(ref<Sam3> sam) const override;
+
+    f32 pdf(ref<CVec3f> to_light) const override;
+
+    float get_average_luminance() const override;
+
+private:
+
+    struct Level
+    {
+        Vec2i  res;
+        size_t offset;
+    };
+
+    bool compensation_ = false;
+
+    float               avg_lum_ = 0;
+    std::vector<Level>  levels_; // from 1x1 to the tile resolution
+    cuda::Buffer<float> weights_; // all levels. the finest level is normalized to tile probabilities
+};
+
 BTRC_BUILTIN_END
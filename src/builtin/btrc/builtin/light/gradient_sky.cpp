@@ -17,6 +17,12 @@ void GradientSky::set_up(const Vec3f &up)
     up_ = normalize(up);
 }
 
+float GradientSky::get_average_luminance() const
+{
+    // cos_theta is uniformly distributed over the sphere
+    return 0.5f * (lower_.get_lum() + upper_.get_lum());
+}
+
 CSpectrum GradientSky::eval_le_inline(CompileContext &cc, ref<CVec3f> to_light) const
 {
     var cos_theta = dot(up_, normalize(to_light));
@@ -21,6 +21,8 @@ public:
 
     void set_up(const Vec3f &up);
 
+    float get_average_luminance() const override;
+
     CSpectrum eval_le_inline(CompileContext &cc, ref<CVec3f> to_light) const override;
 
     SampleLiResult sample_li_inline(CompileContext &cc, ref<Sam3> sam) const override;
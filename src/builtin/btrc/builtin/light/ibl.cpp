@@ -18,12 +18,23 @@ void IBL::set_lut_res(const Vec2i &lut_res)
     lut_res_ = lut_res;
 }
 
+void IBL::set_sampler(Box<EnvirLightSampler> sampler)
+{
+    sampler_ = std::move(sampler);
+}
+
 void IBL::commit()
 {
-    sampler_ = newBox<EnvirLightSampler>();
+    if(!sampler_)
+        sampler_ = newBox<TileEnvirLightSampler>();
     sampler_->preprocess(tex_.get(), lut_res_, 256);
 }
 
+float IBL::get_average_luminance() const
+{
+    return sampler_->get_average_luminance();
+}
+
 CSpectrum IBL::eval_le_inline(CompileContext &cc, ref<CVec3f> to_light) const
 {
     var dir = normalize(CFrame(frame_).global_to_local(to_light));
@@ -83,10 +94,19 @@ RC<Light> IBLCreator::create(RC<const factory::Node> node, factory::Context &con
     auto up = node->parse_child_or("up", Vec3f(0, 0, 1));
     const int lut_res_x = node->parse_child_or("lut_width", 400);
     const int lut_res_y = node->parse_child_or("lut_height", 200);
+    const auto sampler_type = node->parse_child_or<std::string>("sampler", "tile");
     auto result = newRC<IBL>();
     result->set_texture(std::move(tex));
     result->set_up(up);
     result->set_lut_res({ lut_res_x, lut_res_y });
+    if(sampler_type == "hierarchical")
+    {
+        auto sampler = newBox<HierarchicalEnvirLightSampler>();
+        sampler->set_compensation(node->parse_child_or("compensation", false));
+        result->set_sampler(std::move(sampler));
+    }
+    else if(sampler_type != "tile")
+        throw BtrcException("unknown envir light sampler type: " + sampler_type);
     return result;
 }
 
@@ -17,8 +17,13 @@ public:
     
     void set_lut_res(const Vec2i &lut_res);
 
+    // TileEnvirLightSampler is used by default
+    void set_sampler(Box<EnvirLightSampler> sampler);
+
     void commit() override;
 
+    float get_average_luminance() const override;
+
     CSpectrum eval_le_inline(CompileContext &cc, ref<CVec3f> to_light) const override;
 
     SampleLiResult sample_li_inline(CompileContext &cc, ref<Sam3> sam) const override;
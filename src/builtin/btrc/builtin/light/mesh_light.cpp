@@ -1,12 +1,84 @@
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <span>
+
 #include <btrc/builtin/light/mesh_light.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/math/hammersley.h>
 
 BTRC_BUILTIN_BEGIN
 
+namespace
+{
+
+    const char KERNEL[] = "generate_triangle_lum_table";
+
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    std::string generate_triangle_lum_kernel(
+        const Geometry  *geometry,
+        const Texture2D *emission,
+        const Spectrum  &intensity,
+        int              triangle_count,
+        int              n_samples)
+    {
+        CompileContext cc;
+        cuj::ScopedModule cuj_module;
+
+        cuj::kernel(KERNEL, [&](ptr<f32> lum_table)
+        {
+            var ti = cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x();
+            $if(ti < triangle_count)
+            {
+                std::vector<Vec2f> local_samples_data(n_samples);
+                for(int i = 0; i < n_samples; ++i)
+                    local_samples_data[i] = hammersley2d(i, n_samples);
+                var local_samples = cuj::const_data(std::span<const Vec2f>{ local_samples_data });
+
+                // average luminance over the uv footprint of the triangle
+                var i = 0;
+                var lum_sum = 0.0f;
+                $while(i < n_samples)
+                {
+                    var local_sample = local_samples[i];
+                    i = i + 1;
+                    var spt = geometry->sample_primitive(cc, u32(ti), local_sample).point;
+                    var value = CSpectrum(intensity) * emission->sample_spectrum(cc, spt);
+                    lum_sum = lum_sum + value.get_lum();
+                };
+                lum_table[ti] = lum_sum / n_samples;
+            };
+        });
+
+        cuj::PTXGenerator gen;
+        gen.set_options(cuj::Options{
+            .opt_level = cuj::OptimizationLevel::O3,
+            .fast_math = true,
+            .approx_math_func = true
+        });
+        gen.generate(cuj_module);
+
+        return gen.get_ptx();
+    }
+
+} // namespace anonymous
+
 void MeshLight::set_intensity(const Spectrum &intensity)
 {
     intensity_ = intensity;
 }
 
+void MeshLight::set_emission(RC<Texture2D> emission)
+{
+    emission_ = std::move(emission);
+}
+
+void MeshLight::set_emission_sampling(bool enabled)
+{
+    emission_sampling_ = enabled;
+}
+
 void MeshLight::set_geometry(RC<Geometry> geometry, const Transform3D &local_to_world)
 {
     geometry_ = std::move(geometry);
@@ -14,12 +86,97 @@ void MeshLight::set_geometry(RC<Geometry> geometry, const Transform3D &local_to_
     scale_ = length(local_to_world.apply_to_point({ 1, 0, 0 }) - local_to_world.apply_to_point({ 0, 0, 0 }));
 }
 
+void MeshLight::commit()
+{
+    use_triangle_table_ = false;
+    triangle_table_ = {};
+    triangle_pdfs_ = {};
+
+    if(!emission_sampling_)
+    {
+        // emission is assumed to be constant
+        local_power_ = btrc_pi * geometry_->get_area() * (std::max)(intensity_.get_lum(), 0.0f);
+        return;
+    }
+
+    // integrate emitted luminance over each triangle
+
+    const std::vector<float> &areas = geometry_->get_primitive_areas();
+    const int triangle_count = static_cast<int>(areas.size());
+
+    const std::string ptx = generate_triangle_lum_kernel(
+        geometry_.get().get(), emission_.get().get(), intensity_, triangle_count, 256);
+
+    cuda::Module cuda_module;
+    cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+    cuda_module.link();
+
+    cuda::Buffer<float> device_lum(triangle_count);
+    const int block_cnt = up_align(triangle_count, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+    cuda_module.launch(KERNEL, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 }, device_lum.get());
+    throw_on_error(cudaStreamSynchronize(nullptr));
+
+    std::vector<float> lums(triangle_count);
+    device_lum.to_cpu(lums.data());
+
+    EmissionTable table = build_emission_table(areas, lums);
+    local_power_ = btrc_pi * static_cast<float>(table.total_weight);
+
+    if(table.total_weight <= 0)
+        return;
+
+    use_triangle_table_ = true;
+    triangle_table_ = CAliasTable(AliasTable(table.weights));
+    triangle_pdfs_ = cuda::Buffer<float>(table.pdfs);
+}
+
+MeshLight::EmissionTable MeshLight::build_emission_table(std::span<const float> areas, std::span<const float> lums)
+{
+    assert(areas.size() == lums.size());
+    const size_t triangle_count = areas.size();
+
+    EmissionTable result;
+    result.weights.resize(triangle_count);
+    for(size_t i = 0; i < triangle_count; ++i)
+    {
+        const float lum = lums[i];
+        result.weights[i] = std::isfinite(lum) ? areas[i] * (std::max)(lum, 0.0f) : 0.0f;
+        result.total_weight += result.weights[i];
+    }
+
+    // pdfs[i] * areas[i] is the selection probability of triangle i, so they integrate to one over the mesh
+    result.pdfs.resize(triangle_count);
+    if(result.total_weight > 0)
+    {
+        for(size_t i = 0; i < triangle_count; ++i)
+        {
+            result.pdfs[i] = areas[i] > 0 ?
+                static_cast<float>(result.weights[i] / (result.total_weight * areas[i])) : 0.0f;
+        }
+    }
+    return result;
+}
+
+AreaLightBounds MeshLight::get_bounds() const
+{
+    const DirectionCone local_cone = geometry_->get_normal_cone();
+
+    // local_to_world_ is assumed to be a similarity transform, which keeps cone angles
+    AreaLightBounds result;
+    result.bbox = local_to_world_.apply_to_aabb(geometry_->get_bounding_box());
+    result.normal = DirectionCone(
+        normalize(local_to_world_.apply_to_normal(local_cone.axis)), local_cone.cos_theta);
+    result.cos_theta_e = 0;
+    result.power = scale_ * scale_ * local_power_;
+    return result;
+}
+
 CSpectrum MeshLight::eval_le_inline(CompileContext &cc, ref<SurfacePoint> spt, ref<CVec3f> wr) const
 {
     CSpectrum result;
     $if(dot(spt.frame.z, wr) >= 0)
     {
-        result = CSpectrum(intensity_);
+        result = eval_emission(cc, spt);
     }
     $else
     {
@@ -32,7 +189,7 @@ AreaLight::SampleLiResult MeshLight::sample_li_inline(CompileContext &cc, ref<CV
 {
     CTransform3D ctrans = local_to_world_;
 
-    var surface_sample = geometry_->sample(cc, sam);
+    var surface_sample = sample_position(cc, ref_pos, sam);
     var spos = ctrans.apply_to_point(surface_sample.point.position);
     var snor = normalize(ctrans.apply_to_normal(surface_sample.point.frame.z));
     var pos_to_ref = ref_pos - spos;
@@ -42,7 +199,7 @@ AreaLight::SampleLiResult MeshLight::sample_li_inline(CompileContext &cc, ref<CV
     CSpectrum rad;
     $if(dot(pos_to_ref, snor) > 0)
     {
-        rad = CSpectrum(intensity_);
+        rad = eval_emission(cc, surface_sample.point);
     }
     $else
     {
@@ -57,29 +214,30 @@ AreaLight::SampleLiResult MeshLight::sample_li_inline(CompileContext &cc, ref<CV
     return result;
 }
 
-f32 MeshLight::pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<CVec3f> pos, ref<CVec3f> nor) const
+f32 MeshLight::pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const
 {
     f32 result;
-    $if(dot(nor, ref_pos - pos) <= 0)
+    $if(dot(spt.frame.z, ref_pos - spt.position) <= 0)
     {
         result = 0;
     }
     $else
     {
-        var pdf_area = geometry_->pdf(cc, ref_pos, pos);
-        var spt_to_ref = ref_pos - pos;
+        var pdf_area = pdf_position(cc, ref_pos, spt);
+        var spt_to_ref = ref_pos - spt.position;
         var dist2 = length_square(spt_to_ref);
         var dist3 = cstd::sqrt(dist2) * dist2;
-        result = 1 / (scale_ * scale_) * pdf_area * dist3 / cstd::abs(dot(nor, spt_to_ref));
+        result = 1 / (scale_ * scale_) * pdf_area * dist3 / cstd::abs(dot(spt.frame.z, spt_to_ref));
     };
     return result;
 }
 
 AreaLight::SampleEmitResult MeshLight::sample_emit_inline(CompileContext &cc, ref<Sam<5>> sam) const
 {
-    var surface_sample = geometry_->sample(cc, make_sample(sam[0], sam[1], sam[2]));
+    var surface_sample = sample_position(cc, make_sample(sam[0], sam[1], sam[2]));
     var point = surface_sample.point;
     var pdf_pos = surface_sample.pdf;
+    var radiance = eval_emission(cc, point);
 
     var local_dir = sample_hemisphere_zweighted(sam[3], sam[4]);
     var pdf_dir = pdf_sample_hemisphere_zweighted(local_dir);
@@ -89,7 +247,7 @@ AreaLight::SampleEmitResult MeshLight::sample_emit_inline(CompileContext &cc, re
     SampleEmitResult result;
     result.point = point;
     result.direction = point.frame.local_to_global(local_dir);
-    result.radiance = CSpectrum(intensity_);
+    result.radiance = radiance;
     result.pdf_pos = 1 / (scale_ * scale_) * pdf_pos;
     result.pdf_dir = pdf_dir;
 
@@ -101,7 +259,11 @@ AreaLight::PdfEmitResult MeshLight::pdf_emit_inline(CompileContext &cc, ref<Surf
     var local_dir = normalize(spt.frame.global_to_local(wr));
     var pdf_dir = pdf_sample_hemisphere_zweighted(local_dir);
 
-    var pdf_pos = geometry_->pdf(cc, spt.position);
+    f32 pdf_pos;
+    if(use_triangle_table_)
+        pdf_pos = cuj::import_pointer(triangle_pdfs_.get())[spt.prim_id];
+    else
+        pdf_pos = geometry_->pdf(cc, spt.position);
     pdf_pos = 1 / (scale_ * scale_) * pdf_pos;
 
     PdfEmitResult result;
@@ -111,11 +273,56 @@ AreaLight::PdfEmitResult MeshLight::pdf_emit_inline(CompileContext &cc, ref<Surf
     return result;
 }
 
+CSpectrum MeshLight::eval_emission(CompileContext &cc, ref<SurfacePoint> spt) const
+{
+    return CSpectrum(intensity_) * emission_->sample_spectrum(cc, spt);
+}
+
+Geometry::SampleResult MeshLight::sample_position(CompileContext &cc, ref<Sam3> sam) const
+{
+    if(!use_triangle_table_)
+        return geometry_->sample(cc, sam);
+    var prim_id = triangle_table_.sample(sam[0]);
+    var result = geometry_->sample_primitive(cc, prim_id, CVec2f(sam[1], sam[2]));
+    result.pdf = cuj::import_pointer(triangle_pdfs_.get())[prim_id];
+    return result;
+}
+
+Geometry::SampleResult MeshLight::sample_position(CompileContext &cc, ref<CVec3f> ref_pos, ref<Sam3> sam) const
+{
+    if(use_triangle_table_)
+        return sample_position(cc, sam);
+    CTransform3D world_to_local = local_to_world_.inverse();
+    var local_ref = world_to_local.apply_to_point(ref_pos);
+    return geometry_->sample(cc, local_ref, sam);
+}
+
+f32 MeshLight::pdf_position(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const
+{
+    if(use_triangle_table_)
+        return cuj::import_pointer(triangle_pdfs_.get())[spt.prim_id];
+    CTransform3D world_to_local = local_to_world_.inverse();
+    var local_ref = world_to_local.apply_to_point(ref_pos);
+    var local_pos = world_to_local.apply_to_point(spt.position);
+    return geometry_->pdf(cc, local_ref, local_pos, spt.prim_id);
+}
+
 RC<Light> MeshLightCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
     auto intensity = node->parse_child<Spectrum>("intensity");
     auto result = newRC<MeshLight>();
     result->set_intensity(intensity);
+    if(auto emission_node = node->find_child_node("emission"))
+    {
+        result->set_emission(context.create<Texture2D>(emission_node));
+        result->set_emission_sampling(node->parse_child_or("emission_sampling", true));
+    }
+    else
+    {
+        auto emission = newRC<Constant2D>();
+        emission->set_value(1);
+        result->set_emission(std::move(emission));
+    }
     return result;
 }
 
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <span>
+
 #include <btrc/core/geometry.h>
 #include <btrc/core/light.h>
+#include <btrc/core/texture2d.h>
 #include <btrc/factory/context.h>
+#include <btrc/utils/cmath/calias.h>
 
 BTRC_BUILTIN_BEGIN
 
@@ -10,15 +14,37 @@ class MeshLight : public AreaLight
 {
 public:
 
+    // triangle selection weights and area densities for emission sampling
+    struct EmissionTable
+    {
+        std::vector<float> weights; // area times average emitted luminance
+        std::vector<float> pdfs;    // area density on each triangle. all zero when total_weight is 0
+        double             total_weight = 0;
+    };
+
+    // lums are average emitted luminances of triangles. non-finite ones are treated as 0
+    static EmissionTable build_emission_table(std::span<const float> areas, std::span<const float> lums);
+
     void set_intensity(const Spectrum &intensity);
 
+    // le is intensity scaled by emission
+    void set_emission(RC<Texture2D> emission);
+
+    // select triangles by emitted power instead of area.
+    // emission is integrated over each triangle in commit()
+    void set_emission_sampling(bool enabled);
+
     void set_geometry(RC<Geometry> geometry, const Transform3D &local_to_world) override;
 
+    void commit() override;
+
+    AreaLightBounds get_bounds() const override;
+
     CSpectrum eval_le_inline(CompileContext &cc, ref<SurfacePoint> spt, ref<CVec3f> wr) const override;
 
     SampleLiResult sample_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<Sam3> sam) const override;
 
-    f32 pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<CVec3f> pos, ref<CVec3f> nor) const override;
+    f32 pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const override;
 
     SampleEmitResult sample_emit_inline(CompileContext &cc, ref<Sam<5>> sam) const override;
 
@@ -26,10 +52,30 @@ public:
 
 private:
 
+    CSpectrum eval_emission(CompileContext &cc, ref<SurfacePoint> spt) const;
+
+    // in local space
+    Geometry::SampleResult sample_position(CompileContext &cc, ref<Sam3> sam) const;
+
+    // ref_pos is in world space. result is in local space
+    Geometry::SampleResult sample_position(CompileContext &cc, ref<CVec3f> ref_pos, ref<Sam3> sam) const;
+
+    // ref_pos and spt are in world space. result is a local area density.
+    // spt.prim_id is used when triangles are selected by power
+    f32 pdf_position(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const;
+
     BTRC_OBJECT(Geometry, geometry_);
+    BTRC_OBJECT(Texture2D, emission_);
     float scale_ = 1;
     Transform3D local_to_world_;
     Spectrum  intensity_;
+
+    bool emission_sampling_ = false;
+
+    float               local_power_ = 0;
+    bool                use_triangle_table_ = false;
+    CAliasTable         triangle_table_;
+    cuda::Buffer<float> triangle_pdfs_; // area density on each triangle
 };
 
 class MeshLightCreator : public factory::Creator<Light>
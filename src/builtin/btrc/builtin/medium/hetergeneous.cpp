@@ -1,7 +1,19 @@
+#include <algorithm>
+
 #include <btrc/builtin/medium/hetergeneous.h>
+#include <btrc/builtin/medium/majorant_grid.h>
 
 BTRC_BUILTIN_BEGIN
 
+namespace
+{
+
+    // russian roulette of transmittance estimates below the threshold
+    constexpr float TR_RR_THRESHOLD = 0.1f;
+    constexpr float TR_RR_PROB = 0.5f;
+
+} // namespace anonymous
+
 void HetergeneousMedium::set_priority(float priority)
 {
     priority_ = priority;
@@ -22,6 +34,91 @@ void HetergeneousMedium::set_g(RC<Texture3D> g)
     g_ = std::move(g);
 }
 
+void HetergeneousMedium::set_majorant_grid_res(int res)
+{
+    majorant_grid_res_ = res;
+}
+
+void HetergeneousMedium::set_chromatic(bool chromatic)
+{
+    chromatic_ = chromatic;
+}
+
+void HetergeneousMedium::commit()
+{
+    // sigma_t is sampled at 0.5 + 0.5 * uvw, so the grid covers [0, 1]^3 of the texture
+
+    const int res = majorant_grid_res_;
+    const float cell_size = 1.0f / static_cast<float>(res);
+
+    std::vector<float> majorants, controls;
+    majorants.reserve(static_cast<size_t>(res) * res * res);
+    controls.reserve(static_cast<size_t>(res) * res * res);
+    for(int z = 0; z < res; ++z)
+    {
+        for(int y = 0; y < res; ++y)
+        {
+            for(int x = 0; x < res; ++x)
+            {
+                const Vec3f lower = cell_size * Vec3f(
+                    static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                const AABB3f cell = { lower, lower + Vec3f(cell_size) };
+                float max_density, min_density;
+                if(chromatic_)
+                {
+                    const Spectrum max_spec = sigma_t_->get_max_spectrum_in(cell);
+                    const Spectrum min_spec = sigma_t_->get_min_spectrum_in(cell);
+                    max_density = (std::max)({ max_spec.r, max_spec.g, max_spec.b });
+                    min_density = (std::min)({ min_spec.r, min_spec.g, min_spec.b });
+                }
+                else
+                {
+                    max_density = sigma_t_->get_max_float_in(cell);
+                    min_density = sigma_t_->get_min_float_in(cell);
+                }
+                const float majorant = (std::max)(max_density, 0.0f);
+                const float control = std::clamp(min_density, 0.0f, majorant);
+                majorants.push_back(majorant);
+                controls.push_back(control);
+            }
+        }
+    }
+
+    // the segment can leave [0, 1]^3, where only the global bounds hold whatever the addressing mode is
+    float max_density, min_density;
+    if(chromatic_)
+    {
+        const Spectrum max_spec = sigma_t_->get_max_spectrum();
+        const Spectrum min_spec = sigma_t_->get_min_spectrum();
+        max_density = (std::max)({ max_spec.r, max_spec.g, max_spec.b });
+        min_density = (std::min)({ min_spec.r, min_spec.g, min_spec.b });
+    }
+    else
+    {
+        max_density = sigma_t_->get_max_float();
+        min_density = sigma_t_->get_min_float();
+    }
+    outside_majorant_ = (std::max)(max_density, 0.0f);
+    outside_control_ = std::clamp(min_density, 0.0f, outside_majorant_);
+
+    majorant_grid_ = cuda::Buffer<float>(majorants);
+    control_grid_ = cuda::Buffer<float>(controls);
+}
+
+template<typename Func>
+void HetergeneousMedium::traverse_majorant_grid(
+    ref<CVec3f> local_a, ref<CVec3f> local_dir, f32 t_max, const Func &func) const
+{
+    const MajorantGridView grid = {
+        .res              = majorant_grid_res_,
+        .majorants        = cuj::import_pointer(majorant_grid_.get()),
+        .controls         = cuj::import_pointer(control_grid_.get()),
+        .outside_majorant = outside_majorant_,
+        .outside_control  = outside_control_
+    };
+    builtin::traverse_majorant_grid(grid, local_a, local_dir, t_max, func);
+}
+
 Medium::SampleResult HetergeneousMedium::sample(
     CompileContext &cc,
     ref<CVec3f>     a,
@@ -30,9 +127,7 @@ Medium::SampleResult HetergeneousMedium::sample(
     ref<CVec3f>     uvw_b,
     Sampler        &sampler) const
 {
-    const float max_density = std::max(sigma_t_->get_max_float(), 0.001f);
-    const float inv_max_density = 1.0f / max_density;
-    var t_max = length(b - a), t = 0.0f;
+    var t_max = length(b - a);
     
     var local_a = CVec3f(0.5f) + 0.5f * uvw_a;
     var local_b = CVec3f(0.5f) + 0.5f * uvw_b;
@@ -42,33 +137,85 @@ Medium::SampleResult HetergeneousMedium::sample(
     SampleResult result;
     auto shader = newRC<HenyeyGreensteinPhaseShader>();
     result.shader = shader;
+    result.scattered = false;
+    result.throughput = CSpectrum::one();
+
+    // delta tracking with per-cell majorants. free-flight sampling restarts
+    // at cell boundaries, which is valid as exponential distances are memoryless.
+    //
+    // chromatic media share the majorant between channels. collisions are classified
+    // with the extinction of a uniformly chosen hero channel, and the throughput is
+    // the single-sample spectral mis weight p_c / avg(p), with p_c being the probability
+    // of the same decisions if channel c were the hero.
 
-    $loop
+    i32 hero;
+    var pdf_ratio = CSpectrum::one();
+    if(chromatic_)
+        hero = cstd::min(i32(sampler.get1d() * 3.0f), i32(2));
+
+    auto update_pdf_ratio = [&](const CSpectrum &probs)
     {
-        var dt = -cstd::log(1.0f - sampler.get1d()) * inv_max_density;
-        t = t + dt;
-        $if(t >= t_max)
-        {
-            result.scattered = false;
-            result.throughput = CSpectrum::one();
-            $break;
-        };
-        
-        var uvw = local_a + t * local_ba_div_t_max;
-        var density = sigma_t_->sample_float(cc, uvw);
-        $if(sampler.get1d() < density * inv_max_density)
+        var p = pdf_ratio * probs;
+        var avg = (p.r + p.g + p.b) * (1.0f / 3);
+        pdf_ratio = cstd::select(avg > 0.0f, p / avg, CSpectrum::zero());
+    };
+
+    traverse_majorant_grid(local_a, local_ba_div_t_max, t_max, [&](f32 t_beg, f32 t_end, f32 majorant, f32)
+    {
+        boolean stop = false;
+        $if(majorant > 0.0f)
         {
-            var albedo = albedo_->sample_spectrum(cc, uvw);
-            var g = g_->sample_float(cc, uvw);
-            result.scattered = true;
-            result.position = a + t * ba_div_t_max;
-            result.throughput = CSpectrum::one();
-            shader->set_g(g);
-            shader->set_color(albedo);
-            $break;
+            var inv_majorant = 1.0f / majorant;
+            var t = t_beg;
+            $loop
+            {
+                var dt = -cstd::log(1.0f - sampler.get1d()) * inv_majorant;
+                t = t + dt;
+                $if(t >= t_end)
+                {
+                    $break;
+                };
+
+                var uvw = local_a + t * local_ba_div_t_max;
+                boolean collided;
+                if(chromatic_)
+                {
+                    var collision_probs = sigma_t_->sample_spectrum(cc, uvw) * inv_majorant;
+                    var hero_prob = cstd::select(
+                        hero == 0, collision_probs.r, cstd::select(hero == 1, collision_probs.g, collision_probs.b));
+                    collided = sampler.get1d() < hero_prob;
+                    $if(collided)
+                    {
+                        update_pdf_ratio(collision_probs);
+                    }
+                    $else
+                    {
+                        update_pdf_ratio(CSpectrum::one() - collision_probs);
+                    };
+                }
+                else
+                {
+                    var density = sigma_t_->sample_float(cc, uvw);
+                    collided = sampler.get1d() < density * inv_majorant;
+                }
+
+                $if(collided)
+                {
+                    var albedo = albedo_->sample_spectrum(cc, uvw);
+                    var g = g_->sample_float(cc, uvw);
+                    result.scattered = true;
+                    result.position = a + t * ba_div_t_max;
+                    shader->set_g(g);
+                    shader->set_color(albedo);
+                    stop = true;
+                    $break;
+                };
+            };
         };
-    };
+        return stop;
+    });
 
+    result.throughput = pdf_ratio;
     return result;
 }
 
@@ -80,29 +227,73 @@ CSpectrum HetergeneousMedium::tr(
     ref<CVec3f>     uvw_b,
     Sampler        &sampler) const
 {
-    var result = 1.0f, t = 0.0f, t_max = length(b - a);
-    const float max_density = std::max(sigma_t_->get_max_float(), 0.001f);
-    const float inv_max_density = 1.0f / max_density;
+    var result = CSpectrum::one(), t_max = length(b - a);
 
     var local_a = CVec3f(0.5f) + 0.5f * uvw_a;
     var local_b = CVec3f(0.5f) + 0.5f * uvw_b;
     var local_ba_div_t_max = (local_b - local_a) / t_max;
 
-    $loop
+    // residual ratio tracking. the cell minimum is used as control density,
+    // whose transmittance is evaluated analytically, and only the residual is tracked.
+    // channels of chromatic media are tracked together with the shared majorant
+
+    auto russian_roulette = [&]
     {
-        var dt = -cstd::log(1.0f - sampler.get1d()) * inv_max_density;
-        t = t + dt;
-        $if(t >= t_max)
+        var max_result = cstd::max(result.r, cstd::max(result.g, result.b));
+        $if(max_result < TR_RR_THRESHOLD)
         {
-            $break;
+            $if(sampler.get1d() < TR_RR_PROB)
+            {
+                result = CSpectrum::zero();
+            }
+            $else
+            {
+                result = result / (1.0f - TR_RR_PROB);
+            };
         };
-
-        var uvw = local_a + t * local_ba_div_t_max;
-        var density = sigma_t_->sample_float(cc, uvw);
-        result = result * (1.0f - density * inv_max_density);
     };
 
-    return CSpectrum::from_rgb(result, result, result);
+    traverse_majorant_grid(local_a, local_ba_div_t_max, t_max, [&](f32 t_beg, f32 t_end, f32 majorant, f32 control)
+    {
+        result = result * cstd::exp(-control * (t_end - t_beg));
+        russian_roulette();
+
+        var residual_majorant = majorant - control;
+        $if(residual_majorant > 0.0f & !result.is_zero())
+        {
+            var inv_residual_majorant = 1.0f / residual_majorant;
+            var control_spectrum = CSpectrum::from_rgb(control, control, control);
+            var t = t_beg;
+            $loop
+            {
+                var dt = -cstd::log(1.0f - sampler.get1d()) * inv_residual_majorant;
+                t = t + dt;
+                $if(t >= t_end)
+                {
+                    $break;
+                };
+
+                var uvw = local_a + t * local_ba_div_t_max;
+                CSpectrum density;
+                if(chromatic_)
+                    density = sigma_t_->sample_spectrum(cc, uvw);
+                else
+                {
+                    var d = sigma_t_->sample_float(cc, uvw);
+                    density = CSpectrum::from_rgb(d, d, d);
+                }
+                result = result * (CSpectrum::one() - (density - control_spectrum) * inv_residual_majorant);
+                russian_roulette();
+                $if(result.is_zero())
+                {
+                    $break;
+                };
+            };
+        };
+        return result.is_zero();
+    });
+
+    return result;
 }
 
 float HetergeneousMedium::get_priority() const
@@ -113,6 +304,10 @@ float HetergeneousMedium::get_priority() const
 RC<Medium> HetergeneousMediumCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
     const auto priority = node->parse_child_or("priority", 0.0f);
+    const auto majorant_grid_res = node->parse_child_or("majorant_grid_res", 16);
+    const auto chromatic = node->parse_child_or("chromatic", false);
+    if(majorant_grid_res < 1)
+        throw BtrcException("majorant grid resolution must be positive");
     auto sigma_t = context.create<Texture3D>(node->child_node("sigma_t"));
     auto albedo = context.create<Texture3D>(node->child_node("albedo"));
 
@@ -128,6 +323,8 @@ RC<Medium> HetergeneousMediumCreator::create(RC<const factory::Node> node, facto
 
     auto result = newRC<HetergeneousMedium>();
     result->set_priority(priority);
+    result->set_majorant_grid_res(majorant_grid_res);
+    result->set_chromatic(chromatic);
     result->set_sigma_t(std::move(sigma_t));
     result->set_albedo(std::move(albedo));
     result->set_g(std::move(g));
@@ -2,6 +2,7 @@
 
 #include <btrc/core/medium.h>
 #include <btrc/factory/context.h>
+#include <btrc/utils/cuda/buffer.h>
 
 BTRC_BUILTIN_BEGIN
 
@@ -17,6 +18,14 @@ public:
 
     void set_g(RC<Texture3D> g);
 
+    // resolution of the majorant grid along each axis
+    void set_majorant_grid_res(int res);
+
+    // use all channels of sigma_t as per-channel extinction. otherwise only the first channel is used
+    void set_chromatic(bool chromatic);
+
+    void commit() override;
+
     SampleResult sample(
         CompileContext &cc,
         ref<CVec3f>     a,
@@ -37,7 +46,21 @@ public:
 
 private:
 
+    // calls func(t_beg, t_end, majorant, control) for each majorant grid cell along the segment, and for
+    // the parts outside the grid, until it returns true. t is the distance from local_a. control is a lower bound of sigma_t
+    template<typename Func>
+    void traverse_majorant_grid(ref<CVec3f> local_a, ref<CVec3f> local_dir, f32 t_max, const Func &func) const;
+
     float priority_ = 0.0f;
+    int   majorant_grid_res_ = 16;
+    bool  chromatic_ = false;
+
+    float outside_majorant_ = 0.0f;
+    float outside_control_ = 0.0f;
+
+    cuda::Buffer<float> majorant_grid_;
+    cuda::Buffer<float> control_grid_;
+
     BTRC_OBJECT(Texture3D, sigma_t_);
     BTRC_OBJECT(Texture3D, albedo_);
     BTRC_OBJECT(Texture3D, g_);
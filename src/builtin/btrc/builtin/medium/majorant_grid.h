@@ -0,0 +1,151 @@
+#pragma once
+
+#include <btrc/utils/cmath/cmath.h>
+
+BTRC_BUILTIN_BEGIN
+
+// bounds of sigma_t on a res^3 grid over [0, 1]^3, with a single bound pair for everything outside it
+struct MajorantGridView
+{
+    int      res;
+    ptr<f32> majorants;
+    ptr<f32> controls;
+    float    outside_majorant;
+    float    outside_control;
+};
+
+// calls func(t_beg, t_end, majorant, control) for consecutive pieces of local_a + t * local_dir, t in [0, t_max],
+// until it returns true. the pieces cover the whole segment: the part in [0, 1]^3 is split at grid cell boundaries,
+// and the parts before and after it use the outside bounds
+template<typename Func>
+void traverse_majorant_grid(
+    const MajorantGridView &grid, ref<CVec3f> local_a, ref<CVec3f> local_dir, f32 t_max, const Func &func)
+{
+    const int res = grid.res;
+    const float fres = static_cast<float>(res);
+
+    // clip the segment to the unit cube
+
+    var t_in = 0.0f, t_out = t_max;
+    auto clip_axis = [&](f32 o, f32 d)
+    {
+        $if(d != 0.0f)
+        {
+            var inv_d = 1.0f / d;
+            var n = (0.0f - o) * inv_d, f = (1.0f - o) * inv_d;
+            t_in = cstd::max(t_in, cstd::min(n, f));
+            t_out = cstd::min(t_out, cstd::max(n, f));
+        }
+        $elif(o < 0.0f | o > 1.0f)
+        {
+            t_in = t_max;
+            t_out = 0.0f;
+        };
+    };
+    clip_axis(local_a.x, local_dir.x);
+    clip_axis(local_a.y, local_dir.y);
+    clip_axis(local_a.z, local_dir.z);
+
+    // pieces before the cube, in the grid and after the cube. func is called at one place to keep the kernel small
+
+    constexpr int PHASE_BEFORE = 0, PHASE_GRID = 1, PHASE_AFTER = 2;
+    var has_grid_part = t_in < t_out;
+    var phase = cstd::select(
+        has_grid_part, cstd::select(t_in > 0.0f, i32(PHASE_BEFORE), i32(PHASE_GRID)), i32(PHASE_AFTER));
+
+    // 3d dda from the entry point. next_t is the distance to the next cell boundary along each axis
+
+    auto init_axis = [&](f32 o, f32 d, ref<i32> cell, ref<i32> step, ref<f32> next_t, ref<f32> delta_t)
+    {
+        cell = i32(cstd::clamp(cstd::floor((o + t_in * d) * fres), 0.0f, fres - 1.0f));
+        $if(d > 0.0f)
+        {
+            step = 1;
+            next_t = (f32(cell + 1) / fres - o) / d;
+            delta_t = 1.0f / (fres * d);
+        }
+        $elif(d < 0.0f)
+        {
+            step = -1;
+            next_t = (f32(cell) / fres - o) / d;
+            delta_t = -1.0f / (fres * d);
+        }
+        $else
+        {
+            step = 0;
+            next_t = btrc_max_float;
+            delta_t = btrc_max_float;
+        };
+    };
+
+    i32 cell_x, cell_y, cell_z, step_x, step_y, step_z;
+    f32 next_t_x, next_t_y, next_t_z, delta_t_x, delta_t_y, delta_t_z;
+    init_axis(local_a.x, local_dir.x, cell_x, step_x, next_t_x, delta_t_x);
+    init_axis(local_a.y, local_dir.y, cell_y, step_y, next_t_y, delta_t_y);
+    init_axis(local_a.z, local_dir.z, cell_z, step_z, next_t_z, delta_t_z);
+
+    var t = 0.0f;
+    $loop
+    {
+        f32 t_end, majorant, control;
+        $if(phase == PHASE_GRID)
+        {
+            // rounding can put the first boundary slightly before the entry point
+            t_end = cstd::max(t, cstd::min(cstd::min(next_t_x, next_t_y), cstd::min(next_t_z, t_out)));
+            var cell_idx = (cell_z * res + cell_y) * res + cell_x;
+            majorant = grid.majorants[cell_idx];
+            control = grid.controls[cell_idx];
+        }
+        $else
+        {
+            t_end = cstd::select(phase == PHASE_BEFORE, t_in, t_max);
+            majorant = grid.outside_majorant;
+            control = grid.outside_control;
+        };
+
+        var stop = func(t, t_end, majorant, control);
+        t = t_end;
+        $if(stop | t_end >= t_max)
+        {
+            $break;
+        };
+
+        $if(phase == PHASE_BEFORE)
+        {
+            phase = PHASE_GRID;
+        }
+        $elif(phase == PHASE_GRID)
+        {
+            $if(t_end >= t_out)
+            {
+                phase = PHASE_AFTER;
+            }
+            $else
+            {
+                $if(next_t_x <= next_t_y & next_t_x <= next_t_z)
+                {
+                    cell_x = cell_x + step_x;
+                    next_t_x = next_t_x + delta_t_x;
+                }
+                $elif(next_t_y <= next_t_z)
+                {
+                    cell_y = cell_y + step_y;
+                    next_t_y = next_t_y + delta_t_y;
+                }
+                $else
+                {
+                    cell_z = cell_z + step_z;
+                    next_t_z = next_t_z + delta_t_z;
+                };
+
+                // rounding can leave the grid slightly before t_out. the rest goes to the outside piece
+                $if(cell_x < 0 | cell_x >= res | cell_y < 0 | cell_y >= res | cell_z < 0 | cell_z >= res)
+                {
+                    phase = PHASE_AFTER;
+                };
+            };
+        };
+    };
+}
+
+BTRC_BUILTIN_END
@@ -1,6 +1,8 @@
 #include <btrc/builtin/camera/pinhole.h>
 #include <btrc/builtin/film_filter/box.h>
 #include <btrc/builtin/film_filter/gaussian.h>
+#include <btrc/builtin/film_filter/lanczos.h>
+#include <btrc/builtin/film_filter/mitchell.h>
 #include <btrc/builtin/geometry/triangle_mesh.h>
 #include <btrc/builtin/light/gradient_sky.h>
 #include <btrc/builtin/light/ibl.h>
@@ -24,6 +26,7 @@
 #include <btrc/builtin/texture2d/transform.h>
 #include <btrc/builtin/texture3d/array3d.h>
 #include <btrc/builtin/texture3d/binary.h>
+#include <btrc/builtin/texture3d/sparse3d.h>
 #include <btrc/builtin/register.h>
 
 BTRC_BUILTIN_BEGIN
@@ -37,6 +40,8 @@ void register_builtin_creators(factory::Factory<FilmFilter> &factory)
 {
     factory.add_creator(newBox<BoxFilterCreator>());
     factory.add_creator(newBox<GaussianFilterCreator>());
+    factory.add_creator(newBox<MitchellFilterCreator>());
+    factory.add_creator(newBox<LanczosFilterCreator>());
 }
 
 void register_builtin_creators(factory::Factory<Geometry> &factory)
@@ -96,6 +101,7 @@ void register_builtin_creators(factory::Factory<Texture3D> &factory)
     factory.add_creator(newBox<Array3DCreator>());
     factory.add_creator(newBox<Texture3DBinaryOperatorCreator<BinaryOp3D::Add>>());
     factory.add_creator(newBox<Texture3DBinaryOperatorCreator<BinaryOp3D::Mul>>());
+    factory.add_creator(newBox<SparseArray3DCreator>());
 }
 
 void register_builtin_creators(factory::Context &context)
@@ -1,6 +1,7 @@
 #include <btrc/builtin/film_filter/box.h>
 #include <btrc/builtin/renderer/pt/trace.h>
 #include <btrc/builtin/renderer/pt.h>
+#include <btrc/builtin/renderer/wavefront/progressive.h>
 #include <btrc/builtin/renderer/wavefront/preview.h>
 #include <btrc/core/film.h>
 
@@ -11,10 +12,11 @@ namespace
 
     struct LaunchParams
     {
-        int32_t finished_spp;
+        int32_t  finished_spp;
+        int32_t *active_pixels; // launch index to pixel index in adaptive rendering
     };
 
-    CUJ_CLASS(LaunchParams, finished_spp);
+    CUJ_CLASS(LaunchParams, finished_spp, active_pixels);
 
     using Pipeline = optix::MegaKernelPipeline<LaunchParams>;
 
@@ -37,6 +39,8 @@ struct PathTracer::Impl
     Pipeline pipeline;
     wfpt::PreviewImageGenerator preview;
 
+    Box<wfpt::ProgressiveScheduler> progressive;
+
     cuda::Buffer<Vec4f> device_preview_image;
     cuda::Buffer<Vec4f> device_preview_normal;
     cuda::Buffer<Vec4f> device_preview_albedo;
@@ -97,11 +101,31 @@ void PathTracer::commit()
         impl_->film.add_output(Film::OUTPUT_ALBEDO, Film::Float3);
     if(params.normal)
         impl_->film.add_output(Film::OUTPUT_NORMAL, Film::Float3);
+    impl_->progressive = {};
+    if(params.adaptive || params.time_budget > 0 || params.target_error > 0)
+    {
+        impl_->film.add_half_outputs();
+        impl_->progressive = newBox<wfpt::ProgressiveScheduler>(wfpt::ProgressiveParams{
+            .spp                = params.spp,
+            .round_spp          = params.round_spp,
+            .adaptive           = params.adaptive,
+            .adaptive_threshold = params.adaptive_threshold,
+            .time_budget        = params.time_budget,
+            .target_error       = params.target_error
+        });
+    }
 
     // pipeline
 
+    const GlobalSampler::Params sampler_params = {
+        .type = params.sampler,
+        .spp  = params.spp
+    };
+
     auto raygen = [
         &params,
+        &sampler_params,
+        progressive = impl_->progressive != nullptr,
         &film = impl_->film,
         &filter = impl_->filter,
         &camera = impl_->camera,
@@ -109,16 +133,26 @@ void PathTracer::commit()
     (const Pipeline::RecordContext &ctx)
     {
         ref launch_params = ctx.launch_params.get_reference();
-        u32 pixel_x = optix::get_launch_index_x();
-        u32 pixel_y = optix::get_launch_index_y();
-
-        pt::GlobalSampler sampler(film.size(), CVec2u(pixel_x, pixel_y), launch_params.finished_spp);
+        u32 pixel_x, pixel_y;
+        if(progressive)
+        {
+            var pixel = launch_params.active_pixels[optix::get_launch_index_x()];
+            pixel_x = u32(pixel % film.width());
+            pixel_y = u32(pixel / film.width());
+        }
+        else
+        {
+            pixel_x = optix::get_launch_index_x();
+            pixel_y = optix::get_launch_index_y();
+        }
+
+        GlobalSampler sampler(sampler_params, film.size(), CVec2u(pixel_x, pixel_y), launch_params.finished_spp);
 
         // filter importance sampling
 
-        var filter_sample = filter->sample(sampler);
-        var pixel_xf = f32(pixel_x) + 0.5f + filter_sample.x;
-        var pixel_yf = f32(pixel_y) + 0.5f + filter_sample.y;
+        auto filter_sample = filter->sample(sampler);
+        var pixel_xf = f32(pixel_x) + 0.5f + filter_sample.offset.x;
+        var pixel_yf = f32(pixel_y) + 0.5f + filter_sample.offset.y;
         var film_x = pixel_xf / static_cast<float>(film.width());
         var film_y = pixel_yf / static_cast<float>(film.height());
         var time_sample = sampler.get1d();
@@ -149,7 +183,7 @@ void PathTracer::commit()
             *ctx.cc, trace_utils, trace_params, *scene, trace_ray,
             scene->get_volume_primitive_medium_id(), sampler, world_diagonal);
 
-        var radiance = sample_we_result.throughput * trace_result.radiance;
+        var radiance = sample_we_result.throughput * filter_sample.weight * trace_result.radiance;
 
         // write film
 
@@ -189,23 +223,62 @@ Renderer::RenderResult PathTracer::render()
     if(impl_->film.has_output(Film::OUTPUT_NORMAL))
         impl_->film.clear_output(Film::OUTPUT_NORMAL);
 
+    if(impl_->film.has_output(Film::OUTPUT_RADIANCE_HALF))
+    {
+        impl_->film.clear_output(Film::OUTPUT_RADIANCE_HALF);
+        impl_->film.clear_output(Film::OUTPUT_WEIGHT_HALF);
+    }
+
+    auto &params = impl_->params;
     auto &reporter = *impl_->reporter;
     reporter.new_stage();
 
-    for(int sample_index = 0; sample_index < impl_->params.spp; ++sample_index)
+    auto &progressive = impl_->progressive;
+    if(progressive)
     {
-        const LaunchParams launch_params = {
-            .finished_spp = sample_index
-        };
-        impl_->pipeline.launch(launch_params, impl_->width, impl_->height, 1);
-
-        reporter.progress(100.0f * (sample_index + 1.0f) / impl_->params.spp);
-
-        if(reporter.need_preview())
-            new_preview_image();
-
-        if(should_stop())
-            break;
+        progressive->start(impl_->film);
+        while(progressive->begin_round(impl_->film))
+        {
+            const int base_spp = progressive->get_round_base_spp();
+            const int round_spp = progressive->get_round_spp();
+            for(int i = 0; i < round_spp; ++i)
+            {
+                const LaunchParams launch_params = {
+                    .finished_spp  = base_spp + i,
+                    .active_pixels = progressive->get_pixels()
+                };
+                impl_->pipeline.launch(launch_params, progressive->get_pixel_count(), 1, 1);
+
+                reporter.progress(progressive->get_progress((i + 1.0f) / round_spp));
+
+                if(reporter.need_preview())
+                    new_preview_image();
+            }
+
+            // stop only between rounds so that every pixel has whole rounds of samples
+            progressive->end_round(impl_->film);
+            if(should_stop())
+                break;
+        }
+    }
+    else
+    {
+        for(int sample_index = 0; sample_index < params.spp; ++sample_index)
+        {
+            const LaunchParams launch_params = {
+                .finished_spp  = sample_index,
+                .active_pixels = nullptr
+            };
+            impl_->pipeline.launch(launch_params, impl_->width, impl_->height, 1);
+
+            reporter.progress(100.0f * (sample_index + 1.0f) / params.spp);
+
+            if(reporter.need_preview())
+                new_preview_image();
+
+            if(should_stop())
+                break;
+        }
     }
 
     throw_on_error(cudaStreamSynchronize(nullptr));
@@ -220,6 +293,7 @@ Renderer::RenderResult PathTracer::render()
     result.color.swap(impl_->device_preview_image);
     result.albedo.swap(impl_->device_preview_albedo);
     result.normal.swap(impl_->device_preview_normal);
+    result.average_spp = progressive ? progressive->get_average_spp() : static_cast<float>(params.spp);
     return result;
 }
 
@@ -275,6 +349,15 @@ RC<Renderer> PathTracerCreator::create(RC<const factory::Node> node, factory::Co
 {
     PathTracer::Params params;
     params.spp          = node->parse_child_or("spp", params.spp);
+    params.sampler      = string_to_global_sampler_type(node->parse_child_or<std::string>("sampler", "independent"));
+    params.round_spp    = node->parse_child_or("round_spp", params.round_spp);
+    params.time_budget  = node->parse_child_or("time_budget", params.time_budget);
+    params.target_error = node->parse_child_or("target_error", params.target_error);
+    if(auto adaptive_node = node->find_child_node("adaptive"))
+    {
+        params.adaptive           = adaptive_node->parse_child_or("enabled", true);
+        params.adaptive_threshold = adaptive_node->parse_child_or("threshold", params.adaptive_threshold);
+    }
     params.min_depth    = node->parse_child_or("min_depth", params.min_depth);
     params.max_depth    = node->parse_child_or("max_depth", params.max_depth);
     params.rr_threshold = node->parse_child_or("rr_threshold", params.rr_threshold);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <btrc/builtin/sampler/global.h>
 #include <btrc/core/film_filter.h>
 #include <btrc/core/renderer.h>
 #include <btrc/factory/context.h>
@@ -14,6 +15,17 @@ public:
     {
         int spp = 128;
 
+        GlobalSampler::Type sampler = GlobalSampler::Type::Independent;
+
+        // progressive rendering runs in rounds of round_spp samples and stops between rounds.
+        // it is used when adaptive sampling, a time budget or a target error is set,
+        // in which case spp is the per-pixel cap (0 for no cap)
+        int   round_spp = 16;
+        bool  adaptive = false;
+        float adaptive_threshold = 0.01f; // pixels with lower relative error stop being sampled
+        float time_budget = 0;            // in seconds
+        float target_error = 0;           // relative mse of the whole film
+
         int min_depth = 5;
         int max_depth = 10;
         float rr_threshold = 0.1f;
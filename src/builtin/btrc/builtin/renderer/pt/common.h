@@ -1,6 +1,6 @@
 #pragma once
 
-#include <btrc/builtin/sampler/independent.h>
+#include <btrc/builtin/sampler/global.h>
 #include <btrc/utils/optix/pipeline_mk.h>
 
 #define BTRC_PT_BEGIN BTRC_BUILTIN_BEGIN namespace pt {
@@ -8,8 +8,6 @@
 
 BTRC_PT_BEGIN
 
-using GlobalSampler = IndependentSampler;
-
 struct TraceUtils
 {
     using Hit = optix::pipeline_mk_detail::Hit;
@@ -29,6 +29,7 @@ void trace_light_path(
         // sample emission
 
         CVec3f emit_ori, emit_dir, emit_nor;
+        SurfacePoint emit_spt;
         f32 emit_pdf_pos, emit_pdf_dir;
         CSpectrum emit_radiance;
         boolean is_light_area;
@@ -44,6 +45,7 @@ void trace_light_path(
                     sample_emit.point.frame.z,
                     sample_emit.direction);
                 emit_dir = sample_emit.direction;
+                emit_spt = sample_emit.point;
 
                 emit_pdf_pos = select_light_pdf * sample_emit.pdf_pos;
                 emit_pdf_dir = sample_emit.pdf_dir;
@@ -133,7 +135,7 @@ void trace_light_path(
                 {
                     if(auto area = light->as_area())
                     {
-                        p_light_y1_y2_area = area->pdf_li(cc, hit_spt.position, emit_ori, emit_nor) * y2_r_y1_pdf_factor;
+                        p_light_y1_y2_area = area->pdf_li(cc, hit_spt.position, emit_spt) * y2_r_y1_pdf_factor;
                     }
                     else
                     {
@@ -43,7 +43,7 @@ namespace
         $if(!le_params.is_delta)
         {
             var pdf_select_env = light_sampler->pdf(r.o, light_sampler->get_envir_light_index());
-            var pdf_env_dir = area->pdf_li(cc, r.o, hit_info.position, hit_info.frame.z);
+            var pdf_env_dir = area->pdf_li(cc, r.o, hit_info);
             le_pdf = pdf_select_env * pdf_env_dir;
         };
         return le_params.beta * le / (le_pdf + le_params.bsdf_pdf);
@@ -188,10 +188,14 @@ TraceResult trace_path(
         {
             auto sample_medium = medium->sample(cc, r.o, medium_end, sampler);
 
+            // throughput of chromatic media applies whether or not the path is scattered
+
+            beta = beta * sample_medium.throughput;
+
             // modify le_params using full transmittance
 
             var unscatter_tr = medium->tr(cc, r.o, medium_end, sampler);
-            le_params.beta = le_params.beta * unscatter_tr;
+            le_params.beta = le_params.beta * unscatter_tr * sample_medium.throughput;
 
             // handle scattering
 
@@ -200,9 +204,21 @@ TraceResult trace_path(
                 scattered = true;
                 scatter_position = sample_medium.position;
 
+                // replace the rest of long scattering chains with the lighting cache
+
+                if(const int cache_depth = medium->get_lighting_cache_depth(); cache_depth >= 0)
+                {
+                    $if(depth >= cache_depth)
+                    {
+                        var cached = medium->eval_lighting_cache(cc, scatter_position);
+                        result.radiance = result.radiance + beta * cached;
+                        scattered_rr_exit = true;
+                    };
+                }
+
                 // rr termination
 
-                $if(depth >= params.min_depth)
+                $if(!scattered_rr_exit & depth >= params.min_depth)
                 {
                     $if(depth > params.max_depth)
                     {
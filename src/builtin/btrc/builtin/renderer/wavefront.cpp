@@ -1,5 +1,7 @@
 #include <btrc/builtin/film_filter/box.h>
+#include <btrc/builtin/renderer/wavefront/progressive.h>
 #include <btrc/builtin/renderer/wavefront/generate.h>
+#include <btrc/builtin/renderer/wavefront/guiding.h>
 #include <btrc/builtin/renderer/wavefront/medium.h>
 #include <btrc/builtin/renderer/wavefront/preview.h>
 #include <btrc/builtin/renderer/wavefront/shade.h>
@@ -46,6 +48,9 @@ struct WavefrontPathTracer::Impl
     wfpt::ShadowPipeline        shadow;
     wfpt::PreviewImageGenerator preview;
 
+    Box<wfpt::ProgressiveScheduler> progressive;
+    Box<wfpt::PathGuider>           guider;
+
     RC<cuda::Buffer<wfpt::StateCounters>> state_counters;
 
     cuda::Buffer<Vec4f> device_preview_image;
@@ -112,6 +117,19 @@ void WavefrontPathTracer::commit()
         impl_->film.add_output(Film::OUTPUT_ALBEDO, Film::Float3);
     if(params.normal)
         impl_->film.add_output(Film::OUTPUT_NORMAL, Film::Float3);
+    impl_->progressive = {};
+    if(params.adaptive || params.time_budget > 0 || params.target_error > 0)
+    {
+        impl_->film.add_half_outputs();
+        impl_->progressive = newBox<wfpt::ProgressiveScheduler>(wfpt::ProgressiveParams{
+            .spp                = params.spp,
+            .round_spp          = params.round_spp,
+            .adaptive           = params.adaptive,
+            .adaptive_threshold = params.adaptive_threshold,
+            .time_budget        = params.time_budget,
+            .target_error       = params.target_error
+        });
+    }
 
     // counters
 
@@ -123,7 +141,11 @@ void WavefrontPathTracer::commit()
         .min_depth = params.min_depth,
         .max_depth = params.max_depth,
         .rr_threshold = params.rr_threshold,
-        .rr_cont_prob = params.rr_cont_prob
+        .rr_cont_prob = params.rr_cont_prob,
+        .sampler = GlobalSampler::Params{
+            .type = params.sampler,
+            .spp  = params.spp
+        }
     };
 
     impl_->generate = {};
@@ -134,18 +156,33 @@ void WavefrontPathTracer::commit()
 
     impl_->generate.set_mode(
         impl_->params.tile ? wfpt::GeneratePipeline::Mode::Tile : wfpt::GeneratePipeline::Mode::Uniform);
+    impl_->generate.set_sampler(shade_params.sampler);
 
     const AABB3f world_bbox = union_aabb(impl_->camera->get_bounding_box(), impl_->scene->get_bbox());
     const float world_diagonal = 1.2f * length(world_bbox.upper - world_bbox.lower);
 
+    impl_->guider = {};
+    if(params.guiding)
+    {
+        impl_->guider = newBox<wfpt::PathGuider>(impl_->scene->get_bbox(), wfpt::PathGuidingParams{
+            .training_spp           = params.guiding_training_spp,
+            .bsdf_sampling_fraction = params.guiding_bsdf_fraction,
+            .record_count           = params.guiding_record_count
+        });
+    }
+
     {
         cuj::ScopedModule cuj_module;
 
         impl_->generate.record_device_code(
-            cc, *impl_->scene, *impl_->camera, impl_->film, *impl_->filter, impl_->params.spp);
+            cc, *impl_->scene, *impl_->camera, impl_->film, *impl_->filter);
         if(impl_->has_medium)
-            impl_->medium.record_device_code(cc, impl_->film, *impl_->scene, shade_params, world_diagonal);
-        impl_->shade.record_device_code(cc, impl_->film, *impl_->scene, shade_params, world_diagonal);
+        {
+            impl_->medium.record_device_code(
+                cc, impl_->film, *impl_->scene, shade_params, world_diagonal, impl_->guider.get());
+        }
+        impl_->shade.record_device_code(
+            cc, impl_->film, *impl_->scene, shade_params, world_diagonal, impl_->guider.get());
 
         cuj::PTXGenerator ptx_gen;
         ptx_gen.set_options(cuj::Options{
@@ -160,7 +197,9 @@ void WavefrontPathTracer::commit()
         cuda_module->load_ptx_from_memory(ptx.data(), ptx.size());
         cuda_module->link();
 
-        impl_->generate.initialize(cuda_module, params.spp, params.state_count, { impl_->width, impl_->height });
+        // progressive rendering always sets pixels and spp explicitly, where spp may be 0 for no cap
+        impl_->generate.initialize(
+            cuda_module, (std::max)(params.spp, 1), params.state_count, { impl_->width, impl_->height });
         if(impl_->has_medium)
             impl_->medium.initialize(cuda_module, impl_->state_counters, *impl_->scene);
         impl_->shade.initialize(cuda_module, impl_->state_counters, *impl_->scene);
@@ -176,17 +215,19 @@ void WavefrontPathTracer::commit()
         *impl_->scene, impl_->film, *impl_->optix_ctx,
         impl_->scene->has_motion_blur(),
         impl_->scene->is_triangle_only(),
-        2, world_diagonal);
+        2, world_diagonal, impl_->guider.get());
 
     // path state
 
+    const int sampler_state_words = GlobalSampler::get_state_words(params.sampler);
+
     impl_->ray_buffer     = newRC<wfpt::RayBuffer>(params.state_count);
-    impl_->path_buffer    = newRC<wfpt::PathBuffer>(params.state_count);
+    impl_->path_buffer    = newRC<wfpt::PathBuffer>(params.state_count, sampler_state_words);
     impl_->bsdf_le_buffer = newRC<wfpt::BSDFLeBuffer>(params.state_count);
     impl_->inct_buffer    = newRC<wfpt::IntersectionBuffer>(params.state_count);
 
     impl_->next_ray_buffer = newRC<wfpt::RayBuffer>(params.state_count);
-    impl_->next_path_buffer = newRC<wfpt::PathBuffer>(params.state_count);
+    impl_->next_path_buffer = newRC<wfpt::PathBuffer>(params.state_count, sampler_state_words);
     impl_->next_bsdf_le_buffer = newRC<wfpt::BSDFLeBuffer>(params.state_count);
     
     impl_->shadow_ray_buffer = newRC<wfpt::ShadowRayBuffer>(params.state_count);
@@ -204,6 +245,17 @@ std::vector<RC<Object>> WavefrontPathTracer::get_dependent_objects()
 
 Renderer::RenderResult WavefrontPathTracer::render()
 {
+    // training counts against the time budget of progressive rendering
+    float training_seconds = 0;
+    if(impl_->guider)
+    {
+        const auto training_start = std::chrono::steady_clock::now();
+        train_path_guiding();
+        if(should_stop())
+            return {};
+        training_seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - training_start).count();
+    }
+
     impl_->generate.clear();
     impl_->shadow_sampler_buffer->clear();
 
@@ -213,14 +265,104 @@ Renderer::RenderResult WavefrontPathTracer::render()
         impl_->film.clear_output(Film::OUTPUT_ALBEDO);
     if(impl_->film.has_output(Film::OUTPUT_NORMAL))
         impl_->film.clear_output(Film::OUTPUT_NORMAL);
+    if(impl_->film.has_output(Film::OUTPUT_RADIANCE_HALF))
+    {
+        impl_->film.clear_output(Film::OUTPUT_RADIANCE_HALF);
+        impl_->film.clear_output(Film::OUTPUT_WEIGHT_HALF);
+    }
 
-    auto &scene = *impl_->scene;
     auto &params = impl_->params;
     auto &reporter = *impl_->reporter;
 
     reporter.new_stage();
 
-    const uint64_t total_path_count = static_cast<uint64_t>(params.spp) * impl_->width * impl_->height;
+    auto &progressive = impl_->progressive;
+    if(progressive)
+    {
+        progressive->start(impl_->film, training_seconds);
+        while(progressive->begin_round(impl_->film))
+        {
+            const int round_spp = progressive->get_round_spp();
+            const int pixel_count = progressive->get_pixel_count();
+            impl_->generate.set_pixels(
+                progressive->get_pixels(), pixel_count, round_spp, progressive->get_round_base_spp());
+
+            trace_paths(static_cast<uint64_t>(round_spp) * pixel_count, [&](float ratio)
+            {
+                reporter.progress(progressive->get_progress(ratio));
+            });
+
+            // stop only between rounds so that every pixel has whole rounds of samples
+            progressive->end_round(impl_->film);
+            if(should_stop())
+                break;
+        }
+    }
+    else
+    {
+        const uint64_t total_path_count = static_cast<uint64_t>(params.spp) * impl_->width * impl_->height;
+        trace_paths(total_path_count, [&](float ratio)
+        {
+            reporter.progress(100.0f * ratio);
+        });
+    }
+
+    throw_on_error(cudaStreamSynchronize(nullptr));
+
+    reporter.complete_stage();
+    if(should_stop())
+        return {};
+
+    new_preview_image();
+    
+    RenderResult result;
+    result.color.swap(impl_->device_preview_image);
+    result.albedo.swap(impl_->device_preview_albedo);
+    result.normal.swap(impl_->device_preview_normal);
+    result.average_spp = progressive ? progressive->get_average_spp() : static_cast<float>(params.spp);
+    if(impl_->guider)
+        result.dropped_guiding_records = impl_->guider->get_dropped_record_count();
+    return result;
+}
+
+void WavefrontPathTracer::train_path_guiding()
+{
+    auto &guider = *impl_->guider;
+    auto &reporter = *impl_->reporter;
+
+    reporter.new_stage("train path guiding");
+
+    guider.clear();
+    guider.set_recording(true);
+    impl_->shadow_sampler_buffer->clear();
+
+    const int training_spp = guider.get_params().training_spp;
+    const int pixel_count = impl_->width * impl_->height;
+    for(int finished_spp = 0, iteration_spp = 1; finished_spp < training_spp; iteration_spp *= 2)
+    {
+        const int spp = (std::min)(iteration_spp, training_spp - finished_spp);
+        impl_->generate.set_pixels(nullptr, pixel_count, spp, finished_spp);
+
+        trace_paths(static_cast<uint64_t>(spp) * pixel_count, [&](float ratio)
+        {
+            reporter.progress(100.0f * (finished_spp + ratio * spp) / training_spp);
+        });
+        finished_spp += spp;
+
+        if(should_stop())
+            break;
+        guider.update();
+    }
+
+    guider.set_recording(false);
+    reporter.complete_stage();
+}
+
+void WavefrontPathTracer::trace_paths(uint64_t path_count, const std::function<void(float)> &report_progress)
+{
+    auto &scene = *impl_->scene;
+    auto &reporter = *impl_->reporter;
+
     uint64_t finished_path_count = 0;
 
     int active_state_count = 0;
@@ -284,7 +426,7 @@ Renderer::RenderResult WavefrontPathTracer::render()
         impl_->state_counters->to_cpu(&state_counters);
 
         finished_path_count += active_state_count - state_counters.active_state_counter;
-        reporter.progress(100.0f * finished_path_count / total_path_count);
+        report_progress(static_cast<float>(finished_path_count) / path_count);
         active_state_count = state_counters.active_state_counter;
 
         if(state_counters.shadow_ray_counter)
@@ -308,20 +450,6 @@ Renderer::RenderResult WavefrontPathTracer::render()
         if(should_stop())
             break;
     }
-
-    throw_on_error(cudaStreamSynchronize(nullptr));
-
-    reporter.complete_stage();
-    if(should_stop())
-        return {};
-
-    new_preview_image();
-    
-    RenderResult result;
-    result.color.swap(impl_->device_preview_image);
-    result.albedo.swap(impl_->device_preview_albedo);
-    result.normal.swap(impl_->device_preview_normal);
-    return result;
 }
 
 void WavefrontPathTracer::update_device_preview_data()
@@ -377,11 +505,27 @@ RC<Renderer> WavefrontPathTracerCreator::create(RC<const factory::Node> node, fa
     WavefrontPathTracer::Params params;
     params.tile         = node->parse_child_or("tile", params.tile);
     params.spp          = node->parse_child_or("spp", params.spp);
+    params.sampler      = string_to_global_sampler_type(node->parse_child_or<std::string>("sampler", "independent"));
     params.min_depth    = node->parse_child_or("min_depth", params.min_depth);
     params.max_depth    = node->parse_child_or("max_depth", params.max_depth);
     params.rr_threshold = node->parse_child_or("rr_threshold", params.rr_threshold);
     params.rr_cont_prob = node->parse_child_or("rr_cont_prob", params.rr_cont_prob);
     params.state_count  = node->parse_child_or("state_count", params.state_count);
+    params.round_spp    = node->parse_child_or("round_spp", params.round_spp);
+    params.time_budget  = node->parse_child_or("time_budget", params.time_budget);
+    params.target_error = node->parse_child_or("target_error", params.target_error);
+    if(auto adaptive_node = node->find_child_node("adaptive"))
+    {
+        params.adaptive           = adaptive_node->parse_child_or("enabled", true);
+        params.adaptive_threshold = adaptive_node->parse_child_or("threshold", params.adaptive_threshold);
+    }
+    if(auto guiding_node = node->find_child_node("guiding"))
+    {
+        params.guiding               = guiding_node->parse_child_or("enabled", true);
+        params.guiding_training_spp  = guiding_node->parse_child_or("training_spp", params.guiding_training_spp);
+        params.guiding_bsdf_fraction = guiding_node->parse_child_or("bsdf_fraction", params.guiding_bsdf_fraction);
+        params.guiding_record_count  = guiding_node->parse_child_or("record_count", params.guiding_record_count);
+    }
     params.albedo       = node->parse_child_or("albedo", params.albedo);
     params.normal       = node->parse_child_or("normal", params.normal);
 
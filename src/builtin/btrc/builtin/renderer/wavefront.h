@@ -1,5 +1,6 @@
 #pragma once
 
+#include <btrc/builtin/sampler/global.h>
 #include <btrc/core/film_filter.h>
 #include <btrc/core/renderer.h>
 #include <btrc/factory/context.h>
@@ -15,6 +16,24 @@ public:
         bool tile = false;
         int spp = 128;
 
+        GlobalSampler::Type sampler = GlobalSampler::Type::Independent;
+
+        // progressive rendering runs in rounds of round_spp samples and stops between rounds.
+        // it is used when adaptive sampling, a time budget or a target error is set,
+        // in which case spp is the per-pixel cap (0 for no cap)
+        int   round_spp = 16;
+        bool  adaptive = false;
+        float adaptive_threshold = 0.01f; // pixels with lower relative error stop being sampled
+        float time_budget = 0;            // in seconds, including path guiding training
+        float target_error = 0;           // relative mse of the whole film
+
+        // path guiding is trained with guiding_training_spp samples per pixel,
+        // which are not part of the rendered image but take time from time_budget
+        bool  guiding = false;
+        int   guiding_training_spp = 15;
+        float guiding_bsdf_fraction = 0.5f;
+        int   guiding_record_count = 1 << 22;
+
         int   min_depth    = 5;
         int   max_depth    = 10;
         float rr_threshold = 0.1f;
@@ -50,6 +69,13 @@ public:
 
 private:
 
+    // run until all paths from the generate pipeline are finished.
+    // progress is reported as the ratio of finished paths
+    void trace_paths(uint64_t path_count, const std::function<void(float)> &report_progress);
+
+    // iterations of 1, 2, 4, ... spp, each training the guiding distribution used in the next one
+    void train_path_guiding();
+
     void update_device_preview_data();
 
     void new_preview_image();
@@ -0,0 +1,213 @@
+#include <btrc/utils/cmath/cmath.h>
+#include <btrc/utils/file.h>
+#include <btrc/utils/ptx_cache.h>
+
+#include "./adaptive.h"
+
+BTRC_WFPT_BEGIN
+
+namespace
+{
+
+    const char *KERNEL = "select_adaptive_pixels";
+    const char *KERNEL_ERROR = "estimate_film_error";
+    const char *CACHE  = "./.btrc_cache/wfpt_adaptive.ptx";
+
+    // errors of dark pixels are measured relative to this
+    constexpr float MIN_ERROR_REFERENCE = 0.01f;
+
+    std::string generate_kernel_ptx()
+    {
+        using namespace cuj;
+
+        const std::string cache_filename = (get_executable_filename().parent_path() / CACHE).string();
+
+        auto cached_ptx = load_kernel_cache(cache_filename);
+        if(!cached_ptx.empty())
+            return cached_ptx;
+
+        ScopedModule cuj_module;
+
+        kernel(KERNEL, [&](
+            i32         pixel_count,
+            ptr<i32>    pixels,
+            ptr<CVec4f> radiance_buffer,
+            ptr<f32>    weight_buffer,
+            ptr<CVec4f> half_radiance_buffer,
+            ptr<f32>    half_weight_buffer,
+            f32         error_threshold,
+            ptr<i32>    output_pixels,
+            ptr<i32>    output_counter)
+        {
+            i32 i = cstd::thread_idx_x() + cstd::block_idx_x() * cstd::block_dim_x();
+            $if(i >= pixel_count)
+            {
+                $return();
+            };
+
+            var pixel = pixels[i];
+            var weight = weight_buffer[pixel];
+            var half_weight = half_weight_buffer[pixel];
+
+            // keep pixels for which two estimates are not available yet
+            boolean active = true;
+            $if(half_weight > 0 & weight - half_weight > 0)
+            {
+                var radiance = load_aligned(radiance_buffer + pixel).xyz();
+                var half_radiance = load_aligned(half_radiance_buffer + pixel).xyz();
+                var estimate_a = half_radiance / half_weight;
+                var estimate_b = (radiance - half_radiance) / (weight - half_weight);
+                var estimate = radiance / weight;
+
+                // the full estimate is the average of the two, so its error is about half of their difference
+                var diff = 0.5f * (cstd::abs(estimate_a.x - estimate_b.x) +
+                                   cstd::abs(estimate_a.y - estimate_b.y) +
+                                   cstd::abs(estimate_a.z - estimate_b.z));
+                var reference = cstd::max(estimate.x + estimate.y + estimate.z, f32(MIN_ERROR_REFERENCE));
+                active = diff > error_threshold * reference;
+            };
+
+            $if(active)
+            {
+                var output_index = cstd::atomic_add(output_counter, 1);
+                output_pixels[output_index] = pixel;
+            };
+        });
+
+        kernel(KERNEL_ERROR, [&](
+            i32         pixel_count,
+            ptr<CVec4f> radiance_buffer,
+            ptr<f32>    weight_buffer,
+            ptr<CVec4f> half_radiance_buffer,
+            ptr<f32>    half_weight_buffer,
+            ptr<f32>    output_error_sum)
+        {
+            i32 pixel = cstd::thread_idx_x() + cstd::block_idx_x() * cstd::block_dim_x();
+            $if(pixel >= pixel_count)
+            {
+                $return();
+            };
+
+            var weight = weight_buffer[pixel];
+            var half_weight = half_weight_buffer[pixel];
+            $if(half_weight > 0 & weight - half_weight > 0)
+            {
+                var radiance = load_aligned(radiance_buffer + pixel).xyz();
+                var half_radiance = load_aligned(half_radiance_buffer + pixel).xyz();
+                var estimate_a = half_radiance / half_weight;
+                var estimate_b = (radiance - half_radiance) / (weight - half_weight);
+                var estimate = radiance / weight;
+
+                // 0.5 * (a - b) has the same variance as the full estimate
+                var diff = 0.5f * (estimate_a - estimate_b);
+                var reference = cstd::max(dot(estimate, estimate), f32(MIN_ERROR_REFERENCE * MIN_ERROR_REFERENCE));
+                cstd::atomic_add(output_error_sum, dot(diff, diff) / reference);
+            };
+        });
+
+        PTXGenerator gen;
+        gen.set_options(Options{
+            .opt_level = OptimizationLevel::O3,
+            .fast_math = true,
+            .approx_math_func = true
+            });
+        gen.generate(cuj_module);
+
+        create_kernel_cache(cache_filename, gen.get_ptx());
+        return gen.get_ptx();
+    }
+
+} // namespace anonymous
+
+AdaptivePixelSelector::AdaptivePixelSelector()
+{
+    const auto ptx = generate_kernel_ptx();
+    cuda_module_.load_ptx_from_memory(ptx.data(), ptx.size());
+    cuda_module_.link();
+}
+
+void AdaptivePixelSelector::initialize(int width, int height, float error_threshold)
+{
+    error_threshold_ = error_threshold;
+    active_pixel_count_ = width * height;
+
+    std::vector<int32_t> pixels(active_pixel_count_);
+    for(int i = 0; i < active_pixel_count_; ++i)
+        pixels[i] = i;
+
+    if(active_pixels_.get_size() != pixels.size())
+    {
+        active_pixels_.initialize(pixels.size());
+        next_active_pixels_.initialize(pixels.size());
+    }
+    active_pixels_.from_cpu(pixels.data());
+
+    if(!counter_)
+        counter_.initialize(1);
+}
+
+int AdaptivePixelSelector::update(const Film &film)
+{
+    if(!active_pixel_count_)
+        return 0;
+
+    counter_.clear_bytes(0);
+
+    constexpr int BLOCK_SIZE = 256;
+    const int block_cnt = up_align(active_pixel_count_, BLOCK_SIZE) / BLOCK_SIZE;
+    cuda_module_.launch(
+        KERNEL,
+        { block_cnt, 1, 1 },
+        { BLOCK_SIZE, 1, 1 },
+        active_pixel_count_,
+        active_pixels_.get(),
+        film.get_float3_output(Film::OUTPUT_RADIANCE).as<Vec4f>(),
+        film.get_float_output(Film::OUTPUT_WEIGHT).get(),
+        film.get_float3_output(Film::OUTPUT_RADIANCE_HALF).as<Vec4f>(),
+        film.get_float_output(Film::OUTPUT_WEIGHT_HALF).get(),
+        error_threshold_,
+        next_active_pixels_.get(),
+        counter_.get());
+
+    counter_.to_cpu(&active_pixel_count_);
+    active_pixels_.swap(next_active_pixels_);
+    return active_pixel_count_;
+}
+
+float AdaptivePixelSelector::estimate_relative_mse(const Film &film)
+{
+    if(!error_sum_)
+        error_sum_.initialize(1);
+    error_sum_.clear_bytes(0);
+
+    const int pixel_count = film.width() * film.height();
+
+    constexpr int BLOCK_SIZE = 256;
+    const int block_cnt = up_align(pixel_count, BLOCK_SIZE) / BLOCK_SIZE;
+    cuda_module_.launch(
+        KERNEL_ERROR,
+        { block_cnt, 1, 1 },
+        { BLOCK_SIZE, 1, 1 },
+        pixel_count,
+        film.get_float3_output(Film::OUTPUT_RADIANCE).as<Vec4f>(),
+        film.get_float_output(Film::OUTPUT_WEIGHT).get(),
+        film.get_float3_output(Film::OUTPUT_RADIANCE_HALF).as<Vec4f>(),
+        film.get_float_output(Film::OUTPUT_WEIGHT_HALF).get(),
+        error_sum_.get());
+
+    float error_sum;
+    error_sum_.to_cpu(&error_sum);
+    return error_sum / static_cast<float>(pixel_count);
+}
+
+int32_t *AdaptivePixelSelector::get_active_pixels()
+{
+    return active_pixels_.get();
+}
+
+int AdaptivePixelSelector::get_active_pixel_count() const
+{
+    return active_pixel_count_;
+}
+
+BTRC_WFPT_END
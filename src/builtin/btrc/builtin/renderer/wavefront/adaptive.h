@@ -0,0 +1,47 @@
+#pragma once
+
+#include <btrc/core/film.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/uncopyable.h>
+
+#include "./common.h"
+
+BTRC_WFPT_BEGIN
+
+// maintains the list of pixels that still need samples in adaptive rendering.
+// the relative error of a pixel is estimated from the difference between the
+// two independent estimates in the film's full and half outputs
+class AdaptivePixelSelector : public Uncopyable
+{
+public:
+
+    AdaptivePixelSelector();
+
+    // all pixels are active after initialization
+    void initialize(int width, int height, float error_threshold);
+
+    // removes active pixels whose estimated error is below the threshold.
+    // returns the number of remaining active pixels
+    int update(const Film &film);
+
+    // mean relative squared error over all pixels of the film
+    float estimate_relative_mse(const Film &film);
+
+    int32_t *get_active_pixels();
+
+    int get_active_pixel_count() const;
+
+private:
+
+    cuda::Module cuda_module_;
+
+    float error_threshold_ = 0;
+    int   active_pixel_count_ = 0;
+
+    cuda::Buffer<int32_t> active_pixels_;
+    cuda::Buffer<int32_t> next_active_pixels_;
+    cuda::Buffer<int32_t> counter_;
+    cuda::Buffer<float>   error_sum_;
+};
+
+BTRC_WFPT_END
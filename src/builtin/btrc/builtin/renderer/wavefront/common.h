@@ -2,7 +2,7 @@
 
 #include <cuj.h>
 
-#include <btrc/builtin/sampler/independent.h>
+#include <btrc/builtin/sampler/global.h>
 
 #define BTRC_WFPT_BEGIN BTRC_BUILTIN_BEGIN namespace wfpt {
 #define BTRC_WFPT_END   } BTRC_BUILTIN_END
@@ -31,9 +31,8 @@ struct ShadeParams
     int   max_depth = 8;
     float rr_threshold = 0.2f;
     float rr_cont_prob = 0.6f;
-};
 
-//using GlobalSampler = IndependentSampler;
-using GlobalSampler = IndependentSampler;
+    GlobalSampler::Params sampler;
+};
 
 BTRC_WFPT_END
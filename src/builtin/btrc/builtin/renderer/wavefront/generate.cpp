@@ -12,7 +12,8 @@ namespace
 } // namespace anonymous
 
 GeneratePipeline::GeneratePipeline()
-    : mode_(Mode::Uniform), pixel_count_(0), spp_(0), state_count_(0),
+    : mode_(Mode::Uniform), initial_spp_(0), state_count_(0),
+      pixel_indices_(nullptr), pixel_count_(0), spp_(0), base_spp_(0),
       finished_spp_(0), finished_pixel_(0)
 {
 
@@ -23,8 +24,13 @@ void GeneratePipeline::set_mode(Mode mode)
     mode_ = mode;
 }
 
+void GeneratePipeline::set_sampler(const GlobalSampler::Params &params)
+{
+    sampler_params_ = params;
+}
+
 void GeneratePipeline::record_device_code(
-    CompileContext &cc, const Scene &scene, const Camera &camera, Film &film, FilmFilter &filter, int spp)
+    CompileContext &cc, const Scene &scene, const Camera &camera, Film &film, FilmFilter &filter)
 {
     using namespace cuj;
 
@@ -32,11 +38,16 @@ void GeneratePipeline::record_device_code(
 
     kernel(
         GENERATE_KERNEL_NAME,
-        [this, spp, &cc, &scene, &camera, &film, &filter, &film_res](
+        [this, &cc, &scene, &camera, &film, &filter, &film_res](
             CSOAParams soa_params,
             i64        initial_pixel_index,
             i32        new_state_count,
-            i32        active_state_count)
+            i32        active_state_count,
+            ptr<i32>   pixel_indices,
+            i32        use_pixel_indices,
+            i64        pixel_count,
+            i64        spp,
+            i32        base_spp)
     {
         i32 thread_idx = cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x();
         $if(thread_idx >= new_state_count)
@@ -50,8 +61,8 @@ void GeneratePipeline::record_device_code(
         i32 pixel_index, sample_index;
         if(mode_ == Mode::Uniform)
         {
-            pixel_index = i32(accu_state_index % (film_res.x * film_res.y));
-            sample_index = i32(accu_state_index / (film_res.x * film_res.y));
+            pixel_index = i32(accu_state_index % pixel_count);
+            sample_index = i32(accu_state_index / pixel_count);
         }
         else
         {
@@ -59,16 +70,22 @@ void GeneratePipeline::record_device_code(
             pixel_index = i32(accu_state_index / spp);
             sample_index = i32(accu_state_index % spp);
         }
+        sample_index = base_spp + sample_index;
+
+        $if(use_pixel_indices != 0)
+        {
+            pixel_index = pixel_indices[pixel_index];
+        };
         
         i32 pixel_x = pixel_index % film_res.x;
         i32 pixel_y = pixel_index / film_res.x;
 
-        GlobalSampler sampler(film_res, CVec2u(u32(pixel_x), u32(pixel_y)), i32(sample_index));
+        GlobalSampler sampler(sampler_params_, film_res, CVec2u(u32(pixel_x), u32(pixel_y)), i32(sample_index));
 
-        var filter_sample = filter.sample(sampler);
+        auto filter_sample = filter.sample(sampler);
 
-        f32 pixel_xf = f32(pixel_x) + 0.5f + filter_sample.x;
-        f32 pixel_yf = f32(pixel_y) + 0.5f + filter_sample.y;
+        f32 pixel_xf = f32(pixel_x) + 0.5f + filter_sample.offset.x;
+        f32 pixel_yf = f32(pixel_y) + 0.5f + filter_sample.offset.y;
 
         f32 film_x = pixel_xf / static_cast<float>(film_res.x);
         f32 film_y = pixel_yf / static_cast<float>(film_res.y);
@@ -81,27 +98,37 @@ void GeneratePipeline::record_device_code(
         var pixel_coord = CVec2u(u32(pixel_x), u32(pixel_y));
         film.splat_atomic(pixel_coord, Film::OUTPUT_WEIGHT, 1.0f);
 
-        soa_params.path.save(state_index, 0, pixel_coord, sample_we_result.throughput, CSpectrum::zero(), sampler);
+        var throughput = sample_we_result.throughput * filter_sample.weight;
+        soa_params.path.save(state_index, 0, pixel_coord, throughput, CSpectrum::zero(), -1, sampler);
         soa_params.ray.save(state_index, CRay(sample_we_result.pos, sample_we_result.dir), scene.get_volume_primitive_medium_id());
-        soa_params.bsdf_le.save(state_index, sample_we_result.throughput, -1);
+        soa_params.bsdf_le.save(state_index, throughput, -1);
     });
 }
 
 void GeneratePipeline::initialize(RC<cuda::Module> cuda_module, int spp, int state_count, const Vec2i &film_res)
 {
-    assert(!spp_ && !state_count_);
+    assert(!initial_spp_ && !state_count_);
     assert(spp > 0 && state_count > 0);
 
     film_res_ = film_res;
-    pixel_count_ = film_res_.x * film_res_.y;
-    spp_ = spp;
+    initial_spp_ = spp;
     state_count_ = state_count;
-    finished_spp_ = 0;
-    finished_pixel_ = 0;
+    clear();
 
     cuda_module_ = std::move(cuda_module);
 }
 
+void GeneratePipeline::set_pixels(const int32_t *device_pixel_indices, int pixel_count, int spp, int base_spp)
+{
+    assert(pixel_count > 0 && spp > 0);
+    pixel_indices_ = device_pixel_indices;
+    pixel_count_ = pixel_count;
+    spp_ = spp;
+    base_spp_ = base_spp;
+    finished_spp_ = 0;
+    finished_pixel_ = 0;
+}
+
 GeneratePipeline::GeneratePipeline(GeneratePipeline &&other) noexcept
     : GeneratePipeline()
 {
@@ -117,10 +144,14 @@ GeneratePipeline &GeneratePipeline::operator=(GeneratePipeline &&other) noexcept
 void GeneratePipeline::swap(GeneratePipeline &other) noexcept
 {
     std::swap(mode_, other.mode_);
+    std::swap(sampler_params_, other.sampler_params_);
     std::swap(film_res_, other.film_res_);
+    std::swap(initial_spp_, other.initial_spp_);
+    std::swap(state_count_, other.state_count_);
+    std::swap(pixel_indices_, other.pixel_indices_);
     std::swap(pixel_count_, other.pixel_count_);
     std::swap(spp_, other.spp_);
-    std::swap(state_count_, other.state_count_);
+    std::swap(base_spp_, other.base_spp_);
     std::swap(finished_spp_, other.finished_spp_);
     std::swap(finished_pixel_, other.finished_pixel_);
     std::swap(cuda_module_, other.cuda_module_);
@@ -133,6 +164,10 @@ bool GeneratePipeline::is_done() const
 
 void GeneratePipeline::clear()
 {
+    pixel_indices_ = nullptr;
+    pixel_count_ = static_cast<int64_t>(film_res_.x) * film_res_.y;
+    spp_ = initial_spp_;
+    base_spp_ = 0;
     finished_spp_ = 0;
     finished_pixel_ = 0;
 }
@@ -168,7 +203,12 @@ int GeneratePipeline::generate(
         launch_params,
         finished_pixel_,
         new_state_count,
-        active_state_count);
+        active_state_count,
+        pixel_indices_,
+        pixel_indices_ ? 1 : 0,
+        pixel_count_,
+        spp_,
+        static_cast<int32_t>(base_spp_));
 
     finished_pixel_ += new_state_count;
     finished_spp_   = finished_pixel_ / pixel_count_;
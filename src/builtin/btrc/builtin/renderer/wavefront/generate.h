@@ -46,11 +46,17 @@ public:
 
     void set_mode(Mode mode);
 
+    void set_sampler(const GlobalSampler::Params &params);
+
     void record_device_code(
-        CompileContext &cc, const Scene &scene, const Camera &camera, Film &film, FilmFilter &filter, int spp);
+        CompileContext &cc, const Scene &scene, const Camera &camera, Film &film, FilmFilter &filter);
 
     void initialize(RC<cuda::Module> cuda_module, int spp, int state_count, const Vec2i &film_res);
 
+    // restrict following generation to given pixels (indices into the film), each with spp samples
+    // whose sample indices start from base_spp. clear() resets to all pixels with the initial spp
+    void set_pixels(const int32_t *device_pixel_indices, int pixel_count, int spp, int base_spp);
+
     GeneratePipeline(GeneratePipeline &&other) noexcept;
 
     GeneratePipeline &operator=(GeneratePipeline &&other) noexcept;
@@ -73,11 +79,17 @@ private:
 
     Mode mode_;
 
+    GlobalSampler::Params sampler_params_;
+
     Vec2i   film_res_;
-    int64_t pixel_count_;
-    int64_t spp_;
+    int64_t initial_spp_;
     int64_t state_count_;
 
+    const int32_t *pixel_indices_; // null for all pixels
+    int64_t        pixel_count_;
+    int64_t        spp_;
+    int64_t        base_spp_;
+
     int64_t finished_spp_;
     int64_t finished_pixel_;
 
@@ -0,0 +1,282 @@
+#include <btrc/builtin/renderer/wavefront/guiding.h>
+#include <btrc/utils/local_angle.h>
+
+BTRC_WFPT_BEGIN
+
+namespace
+{
+
+    f32 get_component(ref<CVec4f> v, i32 i)
+    {
+        return cstd::select(i == 0, f32(v.x), cstd::select(i == 1, f32(v.y), cstd::select(i == 2, f32(v.z), f32(v.w))));
+    }
+
+    u32 get_component(ref<CVec4u> v, i32 i)
+    {
+        return cstd::select(i == 0, u32(v.x), cstd::select(i == 1, u32(v.y), cstd::select(i == 2, u32(v.z), u32(v.w))));
+    }
+
+    // same as direction_to_square
+    CVec2f direction_to_square(ref<CVec3f> dir)
+    {
+        var z = cstd::clamp(dir.z, -1.0f, 1.0f);
+        var phi = local_angle::phi(dir);
+        return CVec2f(
+            cstd::clamp(0.5f * (z + 1.0f), 0.0f, 1.0f),
+            cstd::clamp(phi / (2 * btrc_pi), 0.0f, 1.0f));
+    }
+
+    // same as square_to_direction
+    CVec3f square_to_direction(ref<CVec2f> square)
+    {
+        var z = 2.0f * square.x - 1.0f;
+        var r = local_angle::cos2sin(z);
+        var phi = 2 * btrc_pi * square.y;
+        return CVec3f(r * cstd::cos(phi), r * cstd::sin(phi), z);
+    }
+
+    // same as DTree::sample::choose
+    i32 choose(f32 &u, f32 p)
+    {
+        constexpr float ONE_MINUS_EPS = 0x1.fffffep-1f;
+        i32 result;
+        $if(u < p)
+        {
+            u = cstd::min(u / p, ONE_MINUS_EPS);
+            result = 0;
+        }
+        $else
+        {
+            u = cstd::min((u - p) / (1.0f - p), ONE_MINUS_EPS);
+            result = 1;
+        };
+        return result;
+    }
+
+} // namespace anonymous
+
+PathGuider::PathGuider(const AABB3f &bbox, const PathGuidingParams &params)
+    : params_(params), sd_tree_(bbox, params.sd_tree)
+{
+    if(params_.record_count < 1)
+        throw BtrcException("path guiding record count must be positive");
+    if(params_.sd_tree.max_directional_nodes < params_.sd_tree.max_spatial_nodes)
+        throw BtrcException("path guiding needs at least one directional node for each spatial node");
+
+    snodes_.initialize(params_.sd_tree.max_spatial_nodes);
+    dnodes_.initialize(params_.sd_tree.max_directional_nodes);
+    record_state_.initialize(2);
+    records_.initialize(params_.record_count);
+
+    clear();
+}
+
+const PathGuidingParams &PathGuider::get_params() const
+{
+    return params_;
+}
+
+void PathGuider::clear()
+{
+    sd_tree_.clear();
+    upload_sd_tree();
+    set_recording(false);
+    dropped_record_count_ = 0;
+}
+
+void PathGuider::set_recording(bool recording)
+{
+    const int32_t state[2] = { 0, recording ? params_.record_count : 0 };
+    record_state_.from_cpu(state);
+}
+
+void PathGuider::update()
+{
+    int32_t state[2];
+    record_state_.to_cpu(state);
+    const int record_count = (std::max)((std::min)(state[0], state[1]), 0);
+    dropped_record_count_ += (std::max)(state[0] - state[1], 0);
+
+    std::vector<Record> records(record_count);
+    if(record_count)
+        records_.to_cpu(records.data(), 0, record_count);
+
+    // parents are always recorded before their children
+    for(int i = record_count - 1; i >= 0; --i)
+    {
+        auto &record = records[i];
+        if(record.parent >= 0)
+            records[record.parent].radiance = records[record.parent].radiance + record.radiance;
+    }
+
+    for(auto &record : records)
+    {
+        if(record.pdf <= 0)
+            continue;
+        auto incident = [](float radiance, float beta) { return beta > 0 ? radiance / beta : 0.0f; };
+        const Spectrum li = Spectrum::from_rgb(
+            incident(record.radiance.r, record.beta.r),
+            incident(record.radiance.g, record.beta.g),
+            incident(record.radiance.b, record.beta.b));
+        sd_tree_.record(record.position, record.direction, li.get_lum() / record.pdf);
+    }
+
+    sd_tree_.update();
+    upload_sd_tree();
+
+    state[0] = 0;
+    record_state_.from_cpu(state);
+}
+
+const SDTree &PathGuider::get_sd_tree() const
+{
+    return sd_tree_;
+}
+
+int64_t PathGuider::get_dropped_record_count() const
+{
+    return dropped_record_count_;
+}
+
+u32 PathGuider::find_dtree(ref<CVec3f> position) const
+{
+    // same as SDTree::find_leaf
+
+    const AABB3f &bbox = sd_tree_.get_bbox();
+    const Vec3f extent = bbox.upper - bbox.lower;
+
+    var px = cstd::clamp((position.x - bbox.lower.x) / extent.x, 0.0f, 1.0f);
+    var py = cstd::clamp((position.y - bbox.lower.y) / extent.y, 0.0f, 1.0f);
+    var pz = cstd::clamp((position.z - bbox.lower.z) / extent.z, 0.0f, 1.0f);
+
+    var snodes = cuj::import_pointer(snodes_.get());
+    var node = u32(0);
+    $while(snodes[node].child != 0)
+    {
+        var axis = snodes[node].axis;
+        var p = cstd::select(axis == 0, px, cstd::select(axis == 1, py, pz));
+        var upper = p >= 0.5f;
+        p = cstd::select(upper, 2.0f * p - 1.0f, 2.0f * p);
+        node = snodes[node].child + cstd::select(upper, u32(1), u32(0));
+        px = cstd::select(axis == 0, p, px);
+        py = cstd::select(axis == 1, p, py);
+        pz = cstd::select(axis == 2, p, pz);
+    };
+    return snodes[node].dtree;
+}
+
+f32 PathGuider::pdf(u32 dtree, ref<CVec3f> dir) const
+{
+    // same as DTree::pdf
+
+    var dnodes = cuj::import_pointer(dnodes_.get());
+    var p = direction_to_square(normalize(dir));
+    var result = 1.0f / (4 * btrc_pi);
+    var node = dtree;
+    $loop
+    {
+        ref n = dnodes[node];
+        var total = n.sum.x + n.sum.y + n.sum.z + n.sum.w;
+        $if(total <= 0)
+        {
+            $break;
+        };
+        var qx = cstd::select(p.x >= 0.5f, i32(1), i32(0));
+        var qy = cstd::select(p.y >= 0.5f, i32(1), i32(0));
+        var q = qx + 2 * qy;
+        result = result * 4.0f * get_component(n.sum, q) / total;
+        p.x = cstd::min(2.0f * p.x - f32(qx), 1.0f);
+        p.y = cstd::min(2.0f * p.y - f32(qy), 1.0f);
+        var child = get_component(n.child, q);
+        $if(child == 0)
+        {
+            $break;
+        };
+        node = child;
+    };
+    return result;
+}
+
+CVec3f PathGuider::sample(u32 dtree, ref<CVec2f> sam) const
+{
+    // same as DTree::sample
+
+    var dnodes = cuj::import_pointer(dnodes_.get());
+    f32 ux = sam.x, uy = sam.y;
+    var origin_x = 0.0f, origin_y = 0.0f;
+    var size = 1.0f;
+    var node = dtree;
+    $loop
+    {
+        ref n = dnodes[node];
+        var total = n.sum.x + n.sum.y + n.sum.z + n.sum.w;
+        $if(total <= 0)
+        {
+            $break;
+        };
+
+        var qx = choose(ux, (n.sum.x + n.sum.z) / total);
+        var low = cstd::select(qx == 0, f32(n.sum.x), f32(n.sum.y));
+        var high = cstd::select(qx == 0, f32(n.sum.z), f32(n.sum.w));
+        var qy = choose(uy, low / (low + high));
+
+        size = 0.5f * size;
+        origin_x = origin_x + size * f32(qx);
+        origin_y = origin_y + size * f32(qy);
+
+        var child = get_component(n.child, qx + 2 * qy);
+        $if(child == 0)
+        {
+            $break;
+        };
+        node = child;
+    };
+    return square_to_direction(CVec2f(origin_x + size * ux, origin_y + size * uy));
+}
+
+i32 PathGuider::add_record(
+    ref<CVec3f> position, ref<CVec3f> dir, f32 pdf, ref<CSpectrum> beta, i32 parent) const
+{
+    var state = cuj::import_pointer(record_state_.get());
+    var capacity = state[1];
+    var result = parent;
+    $if(capacity > 0)
+    {
+        var index = cstd::atomic_add(state, 1);
+        $if(index >= 0 & index < capacity)
+        {
+            ref record = cuj::import_pointer(records_.get())[index];
+            record.position = position;
+            record.parent = parent;
+            record.direction = dir;
+            record.pdf = pdf;
+            record.beta = beta;
+            record.radiance = CSpectrum::zero();
+            result = index;
+        };
+    };
+    return result;
+}
+
+void PathGuider::add_radiance(i32 record, ref<CSpectrum> radiance) const
+{
+    $if(record >= 0)
+    {
+        ref r = cuj::import_pointer(records_.get())[record];
+        cstd::atomic_add(r.radiance.r.address(), radiance.r);
+        cstd::atomic_add(r.radiance.g.address(), radiance.g);
+        cstd::atomic_add(r.radiance.b.address(), radiance.b);
+    };
+}
+
+void PathGuider::upload_sd_tree()
+{
+    std::vector<STreeNode> snodes;
+    std::vector<DTreeNode> dnodes;
+    sd_tree_.flatten(snodes, dnodes);
+    assert(snodes.size() <= snodes_.get_size() && dnodes.size() <= dnodes_.get_size());
+    snodes_.from_cpu(snodes.data(), 0, snodes.size());
+    dnodes_.from_cpu(dnodes.data(), 0, dnodes.size());
+}
+
+BTRC_WFPT_END
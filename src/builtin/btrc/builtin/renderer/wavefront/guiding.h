@@ -0,0 +1,101 @@
+#pragma once
+
+#include <btrc/builtin/renderer/wavefront/sd_tree.h>
+#include <btrc/core/spectrum.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/uncopyable.h>
+
+BTRC_WFPT_BEGIN
+
+namespace path_guider_detail
+{
+
+    // a guided scattering direction, and the radiance contributed
+    // by paths along it in units of film radiance
+    struct Record
+    {
+        Vec3f    position;
+        int32_t  parent;
+        Vec3f    direction;
+        float    pdf;
+        Spectrum beta;
+        Spectrum radiance;
+    };
+
+    CUJ_PROXY_CLASS(
+        CRecord, Record,
+        position, parent, direction, pdf, beta, radiance);
+
+} // namespace path_guider_detail
+
+struct PathGuidingParams
+{
+    int   training_spp = 15;
+    float bsdf_sampling_fraction = 0.5f;
+    int   record_count = 1 << 22;
+
+    SDTree::Params sd_tree;
+};
+
+// practical path guiding (Muller et al. 2017) on surfaces.
+// a record is added for each guided scattering. paths pass the index of their last record on,
+// and radiance they receive is added to it. update() sums the radiance up the record chains
+// on the host and trains the sd-tree with it
+class PathGuider : public Uncopyable
+{
+public:
+
+    using Record = path_guider_detail::Record;
+    using CRecord = path_guider_detail::CRecord;
+
+    PathGuider(const AABB3f &bbox, const PathGuidingParams &params);
+
+    const PathGuidingParams &get_params() const;
+
+    // host
+
+    // restart training with an empty sd-tree
+    void clear();
+
+    void set_recording(bool recording);
+
+    // train with records of the finished iteration
+    void update();
+
+    // records that did not fit in the record buffer since the last clear()
+    int64_t get_dropped_record_count() const;
+
+    const SDTree &get_sd_tree() const;
+
+    // device
+
+    u32 find_dtree(ref<CVec3f> position) const;
+
+    // solid angle density
+    f32 pdf(u32 dtree, ref<CVec3f> dir) const;
+
+    CVec3f sample(u32 dtree, ref<CVec2f> sam) const;
+
+    // returns parent when records are full or not being recorded
+    i32 add_record(ref<CVec3f> position, ref<CVec3f> dir, f32 pdf, ref<CSpectrum> beta, i32 parent) const;
+
+    // radiance is in units of film radiance
+    void add_radiance(i32 record, ref<CSpectrum> radiance) const;
+
+private:
+
+    void upload_sd_tree();
+
+    PathGuidingParams params_;
+    SDTree            sd_tree_;
+
+    cuda::Buffer<STreeNode> snodes_;
+    cuda::Buffer<DTreeNode> dnodes_;
+
+    cuda::Buffer<int32_t> record_state_; // record count and capacity
+    cuda::Buffer<Record>  records_;
+
+    int64_t dropped_record_count_ = 0;
+};
+
+BTRC_WFPT_END
@@ -196,7 +196,7 @@ CSpectrum handle_intersected_light(
                 }
                 $else
                 {
-                    var light_dir_pdf = area->pdf_li(scene.cc, o, inct.position, inct.frame.z);
+                    var light_dir_pdf = area->pdf_li(scene.cc, o, inct);
                     var light_pdf = select_light_pdf * light_dir_pdf;
                     result = beta_le * le / (bsdf_pdf + light_pdf);
                 };
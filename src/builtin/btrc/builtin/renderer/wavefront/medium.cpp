@@ -21,11 +21,12 @@ void MediumPipeline::record_device_code(
     Film              &film,
     const Scene       &scene,
     const ShadeParams &shade_params,
-    float              world_diagonal)
+    float              world_diagonal,
+    const PathGuider  *guider)
 {
     using namespace cuj;
 
-    kernel(KERNEL, [&cc, &film, &shade_params, &scene, world_diagonal, this](
+    kernel(KERNEL, [&cc, &film, &shade_params, &scene, world_diagonal, guider, this](
         i32        total_state_count,
         ptr<i32>   active_state_counter,
         ptr<i32>   shadow_ray_counter,
@@ -44,7 +45,7 @@ void MediumPipeline::record_device_code(
         auto inct_flag = soa.inct.load_flag(soa_index);
         auto load_ray = soa.ray.load(soa_index);
         auto path = soa.path.load(soa_index);
-        GlobalSampler sampler({ film.width(), film.height() }, path.sampler_state);
+        GlobalSampler sampler = soa.path.load_sampler(soa_index, shade_params.sampler, { film.width(), film.height() });
 
         // resolve medium
 
@@ -67,11 +68,15 @@ void MediumPipeline::record_device_code(
         {
             auto sample_medium = medium->sample(cc, load_ray.ray.o, medium_end, sampler);
 
+            // throughput of chromatic media applies whether or not the path is scattered
+
+            path.beta = path.beta * sample_medium.throughput;
+
             // update beta_le
 
             var unscatter_tr = medium->tr(cc, load_ray.ray.o, medium_end, sampler);
             auto [beta_le, bsdf_pdf] = soa.bsdf_le.load(soa_index);
-            soa.bsdf_le.save(soa_index, beta_le * unscatter_tr, bsdf_pdf);
+            soa.bsdf_le.save(soa_index, beta_le * unscatter_tr * sample_medium.throughput, bsdf_pdf);
 
             // handle scattering
 
@@ -79,11 +84,25 @@ void MediumPipeline::record_device_code(
             {
                 scattered = true;
                 scatter_position = sample_medium.position;
-                path.beta = path.beta * sample_medium.throughput;
                 soa.inct.save_flag(
                     soa_index, inct_flag.is_intersected,
                     true, inct_flag.instance_id);
 
+                // replace the rest of long scattering chains with the lighting cache
+
+                if(const int cache_depth = medium->get_lighting_cache_depth(); cache_depth >= 0)
+                {
+                    $if(path.depth >= cache_depth)
+                    {
+                        var cached = path.beta * medium->eval_lighting_cache(cc, scatter_position);
+                        path.path_radiance = path.path_radiance + cached;
+                        if(guider)
+                            guider->add_radiance(path.guide_record, cached);
+                        film.splat_atomic(path.pixel_coord, Film::OUTPUT_RADIANCE, path.path_radiance.to_rgb());
+                        $return();
+                    };
+                }
+
                 // terminate
 
                 var rr_exit = simple_russian_roulette(
@@ -120,7 +139,9 @@ void MediumPipeline::record_device_code(
 
         $if(!scattered)
         {
-            soa.path.save_sampler(soa_index, sampler);
+            soa.path.save(
+                soa_index, path.depth, path.pixel_coord, path.beta,
+                path.path_radiance, path.guide_record, sampler);
             $return();
         };
 
@@ -135,6 +156,7 @@ void MediumPipeline::record_device_code(
                 shadow_soa_index,
                 path.pixel_coord,
                 sample_medium_li.li,
+                path.guide_record,
                 CRay(sample_medium_li.o, sample_medium_li.d, sample_medium_li.t1),
                 shadow_medium_id);
         };
@@ -150,8 +172,12 @@ void MediumPipeline::record_device_code(
 
             var output_index = cstd::atomic_add(active_state_counter, 1);
 
+            // medium scattering is not guided. the record of the ray segment keeps
+            // receiving radiance, which is part of the incident radiance along it
+
             soa.output_path.save(
-                output_index, path.depth + 1, path.pixel_coord, path.beta, path.path_radiance, sampler);
+                output_index, path.depth + 1, path.pixel_coord, path.beta,
+                path.path_radiance, path.guide_record, sampler);
             soa.output_bsdf_le.save(
                 output_index, beta_le, phase_sample.pdf);
             soa.output_ray.save(
@@ -0,0 +1,122 @@
+#include "./progressive.h"
+
+BTRC_WFPT_BEGIN
+
+ProgressiveScheduler::ProgressiveScheduler(const ProgressiveParams &params)
+    : params_(params)
+{
+    if(params_.round_spp < 1)
+        throw BtrcException("progressive rendering round spp must be positive");
+    if(params_.spp <= 0 && params_.time_budget <= 0 && params_.target_error <= 0)
+        throw BtrcException("progressive rendering needs an spp cap, a time budget or a target error");
+}
+
+void ProgressiveScheduler::start(Film &film, float spent_seconds)
+{
+    selector_.initialize(film.width(), film.height(), params_.adaptive_threshold);
+    film.set_half_flag(false);
+
+    start_time_ = Clock::now() - std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<float>(spent_seconds));
+    last_round_seconds_ = 0;
+    round_ = 0;
+    round_spp_ = 0;
+    finished_spp_ = 0;
+    finished_sample_count_ = 0;
+    film_pixel_count_ = film.width() * film.height();
+    pixel_count_ = film_pixel_count_;
+    last_error_ = -1;
+    stop_ = false;
+}
+
+bool ProgressiveScheduler::begin_round(Film &film)
+{
+    if(stop_ || (params_.spp > 0 && finished_spp_ >= params_.spp))
+    {
+        film.set_half_flag(false);
+        return false;
+    }
+
+    round_spp_ = params_.round_spp;
+    if(params_.spp > 0)
+        round_spp_ = (std::min)(round_spp_, params_.spp - finished_spp_);
+    pixel_count_ = selector_.get_active_pixel_count();
+
+    film.set_half_flag(round_ % 2 == 1);
+    round_start_time_ = Clock::now();
+    return true;
+}
+
+void ProgressiveScheduler::end_round(const Film &film)
+{
+    finished_spp_ += round_spp_;
+    finished_sample_count_ += static_cast<int64_t>(round_spp_) * pixel_count_;
+    last_round_seconds_ = std::chrono::duration<float>(Clock::now() - round_start_time_).count();
+    ++round_;
+
+    // both halves have samples after two rounds
+    if(round_ >= 2)
+    {
+        if(params_.target_error > 0)
+        {
+            last_error_ = selector_.estimate_relative_mse(film);
+            if(last_error_ < params_.target_error)
+                stop_ = true;
+        }
+        if(params_.adaptive && !selector_.update(film))
+            stop_ = true;
+    }
+
+    // stop when the next round is not expected to fit in the budget
+    if(params_.time_budget > 0 && get_elapsed_seconds() + last_round_seconds_ > params_.time_budget)
+        stop_ = true;
+}
+
+int ProgressiveScheduler::get_round_spp() const
+{
+    return round_spp_;
+}
+
+int ProgressiveScheduler::get_round_base_spp() const
+{
+    return finished_spp_;
+}
+
+int32_t *ProgressiveScheduler::get_pixels()
+{
+    return selector_.get_active_pixels();
+}
+
+int ProgressiveScheduler::get_pixel_count() const
+{
+    return pixel_count_;
+}
+
+float ProgressiveScheduler::get_progress(float round_ratio) const
+{
+    float ratio = 0;
+    if(params_.spp > 0)
+        ratio = (std::max)(ratio, (finished_spp_ + round_ratio * round_spp_) / params_.spp);
+    if(params_.time_budget > 0)
+        ratio = (std::max)(ratio, get_elapsed_seconds() / params_.time_budget);
+    if(params_.target_error > 0 && last_error_ > 0)
+        ratio = (std::max)(ratio, params_.target_error / last_error_);
+    return 100.0f * (std::min)(ratio, 1.0f);
+}
+
+float ProgressiveScheduler::get_average_spp() const
+{
+    return static_cast<float>(finished_sample_count_) / film_pixel_count_;
+}
+
+float ProgressiveScheduler::get_last_error() const
+{
+    return last_error_;
+}
+
+float ProgressiveScheduler::get_elapsed_seconds() const
+{
+    return std::chrono::duration<float>(Clock::now() - start_time_).count();
+}
+
+BTRC_WFPT_END
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+
+#include "./adaptive.h"
+
+BTRC_WFPT_BEGIN
+
+struct ProgressiveParams
+{
+    int   spp = 0; // per-pixel cap. 0 for no cap
+    int   round_spp = 16;
+    bool  adaptive = false;
+    float adaptive_threshold = 0.01f;
+    float time_budget = 0;  // in seconds. 0 for no limit
+    float target_error = 0; // relative mse. 0 for no target
+};
+
+// issues sample rounds and decides when to stop between them.
+// odd rounds are also accumulated into the film's half outputs, from which errors are estimated
+class ProgressiveScheduler : public Uncopyable
+{
+public:
+
+    explicit ProgressiveScheduler(const ProgressiveParams &params);
+
+    // film must have half outputs. spent_seconds were already used by this render before
+    // the first round, e.g. by path guiding training, and count against the time budget
+    void start(Film &film, float spent_seconds = 0);
+
+    // returns false when rendering is finished
+    bool begin_round(Film &film);
+
+    void end_round(const Film &film);
+
+    int get_round_spp() const;
+
+    // sample index of the first sample in this round
+    int get_round_base_spp() const;
+
+    int32_t *get_pixels();
+
+    int get_pixel_count() const;
+
+    // in percentage, given the ratio of finished work in the current round
+    float get_progress(float round_ratio) const;
+
+    // of the whole film
+    float get_average_spp() const;
+
+    // -1 when not estimated
+    float get_last_error() const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    float get_elapsed_seconds() const;
+
+    ProgressiveParams     params_;
+    AdaptivePixelSelector selector_;
+
+    Clock::time_point start_time_;
+    Clock::time_point round_start_time_;
+    float             last_round_seconds_ = 0;
+
+    int     round_ = 0;
+    int     round_spp_ = 0;
+    int     finished_spp_ = 0;
+    int64_t finished_sample_count_ = 0;
+    int     film_pixel_count_ = 0;
+    int     pixel_count_ = 0; // of the current round
+    float   last_error_ = -1;
+    bool    stop_ = false;
+};
+
+BTRC_WFPT_END
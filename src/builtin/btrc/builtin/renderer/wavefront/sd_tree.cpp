@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stack>
+
+#include <btrc/builtin/renderer/wavefront/sd_tree.h>
+
+BTRC_WFPT_BEGIN
+
+namespace
+{
+
+    int get_quadrant(Vec2f &p)
+    {
+        const int qx = p.x >= 0.5f ? 1 : 0;
+        const int qy = p.y >= 0.5f ? 1 : 0;
+        p.x = (std::min)(2 * p.x - static_cast<float>(qx), 1.0f);
+        p.y = (std::min)(2 * p.y - static_cast<float>(qy), 1.0f);
+        return qx + 2 * qy;
+    }
+
+    float get_total(const DTreeNode &node)
+    {
+        return node.sum.x + node.sum.y + node.sum.z + node.sum.w;
+    }
+
+    // remap u in [0, 1) after choosing between [0, p) and [p, 1)
+    int choose(float &u, float p)
+    {
+        constexpr float ONE_MINUS_EPS = 0x1.fffffep-1f;
+        if(u < p)
+        {
+            u = (std::min)(u / p, ONE_MINUS_EPS);
+            return 0;
+        }
+        u = (std::min)((u - p) / (1 - p), ONE_MINUS_EPS);
+        return 1;
+    }
+
+} // namespace anonymous
+
+Vec2f direction_to_square(const Vec3f &dir)
+{
+    const float z = (std::clamp)(dir.z, -1.0f, 1.0f);
+    float phi = std::atan2(dir.y, dir.x);
+    if(phi < 0)
+        phi += 2 * btrc_pi;
+    return Vec2f(
+        (std::clamp)(0.5f * (z + 1), 0.0f, 1.0f),
+        (std::clamp)(phi / (2 * btrc_pi), 0.0f, 1.0f));
+}
+
+Vec3f square_to_direction(const Vec2f &square)
+{
+    const float z = 2 * square.x - 1;
+    const float r = std::sqrt((std::max)(0.0f, 1 - z * z));
+    const float phi = 2 * btrc_pi * square.y;
+    return Vec3f(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+DTree::DTree()
+    : sample_count_(0)
+{
+    nodes_.push_back({});
+}
+
+void DTree::record(const Vec2f &p, float value)
+{
+    ++sample_count_;
+    if(!(value > 0) || !std::isfinite(value))
+        return;
+
+    Vec2f lp = p;
+    uint32_t node = 0;
+    for(;;)
+    {
+        const int q = get_quadrant(lp);
+        nodes_[node].sum[q] += value;
+        if(!nodes_[node].child[q])
+            break;
+        node = nodes_[node].child[q];
+    }
+}
+
+float DTree::get_energy() const
+{
+    return get_total(nodes_[0]);
+}
+
+int64_t DTree::get_sample_count() const
+{
+    return sample_count_;
+}
+
+void DTree::set_sample_count(int64_t count)
+{
+    sample_count_ = count;
+}
+
+int DTree::get_node_count() const
+{
+    return static_cast<int>(nodes_.size());
+}
+
+float DTree::pdf(const Vec2f &p) const
+{
+    Vec2f lp = p;
+    float result = 1;
+    uint32_t node = 0;
+    for(;;)
+    {
+        const float total = get_total(nodes_[node]);
+        if(total <= 0)
+            break;
+        const int q = get_quadrant(lp);
+        result *= 4 * nodes_[node].sum[q] / total;
+        if(!nodes_[node].child[q])
+            break;
+        node = nodes_[node].child[q];
+    }
+    return result;
+}
+
+Vec2f DTree::sample(const Vec2f &u) const
+{
+    Vec2f lu = u, origin;
+    float size = 1;
+    uint32_t node = 0;
+    for(;;)
+    {
+        auto &sum = nodes_[node].sum;
+        const float total = get_total(nodes_[node]);
+        if(total <= 0)
+            break;
+
+        const int qx = choose(lu.x, (sum.x + sum.z) / total);
+        const float low = qx ? sum.y : sum.x;
+        const float high = qx ? sum.w : sum.z;
+        const int qy = choose(lu.y, low / (low + high));
+
+        size *= 0.5f;
+        origin.x += size * static_cast<float>(qx);
+        origin.y += size * static_cast<float>(qy);
+
+        const uint32_t child = nodes_[node].child[qx + 2 * qy];
+        if(!child)
+            break;
+        node = child;
+    }
+    return Vec2f(origin.x + size * lu.x, origin.y + size * lu.y);
+}
+
+DTree DTree::refine(float threshold, int max_depth) const
+{
+    DTree result;
+    const float total = get_energy();
+    if(total <= 0)
+        return result;
+
+    constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+    struct Item
+    {
+        uint32_t new_node;
+        uint32_t old_node; // NO_NODE when below a leaf of the old tree
+        float    fraction;
+        int      depth;
+    };
+
+    std::stack<Item> items;
+    items.push({ 0, 0, 1.0f, 1 });
+    while(!items.empty())
+    {
+        const Item item = items.top();
+        items.pop();
+
+        for(int q = 0; q < 4; ++q)
+        {
+            // energy below a leaf of the old tree is assumed to be uniform
+            float fraction = 0.25f * item.fraction;
+            uint32_t old_child = NO_NODE;
+            if(item.old_node != NO_NODE)
+            {
+                fraction = nodes_[item.old_node].sum[q] / total;
+                if(nodes_[item.old_node].child[q])
+                    old_child = nodes_[item.old_node].child[q];
+            }
+
+            if(item.depth >= max_depth || fraction <= threshold)
+                continue;
+
+            const uint32_t child = static_cast<uint32_t>(result.nodes_.size());
+            result.nodes_.push_back({});
+            result.nodes_[item.new_node].child[q] = child;
+            items.push({ child, old_child, fraction, item.depth + 1 });
+        }
+    }
+    return result;
+}
+
+const std::vector<DTreeNode> &DTree::get_nodes() const
+{
+    return nodes_;
+}
+
+SDTree::SDTree(const AABB3f &bbox, const Params &params)
+    : bbox_(bbox), params_(params), iteration_(0)
+{
+    // avoid degenerated axes
+    const Vec3f extent = bbox_.upper - bbox_.lower;
+    const float min_extent = 1e-3f * (std::max)({ extent.x, extent.y, extent.z, 1e-3f });
+    for(int i = 0; i < 3; ++i)
+    {
+        if(extent[i] < min_extent)
+        {
+            bbox_.lower[i] -= 0.5f * min_extent;
+            bbox_.upper[i] += 0.5f * min_extent;
+        }
+    }
+    clear();
+}
+
+void SDTree::clear()
+{
+    nodes_.clear();
+    nodes_.push_back({});
+    iteration_ = 0;
+}
+
+void SDTree::record(const Vec3f &position, const Vec3f &direction, float value)
+{
+    nodes_[find_leaf(position)].building.record(direction_to_square(direction), value);
+}
+
+void SDTree::update()
+{
+    for(auto &node : nodes_)
+    {
+        if(!node.child)
+            node.sampling = std::move(node.building);
+    }
+    refine_spatial();
+    refine_directional();
+    ++iteration_;
+}
+
+const AABB3f &SDTree::get_bbox() const
+{
+    return bbox_;
+}
+
+int SDTree::get_iteration_count() const
+{
+    return iteration_;
+}
+
+int SDTree::get_leaf_count() const
+{
+    int result = 0;
+    for(auto &node : nodes_)
+    {
+        if(!node.child)
+            ++result;
+    }
+    return result;
+}
+
+int SDTree::get_directional_node_count() const
+{
+    int result = 0;
+    for(auto &node : nodes_)
+    {
+        if(!node.child)
+            result += node.sampling.get_node_count();
+    }
+    return result;
+}
+
+float SDTree::pdf(const Vec3f &position, const Vec3f &direction) const
+{
+    const float square_pdf = nodes_[find_leaf(position)].sampling.pdf(direction_to_square(direction));
+    return square_pdf / (4 * btrc_pi);
+}
+
+Vec3f SDTree::sample(const Vec3f &position, const Vec2f &u) const
+{
+    return square_to_direction(nodes_[find_leaf(position)].sampling.sample(u));
+}
+
+void SDTree::flatten(std::vector<STreeNode> &snodes, std::vector<DTreeNode> &dnodes) const
+{
+    snodes.clear();
+    dnodes.clear();
+    snodes.reserve(nodes_.size());
+    for(auto &node : nodes_)
+    {
+        STreeNode snode = {};
+        snode.axis = node.axis;
+        snode.child = node.child;
+        if(!node.child)
+        {
+            const uint32_t offset = static_cast<uint32_t>(dnodes.size());
+            snode.dtree = offset;
+            for(auto dnode : node.sampling.get_nodes())
+            {
+                for(int q = 0; q < 4; ++q)
+                {
+                    if(dnode.child[q])
+                        dnode.child[q] += offset;
+                }
+                dnodes.push_back(dnode);
+            }
+        }
+        snodes.push_back(snode);
+    }
+}
+
+uint32_t SDTree::find_leaf(const Vec3f &position) const
+{
+    const Vec3f extent = bbox_.upper - bbox_.lower;
+    Vec3f p = (position - bbox_.lower) / extent;
+    for(int i = 0; i < 3; ++i)
+        p[i] = (std::clamp)(p[i], 0.0f, 1.0f);
+
+    uint32_t node = 0;
+    while(nodes_[node].child)
+    {
+        const uint32_t axis = nodes_[node].axis;
+        if(p[axis] < 0.5f)
+        {
+            p[axis] = 2 * p[axis];
+            node = nodes_[node].child;
+        }
+        else
+        {
+            p[axis] = 2 * p[axis] - 1;
+            node = nodes_[node].child + 1;
+        }
+    }
+    return node;
+}
+
+void SDTree::refine_spatial()
+{
+    const float threshold = params_.spatial_threshold * std::sqrt(std::pow(2.0f, static_cast<float>(iteration_)));
+    int dnode_count = get_directional_node_count();
+
+    std::stack<uint32_t> leaves;
+    for(uint32_t i = 0; i < nodes_.size(); ++i)
+    {
+        if(!nodes_[i].child)
+            leaves.push(i);
+    }
+
+    while(!leaves.empty())
+    {
+        const uint32_t leaf = leaves.top();
+        leaves.pop();
+
+        const int leaf_dnode_count = nodes_[leaf].sampling.get_node_count();
+        if(static_cast<float>(nodes_[leaf].sampling.get_sample_count()) <= threshold ||
+           static_cast<int>(nodes_.size()) + 2 > params_.max_spatial_nodes ||
+           dnode_count + leaf_dnode_count > params_.max_directional_nodes)
+            continue;
+
+        // children inherit the directional distribution with half of the samples
+        DTree dtree = std::move(nodes_[leaf].sampling);
+        dtree.set_sample_count(dtree.get_sample_count() / 2);
+
+        const uint32_t child = static_cast<uint32_t>(nodes_.size());
+        const uint32_t child_axis = (nodes_[leaf].axis + 1) % 3;
+        nodes_[leaf].child = child;
+        nodes_[leaf].sampling = DTree();
+        nodes_[leaf].building = DTree();
+        for(uint32_t i = 0; i < 2; ++i)
+        {
+            Node child_node;
+            child_node.axis = child_axis;
+            child_node.sampling = dtree;
+            nodes_.push_back(std::move(child_node));
+            leaves.push(child + i);
+        }
+        dnode_count += leaf_dnode_count;
+    }
+}
+
+void SDTree::refine_directional()
+{
+    // coarsen all directional trees until they fit in the node budget
+    float threshold = params_.directional_threshold;
+    for(;;)
+    {
+        int dnode_count = 0;
+        for(auto &node : nodes_)
+        {
+            if(!node.child)
+            {
+                node.building = node.sampling.refine(threshold, params_.directional_max_depth);
+                dnode_count += node.building.get_node_count();
+            }
+        }
+        if(dnode_count <= params_.max_directional_nodes || threshold >= 1)
+            break;
+        threshold *= 2;
+    }
+}
+
+BTRC_WFPT_END
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+
+#include <btrc/builtin/renderer/wavefront/common.h>
+#include <btrc/utils/math/aabb.h>
+
+BTRC_WFPT_BEGIN
+
+// flattened sd-tree nodes shared by the host and the device.
+// child index 0 marks a leaf, as roots are never children
+
+struct STreeNode
+{
+    uint32_t axis;
+    uint32_t child; // index of the first child. the second one follows it
+    uint32_t dtree; // root index of the directional tree of a leaf
+    uint32_t pad;
+};
+
+struct DTreeNode
+{
+    Vec4f sum;   // of the four quadrants. quadrant index is x + 2 * y
+    Vec4u child;
+};
+
+CUJ_PROXY_CLASS(CSTreeNode, STreeNode, axis, child, dtree, pad);
+CUJ_PROXY_CLASS(CDTreeNode, DTreeNode, sum, child);
+
+// equal-area mapping between the unit sphere and [0, 1]^2
+Vec2f direction_to_square(const Vec3f &dir);
+Vec3f square_to_direction(const Vec2f &square);
+
+// quadtree over [0, 1]^2 storing how incident radiance is distributed over directions
+class DTree
+{
+public:
+
+    DTree();
+
+    // value is added to the quadrants containing p at every level
+    void record(const Vec2f &p, float value);
+
+    float get_energy() const;
+
+    int64_t get_sample_count() const;
+
+    void set_sample_count(int64_t count);
+
+    int get_node_count() const;
+
+    // density over [0, 1]^2. uniform when nothing is recorded
+    float pdf(const Vec2f &p) const;
+
+    Vec2f sample(const Vec2f &u) const;
+
+    // empty tree whose quadrants holding more than threshold of the energy are subdivided
+    DTree refine(float threshold, int max_depth) const;
+
+    // child indices are local to this tree
+    const std::vector<DTreeNode> &get_nodes() const;
+
+private:
+
+    std::vector<DTreeNode> nodes_;
+    int64_t                sample_count_;
+};
+
+// binary tree over scene space with a pair of directional trees in each leaf.
+// samples are recorded into the building trees, which become the sampling ones in update()
+class SDTree
+{
+public:
+
+    struct Params
+    {
+        float spatial_threshold     = 12000; // c in c * sqrt(2^k)
+        float directional_threshold = 0.01f; // energy ratio
+        int   directional_max_depth = 20;
+        int   max_spatial_nodes     = 1 << 16;
+        int   max_directional_nodes = 1 << 20;
+    };
+
+    SDTree(const AABB3f &bbox, const Params &params);
+
+    // a single leaf with empty directional trees
+    void clear();
+
+    void record(const Vec3f &position, const Vec3f &direction, float value);
+
+    // use the recorded distribution for sampling and refine both trees for the next iteration
+    void update();
+
+    // enlarged on degenerated axes
+    const AABB3f &get_bbox() const;
+
+    int get_iteration_count() const;
+
+    int get_leaf_count() const;
+
+    // of the sampling trees
+    int get_directional_node_count() const;
+
+    float pdf(const Vec3f &position, const Vec3f &direction) const;
+
+    Vec3f sample(const Vec3f &position, const Vec2f &u) const;
+
+    // sampling trees with global child indices
+    void flatten(std::vector<STreeNode> &snodes, std::vector<DTreeNode> &dnodes) const;
+
+private:
+
+    struct Node
+    {
+        uint32_t axis  = 0;
+        uint32_t child = 0;
+        DTree    sampling;
+        DTree    building;
+    };
+
+    uint32_t find_leaf(const Vec3f &position) const;
+
+    void refine_spatial();
+
+    void refine_directional();
+
+    AABB3f bbox_;
+    Params params_;
+
+    std::vector<Node> nodes_;
+    int               iteration_;
+};
+
+BTRC_WFPT_END
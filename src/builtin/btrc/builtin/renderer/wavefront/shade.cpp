@@ -22,7 +22,8 @@ void ShadePipeline::record_device_code(
     Film              &film,
     const Scene       &scene,
     const ShadeParams &shade_params,
-    float              world_diagonal)
+    float              world_diagonal,
+    const PathGuider  *guider)
 {
     using namespace cuj;
 
@@ -48,7 +49,7 @@ void ShadePipeline::record_device_code(
         auto load_ray = soa.ray.load(soa_index);
         auto bsdf_le = soa.bsdf_le.load(soa_index);
 
-        GlobalSampler sampler({ film.width(), film.height() }, path.sampler_state);
+        GlobalSampler sampler = soa.path.load_sampler(soa_index, shade_params.sampler, { film.width(), film.height() });
 
         // handle miss le
 
@@ -60,6 +61,8 @@ void ShadePipeline::record_device_code(
                 splat_path_rad = eval_miss_le(
                     wfpt_scene, load_ray.ray.o, load_ray.ray.d,
                     bsdf_le.beta_le, bsdf_le.bsdf_pdf);
+                if(guider)
+                    guider->add_radiance(path.guide_record, splat_path_rad);
             }
             $if(!inct_flag.is_scattered)
             {
@@ -89,6 +92,8 @@ void ShadePipeline::record_device_code(
         var le_rad = handle_intersected_light(
             wfpt_scene, load_ray.ray.o, load_ray.ray.d, inct,
             bsdf_le.beta_le, bsdf_le.bsdf_pdf, instance.light_id);
+        if(guider)
+            guider->add_radiance(path.guide_record, le_rad);
         $if(inct_flag.is_scattered)
         {
             film.splat_atomic(path.pixel_coord, Film::OUTPUT_RADIANCE, le_rad.to_rgb());
@@ -123,6 +128,14 @@ void ShadePipeline::record_device_code(
 
         Shader::SampleResult bsdf_sample;
 
+        u32 guide_dtree;
+        float bsdf_fraction = 1;
+        if(guider)
+        {
+            guide_dtree = guider->find_dtree(inct.position);
+            bsdf_fraction = guider->get_params().bsdf_sampling_fraction;
+        }
+
         CVec3f gbuffer_albedo;
         CVec3f gbuffer_normal;
 
@@ -143,6 +156,27 @@ void ShadePipeline::record_device_code(
             bsdf_sample = shader->sample(
                 cc, -load_ray.ray.d, sampler.get3d(), TransportMode::Radiance);
 
+            // one-sample mis between the bsdf and the guiding distribution.
+            // delta scattering is never guided
+
+            if(guider)
+            {
+                var guide_sam = sampler.get3d();
+                $if(!bsdf_sample.is_delta)
+                {
+                    $if(guide_sam[0] >= bsdf_fraction)
+                    {
+                        bsdf_sample.dir = guider->sample(guide_dtree, CVec2f(guide_sam[1], guide_sam[2]));
+                        bsdf_sample.bsdf = shader->eval(
+                            cc, bsdf_sample.dir, -load_ray.ray.d, TransportMode::Radiance);
+                        bsdf_sample.pdf = shader->pdf(
+                            cc, bsdf_sample.dir, -load_ray.ray.d, TransportMode::Radiance);
+                    };
+                    bsdf_sample.pdf = bsdf_fraction * bsdf_sample.pdf
+                                    + (1 - bsdf_fraction) * guider->pdf(guide_dtree, bsdf_sample.dir);
+                };
+            }
+
             // shadow ray
 
             $if(sample_shadow.success)
@@ -154,6 +188,11 @@ void ShadePipeline::record_device_code(
                 {
                     shadow_bsdf_pdf = shader->pdf(
                         cc, sample_shadow.d, -load_ray.ray.d, TransportMode::Radiance);
+                    if(guider)
+                    {
+                        shadow_bsdf_pdf = bsdf_fraction * shadow_bsdf_pdf
+                                        + (1 - bsdf_fraction) * guider->pdf(guide_dtree, sample_shadow.d);
+                    }
                 };
             };
         });
@@ -188,6 +227,7 @@ void ShadePipeline::record_device_code(
                 shadow_soa_index,
                 path.pixel_coord,
                 beta_li,
+                path.guide_record,
                 CRay(sample_shadow.o, sample_shadow.d, sample_shadow.t1),
                 shadow_medium_id);
         };
@@ -222,9 +262,20 @@ void ShadePipeline::record_device_code(
 
             var stored_bsdf_pdf = cstd::select(bsdf_sample.is_delta, -bsdf_sample.pdf, f32(bsdf_sample.pdf));
 
+            var guide_record = path.guide_record;
+            if(guider)
+            {
+                $if(!bsdf_sample.is_delta)
+                {
+                    guide_record = guider->add_record(
+                        inct.position, next_ray_d, bsdf_sample.pdf, path.beta, path.guide_record);
+                };
+            }
+
             var output_index = cstd::atomic_add(active_state_counter, 1);
             soa.output_path.save(
-                output_index, path.depth + 1, path.pixel_coord, path.beta, path.path_radiance, sampler);
+                output_index, path.depth + 1, path.pixel_coord, path.beta,
+                path.path_radiance, guide_record, sampler);
             soa.output_bsdf_le.save(output_index, new_beta_le, stored_bsdf_pdf);
             soa.output_ray.save(output_index, CRay(next_ray_o, next_ray_d), next_ray_medium_id);
         }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <btrc/builtin/renderer/wavefront/guiding.h>
 #include <btrc/builtin/renderer/wavefront/soa.h>
 #include <btrc/core/film.h>
 #include <btrc/core/scene.h>
@@ -47,7 +48,8 @@ public:
         Film              &film,
         const Scene       &scene,
         const ShadeParams &shade_params,
-        float              world_diagonal);
+        float              world_diagonal,
+        const PathGuider  *guider);
 
     void initialize(
         RC<cuda::Module>                cuda_module,
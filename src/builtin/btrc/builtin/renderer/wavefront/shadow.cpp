@@ -12,7 +12,12 @@ namespace
     const char *MISS_SHADOW_NAME       = "__miss__shadow";
     const char *CLOSESTHIT_SHADOW_NAME = "__closesthit__shadow";
 
-    std::string generate_shadow_kernel(CompileContext &cc, const Scene &scene, Film &film, float world_diagonal)
+    std::string generate_shadow_kernel(
+        CompileContext   &cc,
+        const Scene      &scene,
+        Film             &film,
+        float             world_diagonal,
+        const PathGuider *guider)
     {
         using namespace cuj;
 
@@ -38,12 +43,12 @@ namespace
 
         kernel(
             MISS_SHADOW_NAME,
-            [&cc, &scene, &film, world_diagonal, global_launch_params]
+            [&cc, &scene, &film, world_diagonal, guider, global_launch_params]
         {
             ref launch_params = global_launch_params.get_reference();
             var launch_idx = optix::get_payload(0);
 
-            auto [pixel_coord, beta] = launch_params.shadow_ray.load_beta(i32(launch_idx));
+            auto [pixel_coord, beta, guide_record] = launch_params.shadow_ray.load_beta(i32(launch_idx));
 
             IndependentSampler sampler({ film.width(), film.height() }, launch_params.sampler_state[launch_idx]);
 
@@ -71,6 +76,8 @@ namespace
 
             sampler.save(launch_params.sampler_state + launch_idx);
             film.splat_atomic(pixel_coord, Film::OUTPUT_RADIANCE, beta.to_rgb());
+            if(guider)
+                guider->add_radiance(guide_record, beta);
         });
 
         kernel(CLOSESTHIT_SHADOW_NAME, [] { });
@@ -95,14 +102,15 @@ ShadowPipeline::ShadowPipeline(
     bool                 motion_blur,
     bool                 triangle_only,
     int                  traversable_depth,
-    float                world_diagonal)
+    float                world_diagonal,
+    const PathGuider    *guider)
 {
     CompileContext cc;
 
     pipeline_ = optix::SimpleOptixPipeline(
         context,
         optix::SimpleOptixPipeline::Program{
-            .ptx                = generate_shadow_kernel(cc, scene, film, world_diagonal),
+            .ptx                = generate_shadow_kernel(cc, scene, film, world_diagonal, guider),
             .launch_params_name = LAUNCH_PARAMS_NAME,
             .raygen_name        = RAYGEN_SHADOW_NAME,
             .miss_name          = MISS_SHADOW_NAME,
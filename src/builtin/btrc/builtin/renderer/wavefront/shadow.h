@@ -1,5 +1,6 @@
 #pragma once
 
+#include <btrc/builtin/renderer/wavefront/guiding.h>
 #include <btrc/builtin/renderer/wavefront/soa.h>
 #include <btrc/builtin/sampler/independent.h>
 #include <btrc/core/film.h>
@@ -51,7 +52,8 @@ public:
         bool                 motion_blur,
         bool                 triangle_only,
         int                  traversable_depth,
-        float                world_diagonal);
+        float                world_diagonal,
+        const PathGuider    *guider);
 
     ShadowPipeline(ShadowPipeline &&other) noexcept;
 
@@ -38,17 +38,20 @@ void CPathSOA::save(
     const CVec2u        &pixel_coord,
     const CSpectrum     &beta,
     const CSpectrum     &path_radiance,
+    i32                  guide_record,
     const GlobalSampler &sampler)
 {
     save_aligned(pixel_coord, pixel_coord_buffer + index);
     save_aligned(CVec4f(beta.r, beta.g, beta.b, cuj::bitcast<f32>(depth)), beta_depth_buffer + index);
-    save_aligned(CVec4f(path_radiance.r, path_radiance.g, path_radiance.b, 1), path_radiance_buffer + index);
+    save_aligned(
+        CVec4f(path_radiance.r, path_radiance.g, path_radiance.b, cuj::bitcast<f32>(guide_record)),
+        path_radiance_buffer + index);
     save_sampler(index, sampler);
 }
 
 void CPathSOA::save_sampler(i32 index, const GlobalSampler &sampler)
 {
-    sampler.save(sampler_state_buffer + index);
+    sampler.save(sampler_state_buffer, index);
 }
 
 CPathSOA::LoadResult CPathSOA::load(i32 index) const
@@ -61,10 +64,15 @@ CPathSOA::LoadResult CPathSOA::load(i32 index) const
     result.pixel_coord = load_aligned(pixel_coord_buffer + index);
     result.beta = CSpectrum::from_rgb(beta_depth.x, beta_depth.y, beta_depth.z);
     result.path_radiance = CSpectrum::from_rgb(path_rad.x, path_rad.y, path_rad.z);
-    result.sampler_state = sampler_state_buffer[index];
+    result.guide_record = cuj::bitcast<i32>(path_rad.w);
     return result;
 }
 
+GlobalSampler CPathSOA::load_sampler(i32 index, const GlobalSampler::Params &params, const Vec2i &res) const
+{
+    return GlobalSampler(params, res, sampler_state_buffer, index);
+}
+
 void CIntersectionSOA::save_flag(i32 index, boolean is_intersected, boolean is_scattered, u32 instance_id)
 {
     u32 flag = instance_id;
@@ -111,10 +119,16 @@ CIntersectionSOA::LoadDetailResult CIntersectionSOA::load_detail(i32 index) cons
     return result;
 }
 
-void CShadowRaySOA::save(i32 index, const CVec2u &pixel_coord, const CSpectrum &beta_li, const CRay &r, CMediumID medium_id)
+void CShadowRaySOA::save(
+    i32              index,
+    const CVec2u    &pixel_coord,
+    const CSpectrum &beta_li,
+    i32              guide_record,
+    const CRay      &r,
+    CMediumID        medium_id)
 {
     save_aligned(pixel_coord, pixel_coord_buffer + index);
-    save_aligned(CVec4f(beta_li.r, beta_li.g, beta_li.b, 1), beta_li_buffer + index);
+    save_aligned(CVec4f(beta_li.r, beta_li.g, beta_li.b, cuj::bitcast<f32>(guide_record)), beta_li_buffer + index);
     ray.save(index, r, medium_id);
 }
 
@@ -129,6 +143,7 @@ CShadowRaySOA::LoadBetaResult CShadowRaySOA::load_beta(i32 index) const
     LoadBetaResult result;
     result.pixel_coord = load_aligned(pixel_coord_buffer + index);
     result.beta_li = CSpectrum::from_rgb(v.x, v.y, v.z);
+    result.guide_record = cuj::bitcast<i32>(v.w);
     return result;
 }
 
@@ -18,10 +18,10 @@ struct BSDFLeSOA
 
 struct PathSOA
 {
-    Vec2u                *pixel_coord_buffer;
-    Vec4f                *beta_depth_buffer;
-    Vec4f                *path_radiance_buffer;
-    GlobalSampler::State *sampler_state_buffer;
+    Vec2u    *pixel_coord_buffer;
+    Vec4f    *beta_depth_buffer;
+    Vec4f    *path_radiance_buffer; // w is the last path guiding record
+    uint32_t *sampler_state_buffer; // see GlobalSampler::get_state_words
 };
 
 struct IntersectionSOA
@@ -33,7 +33,7 @@ struct IntersectionSOA
 struct ShadowRaySOA
 {
     Vec2u *pixel_coord_buffer;
-    Vec4f *beta_li_buffer;
+    Vec4f *beta_li_buffer; // w is the path guiding record receiving li
     RaySOA ray;
 };
 
@@ -78,11 +78,11 @@ CUJ_PROXY_CLASS_EX(
 
     struct LoadResult
     {
-        i32                   depth;
-        CVec2u                pixel_coord;
-        CSpectrum             beta;
-        CSpectrum             path_radiance;
-        GlobalSampler::CState sampler_state;
+        i32       depth;
+        CVec2u    pixel_coord;
+        CSpectrum beta;
+        CSpectrum path_radiance;
+        i32       guide_record; // -1 for none
     };
 
     void save(
@@ -91,11 +91,14 @@ CUJ_PROXY_CLASS_EX(
         const CVec2u        &pixel_coord,
         const CSpectrum     &beta,
         const CSpectrum     &path_radiance,
+        i32                  guide_record,
         const GlobalSampler &sampler);
 
     void save_sampler(i32 index, const GlobalSampler &sampler);
 
     LoadResult load(i32 index) const;
+
+    GlobalSampler load_sampler(i32 index, const GlobalSampler::Params &params, const Vec2i &res) const;
 };
 
 CUJ_PROXY_CLASS_EX(
@@ -135,9 +138,16 @@ CUJ_PROXY_CLASS_EX(CShadowRaySOA, ShadowRaySOA, pixel_coord_buffer, beta_li_buff
     {
         CVec2u    pixel_coord;
         CSpectrum beta_li;
+        i32       guide_record;
     };
 
-    void save(i32 index, const CVec2u &pixel_coord, const CSpectrum &beta_li, const CRay &r, CMediumID medium_id);
+    void save(
+        i32              index,
+        const CVec2u    &pixel_coord,
+        const CSpectrum &beta_li,
+        i32              guide_record,
+        const CRay      &r,
+        CMediumID        medium_id);
 
     CRaySOA::LoadResult load_ray(i32 index) const;
 
@@ -30,12 +30,12 @@ BSDFLeBuffer::operator BSDFLeSOA()
     };
 }
 
-PathBuffer::PathBuffer(int state_count)
+PathBuffer::PathBuffer(int state_count, int sampler_state_words)
 {
     pixel_coord_.initialize(state_count);
     beta_depth_.initialize(state_count);
     path_radiance_.initialize(state_count);
-    sampler_state_.initialize(state_count);
+    sampler_state_.initialize(static_cast<size_t>(state_count) * sampler_state_words);
 }
 
 PathBuffer::operator PathSOA()
@@ -35,16 +35,16 @@ class PathBuffer : public Uncopyable
 {
 public:
 
-    explicit PathBuffer(int state_count);
+    PathBuffer(int state_count, int sampler_state_words);
 
     operator PathSOA();
 
 private:
 
-    cuda::Buffer<Vec2u>                pixel_coord_;
-    cuda::Buffer<Vec4f>                beta_depth_;
-    cuda::Buffer<Vec4f>                path_radiance_;
-    cuda::Buffer<GlobalSampler::State> sampler_state_;
+    cuda::Buffer<Vec2u>    pixel_coord_;
+    cuda::Buffer<Vec4f>    beta_depth_;
+    cuda::Buffer<Vec4f>    path_radiance_;
+    cuda::Buffer<uint32_t> sampler_state_;
 };
 
 class IntersectionBuffer : public Uncopyable
@@ -0,0 +1,169 @@
+#include <btrc/builtin/sampler/global.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/unreachable.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    template<typename T>
+    constexpr int STATE_WORDS = static_cast<int>(sizeof(typename T::State) / sizeof(uint32_t));
+
+    static_assert(sizeof(IndependentSampler::State) % sizeof(uint32_t) == 0);
+    static_assert(sizeof(HaltonSampler::State) % sizeof(uint32_t) == 0);
+    static_assert(sizeof(ZSobolSampler::State) % sizeof(uint32_t) == 0);
+    static_assert(sizeof(StatelessSampler::State) % sizeof(uint32_t) == 0);
+
+    template<typename T>
+    typename T::CState load_state(ptr<u32> state_buffer, i32 index)
+    {
+        constexpr int words = STATE_WORDS<T>;
+        typename T::CState result;
+        var dst = cuj::bitcast<ptr<u32>>(result.address());
+        var src = state_buffer + index * words;
+        if constexpr(words == 4)
+        {
+            var v = load_aligned(cuj::bitcast<ptr<CVec4u>>(src));
+            dst[0] = v.x;
+            dst[1] = v.y;
+            dst[2] = v.z;
+            dst[3] = v.w;
+        }
+        else
+        {
+            for(int i = 0; i < words; ++i)
+                dst[i] = src[i];
+        }
+        return result;
+    }
+
+    template<typename T>
+    void save_state(const T &sampler, ptr<u32> state_buffer, i32 index)
+    {
+        constexpr int words = STATE_WORDS<T>;
+        typename T::CState state;
+        sampler.save(state.address());
+        var src = cuj::bitcast<ptr<u32>>(state.address());
+        var dst = state_buffer + index * words;
+        if constexpr(words == 4)
+        {
+            save_aligned(CVec4u(src[0], src[1], src[2], src[3]), cuj::bitcast<ptr<CVec4u>>(dst));
+        }
+        else
+        {
+            for(int i = 0; i < words; ++i)
+                dst[i] = src[i];
+        }
+    }
+
+} // namespace anonymous
+
+int GlobalSampler::get_state_words(Type type)
+{
+    switch(type)
+    {
+    case Type::Independent:    return STATE_WORDS<IndependentSampler>;
+    case Type::Halton:
+    case Type::PermutedHalton: return STATE_WORDS<HaltonSampler>;
+    case Type::ZSobol:         return STATE_WORDS<ZSobolSampler>;
+    case Type::Stateless:      return STATE_WORDS<StatelessSampler>;
+    }
+    unreachable();
+}
+
+GlobalSampler::GlobalSampler(const Params &params, const Vec2i &res, const CVec2u &pixel, i32 sample_index)
+{
+    switch(params.type)
+    {
+    case Type::Independent:
+        sampler_.emplace<IndependentSampler>(res, pixel, sample_index);
+        return;
+    case Type::Halton:
+        sampler_.emplace<HaltonSampler>(res, HaltonSampler::Randomization::Owen, pixel, sample_index);
+        return;
+    case Type::PermutedHalton:
+        sampler_.emplace<HaltonSampler>(res, HaltonSampler::Randomization::PermuteDigits, pixel, sample_index);
+        return;
+    case Type::ZSobol:
+        sampler_.emplace<ZSobolSampler>(res, params.spp, pixel, sample_index);
+        return;
+    case Type::Stateless:
+        sampler_.emplace<StatelessSampler>(res, pixel, sample_index);
+        return;
+    }
+    unreachable();
+}
+
+GlobalSampler::GlobalSampler(const Params &params, const Vec2i &res, ptr<u32> state_buffer, i32 index)
+{
+    switch(params.type)
+    {
+    case Type::Independent:
+    {
+        var state = load_state<IndependentSampler>(state_buffer, index);
+        sampler_.emplace<IndependentSampler>(res, state);
+        return;
+    }
+    case Type::Halton:
+        sampler_.emplace<HaltonSampler>(
+            res, HaltonSampler::Randomization::Owen, load_state<HaltonSampler>(state_buffer, index));
+        return;
+    case Type::PermutedHalton:
+        sampler_.emplace<HaltonSampler>(
+            res, HaltonSampler::Randomization::PermuteDigits, load_state<HaltonSampler>(state_buffer, index));
+        return;
+    case Type::ZSobol:
+        sampler_.emplace<ZSobolSampler>(res, params.spp, load_state<ZSobolSampler>(state_buffer, index));
+        return;
+    case Type::Stateless:
+        sampler_.emplace<StatelessSampler>(res, load_state<StatelessSampler>(state_buffer, index));
+        return;
+    }
+    unreachable();
+}
+
+void GlobalSampler::save(ptr<u32> state_buffer, i32 index) const
+{
+    sampler_.match(
+        [](std::monostate) { unreachable(); },
+        [&](const auto &sampler) { save_state(sampler, state_buffer, index); });
+}
+
+f32 GlobalSampler::get1d()
+{
+    return sampler_.match(
+        [](std::monostate) -> f32 { unreachable(); },
+        [](auto &sampler) -> f32 { return sampler.get1d(); });
+}
+
+Sam2 GlobalSampler::get2d()
+{
+    return sampler_.match(
+        [](std::monostate) -> Sam2 { unreachable(); },
+        [](auto &sampler) -> Sam2 { return sampler.get2d(); });
+}
+
+Sam3 GlobalSampler::get3d()
+{
+    return sampler_.match(
+        [](std::monostate) -> Sam3 { unreachable(); },
+        [](auto &sampler) -> Sam3 { return sampler.get3d(); });
+}
+
+GlobalSampler::Type string_to_global_sampler_type(std::string_view str)
+{
+    if(str == "independent")
+        return GlobalSampler::Type::Independent;
+    if(str == "halton")
+        return GlobalSampler::Type::Halton;
+    if(str == "halton_permuted")
+        return GlobalSampler::Type::PermutedHalton;
+    if(str == "zsobol")
+        return GlobalSampler::Type::ZSobol;
+    if(str == "stateless")
+        return GlobalSampler::Type::Stateless;
+    throw BtrcException("unknown sampler type: " + std::string(str));
+}
+
+BTRC_BUILTIN_END
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <btrc/builtin/sampler/halton.h>
+#include <btrc/builtin/sampler/independent.h>
+#include <btrc/builtin/sampler/stateless.h>
+#include <btrc/builtin/sampler/zsobol.h>
+#include <btrc/utils/variant.h>
+
+BTRC_BUILTIN_BEGIN
+
+// per-pixel sampler of renderers, whose type is chosen when generating code.
+// states are saved as get_state_words(type) 32-bit words per path
+class GlobalSampler : public Sampler
+{
+public:
+
+    enum class Type
+    {
+        Independent,
+        Halton,
+        PermutedHalton,
+        ZSobol,
+        Stateless
+    };
+
+    struct Params
+    {
+        Type type = Type::Independent;
+        int  spp  = 0; // 0 for no known sample count
+    };
+
+    static int get_state_words(Type type);
+
+    GlobalSampler(const Params &params, const Vec2i &res, const CVec2u &pixel, i32 sample_index);
+
+    // load the index-th state from buffer
+    GlobalSampler(const Params &params, const Vec2i &res, ptr<u32> state_buffer, i32 index);
+
+    void save(ptr<u32> state_buffer, i32 index) const;
+
+    f32 get1d() override;
+
+    Sam2 get2d() override;
+
+    Sam3 get3d() override;
+
+private:
+
+    Variant<std::monostate, IndependentSampler, HaltonSampler, ZSobolSampler, StatelessSampler> sampler_;
+};
+
+GlobalSampler::Type string_to_global_sampler_type(std::string_view str);
+
+BTRC_BUILTIN_END
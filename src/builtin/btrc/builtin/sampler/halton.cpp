@@ -36,14 +36,15 @@ namespace
         return mod(x, n);
     }
 
-    f32 sample_halton(u32 dim, u64 halton_index)
+    f32 owen_scrambled_halton(u32 dim, u64 halton_index)
     {
         return owen_scrambled_radical_inverse(i32(dim), halton_index, mix_bits(u64(1u + (dim << 4))));
     }
 
 } // namespace anonymous
 
-HaltonSampler::HaltonSampler(const Vec2i &res, const CVec2u &pixel, i32 sample_index)
+HaltonSampler::HaltonSampler(const Vec2i &res, Randomization randomization, const CVec2u &pixel, i32 sample_index)
+    : randomization_(randomization)
 {
     initialize_consts(res);
 
@@ -66,7 +67,8 @@ HaltonSampler::HaltonSampler(const Vec2i &res, const CVec2u &pixel, i32 sample_i
     state_.dimension = 2;
 }
 
-HaltonSampler::HaltonSampler(const Vec2i &res, const CState &state)
+HaltonSampler::HaltonSampler(const Vec2i &res, Randomization randomization, const CState &state)
+    : randomization_(randomization)
 {
     initialize_consts(res);
     state_ = state;
@@ -83,7 +85,7 @@ f32 HaltonSampler::get1d()
     {
         state_.dimension = 2;
     };
-    var result = sample_halton(state_.dimension, state_.halton_index);
+    var result = sample_dimension(state_.dimension);
     state_.dimension = state_.dimension + 1;
     return result;
 }
@@ -94,8 +96,8 @@ Sam2 HaltonSampler::get2d()
     {
         state_.dimension = 2;
     };
-    var x = sample_halton(state_.dimension, state_.halton_index);
-    var y = sample_halton(state_.dimension + 1, state_.halton_index);
+    var x = sample_dimension(state_.dimension);
+    var y = sample_dimension(state_.dimension + 1);
     state_.dimension = state_.dimension + 2;
     return make_sample(x, y);
 }
@@ -106,9 +108,9 @@ Sam3 HaltonSampler::get3d()
     {
         state_.dimension = 2;
     };
-    var x = sample_halton(state_.dimension, state_.halton_index);
-    var y = sample_halton(state_.dimension + 1, state_.halton_index);
-    var z = sample_halton(state_.dimension + 2, state_.halton_index);
+    var x = sample_dimension(state_.dimension);
+    var y = sample_dimension(state_.dimension + 1);
+    var z = sample_dimension(state_.dimension + 2);
     state_.dimension = state_.dimension + 3;
     return make_sample(x, y, z);
 }
@@ -132,4 +134,21 @@ void HaltonSampler::initialize_consts(const Vec2i &res)
     mult_inverse_[1] = static_cast<int>(multiplicative_inverse(base_scales_[0], base_scales_[1]));
 }
 
+f32 HaltonSampler::sample_dimension(u32 dim) const
+{
+    if(randomization_ == Randomization::Owen)
+        return owen_scrambled_halton(dim, state_.halton_index);
+
+    f32 result;
+    $if(dim < DIGIT_PERMUTATION_DIMENSIONS)
+    {
+        result = digit_permuted_radical_inverse(i32(dim), state_.halton_index);
+    }
+    $else
+    {
+        result = owen_scrambled_halton(dim, state_.halton_index);
+    };
+    return result;
+}
+
 BTRC_BUILTIN_END
@@ -24,9 +24,15 @@ public:
     using State = halton_sampler_detail::State;
     using CState = halton_sampler_detail::CState;
 
-    HaltonSampler(const Vec2i &res, const CVec2u &pixel, i32 sample_index);
+    enum class Randomization
+    {
+        Owen,         // hashed owen scrambling
+        PermuteDigits // precomputed digit permutations for the first DIGIT_PERMUTATION_DIMENSIONS dimensions
+    };
 
-    HaltonSampler(const Vec2i &res, const CState &state);
+    HaltonSampler(const Vec2i &res, Randomization randomization, const CVec2u &pixel, i32 sample_index);
+
+    HaltonSampler(const Vec2i &res, Randomization randomization, const CState &state);
 
     void save(ptr<CState> output) const;
 
@@ -40,6 +46,9 @@ private:
 
     void initialize_consts(const Vec2i &res);
 
+    f32 sample_dimension(u32 dim) const;
+
+    Randomization randomization_;
     Vec2i base_scales_;
     Vec2i base_exponents_;
     int mult_inverse_[2];
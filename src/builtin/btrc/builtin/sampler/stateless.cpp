@@ -0,0 +1,68 @@
+#include <btrc/builtin/sampler/stateless.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    // philox-2x32-10 (Salmon et al. 2011)
+    CVec2u philox2x32(u32 c0, u32 c1, u32 key)
+    {
+        constexpr uint32_t MULTIPLIER = 0xd256d347u;
+        constexpr uint32_t KEY_INCREMENT = 0x9e3779b9u;
+        for(int i = 0; i < 10; ++i)
+        {
+            var prod = u64(c0) * MULTIPLIER;
+            c0 = u32(prod >> 32) ^ key ^ c1;
+            c1 = u32(prod);
+            key = key + KEY_INCREMENT;
+        }
+        return CVec2u(c0, c1);
+    }
+
+    f32 bits_to_float(u32 bits)
+    {
+        return f32(bits >> 8) * 0x1p-24f;
+    }
+
+} // namespace anonymous
+
+StatelessSampler::StatelessSampler(const Vec2i &res, const CVec2u &pixel, i32 sample_index)
+{
+    state_.pixel_index = pixel.y * static_cast<uint32_t>(res.x) + pixel.x;
+    state_.sample_index = u32(sample_index);
+    state_.dimension = 0;
+}
+
+StatelessSampler::StatelessSampler(const Vec2i &res, const CState &state)
+{
+    state_ = state;
+}
+
+void StatelessSampler::save(ptr<CState> output) const
+{
+    *output = state_;
+}
+
+f32 StatelessSampler::get1d()
+{
+    var bits = philox2x32(state_.dimension, state_.sample_index, state_.pixel_index);
+    state_.dimension = state_.dimension + 1;
+    return bits_to_float(bits.x);
+}
+
+Sam2 StatelessSampler::get2d()
+{
+    var bits = philox2x32(state_.dimension, state_.sample_index, state_.pixel_index);
+    state_.dimension = state_.dimension + 1;
+    return make_sample(bits_to_float(bits.x), bits_to_float(bits.y));
+}
+
+Sam3 StatelessSampler::get3d()
+{
+    var xy = get2d();
+    var z = get1d();
+    return make_sample(xy[0], xy[1], z);
+}
+
+BTRC_BUILTIN_END
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <btrc/core/sampler.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace stateless_sampler_detail
+{
+
+    struct State
+    {
+        uint32_t pixel_index;
+        uint32_t sample_index;
+        uint32_t dimension;
+    };
+
+    CUJ_PROXY_CLASS(CState, State, pixel_index, sample_index, dimension);
+
+} // namespace stateless_sampler_detail
+
+// independent samples derived from (pixel, sample, dimension) with a counter-based generator,
+// so that the state is only the counter
+class StatelessSampler : public Sampler
+{
+public:
+
+    using State = stateless_sampler_detail::State;
+    using CState = stateless_sampler_detail::CState;
+
+    StatelessSampler(const Vec2i &res, const CVec2u &pixel, i32 sample_index);
+
+    StatelessSampler(const Vec2i &res, const CState &state);
+
+    void save(ptr<CState> output) const;
+
+    f32 get1d() override;
+
+    Sam2 get2d() override;
+
+    Sam3 get3d() override;
+
+private:
+
+    CState state_;
+};
+
+BTRC_BUILTIN_END
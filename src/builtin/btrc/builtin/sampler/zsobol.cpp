@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <bit>
+
+#include <btrc/builtin/sampler/zsobol.h>
+#include <btrc/utils/low_discrepancy.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    // sample indices beyond the known spp overlap with sequences of other pixels
+    constexpr int UNKNOWN_SPP_LOG2 = 16;
+
+    // all permutations of 4 digits. digit d is mapped to (p >> (2 * d)) & 3
+    constexpr uint32_t PERMUTATIONS[24] = {
+        0xe4, 0xb4, 0xd8, 0x78, 0x6c, 0x9c,
+        0xe1, 0xb1, 0xc9, 0x39, 0x2d, 0x8d,
+        0xc6, 0x36, 0xd2, 0x72, 0x4e, 0x1e,
+        0x27, 0x87, 0x1b, 0x4b, 0x63, 0x93
+    };
+
+    // owen scrambling seeds of a dimension
+    u64 hash_dimension(u32 dimension)
+    {
+        return mix_bits(u64(dimension) ^ 0x9e3779b97f4a7c15ull);
+    }
+
+} // namespace anonymous
+
+ZSobolSampler::ZSobolSampler(const Vec2i &res, int spp, const CVec2u &pixel, i32 sample_index)
+{
+    initialize_consts(res, spp);
+    state_.dimension = 0;
+    state_.morton_index = (encode_morton2(pixel.x, pixel.y) << log2_spp_) | u64(sample_index);
+}
+
+ZSobolSampler::ZSobolSampler(const Vec2i &res, int spp, const CState &state)
+{
+    initialize_consts(res, spp);
+    state_ = state;
+}
+
+void ZSobolSampler::save(ptr<CState> output) const
+{
+    *output = state_;
+}
+
+f32 ZSobolSampler::get1d()
+{
+    var sample_index = get_sample_index();
+    state_.dimension = state_.dimension + 1;
+    return sobol_sample(sample_index, 0, u32(hash_dimension(state_.dimension)));
+}
+
+Sam2 ZSobolSampler::get2d()
+{
+    var sample_index = get_sample_index();
+    state_.dimension = state_.dimension + 2;
+    var bits = hash_dimension(state_.dimension);
+    var x = sobol_sample(sample_index, 0, u32(bits));
+    var y = sobol_sample(sample_index, 1, u32(bits >> 32));
+    return make_sample(x, y);
+}
+
+Sam3 ZSobolSampler::get3d()
+{
+    var xy = get2d();
+    var z = get1d();
+    return make_sample(xy[0], xy[1], z);
+}
+
+void ZSobolSampler::initialize_consts(const Vec2i &res, int spp)
+{
+    log2_spp_ = spp > 0 ? std::bit_width(std::bit_ceil(static_cast<uint32_t>(spp))) - 1 : UNKNOWN_SPP_LOG2;
+    const uint32_t res_pow2 = std::bit_ceil(static_cast<uint32_t>((std::max)({ res.x, res.y, 1 })));
+    base4_digits_ = std::bit_width(res_pow2) - 1 + (log2_spp_ + 1) / 2;
+}
+
+u64 ZSobolSampler::get_sample_index() const
+{
+    var permutations = cuj::const_data(std::span<const uint32_t>(PERMUTATIONS));
+    const bool pow2_samples = (log2_spp_ & 1) != 0;
+    const int last_digit = pow2_samples ? 1 : 0;
+    var dimension_hash = u64(state_.dimension * 0x55555555u);
+
+    // permute base-4 digits from the highest one, depending on all higher digits
+    u64 sample_index = 0;
+    var i = i32(base4_digits_ - 1);
+    $while(i >= last_digit)
+    {
+        var digit_shift = u64(2 * i - (pow2_samples ? 1 : 0));
+        var digit = u32(state_.morton_index >> digit_shift) & 3;
+        var higher_digits = state_.morton_index >> (digit_shift + 2);
+        var p = (mix_bits(higher_digits ^ dimension_hash) >> 24) % 24;
+        digit = (permutations[p] >> (2 * digit)) & 3;
+        sample_index = sample_index | (u64(digit) << digit_shift);
+        i = i - 1;
+    };
+
+    // the remaining base-2 digit is flipped
+    if(pow2_samples)
+    {
+        var digit = state_.morton_index & 1;
+        sample_index = sample_index | (digit ^ (mix_bits((state_.morton_index >> 1) ^ dimension_hash) & 1));
+    }
+
+    return sample_index;
+}
+
+BTRC_BUILTIN_END
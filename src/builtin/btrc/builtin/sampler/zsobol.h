@@ -0,0 +1,54 @@
+#pragma once
+
+#include <btrc/core/sampler.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace zsobol_sampler_detail
+{
+
+    struct State
+    {
+        uint32_t dimension;
+        uint64_t morton_index;
+    };
+
+    CUJ_PROXY_CLASS(CState, State, dimension, morton_index);
+
+} // namespace zsobol_sampler_detail
+
+// sobol sampler with morton-ordered pixel samples (Ahmed and Wonka 2020, as in pbrt-v4).
+// base-4 digits of the morton index are permuted per dimension, which distributes
+// the error as blue noise over pixels. samples are scrambled with hashed owen scrambling
+class ZSobolSampler : public Sampler
+{
+public:
+
+    using State = zsobol_sampler_detail::State;
+    using CState = zsobol_sampler_detail::CState;
+
+    // spp <= 0 for no known sample count
+    ZSobolSampler(const Vec2i &res, int spp, const CVec2u &pixel, i32 sample_index);
+
+    ZSobolSampler(const Vec2i &res, int spp, const CState &state);
+
+    void save(ptr<CState> output) const;
+
+    f32 get1d() override;
+
+    Sam2 get2d() override;
+
+    Sam3 get3d() override;
+
+private:
+
+    void initialize_consts(const Vec2i &res, int spp);
+
+    u64 get_sample_index() const;
+
+    int log2_spp_;
+    int base4_digits_;
+    CState state_;
+};
+
+BTRC_BUILTIN_END
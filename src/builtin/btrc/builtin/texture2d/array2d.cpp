@@ -1,18 +1,93 @@
+#include <cmath>
+
 #include <btrc/builtin/texture2d/array2d.h>
 #include <btrc/builtin/texture2d/description.h>
+#include <btrc/utils/hash.h>
 
 BTRC_BUILTIN_BEGIN
 
+namespace
+{
+
+    float srgb_to_linear(float v)
+    {
+        return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+
+    // single-channel textures are fetched as (r, 0, 0), so only rgb(a) ones have host images
+    template<typename Texel>
+    constexpr bool has_host_image_v =
+        std::is_same_v<Texel, Vec3b> || std::is_same_v<Texel, Vec4b> ||
+        std::is_same_v<Texel, Vec3f> || std::is_same_v<Texel, Vec4f>;
+
+    Image<Vec3f> to_linear_rgb(const ImageDynamic &image, bool srgb)
+    {
+        Image<Vec3f> result;
+        image.match(
+            [](std::monostate) { unreachable(); },
+            [&](auto &typed_image)
+        {
+            using Texel = typename std::remove_cvref_t<decltype(typed_image)>::Texel;
+            if constexpr(std::is_same_v<Texel, Vec3b> || std::is_same_v<Texel, Vec4b>)
+            {
+                result = typed_image.template to<Vec3f>();
+                if(srgb)
+                {
+                    for(auto &texel : result)
+                        texel = Vec3f(srgb_to_linear(texel.x), srgb_to_linear(texel.y), srgb_to_linear(texel.z));
+                }
+            }
+            else if constexpr(std::is_same_v<Texel, Vec3f> || std::is_same_v<Texel, Vec4f>)
+                result = typed_image.template to<Vec3f>();
+        });
+        return result;
+    }
+
+    // texel sizes tell the rgb(a) texel types apart
+    template<typename Texel>
+    uint64_t compute_content_hash(const Image<Texel> &image, const cuda::Texture::Description &desc)
+    {
+        const int header[7] = {
+            image.width(), image.height(),
+            static_cast<int>(desc.address_modes[0]), static_cast<int>(desc.address_modes[1]),
+            static_cast<int>(desc.filter_mode), desc.srgb_to_linear ? 1 : 0, static_cast<int>(sizeof(Texel))
+        };
+        uint64_t h = hash::murmur_hash64A(header, sizeof(header), 0);
+        h = hash::murmur_hash64A(desc.border_value, sizeof(desc.border_value), h);
+        return hash::murmur_hash64A(image.data(), sizeof(Texel) * image.width() * image.height(), h);
+    }
+
+} // namespace anonymous
+
 void Array2D::initialize(RC<const cuda::Texture> cuda_texture)
 {
     tex_ = std::move(cuda_texture);
+    filename_ = {};
+    content_hash_ = 0;
 }
 
 void Array2D::initialize(const std::string &filename, const cuda::Texture::Description &desc)
 {
+    auto image = ImageDynamic::load(filename);
+
+    auto arr = newRC<cuda::Array>();
+    uint64_t content_hash = 0;
+    image.match(
+        [](std::monostate) { unreachable(); },
+        [&](auto &typed_image)
+    {
+        arr->load_from_memory(typed_image);
+        using Texel = typename std::remove_cvref_t<decltype(typed_image)>::Texel;
+        if constexpr(has_host_image_v<Texel>)
+            content_hash = compute_content_hash(typed_image, desc);
+    });
+
     auto tex = newRC<cuda::Texture>();
-    tex->initialize(filename, desc);
+    tex->initialize(std::move(arr), desc);
     tex_ = std::move(tex);
+    desc_ = desc;
+    filename_ = filename;
+    content_hash_ = content_hash;
 }
 
 CSpectrum Array2D::sample_spectrum_inline(CompileContext &cc, ref<CVec2f> uv) const
@@ -29,6 +104,29 @@ f32 Array2D::sample_float_inline(CompileContext &cc, ref<CVec2f> uv) const
     return r;
 }
 
+Image<Vec3f> Array2D::load_host_image() const
+{
+    if(filename_.empty())
+        return {};
+    return to_linear_rgb(ImageDynamic::load(filename_), desc_.srgb_to_linear);
+}
+
+const cuda::Texture::Description &Array2D::get_description() const
+{
+    return desc_;
+}
+
+Vec2i Array2D::get_resolution() const
+{
+    auto &arr = tex_->get_array();
+    return Vec2i(arr.get_width(), arr.get_height());
+}
+
+uint64_t Array2D::get_content_hash() const
+{
+    return content_hash_;
+}
+
 RC<Texture2D> Array2DCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
     const auto filename = context.resolve_path(node->parse_child<std::string>("filename")).string();
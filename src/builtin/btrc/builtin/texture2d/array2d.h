@@ -3,6 +3,7 @@
 #include <btrc/core/texture2d.h>
 #include <btrc/factory/context.h>
 #include <btrc/utils/cuda/texture.h>
+#include <btrc/utils/image.h>
 
 BTRC_BUILTIN_BEGIN
 
@@ -18,9 +19,26 @@ public:
 
     f32 sample_float_inline(CompileContext &cc, ref<CVec2f> uv) const override;
 
+    // rgb texels in linear space, re-read from the file for preprocessing on the host
+    // so that no host copy is kept. empty for single-channel textures and ones not loaded from files
+    Image<Vec3f> load_host_image() const;
+
+    const cuda::Texture::Description &get_description() const;
+
+    // in texels
+    Vec2i get_resolution() const;
+
+    // hash of the file texels and sampling description, computed when loading the file,
+    // so that tables derived from load_host_image can be cached without reading it. 0 when it is empty
+    uint64_t get_content_hash() const;
+
 private:
 
     RC<const cuda::Texture> tex_;
+
+    std::string                filename_;
+    cuda::Texture::Description desc_;
+    uint64_t                   content_hash_ = 0;
 };
 
 class Array2DCreator : public factory::Creator<Texture2D>
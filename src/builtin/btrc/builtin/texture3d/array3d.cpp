@@ -17,6 +17,15 @@ void Array3D::initialize_from_text(const std::string &text_filename, const cuda:
     initialize(std::move(tex));
 }
 
+void Array3D::initialize_from_binary(const std::string &binary_filename, const cuda::Texture::Description &desc)
+{
+    auto arr = newRC<cuda::Array>();
+    arr->load_from_binary(binary_filename);
+    auto tex = newRC<cuda::Texture>();
+    tex->initialize(std::move(arr), desc);
+    initialize(std::move(tex));
+}
+
 void Array3D::initialize_from_images(const std::vector<std::string> &image_filenames, const cuda::Texture::Description &desc)
 {
     auto arr = newRC<cuda::Array>();
@@ -52,12 +61,42 @@ Spectrum Array3D::get_min_spectrum() const
     return Spectrum::from_rgb(v.x, v.y, v.z);
 }
 
+float Array3D::get_max_float_in(const AABB3f &uvw_range) const
+{
+    return tex_->get_value_range(uvw_range.lower, uvw_range.upper).second.x;
+}
+
+float Array3D::get_min_float_in(const AABB3f &uvw_range) const
+{
+    return tex_->get_value_range(uvw_range.lower, uvw_range.upper).first.x;
+}
+
+Spectrum Array3D::get_max_spectrum_in(const AABB3f &uvw_range) const
+{
+    auto v = tex_->get_value_range(uvw_range.lower, uvw_range.upper).second;
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
+Spectrum Array3D::get_min_spectrum_in(const AABB3f &uvw_range) const
+{
+    auto v = tex_->get_value_range(uvw_range.lower, uvw_range.upper).first;
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
 RC<Texture3D> Array3DCreator::create(RC<const factory::Node> node, factory::Context &context)
 {
-    const auto text_filename = context.resolve_path(node->parse_child<std::string>("text"));
     const auto desc = parse_texture_desc(node);
     auto result = newRC<Array3D>();
-    result->initialize_from_text(text_filename.string(), desc);
+    if(node->find_child_node("binary"))
+    {
+        const auto binary_filename = context.resolve_path(node->parse_child<std::string>("binary"));
+        result->initialize_from_binary(binary_filename.string(), desc);
+    }
+    else
+    {
+        const auto text_filename = context.resolve_path(node->parse_child<std::string>("text"));
+        result->initialize_from_text(text_filename.string(), desc);
+    }
     return result;
 }
 
@@ -14,6 +14,8 @@ public:
 
     void initialize_from_text(const std::string &text_filename, const cuda::Texture::Description &desc);
 
+    void initialize_from_binary(const std::string &binary_filename, const cuda::Texture::Description &desc);
+
     void initialize_from_images(const std::vector<std::string> &image_filenames, const cuda::Texture::Description &desc);
 
     CSpectrum sample_spectrum_inline(CompileContext &cc, ref<CVec3f> uvw) const override;
@@ -24,6 +26,14 @@ public:
 
     Spectrum get_min_spectrum() const override;
 
+    float get_max_float_in(const AABB3f &uvw_range) const override;
+
+    float get_min_float_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_max_spectrum_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_min_spectrum_in(const AABB3f &uvw_range) const override;
+
 private:
 
     RC<const cuda::Texture> tex_;
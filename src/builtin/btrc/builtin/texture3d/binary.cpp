@@ -126,6 +126,66 @@ float Texture3DBinaryOperator<OP>::get_min_float() const
     unreachable();
 }
 
+template<BinaryOp3D OP>
+float Texture3DBinaryOperator<OP>::get_max_float_in(const AABB3f &uvw_range) const
+{
+    const float lmax = lhs_->get_max_float_in(uvw_range);
+    const float lmin = lhs_->get_min_float_in(uvw_range);
+    const float rmax = rhs_->get_max_float_in(uvw_range);
+    const float rmin = rhs_->get_min_float_in(uvw_range);
+    switch(OP)
+    {
+    case BinaryOp3D::Add: return lmax + rmax;
+    case BinaryOp3D::Mul: return std::max(std::max(lmax * rmax, lmax * rmin), std::max(lmin * rmax, lmin * rmin));
+    }
+    unreachable();
+}
+
+template<BinaryOp3D OP>
+float Texture3DBinaryOperator<OP>::get_min_float_in(const AABB3f &uvw_range) const
+{
+    const float lmax = lhs_->get_max_float_in(uvw_range);
+    const float lmin = lhs_->get_min_float_in(uvw_range);
+    const float rmax = rhs_->get_max_float_in(uvw_range);
+    const float rmin = rhs_->get_min_float_in(uvw_range);
+    switch(OP)
+    {
+    case BinaryOp3D::Add: return lmin + rmin;
+    case BinaryOp3D::Mul: return std::min(std::min(lmax * rmax, lmax * rmin), std::min(lmin * rmax, lmin * rmin));
+    }
+    unreachable();
+}
+
+template<BinaryOp3D OP>
+Spectrum Texture3DBinaryOperator<OP>::get_max_spectrum_in(const AABB3f &uvw_range) const
+{
+    const Spectrum lmax = lhs_->get_max_spectrum_in(uvw_range);
+    const Spectrum lmin = lhs_->get_min_spectrum_in(uvw_range);
+    const Spectrum rmax = rhs_->get_max_spectrum_in(uvw_range);
+    const Spectrum rmin = rhs_->get_min_spectrum_in(uvw_range);
+    switch(OP)
+    {
+    case BinaryOp3D::Add: return lmax + rmax;
+    case BinaryOp3D::Mul: return max(max(lmax * rmax, lmax * rmin), max(lmin * rmax, lmin * rmin));
+    }
+    unreachable();
+}
+
+template<BinaryOp3D OP>
+Spectrum Texture3DBinaryOperator<OP>::get_min_spectrum_in(const AABB3f &uvw_range) const
+{
+    const Spectrum lmax = lhs_->get_max_spectrum_in(uvw_range);
+    const Spectrum lmin = lhs_->get_min_spectrum_in(uvw_range);
+    const Spectrum rmax = rhs_->get_max_spectrum_in(uvw_range);
+    const Spectrum rmin = rhs_->get_min_spectrum_in(uvw_range);
+    switch(OP)
+    {
+    case BinaryOp3D::Add: return lmin + rmin;
+    case BinaryOp3D::Mul: return min(min(lmax * rmax, lmax * rmin), min(lmin * rmax, lmin * rmin));
+    }
+    unreachable();
+}
+
 template<BinaryOp3D OP>
 std::string Texture3DBinaryOperatorCreator<OP>::get_name() const
 {
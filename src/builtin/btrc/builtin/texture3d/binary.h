@@ -36,6 +36,14 @@ public:
 
     float get_min_float() const override;
 
+    float get_max_float_in(const AABB3f &uvw_range) const override;
+
+    float get_min_float_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_max_spectrum_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_min_spectrum_in(const AABB3f &uvw_range) const override;
+
 private:
 
     BTRC_OBJECT(Texture3D, lhs_);
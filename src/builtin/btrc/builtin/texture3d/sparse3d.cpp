@@ -0,0 +1,182 @@
+#include <btrc/builtin/texture3d/sparse3d.h>
+#include <btrc/utils/volume_file.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    // sparse grids have 1 or 3 channels. extra channels are dropped in place
+    void to_sparse_channels(std::vector<float> &data, int channels, int &sparse_channels)
+    {
+        sparse_channels = channels == 1 ? 1 : 3;
+        if(channels == sparse_channels)
+            return;
+        if(channels < sparse_channels)
+            throw BtrcException("SparseArray3D: unsupported channel count: " + std::to_string(channels));
+
+        const size_t texel_count = data.size() / channels;
+        for(size_t i = 0; i < texel_count; ++i)
+        {
+            for(int c = 0; c < sparse_channels; ++c)
+                data[i * sparse_channels + c] = data[i * channels + c];
+        }
+        data.resize(texel_count * sparse_channels);
+    }
+
+} // namespace anonymous
+
+void SparseArray3D::initialize(SparseBrickGrid grid)
+{
+    bricks_ = cuda::Buffer<SparseBrick>(grid.get_bricks());
+    if(!grid.get_pool().empty())
+        pool_ = cuda::Buffer<float>(grid.get_pool());
+    else
+        pool_ = cuda::Buffer<float>();
+    grid.release_pool();
+    grid_ = std::move(grid);
+}
+
+void SparseArray3D::initialize_from_dense(int width, int height, int depth, int channels, const float *data)
+{
+    initialize(SparseBrickGrid::from_dense(width, height, depth, channels, data));
+}
+
+void SparseArray3D::initialize_from_text(const std::string &text_filename)
+{
+    int width, height, depth, channels, sparse_channels;
+    auto data = load_text_volume(text_filename, width, height, depth, channels);
+    to_sparse_channels(data, channels, sparse_channels);
+    initialize_from_dense(width, height, depth, sparse_channels, data.data());
+}
+
+void SparseArray3D::initialize_from_binary(const std::string &binary_filename)
+{
+    const MappedVolumeFile file(binary_filename);
+    initialize(SparseBrickGrid::from_volume_file(file));
+}
+
+CSpectrum SparseArray3D::sample_spectrum_inline(CompileContext &cc, ref<CVec3f> uvw) const
+{
+    var v = lookup(uvw);
+    return CSpectrum::from_rgb(v.x, v.y, v.z);
+}
+
+f32 SparseArray3D::sample_float_inline(CompileContext &cc, ref<CVec3f> uvw) const
+{
+    return lookup(uvw).x;
+}
+
+Spectrum SparseArray3D::get_max_spectrum() const
+{
+    auto v = grid_.get_max_value();
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
+Spectrum SparseArray3D::get_min_spectrum() const
+{
+    auto v = grid_.get_min_value();
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
+float SparseArray3D::get_max_float_in(const AABB3f &uvw_range) const
+{
+    return grid_.get_value_range(uvw_range.lower, uvw_range.upper).second.x;
+}
+
+float SparseArray3D::get_min_float_in(const AABB3f &uvw_range) const
+{
+    return grid_.get_value_range(uvw_range.lower, uvw_range.upper).first.x;
+}
+
+Spectrum SparseArray3D::get_max_spectrum_in(const AABB3f &uvw_range) const
+{
+    auto v = grid_.get_value_range(uvw_range.lower, uvw_range.upper).second;
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
+Spectrum SparseArray3D::get_min_spectrum_in(const AABB3f &uvw_range) const
+{
+    auto v = grid_.get_value_range(uvw_range.lower, uvw_range.upper).first;
+    return Spectrum::from_rgb(v.x, v.y, v.z);
+}
+
+const SparseBrickGrid &SparseArray3D::get_grid() const
+{
+    return grid_;
+}
+
+CVec3f SparseArray3D::lookup(ref<CVec3f> uvw) const
+{
+    // same as SparseBrickGrid::sample
+
+    const int channels = grid_.get_channels();
+    const Vec3i brick_res = grid_.get_brick_res();
+
+    var bricks = cuj::import_pointer(bricks_.get());
+    var pool = cuj::import_pointer(pool_.get());
+
+    auto to_texel = [](f32 u, int res, f32 &frac)
+    {
+        var p = cstd::clamp(u * static_cast<float>(res) - 0.5f, 0.0f, static_cast<float>(res - 1));
+        var texel = cstd::min(i32(cstd::floor(p)), i32(res - 1));
+        frac = p - f32(texel);
+        return texel;
+    };
+
+    f32 fx, fy, fz;
+    var x = to_texel(uvw.x, grid_.get_width(), fx);
+    var y = to_texel(uvw.y, grid_.get_height(), fy);
+    var z = to_texel(uvw.z, grid_.get_depth(), fz);
+
+    var bx = x / SPARSE_BRICK_SIZE, by = y / SPARSE_BRICK_SIZE, bz = z / SPARSE_BRICK_SIZE;
+    ref brick = bricks[(bz * brick_res.y + by) * brick_res.x + bx];
+
+    CVec3f result;
+    $if(brick.pool_offset < 0)
+    {
+        result = brick.uniform_value;
+    }
+    $else
+    {
+        var lx = x - bx * SPARSE_BRICK_SIZE;
+        var ly = y - by * SPARSE_BRICK_SIZE;
+        var lz = z - bz * SPARSE_BRICK_SIZE;
+
+        auto texel = [&](int dx, int dy, int dz)
+        {
+            var idx = brick.pool_offset + channels *
+                (((lz + dz) * SPARSE_BRICK_STORAGE_SIZE + ly + dy) * SPARSE_BRICK_STORAGE_SIZE + lx + dx);
+            if(channels == 1)
+                return CVec3f(pool[idx]);
+            return CVec3f(pool[idx], pool[idx + 1], pool[idx + 2]);
+        };
+
+        var v00 = texel(0, 0, 0) * (1.0f - fx) + texel(1, 0, 0) * fx;
+        var v10 = texel(0, 1, 0) * (1.0f - fx) + texel(1, 1, 0) * fx;
+        var v01 = texel(0, 0, 1) * (1.0f - fx) + texel(1, 0, 1) * fx;
+        var v11 = texel(0, 1, 1) * (1.0f - fx) + texel(1, 1, 1) * fx;
+        var v0 = v00 * (1.0f - fy) + v10 * fy;
+        var v1 = v01 * (1.0f - fy) + v11 * fy;
+        result = v0 * (1.0f - fz) + v1 * fz;
+    };
+    return result;
+}
+
+RC<Texture3D> SparseArray3DCreator::create(RC<const factory::Node> node, factory::Context &context)
+{
+    auto result = newRC<SparseArray3D>();
+    if(node->find_child_node("binary"))
+    {
+        const auto binary_filename = context.resolve_path(node->parse_child<std::string>("binary"));
+        result->initialize_from_binary(binary_filename.string());
+    }
+    else
+    {
+        const auto text_filename = context.resolve_path(node->parse_child<std::string>("text"));
+        result->initialize_from_text(text_filename.string());
+    }
+    return result;
+}
+
+BTRC_BUILTIN_END
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <btrc/builtin/texture3d/sparse_grid.h>
+#include <btrc/core/texture3d.h>
+#include <btrc/factory/context.h>
+#include <btrc/utils/cuda/buffer.h>
+
+BTRC_BUILTIN_BEGIN
+
+CUJ_PROXY_CLASS(CSparseBrick, SparseBrick, uniform_value, pool_offset);
+
+// 3d texture made of 8^3 bricks. uniform bricks are not stored.
+// always uses clamp addressing and linear filtering
+class SparseArray3D : public Texture3D
+{
+public:
+
+    // the pool of grid is released after uploading it. only the indirection grid and the bounds stay on the host
+    void initialize(SparseBrickGrid grid);
+
+    void initialize_from_dense(int width, int height, int depth, int channels, const float *data);
+
+    void initialize_from_text(const std::string &text_filename);
+
+    void initialize_from_binary(const std::string &binary_filename);
+
+    CSpectrum sample_spectrum_inline(CompileContext &cc, ref<CVec3f> uvw) const override;
+
+    f32 sample_float_inline(CompileContext &cc, ref<CVec3f> uvw) const override;
+
+    Spectrum get_max_spectrum() const override;
+
+    Spectrum get_min_spectrum() const override;
+
+    float get_max_float_in(const AABB3f &uvw_range) const override;
+
+    float get_min_float_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_max_spectrum_in(const AABB3f &uvw_range) const override;
+
+    Spectrum get_min_spectrum_in(const AABB3f &uvw_range) const override;
+
+    // without the brick pool
+    const SparseBrickGrid &get_grid() const;
+
+private:
+
+    CVec3f lookup(ref<CVec3f> uvw) const;
+
+    SparseBrickGrid grid_;
+
+    cuda::Buffer<SparseBrick> bricks_;
+    cuda::Buffer<float>       pool_;
+};
+
+class SparseArray3DCreator : public factory::Creator<Texture3D>
+{
+public:
+
+    std::string get_name() const override { return "sparse_array"; }
+
+    RC<Texture3D> create(RC<const factory::Node> node, factory::Context &context) override;
+};
+
+BTRC_BUILTIN_END
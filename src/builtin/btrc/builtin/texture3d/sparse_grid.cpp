@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#include <btrc/builtin/texture3d/sparse_grid.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/half.h>
+
+BTRC_BUILTIN_BEGIN
+
+namespace
+{
+
+    Vec3f min(const Vec3f &a, const Vec3f &b)
+    {
+        return { (std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z) };
+    }
+
+    Vec3f max(const Vec3f &a, const Vec3f &b)
+    {
+        return { (std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z) };
+    }
+
+    int storage_index(int x, int y, int z)
+    {
+        return (z * SPARSE_BRICK_STORAGE_SIZE + y) * SPARSE_BRICK_STORAGE_SIZE + x;
+    }
+
+    // texel coordinate and lerp factor of the lower texel touched by linear filtering
+    void to_texel(float uvw, int res, int &texel, float &frac)
+    {
+        const float p = std::clamp(uvw * res - 0.5f, 0.0f, static_cast<float>(res - 1));
+        texel = (std::min)(static_cast<int>(std::floor(p)), res - 1);
+        frac = p - static_cast<float>(texel);
+    }
+
+} // namespace anonymous
+
+template<typename FetchTexel>
+SparseBrickGrid SparseBrickGrid::build(int width, int height, int depth, int channels, const FetchTexel &fetch_texel)
+{
+    if(width <= 0 || height <= 0 || depth <= 0)
+        throw BtrcException("SparseBrickGrid: invalid resolution");
+    if(channels != 1 && channels != 3)
+        throw BtrcException("SparseBrickGrid: unsupported channel count: " + std::to_string(channels));
+
+    SparseBrickGrid result;
+    result.width_ = width;
+    result.height_ = height;
+    result.depth_ = depth;
+    result.channels_ = channels;
+    result.brick_res_ = {
+        (width  + SPARSE_BRICK_SIZE - 1) / SPARSE_BRICK_SIZE,
+        (height + SPARSE_BRICK_SIZE - 1) / SPARSE_BRICK_SIZE,
+        (depth  + SPARSE_BRICK_SIZE - 1) / SPARSE_BRICK_SIZE
+    };
+
+    auto fetch_clamped = [&](int x, int y, int z)
+    {
+        return fetch_texel(std::clamp(x, 0, width - 1), std::clamp(y, 0, height - 1), std::clamp(z, 0, depth - 1));
+    };
+
+    const size_t brick_count = static_cast<size_t>(result.brick_res_.x) * result.brick_res_.y * result.brick_res_.z;
+    result.bricks_.reserve(brick_count);
+    result.brick_min_values_.reserve(brick_count);
+    result.brick_max_values_.reserve(brick_count);
+    result.min_value_ = Vec3f((std::numeric_limits<float>::max)());
+    result.max_value_ = Vec3f(std::numeric_limits<float>::lowest());
+
+    std::vector<Vec3f> texels(SPARSE_BRICK_STORAGE_TEXELS);
+    for(int bz = 0; bz < result.brick_res_.z; ++bz)
+    {
+        for(int by = 0; by < result.brick_res_.y; ++by)
+        {
+            for(int bx = 0; bx < result.brick_res_.x; ++bx)
+            {
+                const int x0 = bx * SPARSE_BRICK_SIZE;
+                const int y0 = by * SPARSE_BRICK_SIZE;
+                const int z0 = bz * SPARSE_BRICK_SIZE;
+
+                Vec3f brick_min((std::numeric_limits<float>::max)());
+                Vec3f brick_max(std::numeric_limits<float>::lowest());
+                bool uniform = true;
+                for(int z = 0; z < SPARSE_BRICK_STORAGE_SIZE; ++z)
+                {
+                    for(int y = 0; y < SPARSE_BRICK_STORAGE_SIZE; ++y)
+                    {
+                        for(int x = 0; x < SPARSE_BRICK_STORAGE_SIZE; ++x)
+                        {
+                            const Vec3f texel = fetch_clamped(x0 + x, y0 + y, z0 + z);
+                            texels[storage_index(x, y, z)] = texel;
+                            brick_min = min(brick_min, texel);
+                            brick_max = max(brick_max, texel);
+                            uniform &= texel.x == texels[0].x && texel.y == texels[0].y && texel.z == texels[0].z;
+                        }
+                    }
+                }
+
+                SparseBrick brick;
+                brick.uniform_value = texels[0];
+                brick.pool_offset = -1;
+                if(!uniform)
+                {
+                    if(result.pool_.size() + SPARSE_BRICK_STORAGE_TEXELS * channels >
+                       static_cast<size_t>((std::numeric_limits<int32_t>::max)()))
+                        throw BtrcException("SparseBrickGrid: brick pool is too large");
+
+                    brick.pool_offset = static_cast<int32_t>(result.pool_.size());
+                    for(auto &texel : texels)
+                    {
+                        result.pool_.push_back(texel.x);
+                        if(channels == 3)
+                        {
+                            result.pool_.push_back(texel.y);
+                            result.pool_.push_back(texel.z);
+                        }
+                    }
+                }
+
+                result.bricks_.push_back(brick);
+                result.brick_min_values_.push_back(brick_min);
+                result.brick_max_values_.push_back(brick_max);
+                result.min_value_ = min(result.min_value_, brick_min);
+                result.max_value_ = max(result.max_value_, brick_max);
+            }
+        }
+    }
+
+    result.pool_size_ = result.pool_.size();
+    return result;
+}
+
+SparseBrickGrid SparseBrickGrid::from_dense(int width, int height, int depth, int channels, const float *data)
+{
+    return build(width, height, depth, channels, [&](int x, int y, int z)
+    {
+        const float *texel = data + ((static_cast<size_t>(z) * height + y) * width + x) * channels;
+        return channels == 1 ? Vec3f(texel[0]) : Vec3f(texel[0], texel[1], texel[2]);
+    });
+}
+
+SparseBrickGrid SparseBrickGrid::from_volume_file(const MappedVolumeFile &file)
+{
+    auto &header = file.get_header();
+    const int file_channels = static_cast<int>(header.channels);
+    if(file_channels == 2)
+        throw BtrcException("SparseBrickGrid: unsupported channel count: 2");
+    const int channels = file_channels == 1 ? 1 : 3;
+    const int width = header.width, height = header.height, depth = header.depth;
+
+    auto texel_offset = [&](int x, int y, int z)
+    {
+        return ((static_cast<size_t>(z) * height + y) * width + x) * file_channels;
+    };
+
+    if(header.component == VolumeFileComponent::F32)
+    {
+        auto data = static_cast<const float *>(file.get_data());
+        return build(width, height, depth, channels, [&](int x, int y, int z)
+        {
+            const float *texel = data + texel_offset(x, y, z);
+            return channels == 1 ? Vec3f(texel[0]) : Vec3f(texel[0], texel[1], texel[2]);
+        });
+    }
+
+    auto data = static_cast<const uint16_t *>(file.get_data());
+    return build(width, height, depth, channels, [&](int x, int y, int z)
+    {
+        const uint16_t *texel = data + texel_offset(x, y, z);
+        if(channels == 1)
+            return Vec3f(half_to_float(texel[0]));
+        return Vec3f(half_to_float(texel[0]), half_to_float(texel[1]), half_to_float(texel[2]));
+    });
+}
+
+void SparseBrickGrid::release_pool()
+{
+    pool_ = {};
+}
+
+int SparseBrickGrid::get_width() const
+{
+    return width_;
+}
+
+int SparseBrickGrid::get_height() const
+{
+    return height_;
+}
+
+int SparseBrickGrid::get_depth() const
+{
+    return depth_;
+}
+
+int SparseBrickGrid::get_channels() const
+{
+    return channels_;
+}
+
+const Vec3i &SparseBrickGrid::get_brick_res() const
+{
+    return brick_res_;
+}
+
+const std::vector<SparseBrick> &SparseBrickGrid::get_bricks() const
+{
+    return bricks_;
+}
+
+const std::vector<float> &SparseBrickGrid::get_pool() const
+{
+    return pool_;
+}
+
+int SparseBrickGrid::get_allocated_brick_count() const
+{
+    return static_cast<int>(pool_size_ / (SPARSE_BRICK_STORAGE_TEXELS * channels_));
+}
+
+size_t SparseBrickGrid::get_memory_bytes() const
+{
+    return bricks_.size() * sizeof(SparseBrick) + pool_size_ * sizeof(float);
+}
+
+size_t SparseBrickGrid::get_dense_memory_bytes() const
+{
+    // 3-channel cuda arrays are padded to 4 channels
+    const size_t texel_bytes = (channels_ == 1 ? 1 : 4) * sizeof(float);
+    return static_cast<size_t>(width_) * height_ * depth_ * texel_bytes;
+}
+
+Vec3f SparseBrickGrid::sample(const Vec3f &uvw) const
+{
+    assert(pool_.size() == pool_size_);
+
+    int x, y, z; float fx, fy, fz;
+    to_texel(uvw.x, width_, x, fx);
+    to_texel(uvw.y, height_, y, fy);
+    to_texel(uvw.z, depth_, z, fz);
+
+    const int bx = x / SPARSE_BRICK_SIZE, by = y / SPARSE_BRICK_SIZE, bz = z / SPARSE_BRICK_SIZE;
+    auto &brick = bricks_[(static_cast<size_t>(bz) * brick_res_.y + by) * brick_res_.x + bx];
+    if(brick.pool_offset < 0)
+        return brick.uniform_value;
+
+    x -= bx * SPARSE_BRICK_SIZE;
+    y -= by * SPARSE_BRICK_SIZE;
+    z -= bz * SPARSE_BRICK_SIZE;
+
+    auto texel = [&](int dx, int dy, int dz)
+    {
+        const float *t = &pool_[brick.pool_offset + storage_index(x + dx, y + dy, z + dz) * channels_];
+        return channels_ == 1 ? Vec3f(t[0]) : Vec3f(t[0], t[1], t[2]);
+    };
+
+    const Vec3f v00 = texel(0, 0, 0) * (1 - fx) + texel(1, 0, 0) * fx;
+    const Vec3f v10 = texel(0, 1, 0) * (1 - fx) + texel(1, 1, 0) * fx;
+    const Vec3f v01 = texel(0, 0, 1) * (1 - fx) + texel(1, 0, 1) * fx;
+    const Vec3f v11 = texel(0, 1, 1) * (1 - fx) + texel(1, 1, 1) * fx;
+    const Vec3f v0 = v00 * (1 - fy) + v10 * fy;
+    const Vec3f v1 = v01 * (1 - fy) + v11 * fy;
+    return v0 * (1 - fz) + v1 * fz;
+}
+
+const Vec3f &SparseBrickGrid::get_min_value() const
+{
+    return min_value_;
+}
+
+const Vec3f &SparseBrickGrid::get_max_value() const
+{
+    return max_value_;
+}
+
+std::pair<Vec3f, Vec3f> SparseBrickGrid::get_value_range(const Vec3f &uvw_lower, const Vec3f &uvw_upper) const
+{
+    if(bricks_.empty())
+        return { min_value_, max_value_ };
+
+    // bounds of a brick include its extra texels, so the brick containing
+    // the lower texel of each lookup is sufficient
+
+    int x0, y0, z0, x1, y1, z1; float f;
+    to_texel(uvw_lower.x, width_, x0, f);
+    to_texel(uvw_lower.y, height_, y0, f);
+    to_texel(uvw_lower.z, depth_, z0, f);
+    to_texel(uvw_upper.x, width_, x1, f);
+    to_texel(uvw_upper.y, height_, y1, f);
+    to_texel(uvw_upper.z, depth_, z1, f);
+
+    Vec3f minv((std::numeric_limits<float>::max)());
+    Vec3f maxv(std::numeric_limits<float>::lowest());
+    for(int bz = z0 / SPARSE_BRICK_SIZE; bz <= z1 / SPARSE_BRICK_SIZE; ++bz)
+    {
+        for(int by = y0 / SPARSE_BRICK_SIZE; by <= y1 / SPARSE_BRICK_SIZE; ++by)
+        {
+            for(int bx = x0 / SPARSE_BRICK_SIZE; bx <= x1 / SPARSE_BRICK_SIZE; ++bx)
+            {
+                const size_t i = (static_cast<size_t>(bz) * brick_res_.y + by) * brick_res_.x + bx;
+                minv = min(minv, brick_min_values_[i]);
+                maxv = max(maxv, brick_max_values_[i]);
+            }
+        }
+    }
+    return { minv, maxv };
+}
+
+BTRC_BUILTIN_END
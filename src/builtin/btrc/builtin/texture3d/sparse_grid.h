@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+
+#include <btrc/utils/math/aabb.h>
+#include <btrc/utils/volume_file.h>
+
+BTRC_BUILTIN_BEGIN
+
+constexpr int SPARSE_BRICK_SIZE = 8;
+
+// stored bricks have one extra texel along each axis (copied from the next brick),
+// so that a trilinear lookup never leaves the brick it starts in
+constexpr int SPARSE_BRICK_STORAGE_SIZE = SPARSE_BRICK_SIZE + 1;
+constexpr int SPARSE_BRICK_STORAGE_TEXELS =
+    SPARSE_BRICK_STORAGE_SIZE * SPARSE_BRICK_STORAGE_SIZE * SPARSE_BRICK_STORAGE_SIZE;
+
+// indirection grid entry. bricks whose texels (including the extra ones) are all equal
+// are not stored in the pool and evaluate to uniform_value
+struct SparseBrick
+{
+    Vec3f   uniform_value;
+    int32_t pool_offset; // offset of the first float in the pool. -1 for uniform brick
+};
+
+// host side brick pool of a sparse 3d texture with 1 or 3 channels.
+// texel addressing follows cuda textures with clamp mode and linear filtering
+class SparseBrickGrid
+{
+public:
+
+    // data is z-major, then y, then x, with 'channels' floats per texel
+    static SparseBrickGrid from_dense(int width, int height, int depth, int channels, const float *data);
+
+    // bricks are built from the mapped texels without expanding the file to floats.
+    // 1-channel files give 1 channel, and 4-channel files give their first 3 channels
+    static SparseBrickGrid from_volume_file(const MappedVolumeFile &file);
+
+    // frees the brick pool once it has been uploaded. the indirection grid and the bounds are kept.
+    // get_pool() is empty and sample() must not be called afterwards
+    void release_pool();
+
+    int get_width() const;
+
+    int get_height() const;
+
+    int get_depth() const;
+
+    int get_channels() const;
+
+    const Vec3i &get_brick_res() const;
+
+    const std::vector<SparseBrick> &get_bricks() const;
+
+    const std::vector<float> &get_pool() const;
+
+    int get_allocated_brick_count() const;
+
+    size_t get_memory_bytes() const;
+
+    size_t get_dense_memory_bytes() const;
+
+    // reference trilinear lookup. requires the brick pool
+    Vec3f sample(const Vec3f &uvw) const;
+
+    const Vec3f &get_min_value() const;
+
+    const Vec3f &get_max_value() const;
+
+    // bounds of values that may be fetched in the given texcoord range
+    std::pair<Vec3f, Vec3f> get_value_range(const Vec3f &uvw_lower, const Vec3f &uvw_upper) const;
+
+private:
+
+    // fetch_texel(x, y, z) returns the texel at clamped coordinates
+    template<typename FetchTexel>
+    static SparseBrickGrid build(int width, int height, int depth, int channels, const FetchTexel &fetch_texel);
+
+    int width_    = 0;
+    int height_   = 0;
+    int depth_    = 0;
+    int channels_ = 1;
+
+    Vec3i brick_res_;
+
+    std::vector<SparseBrick> bricks_;
+    std::vector<float>       pool_;
+    size_t                   pool_size_ = 0; // float count of the pool, kept after release_pool
+
+    Vec3f              min_value_;
+    Vec3f              max_value_;
+    std::vector<Vec3f> brick_min_values_;
+    std::vector<Vec3f> brick_max_values_;
+};
+
+BTRC_BUILTIN_END
@@ -70,14 +70,92 @@ void run(const std::string &scene_filename)
     ObjectDAG dag(renderer);
     dag.commit();
 
-    std::cout << "render image" << std::endl;
+    if(const auto bvh_stats = scene->get_volume_bvh_stats(); bvh_stats.node_count)
+    {
+        std::cout << "volume bvh: "
+                  << bvh_stats.node_count << " nodes, "
+                  << "depth " << bvh_stats.max_depth << ", "
+                  << "sah cost " << bvh_stats.sah_cost << ", "
+                  << "build time " << bvh_stats.build_time_ms << "ms" << std::endl;
+    }
 
-    auto result = renderer->render();
-    
-    std::cout << "execute post processors" << std::endl;
+    if(const auto cell_stats = scene->get_volume_macro_cell_stats(); cell_stats.cell_count)
+    {
+        std::cout << "volume macro cells: "
+                  << cell_stats.empty_cell_count << "/" << cell_stats.cell_count << " empty" << std::endl;
+    }
+
+    if(const auto cache_stats = scene->get_volume_lighting_cache_stats(); cache_stats.resolution)
+    {
+        std::cout << "volume lighting cache: "
+                  << cache_stats.resolution << "^3 cells, "
+                  << cache_stats.iterations << " iterations, "
+                  << "residual " << cache_stats.residual << ", "
+                  << "direct lum " << cache_stats.direct_lum << ", "
+                  << "scattered lum " << cache_stats.scattered_lum << ", "
+                  << "build time " << cache_stats.build_time_ms << "ms" << std::endl;
+
+        if(cache_stats.reference_error >= 0)
+            std::cout << "volume lighting cache error against reference: " << cache_stats.reference_error << std::endl;
+
+        if(cache_stats.anisotropic_samples)
+        {
+            std::cout << "warning: volume lighting cache treats anisotropic phase functions as isotropic ("
+                      << cache_stats.anisotropic_samples << " samples)" << std::endl;
+        }
+    }
 
-    for(auto &p : post_processors)
-        p->process(result.color, result.albedo, result.normal, width, height);
+    // volumes move by volume_velocity between frames. outputs of post processors are overwritten by each frame
+
+    int frame_count = 1;
+    Vec3f volume_velocity;
+    if(auto frames_node = root_node->find_child_node("frames"))
+    {
+        frame_count = frames_node->parse_child_or("count", frame_count);
+        volume_velocity = frames_node->parse_child_or("volume_velocity", volume_velocity);
+    }
+
+    for(int frame = 0; frame < frame_count; ++frame)
+    {
+        if(frame > 0)
+        {
+            std::cout << "update frame " << frame << std::endl;
+
+            for(auto &vol : scene->get_volumes())
+            {
+                const auto geo = vol->get_geometry_info();
+                vol->set_geometry(geo.o + volume_velocity, geo.x, geo.y, geo.z);
+            }
+
+            if(!scene->update_volume_geometry())
+            {
+                std::cout << "regenerate kernels" << std::endl;
+                renderer->commit();
+            }
+        }
+
+        std::cout << "render image" << std::endl;
+
+        auto result = renderer->render();
+        std::cout << "average spp: " << result.average_spp << std::endl;
+
+        if(result.dropped_guiding_records)
+        {
+            std::cout << "warning: " << result.dropped_guiding_records
+                      << " path guiding records were dropped, consider a larger guiding.record_count" << std::endl;
+        }
+
+        if(const auto cell_stats = scene->get_volume_macro_cell_stats(); cell_stats.span_count)
+        {
+            std::cout << "volume macro cell spans: "
+                      << cell_stats.skipped_span_count << "/" << cell_stats.span_count << " skipped" << std::endl;
+        }
+
+        std::cout << "execute post processors" << std::endl;
+
+        for(auto &p : post_processors)
+            p->process(result.color, result.albedo, result.normal, width, height);
+    }
 }
 
 int main(int argc, char *argv[])
@@ -72,6 +72,57 @@ CVec2f sample_triangle_uniform(f32 u1, f32 u2)
     return CVec2f(1.0f - t, t * u2);
 }
 
+namespace
+{
+
+    f32 angle_between(ref<CVec3f> a, ref<CVec3f> b)
+    {
+        return 2.0f * cstd::atan2(length(a - b), length(a + b));
+    }
+
+    // normalized component of v orthogonal to w
+    CVec3f orthogonalize(ref<CVec3f> v, ref<CVec3f> w)
+    {
+        return normalize(v - dot(v, w) * w);
+    }
+
+} // namespace anonymous
+
+f32 spherical_triangle_area(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> c)
+{
+    return cstd::abs(2.0f * cstd::atan2(dot(a, cross(b, c)), 1.0f + dot(a, b) + dot(a, c) + dot(b, c)));
+}
+
+CVec3f sample_spherical_triangle(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> c, f32 u1, f32 u2)
+{
+    var n_ab = normalize(cross(a, b));
+    var n_bc = normalize(cross(b, c));
+    var n_ca = normalize(cross(c, a));
+
+    var alpha = angle_between(n_ab, -n_ca);
+    var beta  = angle_between(n_bc, -n_ab);
+    var gamma = angle_between(n_ca, -n_bc);
+
+    // area of the sub-triangle to sample, plus pi
+    var sub_area_pi = lerp(btrc_pi, alpha + beta + gamma, u1);
+
+    var cos_alpha = cstd::cos(alpha);
+    var sin_alpha = cstd::sin(alpha);
+    var sin_phi = cstd::sin(sub_area_pi) * cos_alpha - cstd::cos(sub_area_pi) * sin_alpha;
+    var cos_phi = cstd::cos(sub_area_pi) * cos_alpha + cstd::sin(sub_area_pi) * sin_alpha;
+
+    var k1 = cos_phi + cos_alpha;
+    var k2 = sin_phi - sin_alpha * dot(a, b);
+    var cos_bp = (k2 + (k2 * cos_phi - k1 * sin_phi) * cos_alpha) / ((k2 * sin_phi + k1 * cos_phi) * sin_alpha);
+    cos_bp = cstd::clamp(cos_bp, -1.0f, 1.0f);
+    var sin_bp = cstd::sqrt(cstd::max(f32(0), 1.0f - cos_bp * cos_bp));
+    var cp = cos_bp * a + sin_bp * orthogonalize(c, a);
+
+    var cos_theta = 1.0f - u2 * (1.0f - dot(cp, b));
+    var sin_theta = cstd::sqrt(cstd::max(f32(0), 1.0f - cos_theta * cos_theta));
+    return cos_theta * b + sin_theta * orthogonalize(cp, b);
+}
+
 CVec2f sample_disk_uniform(f32 u1, f32 u2)
 {
     var phi = 2 * btrc_pi * u1;
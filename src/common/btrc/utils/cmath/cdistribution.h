@@ -29,6 +29,13 @@ f32 pdf_sample_hemisphere_zweighted(ref<CVec3f> v); // v must be normalized
 
 CVec2f sample_triangle_uniform(f32 u1, f32 u2);
 
+// spherical triangle. a, b and c must be normalized
+
+f32 spherical_triangle_area(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> c);
+
+// uniform in solid angle (Arvo 1995)
+CVec3f sample_spherical_triangle(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> c, f32 u1, f32 u2);
+
 // disk
 
 CVec2f sample_disk_uniform(f32 u1, f32 u2);
@@ -3,8 +3,10 @@
 
 #include <btrc/utils/cuda/array.h>
 #include <btrc/utils/cuda/error.h>
+#include <btrc/utils/half.h>
 #include <btrc/utils/scope_guard.h>
 #include <btrc/utils/unreachable.h>
+#include <btrc/utils/volume_file.h>
 
 BTRC_CUDA_BEGIN
 
@@ -87,6 +89,16 @@ namespace
         throw BtrcException("unsupported channel format");
     }
 
+    Vec3f min(const Vec3f &a, const Vec3f &b)
+    {
+        return { (std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z) };
+    }
+
+    Vec3f max(const Vec3f &a, const Vec3f &b)
+    {
+        return { (std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z) };
+    }
+
 } // namespace anonymous
 
 Array::Array()
@@ -218,6 +230,7 @@ void Array::load_from_memory(int width, int height, int depth, Format format, co
     throw_on_error(cudaMemcpy3D(&copy_params));
 
     std::tie(min_value_, max_value_) = find_minmax_values(width, height, depth, format, linear_data);
+    compute_value_blocks(width, height, depth, format, linear_data);
 }
 
 void Array::load_from_images(const std::vector<std::string> &filenames)
@@ -384,6 +397,23 @@ void Array::load_from_text(const std::string &filename)
         throw BtrcException("unknown component type: " + component);
 }
 
+void Array::load_from_binary(const std::string &filename)
+{
+    // the mapped file is uploaded directly. pages are read by the driver during the copy
+    const MappedVolumeFile file(filename);
+    auto &header = file.get_header();
+
+    const bool half = header.component == VolumeFileComponent::F16;
+    Format format;
+    switch(header.channels)
+    {
+    case 1:  format = half ? Format::F16x1 : Format::F32x1; break;
+    case 2:  format = half ? Format::F16x2 : Format::F32x2; break;
+    default: format = half ? Format::F16x4 : Format::F32x4; break;
+    }
+    load_from_memory(header.width, header.height, header.depth, format, file.get_data());
+}
+
 bool Array::is_2d() const
 {
     return depth_ == 0;
@@ -429,85 +459,131 @@ const Vec3f &Array::get_max_value() const
     return max_value_;
 }
 
+std::pair<Vec3f, Vec3f> Array::get_texel_value_range(const Vec3i &lower, const Vec3i &upper) const
+{
+    if(!is_3d() || block_min_values_.empty())
+        return { min_value_, max_value_ };
+
+    assert(0 <= lower.x && lower.x <= upper.x && upper.x < width_);
+    assert(0 <= lower.y && lower.y <= upper.y && upper.y < height_);
+    assert(0 <= lower.z && lower.z <= upper.z && upper.z < depth_);
+
+    const int bx0 = lower.x / VALUE_BLOCK_SIZE;
+    const int by0 = lower.y / VALUE_BLOCK_SIZE;
+    const int bz0 = lower.z / VALUE_BLOCK_SIZE;
+    const int bx1 = upper.x / VALUE_BLOCK_SIZE;
+    const int by1 = upper.y / VALUE_BLOCK_SIZE;
+    const int bz1 = upper.z / VALUE_BLOCK_SIZE;
+
+    Vec3f minv((std::numeric_limits<float>::max)());
+    Vec3f maxv(std::numeric_limits<float>::lowest());
+    for(int bz = bz0; bz <= bz1; ++bz)
+    {
+        for(int by = by0; by <= by1; ++by)
+        {
+            for(int bx = bx0; bx <= bx1; ++bx)
+            {
+                const size_t i = (static_cast<size_t>(bz) * value_block_res_.y + by) * value_block_res_.x + bx;
+                minv = min(minv, block_min_values_[i]);
+                maxv = max(maxv, block_max_values_[i]);
+            }
+        }
+    }
+    return { minv, maxv };
+}
+
 namespace
 {
 
-    template<typename Component, int ComponentCount, bool Normalize>
-    std::pair<Vec3f, Vec3f> find_minmax_impl(
-        int width, int height, int depth, const void *data)
+    struct HalfComponent
     {
-        Vec3<Component> minv(std::numeric_limits<Component>::max());
-        Vec3<Component> maxv(std::numeric_limits<Component>::lowest());
+        uint16_t bits;
 
-        const size_t texel_count = static_cast<size_t>(width) * height * depth;
-        auto comp = static_cast<const Component *>(data);
+        explicit operator float() const { return half_to_float(bits); }
+    };
+
+    template<typename Component, int ComponentCount, bool Normalize, typename Func>
+    void for_each_texel_impl(int width, int height, int depth, const void *data, const Func &func)
+    {
+        constexpr float factor = Normalize ?
+            static_cast<float>(1.0 / static_cast<double>((std::numeric_limits<Component>::max)())) : 1.0f;
 
-        for(size_t i = 0; i < texel_count; ++i)
+        auto comp = static_cast<const Component *>(data);
+        for(int z = 0; z < depth; ++z)
         {
-            Vec3<Component> texel;
-            texel.x = *comp++;
-            if constexpr(ComponentCount >= 2)
-                texel.y = *comp++;
-            if constexpr(ComponentCount == 4)
+            for(int y = 0; y < height; ++y)
             {
-                texel.z = *comp++;
-                ++comp;
+                for(int x = 0; x < width; ++x)
+                {
+                    Vec3f texel(0.0f);
+                    texel.x = static_cast<float>(*comp++) * factor;
+                    if constexpr(ComponentCount >= 2)
+                        texel.y = static_cast<float>(*comp++) * factor;
+                    if constexpr(ComponentCount == 4)
+                    {
+                        texel.z = static_cast<float>(*comp++) * factor;
+                        ++comp;
+                    }
+                    func(x, y, z, texel);
+                }
             }
-
-            minv.x = (std::min)(minv.x, texel.x);
-            minv.y = (std::min)(minv.y, texel.y);
-            minv.z = (std::min)(minv.z, texel.z);
-
-            maxv.x = (std::max)(maxv.x, texel.x);
-            maxv.y = (std::max)(maxv.y, texel.y);
-            maxv.z = (std::max)(maxv.z, texel.z);
         }
+    }
 
-#define CONVERT_COMP(TYPE)                                                             \
-        if constexpr(std::is_same_v<Component, TYPE>)                                  \
-        {                                                                              \
-            if constexpr(Normalize)                                                    \
-            {                                                                          \
-                constexpr float factor = static_cast<float>(                           \
-                    1.0 / std::numeric_limits<Component>::max());                      \
-                const Vec3f minr = {                                                   \
-                    static_cast<float>(minv.x) * factor,                               \
-                    static_cast<float>(minv.y) * factor,                               \
-                    static_cast<float>(minv.z) * factor                                \
-                };                                                                     \
-                const Vec3f maxr = {                                                   \
-                    static_cast<float>(maxv.x) * factor,                               \
-                    static_cast<float>(maxv.y) * factor,                               \
-                    static_cast<float>(maxv.z) * factor                                \
-                };                                                                     \
-                return { minr, maxr };                                                 \
-            }                                                                          \
-            else                                                                       \
-            {                                                                          \
-                const Vec3f minr = {                                                   \
-                    static_cast<float>(minv.x),                                        \
-                    static_cast<float>(minv.y),                                        \
-                    static_cast<float>(minv.z)                                         \
-                };                                                                     \
-                const Vec3f maxr = {                                                   \
-                    static_cast<float>(maxv.x),                                        \
-                    static_cast<float>(maxv.y),                                        \
-                    static_cast<float>(maxv.z)                                         \
-                };                                                                     \
-                return { minr, maxr };                                                 \
-            }                                                                          \
+    // calls func(x, y, z, texel) for each texel, with components converted to float
+    template<typename Func>
+    void for_each_texel(
+        int width, int height, int depth,
+        Array::Format format, const void *data, const Func &func)
+    {
+        using Format = Array::Format;
+        const int w = width, h = height, d = depth;
+        switch(format)
+        {
+        case Format::S8x1:      return for_each_texel_impl<int8_t, 1, false>(w, h, d, data, func);
+        case Format::S8x2:      return for_each_texel_impl<int8_t, 2, false>(w, h, d, data, func);
+        case Format::S8x4:      return for_each_texel_impl<int8_t, 4, false>(w, h, d, data, func);
+        case Format::U8x1:      return for_each_texel_impl<uint8_t, 1, false>(w, h, d, data, func);
+        case Format::U8x2:      return for_each_texel_impl<uint8_t, 2, false>(w, h, d, data, func);
+        case Format::U8x4:      return for_each_texel_impl<uint8_t, 4, false>(w, h, d, data, func);
+        case Format::S16x1:     return for_each_texel_impl<int16_t, 1, false>(w, h, d, data, func);
+        case Format::S16x2:     return for_each_texel_impl<int16_t, 2, false>(w, h, d, data, func);
+        case Format::S16x4:     return for_each_texel_impl<int16_t, 4, false>(w, h, d, data, func);
+        case Format::U16x1:     return for_each_texel_impl<uint16_t, 1, false>(w, h, d, data, func);
+        case Format::U16x2:     return for_each_texel_impl<uint16_t, 2, false>(w, h, d, data, func);
+        case Format::U16x4:     return for_each_texel_impl<uint16_t, 4, false>(w, h, d, data, func);
+        case Format::S32x1:     return for_each_texel_impl<int32_t, 1, false>(w, h, d, data, func);
+        case Format::S32x2:     return for_each_texel_impl<int32_t, 2, false>(w, h, d, data, func);
+        case Format::S32x4:     return for_each_texel_impl<int32_t, 4, false>(w, h, d, data, func);
+        case Format::U32x1:     return for_each_texel_impl<uint32_t, 1, false>(w, h, d, data, func);
+        case Format::U32x2:     return for_each_texel_impl<uint32_t, 2, false>(w, h, d, data, func);
+        case Format::U32x4:     return for_each_texel_impl<uint32_t, 4, false>(w, h, d, data, func);
+        case Format::F32x1:     return for_each_texel_impl<float, 1, false>(w, h, d, data, func);
+        case Format::F32x2:     return for_each_texel_impl<float, 2, false>(w, h, d, data, func);
+        case Format::F32x4:     return for_each_texel_impl<float, 4, false>(w, h, d, data, func);
+        case Format::SNorm8x1:  return for_each_texel_impl<int8_t, 1, true>(w, h, d, data, func);
+        case Format::SNorm8x2:  return for_each_texel_impl<int8_t, 2, true>(w, h, d, data, func);
+        case Format::SNorm8x4:  return for_each_texel_impl<int8_t, 4, true>(w, h, d, data, func);
+        case Format::UNorm8x1:  return for_each_texel_impl<uint8_t, 1, true>(w, h, d, data, func);
+        case Format::UNorm8x2:  return for_each_texel_impl<uint8_t, 2, true>(w, h, d, data, func);
+        case Format::UNorm8x4:  return for_each_texel_impl<uint8_t, 4, true>(w, h, d, data, func);
+        case Format::SNorm16x1: return for_each_texel_impl<int16_t, 1, true>(w, h, d, data, func);
+        case Format::SNorm16x2: return for_each_texel_impl<int16_t, 2, true>(w, h, d, data, func);
+        case Format::SNorm16x4: return for_each_texel_impl<int16_t, 4, true>(w, h, d, data, func);
+        case Format::UNorm16x1: return for_each_texel_impl<uint16_t, 1, true>(w, h, d, data, func);
+        case Format::UNorm16x2: return for_each_texel_impl<uint16_t, 2, true>(w, h, d, data, func);
+        case Format::UNorm16x4: return for_each_texel_impl<uint16_t, 4, true>(w, h, d, data, func);
+        case Format::SNorm32x1: return for_each_texel_impl<int32_t, 1, true>(w, h, d, data, func);
+        case Format::SNorm32x2: return for_each_texel_impl<int32_t, 2, true>(w, h, d, data, func);
+        case Format::SNorm32x4: return for_each_texel_impl<int32_t, 4, true>(w, h, d, data, func);
+        case Format::UNorm32x1: return for_each_texel_impl<uint32_t, 1, true>(w, h, d, data, func);
+        case Format::UNorm32x2: return for_each_texel_impl<uint32_t, 2, true>(w, h, d, data, func);
+        case Format::UNorm32x4: return for_each_texel_impl<uint32_t, 4, true>(w, h, d, data, func);
+        case Format::F16x1:     return for_each_texel_impl<HalfComponent, 1, false>(w, h, d, data, func);
+        case Format::F16x2:     return for_each_texel_impl<HalfComponent, 2, false>(w, h, d, data, func);
+        case Format::F16x4:     return for_each_texel_impl<HalfComponent, 4, false>(w, h, d, data, func);
         }
-
-
-        if constexpr(std::is_same_v<Component, float>)
-            return { minv, maxv };
-        CONVERT_COMP(int32_t)
-        CONVERT_COMP(uint32_t)
-        CONVERT_COMP(int16_t)
-        CONVERT_COMP(uint16_t)
-        CONVERT_COMP(int8_t)
-        CONVERT_COMP(uint8_t)
-        throw BtrcException("Array::find_minmax_values: unsupported format");
+        unreachable();
     }
 
 } // namespace anonymous
@@ -516,53 +592,37 @@ std::pair<Vec3f, Vec3f> Array::find_minmax_values(
     int width, int height, int depth,
     Format format, const void *data)
 {
-    switch(format)
+    Vec3f minv((std::numeric_limits<float>::max)());
+    Vec3f maxv(std::numeric_limits<float>::lowest());
+    for_each_texel(width, height, depth, format, data, [&](int, int, int, const Vec3f &texel)
     {
-    case Format::S8x1:      return find_minmax_impl<int8_t, 1, false>(width, height, depth, data);
-    case Format::S8x2:      return find_minmax_impl<int8_t, 2, false>(width, height, depth, data);
-    case Format::S8x4:      return find_minmax_impl<int8_t, 4, false>(width, height, depth, data);
-    case Format::U8x1:      return find_minmax_impl<uint8_t, 1, false>(width, height, depth, data);
-    case Format::U8x2:      return find_minmax_impl<uint8_t, 2, false>(width, height, depth, data);
-    case Format::U8x4:      return find_minmax_impl<uint8_t, 4, false>(width, height, depth, data);
-    case Format::S16x1:     return find_minmax_impl<int16_t, 1, false>(width, height, depth, data);
-    case Format::S16x2:     return find_minmax_impl<int16_t, 2, false>(width, height, depth, data);
-    case Format::S16x4:     return find_minmax_impl<int16_t, 4, false>(width, height, depth, data);
-    case Format::U16x1:     return find_minmax_impl<uint16_t, 1, false>(width, height, depth, data);
-    case Format::U16x2:     return find_minmax_impl<uint16_t, 2, false>(width, height, depth, data);
-    case Format::U16x4:     return find_minmax_impl<uint16_t, 4, false>(width, height, depth, data);
-    case Format::S32x1:     return find_minmax_impl<int32_t, 1, false>(width, height, depth, data);
-    case Format::S32x2:     return find_minmax_impl<int32_t, 2, false>(width, height, depth, data);
-    case Format::S32x4:     return find_minmax_impl<int32_t, 4, false>(width, height, depth, data);
-    case Format::U32x1:     return find_minmax_impl<uint32_t, 1, false>(width, height, depth, data);
-    case Format::U32x2:     return find_minmax_impl<uint32_t, 2, false>(width, height, depth, data);
-    case Format::U32x4:     return find_minmax_impl<uint32_t, 4, false>(width, height, depth, data);
-    case Format::F32x1:     return find_minmax_impl<float, 1, false>(width, height, depth, data);
-    case Format::F32x2:     return find_minmax_impl<float, 2, false>(width, height, depth, data);
-    case Format::F32x4:     return find_minmax_impl<float, 4, false>(width, height, depth, data);
-    case Format::SNorm8x1:  return find_minmax_impl<int8_t, 1, true>(width, height, depth, data);
-    case Format::SNorm8x2:  return find_minmax_impl<int8_t, 2, true>(width, height, depth, data);
-    case Format::SNorm8x4:  return find_minmax_impl<int8_t, 4, true>(width, height, depth, data);
-    case Format::UNorm8x1:  return find_minmax_impl<uint8_t, 1, true>(width, height, depth, data);
-    case Format::UNorm8x2:  return find_minmax_impl<uint8_t, 2, true>(width, height, depth, data);
-    case Format::UNorm8x4:  return find_minmax_impl<uint8_t, 4, true>(width, height, depth, data);
-    case Format::SNorm16x1: return find_minmax_impl<int16_t, 1, true>(width, height, depth, data);
-    case Format::SNorm16x2: return find_minmax_impl<int16_t, 2, true>(width, height, depth, data);
-    case Format::SNorm16x4: return find_minmax_impl<int16_t, 4, true>(width, height, depth, data);
-    case Format::UNorm16x1: return find_minmax_impl<uint16_t, 1, true>(width, height, depth, data);
-    case Format::UNorm16x2: return find_minmax_impl<uint16_t, 2, true>(width, height, depth, data);
-    case Format::UNorm16x4: return find_minmax_impl<uint16_t, 4, true>(width, height, depth, data);
-    case Format::SNorm32x1: return find_minmax_impl<int32_t, 1, true>(width, height, depth, data);
-    case Format::SNorm32x2: return find_minmax_impl<int32_t, 2, true>(width, height, depth, data);
-    case Format::SNorm32x4: return find_minmax_impl<int32_t, 4, true>(width, height, depth, data);
-    case Format::UNorm32x1: return find_minmax_impl<uint32_t, 1, true>(width, height, depth, data);
-    case Format::UNorm32x2: return find_minmax_impl<uint32_t, 2, true>(width, height, depth, data);
-    case Format::UNorm32x4: return find_minmax_impl<uint32_t, 4, true>(width, height, depth, data);
-    case Format::F16x1:
-    case Format::F16x2:
-    case Format::F16x4:
-        throw BtrcException("unimplemented");
-    }
-    unreachable();
+        minv = min(minv, texel);
+        maxv = max(maxv, texel);
+    });
+    return { minv, maxv };
+}
+
+void Array::compute_value_blocks(int width, int height, int depth, Format format, const void *data)
+{
+    value_block_res_ = {
+        (width  + VALUE_BLOCK_SIZE - 1) / VALUE_BLOCK_SIZE,
+        (height + VALUE_BLOCK_SIZE - 1) / VALUE_BLOCK_SIZE,
+        (depth  + VALUE_BLOCK_SIZE - 1) / VALUE_BLOCK_SIZE
+    };
+    const size_t block_count =
+        static_cast<size_t>(value_block_res_.x) * value_block_res_.y * value_block_res_.z;
+    block_min_values_.assign(block_count, Vec3f((std::numeric_limits<float>::max)()));
+    block_max_values_.assign(block_count, Vec3f(std::numeric_limits<float>::lowest()));
+
+    for_each_texel(width, height, depth, format, data, [&](int x, int y, int z, const Vec3f &texel)
+    {
+        const int bx = x / VALUE_BLOCK_SIZE;
+        const int by = y / VALUE_BLOCK_SIZE;
+        const int bz = z / VALUE_BLOCK_SIZE;
+        const size_t i = (static_cast<size_t>(bz) * value_block_res_.y + by) * value_block_res_.x + bx;
+        block_min_values_[i] = min(block_min_values_[i], texel);
+        block_max_values_[i] = max(block_max_values_[i], texel);
+    });
 }
 
 BTRC_CUDA_END
@@ -91,6 +91,9 @@ public:
 
     void load_from_text(const std::string &filename);
 
+    // see btrc/utils/volume_file.h
+    void load_from_binary(const std::string &filename);
+
     // query
 
     bool is_2d() const;
@@ -111,12 +114,20 @@ public:
 
     const Vec3f &get_max_value() const;
 
+    // bounds of values of texels in [lower, upper] (inclusive, inside the array) of a 3d array.
+    // global bounds are returned for other arrays
+    std::pair<Vec3f, Vec3f> get_texel_value_range(const Vec3i &lower, const Vec3i &upper) const;
+
 private:
 
+    static constexpr int VALUE_BLOCK_SIZE = 8;
+
     static std::pair<Vec3f, Vec3f> find_minmax_values(
         int width, int height, int depth,
         Format format, const void *data);
 
+    void compute_value_blocks(int width, int height, int depth, Format format, const void *data);
+
     int         width_;
     int         height_;
     int         depth_;
@@ -124,6 +135,11 @@ private:
     cudaArray_t arr_;
     Vec3f       max_value_;
     Vec3f       min_value_;
+
+    // per-block value bounds of 3d array
+    Vec3i              value_block_res_;
+    std::vector<Vec3f> block_min_values_;
+    std::vector<Vec3f> block_max_values_;
 };
 
 BTRC_CUDA_END
@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
 #include <btrc/utils/cuda/error.h>
 #include <btrc/utils/cuda/texture.h>
 #include <btrc/utils/scope_guard.h>
@@ -24,6 +28,87 @@ namespace
         unreachable();
     }
 
+    // texel ranges that a range of texel indices along an unbounded axis is mapped to
+    struct TexelRanges
+    {
+        int  count = 0;
+        int  lower[2] = {};
+        int  upper[2] = {};
+        bool border = false;
+
+        void add(int l, int u)
+        {
+            assert(count < 2);
+            lower[count] = l;
+            upper[count] = u;
+            ++count;
+        }
+    };
+
+    int positive_mod(int a, int b)
+    {
+        const int r = a % b;
+        return r < 0 ? r + b : r;
+    }
+
+    TexelRanges map_texel_range(int lower, int upper, int size, Texture::AddressMode mode)
+    {
+        TexelRanges result;
+        if(mode == Texture::AddressMode::Clamp)
+        {
+            result.add(std::clamp(lower, 0, size - 1), std::clamp(upper, 0, size - 1));
+            return result;
+        }
+
+        if(mode == Texture::AddressMode::Border)
+        {
+            result.border = lower < 0 || upper >= size;
+            if(lower < size && upper >= 0)
+                result.add((std::max)(lower, 0), (std::min)(upper, size - 1));
+            return result;
+        }
+
+        if(upper - lower + 1 >= size)
+        {
+            result.add(0, size - 1);
+            return result;
+        }
+
+        if(mode == Texture::AddressMode::Wrap)
+        {
+            const int l = positive_mod(lower, size);
+            const int u = l + upper - lower;
+            if(u < size)
+                result.add(l, u);
+            else
+            {
+                result.add(l, size - 1);
+                result.add(0, u - size);
+            }
+            return result;
+        }
+
+        // mirror repeats [0, size) and its reflection with period 2 * size.
+        // a range shorter than size crosses at most one of the reflections at size and 2 * size
+        const int l = positive_mod(lower, 2 * size);
+        const int u = l + upper - lower;
+        auto add_piece = [&](int piece_lower, int piece_upper)
+        {
+            if(piece_lower > piece_upper)
+                return;
+            if(piece_upper < size)
+                result.add(piece_lower, piece_upper);
+            else if(piece_upper < 2 * size)
+                result.add(2 * size - 1 - piece_upper, 2 * size - 1 - piece_lower);
+            else
+                result.add(piece_lower - 2 * size, piece_upper - 2 * size);
+        };
+        add_piece(l, (std::min)(u, size - 1));
+        add_piece((std::max)(l, size), (std::min)(u, 2 * size - 1));
+        add_piece((std::max)(l, 2 * size), u);
+        return result;
+    }
+
 } // namespace anonymous
 
 Texture::Texture()
@@ -52,6 +137,7 @@ Texture::~Texture()
 void Texture::swap(Texture &other) noexcept
 {
     std::swap(arr_, other.arr_);
+    std::swap(desc_, other.desc_);
     std::swap(tex_, other.tex_);
 }
 
@@ -64,6 +150,7 @@ void Texture::initialize(RC<const Array> arr, const Description &desc)
 {
     destroy();
     arr_ = std::move(arr);
+    desc_ = desc;
     BTRC_SCOPE_FAIL{ arr_ = {}; tex_ = 0; };
 
     cudaTextureDesc cu_desc = {};
@@ -116,6 +203,12 @@ cudaTextureObject_t Texture::get_tex() const
     return tex_;
 }
 
+const Array &Texture::get_array() const
+{
+    assert(arr_);
+    return *arr_;
+}
+
 Vec3f Texture::get_min_value() const
 {
     return arr_->get_min_value();
@@ -126,6 +219,51 @@ Vec3f Texture::get_max_value() const
     return arr_->get_max_value();
 }
 
+std::pair<Vec3f, Vec3f> Texture::get_value_range(const Vec3f &uvw_lower, const Vec3f &uvw_upper) const
+{
+    if(!arr_->is_3d())
+        return { arr_->get_min_value(), arr_->get_max_value() };
+
+    // texels touched by point or linear filtering, before applying address modes
+
+    const int sizes[3] = { arr_->get_width(), arr_->get_height(), arr_->get_depth() };
+    TexelRanges ranges[3];
+    for(int i = 0; i < 3; ++i)
+    {
+        // clamped so that ranges spanning many periods do not overflow
+        const double size = sizes[i];
+        const double lower = std::clamp(std::floor(uvw_lower[i] * size - 0.5), -1e9, 1e9);
+        const double upper = std::clamp(std::floor(uvw_upper[i] * size - 0.5) + 1, -1e9, 1e9);
+        ranges[i] = map_texel_range(
+            static_cast<int>(lower), static_cast<int>(upper), sizes[i], desc_.address_modes[i]);
+    }
+
+    Vec3f minv((std::numeric_limits<float>::max)());
+    Vec3f maxv(std::numeric_limits<float>::lowest());
+    if(ranges[0].border || ranges[1].border || ranges[2].border)
+    {
+        const Vec3f border(desc_.border_value[0], desc_.border_value[1], desc_.border_value[2]);
+        minv = border;
+        maxv = border;
+    }
+
+    for(int x = 0; x < ranges[0].count; ++x)
+    {
+        for(int y = 0; y < ranges[1].count; ++y)
+        {
+            for(int z = 0; z < ranges[2].count; ++z)
+            {
+                const Vec3i lower(ranges[0].lower[x], ranges[1].lower[y], ranges[2].lower[z]);
+                const Vec3i upper(ranges[0].upper[x], ranges[1].upper[y], ranges[2].upper[z]);
+                const auto [range_min, range_max] = arr_->get_texel_value_range(lower, upper);
+                minv = min(minv, range_min);
+                maxv = max(maxv, range_max);
+            }
+        }
+    }
+    return { minv, maxv };
+}
+
 void Texture::destroy()
 {
     if(tex_)
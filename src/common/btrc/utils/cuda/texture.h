@@ -46,15 +46,22 @@ public:
 
     cudaTextureObject_t get_tex() const;
 
+    const Array &get_array() const;
+
     Vec3f get_min_value() const;
 
     Vec3f get_max_value() const;
 
+    // bounds of values that may be fetched in the given texcoord range with point or linear filtering,
+    // following the address modes
+    std::pair<Vec3f, Vec3f> get_value_range(const Vec3f &uvw_lower, const Vec3f &uvw_upper) const;
+
 private:
 
     void destroy();
 
     RC<const Array>     arr_;
+    Description         desc_;
     cudaTextureObject_t tex_;
 };
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+
+#include <btrc/common.h>
+
+BTRC_BEGIN
+
+// host conversions between float and ieee 754 binary16 bits
+
+inline float half_to_float(uint16_t h)
+{
+    const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    const uint32_t exp = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+
+    if(exp == 0)
+    {
+        // zero or subnormal
+        const float v = std::bit_cast<float>(uint32_t(0x33800000)) * static_cast<float>(mantissa); // 2^-24
+        return sign ? -v : v;
+    }
+    if(exp == 0x1f)
+        return std::bit_cast<float>(sign | 0x7f800000 | (mantissa << 13));
+    return std::bit_cast<float>(sign | ((exp + 112) << 23) | (mantissa << 13));
+}
+
+// rounds to nearest even
+inline uint16_t float_to_half(float f)
+{
+    const uint32_t bits = std::bit_cast<uint32_t>(f);
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t abs_bits = bits & 0x7fffffff;
+
+    if(abs_bits >= 0x7f800000)
+        return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x200 : 0);
+    if(abs_bits >= 0x477ff000) // rounds to a value above the largest half
+        return sign | 0x7c00;
+    if(abs_bits < 0x38800000)
+    {
+        // subnormal half. add the value to 0.5 so that the fpu does the rounding
+        const float v = std::bit_cast<float>(abs_bits) + 0.5f;
+        return sign | static_cast<uint16_t>(std::bit_cast<uint32_t>(v) - 0x3f000000);
+    }
+
+    const uint32_t odd = (abs_bits >> 13) & 1;
+    const uint32_t rounded = abs_bits + 0xc8000fff + odd; // rebias exponent by -112 and round
+    return sign | static_cast<uint16_t>(rounded >> 13);
+}
+
+BTRC_END
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include <btrc/utils/cmath/cmath.h>
 
 BTRC_BEGIN
@@ -9,6 +11,42 @@ BTRC_BEGIN
 namespace hash
 {
 
+    inline uint64_t murmur_hash64A(const void *data, size_t len, uint64_t seed)
+    {
+        constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
+        constexpr int r = 47;
+        auto key = static_cast<const uint8_t *>(data);
+        uint64_t h = seed ^ (len * m);
+        const uint8_t *end = key + 8 * (len / 8);
+        while(key != end)
+        {
+            uint64_t k;
+            std::memcpy(&k, key, sizeof(uint64_t));
+            key += 8;
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+        switch(len & 7)
+        {
+        case 7: h ^= uint64_t(key[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(key[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(key[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(key[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(key[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(key[1]) << 8;  [[fallthrough]];
+        case 1: h ^= uint64_t(key[0]);
+                h *= m;
+        default: break;
+        }
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
     inline u64 murmur_hash64A(ptr<u8> key, u64 len, u64 seed)
     {
         constexpr uint64_t m = 0xc6a4a7935bd1e995ull;
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+
 #include <btrc/utils/low_discrepancy.h>
 #include <btrc/utils/prime.h>
 
@@ -43,6 +48,137 @@ namespace
         return i32((i + p) % l);
     }
 
+    // same as permutation_element
+    uint32_t permutation_element_host(uint32_t i, uint32_t l, uint32_t p)
+    {
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do
+        {
+            i ^= p;
+            i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1u | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while(i >= l);
+        return (i + p) % l;
+    }
+
+    struct DigitPermutations
+    {
+        // permutation of digit d of base index i starts at offsets[i] + d * base
+        std::array<uint32_t, DIGIT_PERMUTATION_DIMENSIONS> offsets = {};
+        std::array<uint32_t, DIGIT_PERMUTATION_DIMENSIONS> digit_counts = {};
+        std::vector<uint32_t> permutations;
+    };
+
+    DigitPermutations compute_digit_permutations()
+    {
+        DigitPermutations result;
+        for(int i = 0; i < DIGIT_PERMUTATION_DIMENSIONS; ++i)
+        {
+            const uint32_t base = static_cast<uint32_t>(PRIME_TABLE[i]);
+            const uint64_t seed = mix_bits_host(1u + (static_cast<uint64_t>(i) << 4));
+
+            // enough digits to reach float precision
+            const float inv_base = 1.0f / static_cast<float>(base);
+            float inv_base_m = 1;
+            uint32_t digit_count = 0;
+            while(1.0f - inv_base_m < 1)
+            {
+                inv_base_m *= inv_base;
+                ++digit_count;
+            }
+
+            result.offsets[i] = static_cast<uint32_t>(result.permutations.size());
+            result.digit_counts[i] = digit_count;
+            for(uint32_t d = 0; d < digit_count; ++d)
+            {
+                const uint32_t digit_seed = static_cast<uint32_t>(mix_bits_host(seed ^ (static_cast<uint64_t>(d) << 32)));
+                for(uint32_t v = 0; v < base; ++v)
+                    result.permutations.push_back(permutation_element_host(v, base, digit_seed));
+            }
+        }
+        return result;
+    }
+
+    const DigitPermutations &get_digit_permutations()
+    {
+        static const auto result = compute_digit_permutations();
+        return result;
+    }
+
+    // generator matrices of the first two sobol dimensions. column i maps bit i of
+    // the index to the output, whose highest bit has the largest weight
+    std::array<uint32_t, 2 * SOBOL_MATRIX_SIZE> compute_sobol_matrices()
+    {
+        std::array<uint32_t, 2 * SOBOL_MATRIX_SIZE> result = {};
+
+        // van der corput
+        for(int i = 0; i < 32; ++i)
+            result[i] = 1u << (31 - i);
+
+        // primitive polynomial x + 1: m_k = 2 * m_{k-1} xor m_{k-1}, m_1 = 1
+        uint64_t m = 1;
+        for(int k = 1; k <= SOBOL_MATRIX_SIZE; ++k)
+        {
+            if(k > 1)
+                m = (m << 1) ^ m;
+            result[SOBOL_MATRIX_SIZE + k - 1] =
+                static_cast<uint32_t>(k <= 32 ? m << (32 - k) : m >> (k - 32));
+        }
+        return result;
+    }
+
+    u32 reverse_bits32(u32 v)
+    {
+        v = (v << 16) | (v >> 16);
+        v = ((v & 0x00ff00ffu) << 8) | ((v & 0xff00ff00u) >> 8);
+        v = ((v & 0x0f0f0f0fu) << 4) | ((v & 0xf0f0f0f0u) >> 4);
+        v = ((v & 0x33333333u) << 2) | ((v & 0xccccccccu) >> 2);
+        v = ((v & 0x55555555u) << 1) | ((v & 0xaaaaaaaau) >> 1);
+        return v;
+    }
+
+    u32 fast_owen_scramble(u32 v, u32 seed)
+    {
+        v = reverse_bits32(v);
+        v = v ^ (v * 0x3d20adeau);
+        v = v + seed;
+        v = v * ((seed >> 16) | 1u);
+        v = v ^ (v * 0x05526c56u);
+        v = v ^ (v * 0x53a22864u);
+        return reverse_bits32(v);
+    }
+
+    u64 left_shift2(u64 x)
+    {
+        x = x & 0xffffffffull;
+        x = (x ^ (x << 16)) & 0x0000ffff0000ffffull;
+        x = (x ^ (x << 8))  & 0x00ff00ff00ff00ffull;
+        x = (x ^ (x << 4))  & 0x0f0f0f0f0f0f0f0full;
+        x = (x ^ (x << 2))  & 0x3333333333333333ull;
+        x = (x ^ (x << 1))  & 0x5555555555555555ull;
+        return x;
+    }
+
 } // namespace anonymous
 
 u64 mix_bits(u64 v)
@@ -98,6 +234,106 @@ f32 owen_scrambled_radical_inverse(i32 base_index, u64 a, u64 hash)
     return cstd::min(inv_base_m * f32(reversed_digits), 0x1.fffffep-1f);
 }
 
+f32 digit_permuted_radical_inverse(i32 base_index, u64 a)
+{
+    auto &tables = get_digit_permutations();
+    var prims = cuj::const_data(std::span<const int>(PRIME_TABLE));
+    var offsets = cuj::const_data(std::span<const uint32_t>(tables.offsets));
+    var digit_counts = cuj::const_data(std::span<const uint32_t>(tables.digit_counts));
+    var permutations = cuj::const_data(std::span<const uint32_t>(tables.permutations));
+
+    var base = u64(prims[base_index]);
+    var inv_base = 1.0f / f32(base), inv_base_m = 1.0f;
+    var permutation = offsets[base_index];
+    u64 reversed_digits = 0;
+    $forrange(i, 0, i32(digit_counts[base_index]))
+    {
+        (void)i;
+        var next = a / base;
+        var digit_value = a - next * base;
+        reversed_digits = reversed_digits * base + u64(permutations[permutation + u32(digit_value)]);
+        inv_base_m = inv_base_m * inv_base;
+        permutation = permutation + u32(base);
+        a = next;
+    };
+    return cstd::min(inv_base_m * f32(reversed_digits), 0x1.fffffep-1f);
+}
+
+uint64_t mix_bits_host(uint64_t v)
+{
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44d;
+    v ^= v >> 33;
+    return v;
+}
+
+float owen_scrambled_radical_inverse_host(int base_index, uint64_t a, uint64_t hash)
+{
+    const uint64_t base = static_cast<uint64_t>(PRIME_TABLE[base_index]);
+    const float inv_base = 1.0f / static_cast<float>(base);
+    float inv_base_m = 1;
+    uint64_t reversed_digits = 0;
+    while(1.0f - inv_base_m < 1)
+    {
+        const uint64_t next = a / base;
+        const uint64_t digit_hash = mix_bits_host(hash ^ reversed_digits);
+        const uint32_t digit_value = permutation_element_host(
+            static_cast<uint32_t>(a - next * base), static_cast<uint32_t>(base), static_cast<uint32_t>(digit_hash));
+        reversed_digits = reversed_digits * base + digit_value;
+        inv_base_m *= inv_base;
+        a = next;
+    }
+    return (std::min)(inv_base_m * static_cast<float>(reversed_digits), 0x1.fffffep-1f);
+}
+
+float digit_permuted_radical_inverse_host(int base_index, uint64_t a)
+{
+    assert(base_index < DIGIT_PERMUTATION_DIMENSIONS);
+    auto &tables = get_digit_permutations();
+    const uint64_t base = static_cast<uint64_t>(PRIME_TABLE[base_index]);
+    const float inv_base = 1.0f / static_cast<float>(base);
+    float inv_base_m = 1;
+    const uint32_t *permutation = &tables.permutations[tables.offsets[base_index]];
+    uint64_t reversed_digits = 0;
+    for(uint32_t i = 0; i < tables.digit_counts[base_index]; ++i)
+    {
+        const uint64_t next = a / base;
+        reversed_digits = reversed_digits * base + permutation[a - next * base];
+        inv_base_m *= inv_base;
+        permutation += base;
+        a = next;
+    }
+    return (std::min)(inv_base_m * static_cast<float>(reversed_digits), 0x1.fffffep-1f);
+}
+
+u64 encode_morton2(u32 x, u32 y)
+{
+    return (left_shift2(u64(y)) << 1) | left_shift2(u64(x));
+}
+
+f32 sobol_sample(u64 a, int dimension, u32 seed)
+{
+    assert(dimension == 0 || dimension == 1);
+    static const auto matrices = compute_sobol_matrices();
+    var matrix = cuj::const_data(std::span<const uint32_t>(
+        matrices.data() + dimension * SOBOL_MATRIX_SIZE, SOBOL_MATRIX_SIZE));
+    u32 v = 0;
+    var i = 0;
+    $while(a != 0)
+    {
+        $if((a & 1) != 0)
+        {
+            v = v ^ matrix[i];
+        };
+        a = a >> 1;
+        i = i + 1;
+    };
+    v = fast_owen_scramble(v, seed);
+    return cstd::min(f32(v) * 0x1p-32f, 0x1.fffffep-1f);
+}
+
 u64 inverse_radical_inverse(u64 inverse, i32 base, i32 digits)
 {
     u64 index = 0;
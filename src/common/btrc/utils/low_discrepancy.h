@@ -12,4 +12,26 @@ u64 inverse_radical_inverse(u64 inverse, i32 base, i32 digits);
 
 f32 owen_scrambled_radical_inverse(i32 base_index, u64 a, u64 hash);
 
+// radical inverse with a precomputed random permutation for each digit (random-digit-permutation halton).
+// tables exist for base indices less than DIGIT_PERMUTATION_DIMENSIONS, and the permutations of
+// base index i are seeded by mix_bits(1 + (i << 4))
+constexpr int DIGIT_PERMUTATION_DIMENSIONS = 32;
+
+f32 digit_permuted_radical_inverse(i32 base_index, u64 a);
+
+// host versions of mix_bits and the randomized radical inverses, for tests and benchmarks
+uint64_t mix_bits_host(uint64_t v);
+
+float owen_scrambled_radical_inverse_host(int base_index, uint64_t a, uint64_t hash);
+
+float digit_permuted_radical_inverse_host(int base_index, uint64_t a);
+
+u64 encode_morton2(u32 x, u32 y);
+
+// sobol sample in one of the first two dimensions, with hashed owen scrambling.
+// a must be less than 2^SOBOL_MATRIX_SIZE
+constexpr int SOBOL_MATRIX_SIZE = 52;
+
+f32 sobol_sample(u64 a, int dimension, u32 seed);
+
 BTRC_END
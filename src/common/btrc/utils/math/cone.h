@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#include <btrc/utils/math/scalar.h>
+#include <btrc/utils/math/vec3.h>
+
+BTRC_BEGIN
+
+// set of directions within an angle around axis
+struct DirectionCone
+{
+    Vec3f axis = Vec3f(0, 0, 1);
+    float cos_theta = -1;
+
+    DirectionCone() = default;
+
+    DirectionCone(const Vec3f &axis, float cos_theta);
+
+    static DirectionCone entire_sphere();
+};
+
+DirectionCone union_cone(const DirectionCone &a, const DirectionCone &b);
+
+// ========================== impl ==========================
+
+inline DirectionCone::DirectionCone(const Vec3f &axis, float cos_theta)
+    : axis(axis), cos_theta(cos_theta)
+{
+    
+}
+
+inline DirectionCone DirectionCone::entire_sphere()
+{
+    return DirectionCone(Vec3f(0, 0, 1), -1);
+}
+
+inline DirectionCone union_cone(const DirectionCone &a, const DirectionCone &b)
+{
+    auto safe_acos = [](float x) { return std::acos((std::clamp)(x, -1.0f, 1.0f)); };
+
+    const float theta_a = safe_acos(a.cos_theta);
+    const float theta_b = safe_acos(b.cos_theta);
+    const float theta_d = safe_acos(dot(a.axis, b.axis));
+    if((std::min)(theta_d + theta_b, btrc_pi) <= theta_a)
+        return a;
+    if((std::min)(theta_d + theta_a, btrc_pi) <= theta_b)
+        return b;
+
+    const float theta_o = 0.5f * (theta_a + theta_d + theta_b);
+    if(theta_o >= btrc_pi)
+        return DirectionCone::entire_sphere();
+
+    // rotate a.axis towards b.axis
+    const Vec3f rotate_axis = cross(a.axis, b.axis);
+    if(length_square(rotate_axis) <= 0)
+        return DirectionCone::entire_sphere();
+    const float theta_r = theta_o - theta_a;
+    const Vec3f k = normalize(rotate_axis);
+    const Vec3f axis = a.axis * std::cos(theta_r) + cross(k, a.axis) * std::sin(theta_r);
+    return DirectionCone(normalize(axis), std::cos(theta_o));
+}
+
+BTRC_END
@@ -2,6 +2,7 @@
 
 #include <btrc/utils/math/aabb.h>
 #include <btrc/utils/math/alias.h>
+#include <btrc/utils/math/cone.h>
 #include <btrc/utils/math/frame.h>
 #include <btrc/utils/math/hammersley.h>
 #include <btrc/utils/math/mat3.h>
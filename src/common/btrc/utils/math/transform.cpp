@@ -72,6 +72,14 @@ Vec3f Transform3D::apply_to_point(const Vec3f &p) const
         mat.at(2, 0) * p.x + mat.at(2, 1) * p.y + mat.at(2, 2) * p.z + mat.at(2, 3));
 }
 
+Vec3f Transform3D::apply_to_normal(const Vec3f &n) const
+{
+    return Vec3f(
+        inv.at(0, 0) * n.x + inv.at(1, 0) * n.y + inv.at(2, 0) * n.z,
+        inv.at(0, 1) * n.x + inv.at(1, 1) * n.y + inv.at(2, 1) * n.z,
+        inv.at(0, 2) * n.x + inv.at(1, 2) * n.y + inv.at(2, 2) * n.z);
+}
+
 AABB3f Transform3D::apply_to_aabb(const AABB3f &bbox) const
 {
     AABB3f result;
@@ -47,6 +47,8 @@ struct Transform3D
 
     Vec3f apply_to_point(const Vec3f &p) const;
 
+    Vec3f apply_to_normal(const Vec3f &n) const;
+
     AABB3f apply_to_aabb(const AABB3f &bbox) const;
 
     static Transform3D translate(float x, float y, float z);
@@ -0,0 +1,218 @@
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <btrc/utils/exception.h>
+#include <btrc/utils/half.h>
+#include <btrc/utils/scope_guard.h>
+#include <btrc/utils/volume_file.h>
+
+BTRC_BEGIN
+
+size_t get_volume_file_component_size(VolumeFileComponent component)
+{
+    switch(component)
+    {
+    case VolumeFileComponent::F32: return 4;
+    case VolumeFileComponent::F16: return 2;
+    }
+    throw BtrcException("unknown volume file component type");
+}
+
+MappedVolumeFile::MappedVolumeFile(const std::string &filename)
+{
+    BTRC_SCOPE_FAIL{ unmap(); };
+
+#ifdef _WIN32
+    file_handle_ = CreateFileA(
+        filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file_handle_ == INVALID_HANDLE_VALUE)
+    {
+        file_handle_ = nullptr;
+        throw BtrcException("failed to open file: " + filename);
+    }
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file_handle_, &file_size))
+        throw BtrcException("failed to get size of " + filename);
+    mapped_size_ = static_cast<size_t>(file_size.QuadPart);
+    if(mapped_size_ < sizeof(VolumeFileHeader))
+        throw BtrcException("invalid volume file: " + filename);
+    mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mapping_handle_)
+        throw BtrcException("failed to map " + filename);
+    mapped_ = static_cast<const unsigned char *>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+    if(!mapped_)
+        throw BtrcException("failed to map " + filename);
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw BtrcException("failed to open file: " + filename);
+    BTRC_SCOPE_EXIT{ close(fd); };
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        throw BtrcException("failed to get size of " + filename);
+    if(static_cast<size_t>(st.st_size) < sizeof(VolumeFileHeader))
+        throw BtrcException("invalid volume file: " + filename);
+    void *mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mapped == MAP_FAILED)
+        throw BtrcException("failed to map " + filename);
+    mapped_ = static_cast<const unsigned char *>(mapped);
+    mapped_size_ = static_cast<size_t>(st.st_size);
+    madvise(mapped, mapped_size_, MADV_SEQUENTIAL);
+#endif
+
+    std::memcpy(&header_, mapped_, sizeof(VolumeFileHeader));
+    if(std::memcmp(header_.magic, VOLUME_FILE_MAGIC, sizeof(VOLUME_FILE_MAGIC)) != 0)
+        throw BtrcException("invalid volume file: " + filename);
+    if(header_.version != VOLUME_FILE_VERSION)
+        throw BtrcException("unsupported volume file version: " + std::to_string(header_.version));
+    if(header_.channels != 1 && header_.channels != 2 && header_.channels != 4)
+        throw BtrcException("unsupported channel count: " + std::to_string(header_.channels));
+    if(header_.width <= 0 || header_.height <= 0 || header_.depth <= 0)
+        throw BtrcException("invalid volume resolution in " + filename);
+    if(header_.data_offset % VOLUME_FILE_DATA_ALIGNMENT != 0 ||
+       header_.data_offset + get_data_size() > mapped_size_)
+        throw BtrcException("truncated volume file: " + filename);
+}
+
+MappedVolumeFile::~MappedVolumeFile()
+{
+    unmap();
+}
+
+const VolumeFileHeader &MappedVolumeFile::get_header() const
+{
+    return header_;
+}
+
+const void *MappedVolumeFile::get_data() const
+{
+    return mapped_ + header_.data_offset;
+}
+
+size_t MappedVolumeFile::get_data_size() const
+{
+    return static_cast<size_t>(header_.width) * header_.height * header_.depth
+         * header_.channels * get_volume_file_component_size(header_.component);
+}
+
+std::vector<float> MappedVolumeFile::to_float() const
+{
+    const size_t count = static_cast<size_t>(header_.width) * header_.height * header_.depth * header_.channels;
+    std::vector<float> result(count);
+    if(header_.component == VolumeFileComponent::F32)
+        std::memcpy(result.data(), get_data(), count * sizeof(float));
+    else
+    {
+        auto src = static_cast<const uint16_t *>(get_data());
+        for(size_t i = 0; i < count; ++i)
+            result[i] = half_to_float(src[i]);
+    }
+    return result;
+}
+
+void MappedVolumeFile::unmap()
+{
+#ifdef _WIN32
+    if(mapped_)
+        UnmapViewOfFile(mapped_);
+    if(mapping_handle_)
+        CloseHandle(mapping_handle_);
+    if(file_handle_)
+        CloseHandle(file_handle_);
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+#else
+    if(mapped_)
+        munmap(const_cast<unsigned char *>(mapped_), mapped_size_);
+#endif
+    mapped_ = nullptr;
+    mapped_size_ = 0;
+}
+
+void save_volume_file(
+    const std::string  &filename,
+    int                 width,
+    int                 height,
+    int                 depth,
+    int                 channels,
+    VolumeFileComponent component,
+    const float        *data)
+{
+    if(channels != 1 && channels != 2 && channels != 4)
+        throw BtrcException("unsupported channel count: " + std::to_string(channels));
+    if(width <= 0 || height <= 0 || depth <= 0)
+        throw BtrcException("invalid volume resolution");
+
+    std::ofstream fout(filename, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if(!fout)
+        throw BtrcException("failed to create file: " + filename);
+
+    VolumeFileHeader header = {};
+    std::memcpy(header.magic, VOLUME_FILE_MAGIC, sizeof(VOLUME_FILE_MAGIC));
+    header.version = VOLUME_FILE_VERSION;
+    header.component = component;
+    header.channels = static_cast<uint32_t>(channels);
+    header.width = width;
+    header.height = height;
+    header.depth = depth;
+    header.data_offset =
+        (sizeof(VolumeFileHeader) + VOLUME_FILE_DATA_ALIGNMENT - 1) / VOLUME_FILE_DATA_ALIGNMENT * VOLUME_FILE_DATA_ALIGNMENT;
+
+    fout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    const std::vector<char> padding(header.data_offset - sizeof(header), 0);
+    fout.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+
+    const size_t count = static_cast<size_t>(width) * height * depth * channels;
+    if(component == VolumeFileComponent::F32)
+        fout.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(count * sizeof(float)));
+    else
+    {
+        std::vector<uint16_t> halfs(count);
+        for(size_t i = 0; i < count; ++i)
+            halfs[i] = float_to_half(data[i]);
+        fout.write(reinterpret_cast<const char *>(halfs.data()), static_cast<std::streamsize>(count * sizeof(uint16_t)));
+    }
+
+    if(!fout)
+        throw BtrcException("failed to write " + filename);
+}
+
+std::vector<float> load_text_volume(
+    const std::string &filename, int &width, int &height, int &depth, int &channels)
+{
+    std::ifstream fin(filename, std::ifstream::in);
+    if(!fin)
+        throw BtrcException("failed to open file: " + filename);
+
+    std::string component;
+    fin >> component;
+    fin >> channels >> width >> height >> depth;
+    if(!fin)
+        throw BtrcException("load_text_volume: failed to parse file head");
+
+    if(component != "float")
+        throw BtrcException("load_text_volume: unsupported component type: " + component);
+    if(channels != 1 && channels != 3 && channels != 4)
+        throw BtrcException("unsupported channel count: " + std::to_string(channels));
+    if(width <= 0 || height <= 0 || depth <= 0)
+        throw BtrcException("load_text_volume: invalid resolution");
+
+    std::vector<float> data(static_cast<size_t>(width) * height * depth * channels);
+    for(auto &comp : data)
+        fin >> comp;
+    if(!fin)
+        throw BtrcException("failed to load " + filename);
+    return data;
+}
+
+BTRC_END
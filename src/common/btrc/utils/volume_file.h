@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <btrc/utils/uncopyable.h>
+
+BTRC_BEGIN
+
+// binary dense volume file:
+//     header (VolumeFileHeader)
+//     padding to header.data_offset (multiple of VOLUME_FILE_DATA_ALIGNMENT)
+//     texels in z-major, then y, then x order, with 'channels' components per texel
+//
+// channels is 1, 2 or 4 so that the data can be uploaded to a cuda array without repacking
+
+enum class VolumeFileComponent : uint32_t
+{
+    F32 = 0,
+    F16 = 1
+};
+
+struct VolumeFileHeader
+{
+    char                magic[8];
+    uint32_t            version;
+    VolumeFileComponent component;
+    uint32_t            channels;
+    int32_t             width;
+    int32_t             height;
+    int32_t             depth;
+    uint64_t            data_offset;
+};
+
+constexpr char     VOLUME_FILE_MAGIC[8] = { 'B', 'T', 'R', 'C', 'V', 'O', 'L', '\0' };
+constexpr uint32_t VOLUME_FILE_VERSION = 1;
+constexpr size_t   VOLUME_FILE_DATA_ALIGNMENT = 64;
+
+size_t get_volume_file_component_size(VolumeFileComponent component);
+
+// read-only memory mapping of a volume file
+class MappedVolumeFile : public Uncopyable
+{
+public:
+
+    explicit MappedVolumeFile(const std::string &filename);
+
+    ~MappedVolumeFile();
+
+    const VolumeFileHeader &get_header() const;
+
+    const void *get_data() const;
+
+    size_t get_data_size() const;
+
+    // components converted to float
+    std::vector<float> to_float() const;
+
+private:
+
+    void unmap();
+
+    VolumeFileHeader header_ = {};
+
+    const unsigned char *mapped_ = nullptr;
+    size_t               mapped_size_ = 0;
+
+#ifdef _WIN32
+    void *file_handle_ = nullptr;
+    void *mapping_handle_ = nullptr;
+#endif
+};
+
+// data has 'channels' floats per texel
+void save_volume_file(
+    const std::string  &filename,
+    int                 width,
+    int                 height,
+    int                 depth,
+    int                 channels,
+    VolumeFileComponent component,
+    const float        *data);
+
+// reads the text format accepted by cuda::Array::load_from_text on the host.
+// only float components are supported
+std::vector<float> load_text_volume(
+    const std::string &filename, int &width, int &height, int &depth, int &channels);
+
+BTRC_END
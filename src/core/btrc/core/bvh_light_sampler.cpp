@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <cmath>
+
+#include <btrc/core/bvh_light_sampler.h>
+
+BTRC_BEGIN
+
+namespace
+{
+
+    constexpr uint64_t NO_TRAIL = (std::numeric_limits<uint64_t>::max)();
+
+    // sah splitting is replaced by median splitting below this depth,
+    // which keeps trails within 64 bits
+    constexpr int MAX_SAH_DEPTH = 32;
+
+    constexpr int BUCKET_COUNT = 12;
+
+    constexpr float ONE_MINUS_EPS = 0x1.fffffep-1f;
+
+    AreaLightBounds union_bounds(const AreaLightBounds &a, const AreaLightBounds &b)
+    {
+        AreaLightBounds result;
+        result.bbox = union_aabb(a.bbox, b.bbox);
+        result.normal = union_cone(a.normal, b.normal);
+        result.cos_theta_e = (std::min)(a.cos_theta_e, b.cos_theta_e);
+        result.power = a.power + b.power;
+        return result;
+    }
+
+    float surface_area(const AABB3f &bbox)
+    {
+        const Vec3f d = bbox.upper - bbox.lower;
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // surface area orientation heuristic
+    float cost(const AreaLightBounds &bounds)
+    {
+        auto safe_acos = [](float x) { return std::acos((std::clamp)(x, -1.0f, 1.0f)); };
+        const float cos_theta_o = bounds.normal.cos_theta;
+        const float theta_o = safe_acos(cos_theta_o);
+        const float theta_e = safe_acos(bounds.cos_theta_e);
+        const float theta_w = (std::min)(theta_o + theta_e, btrc_pi);
+        const float sin_theta_o = std::sqrt((std::max)(0.0f, 1 - cos_theta_o * cos_theta_o));
+        const float m_omega = 2 * btrc_pi * (1 - cos_theta_o) + 0.5f * btrc_pi * (
+            2 * theta_w * sin_theta_o - std::cos(theta_o - 2 * theta_w) - 2 * theta_o * sin_theta_o + cos_theta_o);
+        return bounds.power * m_omega * surface_area(bounds.bbox);
+    }
+
+    // cos(max(0, a - b)) and sin(max(0, a - b))
+
+    f32 cos_sub_clamped(f32 sin_a, f32 cos_a, f32 sin_b, f32 cos_b)
+    {
+        return cstd::select(cos_a > cos_b, f32(1), cos_a * cos_b + sin_a * sin_b);
+    }
+
+    f32 sin_sub_clamped(f32 sin_a, f32 cos_a, f32 sin_b, f32 cos_b)
+    {
+        return cstd::select(cos_a > cos_b, f32(0), sin_a * cos_b - cos_a * sin_b);
+    }
+
+    f32 sin_from_cos(f32 cos_theta)
+    {
+        return cstd::sqrt(cstd::max(f32(0), 1.0f - cos_theta * cos_theta));
+    }
+
+    // conservative estimation of the contribution of lights in node to p
+    f32 importance(ref<bvh_light_sampler_detail::CNode> node, ref<CVec3f> p)
+    {
+        var center = 0.5f * (node.lower + node.upper);
+        var center_to_p = p - center;
+        var dist2 = length_square(center_to_p);
+        var radius2 = length_square(node.upper - center);
+        var clamped_dist2 = cstd::max(dist2, cstd::sqrt(radius2));
+
+        // directions from the bounding sphere to p
+        var cos_theta_b = cstd::select(
+            dist2 < radius2, f32(-1), cstd::sqrt(cstd::max(f32(0), 1.0f - radius2 / dist2)));
+        var sin_theta_b = sin_from_cos(cos_theta_b);
+
+        var cos_theta_w = cstd::select(
+            dist2 > 0, dot(node.axis, center_to_p) / cstd::sqrt(dist2), f32(0));
+        var sin_theta_w = sin_from_cos(cos_theta_w);
+
+        var cos_theta_o = node.cos_theta_o;
+        var sin_theta_o = sin_from_cos(cos_theta_o);
+
+        var cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        var sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        var cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+
+        return cstd::select(
+            cos_theta_p <= node.cos_theta_e, f32(0), node.power * cos_theta_p / clamped_dist2);
+    }
+
+    // remap u in [0, 1) after choosing between [0, p) and [p, 1)
+    boolean choose_first(f32 &u, f32 p)
+    {
+        boolean result;
+        $if(u < p)
+        {
+            u = cstd::min(u / p, ONE_MINUS_EPS);
+            result = true;
+        }
+        $else
+        {
+            u = cstd::min((u - p) / (1.0f - p), ONE_MINUS_EPS);
+            result = false;
+        };
+        return result;
+    }
+
+} // namespace anonymous
+
+struct BVHLightSampler::BuildLight
+{
+    AreaLightBounds bounds;
+    Vec3f           centroid;
+    int             light_index;
+};
+
+void BVHLightSampler::clear()
+{
+    lights_ = {};
+    envir_light_index_ = -1;
+    envir_light_ = {};
+    envir_light_prob_ = 0;
+    host_nodes_ = {};
+    nodes_ = {};
+    trails_ = {};
+    emit_table_ = {};
+    emit_pdfs_ = {};
+}
+
+void BVHLightSampler::add_light(RC<Light> light)
+{
+    if(!light->is_area())
+    {
+        assert(!envir_light_);
+        envir_light_ = std::dynamic_pointer_cast<EnvirLight>(light);
+        envir_light_index_ = static_cast<int>(lights_.size());
+    }
+    lights_.push_back(std::move(light));
+}
+
+void BVHLightSampler::commit(const AABB3f &scene_bbox)
+{
+    host_nodes_ = {};
+    nodes_ = {};
+    trails_ = {};
+    emit_table_ = {};
+    emit_pdfs_ = {};
+    if(lights_.empty())
+        return;
+
+    // lights emitting nothing are never selected
+
+    std::vector<BuildLight> build_lights;
+    float total_power = 0;
+    for(size_t i = 0; i < lights_.size(); ++i)
+    {
+        if(auto area = lights_[i]->as_area())
+        {
+            auto bounds = area->get_bounds();
+            if(bounds.power > 0)
+            {
+                const Vec3f centroid = 0.5f * (bounds.bbox.lower + bounds.bbox.upper);
+                build_lights.push_back({ bounds, centroid, static_cast<int>(i) });
+                total_power += bounds.power;
+            }
+        }
+    }
+
+    if(!build_lights.empty())
+    {
+        build(build_lights, 0, build_lights.size(), 0);
+        nodes_ = cuda::Buffer<Node>(host_nodes_);
+    }
+
+    if(envir_light_)
+        envir_light_prob_ = host_nodes_.empty() ? 1.0f : 0.5f;
+    else
+        envir_light_prob_ = 0;
+
+    // trails of lights in the bvh
+
+    struct Item
+    {
+        int      node;
+        uint64_t trail;
+        int      depth;
+    };
+    std::vector<uint64_t> trails(lights_.size(), NO_TRAIL);
+    std::vector<Item> items;
+    if(!host_nodes_.empty())
+        items.push_back({ 0, 0, 0 });
+    while(!items.empty())
+    {
+        const Item item = items.back();
+        items.pop_back();
+        auto &node = host_nodes_[item.node];
+        if(node.is_leaf)
+        {
+            trails[node.child_or_light] = item.trail;
+            continue;
+        }
+        assert(item.depth < 64);
+        items.push_back({ item.node + 1, item.trail, item.depth + 1 });
+        items.push_back({ node.child_or_light, item.trail | (uint64_t(1) << item.depth), item.depth + 1 });
+    }
+    trails_ = cuda::Buffer<uint64_t>(trails);
+
+    // emission
+
+    std::vector<float> emit_pdfs(lights_.size(), 0.0f);
+    if(envir_light_)
+        emit_pdfs[envir_light_index_] = envir_light_prob_;
+    for(auto &light : build_lights)
+        emit_pdfs[light.light_index] = (1 - envir_light_prob_) * light.bounds.power / total_power;
+    if(!envir_light_ && build_lights.empty())
+    {
+        // nothing emits. keep emission sampling valid
+        std::fill(emit_pdfs.begin(), emit_pdfs.end(), 1.0f / static_cast<float>(lights_.size()));
+    }
+    emit_table_ = CAliasTable(AliasTable(emit_pdfs));
+    emit_pdfs_ = cuda::Buffer<float>(emit_pdfs);
+}
+
+BVHLightSampler::SampleResult BVHLightSampler::sample(const CVec3f &ref, f32 sam) const
+{
+    SampleResult result;
+    result.light_idx = -1;
+    result.pdf = 0;
+    if(lights_.empty())
+        return result;
+
+    auto select_area_light = [&](f32 u)
+    {
+        var nodes = cuj::import_pointer(nodes_.get());
+        const float bvh_prob = 1 - envir_light_prob_;
+        if(host_nodes_.size() == 1)
+        {
+            $if(importance(nodes[0], ref) > 0)
+            {
+                result.light_idx = nodes[0].child_or_light;
+                result.pdf = bvh_prob;
+            };
+            return;
+        }
+
+        var node_idx = i32(0);
+        var pdf = f32(bvh_prob);
+        $loop
+        {
+            $if(nodes[node_idx].is_leaf != 0)
+            {
+                result.light_idx = nodes[node_idx].child_or_light;
+                result.pdf = pdf;
+                $break;
+            };
+            var second = nodes[node_idx].child_or_light;
+            var importance0 = importance(nodes[node_idx + 1], ref);
+            var importance1 = importance(nodes[second], ref);
+            var total = importance0 + importance1;
+            $if(total <= 0)
+            {
+                $break;
+            };
+            var p0 = importance0 / total;
+            $if(choose_first(u, p0))
+            {
+                pdf = pdf * p0;
+                node_idx = node_idx + 1;
+            }
+            $else
+            {
+                pdf = pdf * (1.0f - p0);
+                node_idx = second;
+            };
+        };
+    };
+
+    if(envir_light_ && !host_nodes_.empty())
+    {
+        var u = sam;
+        $if(choose_first(u, f32(envir_light_prob_)))
+        {
+            result.light_idx = envir_light_index_;
+            result.pdf = envir_light_prob_;
+        }
+        $else
+        {
+            select_area_light(u);
+        };
+    }
+    else if(envir_light_)
+    {
+        result.light_idx = envir_light_index_;
+        result.pdf = 1;
+    }
+    else if(!host_nodes_.empty())
+        select_area_light(sam);
+
+    return result;
+}
+
+f32 BVHLightSampler::pdf(const CVec3f &ref, i32 light_index) const
+{
+    var result = f32(0);
+    if(lights_.empty())
+        return result;
+
+    if(envir_light_)
+    {
+        $if(light_index == envir_light_index_)
+        {
+            result = envir_light_prob_;
+        };
+    }
+
+    if(host_nodes_.empty())
+        return result;
+
+    var nodes = cuj::import_pointer(nodes_.get());
+    var trail = cuj::import_pointer(trails_.get())[light_index];
+    const float bvh_prob = 1 - envir_light_prob_;
+    $if(trail != u64(NO_TRAIL))
+    {
+        if(host_nodes_.size() == 1)
+        {
+            result = cstd::select(importance(nodes[0], ref) > 0, f32(bvh_prob), f32(0));
+        }
+        else
+        {
+            var node_idx = i32(0);
+            var pdf = f32(bvh_prob);
+            $while(nodes[node_idx].is_leaf == 0)
+            {
+                var second = nodes[node_idx].child_or_light;
+                var importance0 = importance(nodes[node_idx + 1], ref);
+                var importance1 = importance(nodes[second], ref);
+                var total = importance0 + importance1;
+                $if(total <= 0)
+                {
+                    pdf = 0;
+                    $break;
+                };
+                $if((trail & u64(1)) != u64(0))
+                {
+                    pdf = pdf * importance1 / total;
+                    node_idx = second;
+                }
+                $else
+                {
+                    pdf = pdf * importance0 / total;
+                    node_idx = node_idx + 1;
+                };
+                trail = trail >> u64(1);
+            };
+            result = pdf;
+        }
+    };
+
+    return result;
+}
+
+LightSampler::SampleEmitResult BVHLightSampler::sample_emit(f32 sam) const
+{
+    SampleEmitResult result;
+    if(lights_.empty())
+    {
+        result.light_idx = -1;
+        result.pdf = 0;
+        return result;
+    }
+    var idx = i32(emit_table_.sample(sam));
+    result.light_idx = idx;
+    result.pdf = cuj::import_pointer(emit_pdfs_.get())[idx];
+    return result;
+}
+
+f32 BVHLightSampler::pdf_emit(i32 light_index) const
+{
+    if(lights_.empty())
+        return 0;
+    return cuj::import_pointer(emit_pdfs_.get())[light_index];
+}
+
+int BVHLightSampler::get_light_count() const
+{
+    return static_cast<int>(lights_.size());
+}
+
+RC<const Light> BVHLightSampler::get_light(int index) const
+{
+    return lights_[index];
+}
+
+RC<const EnvirLight> BVHLightSampler::get_envir_light() const
+{
+    return envir_light_;
+}
+
+int BVHLightSampler::get_envir_light_index() const
+{
+    return envir_light_index_;
+}
+
+int BVHLightSampler::build(std::vector<BuildLight> &lights, size_t begin, size_t end, int depth)
+{
+    const int node_index = static_cast<int>(host_nodes_.size());
+    host_nodes_.push_back({});
+
+    auto make_node = [&](const AreaLightBounds &bounds, int child_or_light, bool is_leaf)
+    {
+        Node &node = host_nodes_[node_index];
+        node.lower = bounds.bbox.lower;
+        node.power = bounds.power;
+        node.upper = bounds.bbox.upper;
+        node.cos_theta_o = bounds.normal.cos_theta;
+        node.axis = bounds.normal.axis;
+        node.cos_theta_e = bounds.cos_theta_e;
+        node.child_or_light = child_or_light;
+        node.is_leaf = is_leaf ? 1 : 0;
+    };
+
+    if(end - begin == 1)
+    {
+        make_node(lights[begin].bounds, lights[begin].light_index, true);
+        return node_index;
+    }
+
+    AreaLightBounds bounds = lights[begin].bounds;
+    AABB3f centroid_bbox;
+    for(size_t i = begin; i < end; ++i)
+    {
+        if(i != begin)
+            bounds = union_bounds(bounds, lights[i].bounds);
+        centroid_bbox = union_aabb(centroid_bbox, lights[i].centroid);
+    }
+
+    const Vec3f extent = bounds.bbox.upper - bounds.bbox.lower;
+    const Vec3f centroid_extent = centroid_bbox.upper - centroid_bbox.lower;
+    const float max_extent = (std::max)({ extent.x, extent.y, extent.z });
+
+    auto get_bucket = [&](const BuildLight &light, int axis)
+    {
+        const float t = (light.centroid[axis] - centroid_bbox.lower[axis]) / centroid_extent[axis];
+        return (std::clamp)(static_cast<int>(BUCKET_COUNT * t), 0, BUCKET_COUNT - 1);
+    };
+
+    int best_axis = -1, best_split = 0;
+    float best_cost = (std::numeric_limits<float>::max)();
+    if(depth < MAX_SAH_DEPTH)
+    {
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            if(centroid_extent[axis] <= 0)
+                continue;
+
+            AreaLightBounds bucket_bounds[BUCKET_COUNT];
+            bool bucket_used[BUCKET_COUNT] = {};
+            for(size_t i = begin; i < end; ++i)
+            {
+                const int b = get_bucket(lights[i], axis);
+                bucket_bounds[b] = bucket_used[b] ? union_bounds(bucket_bounds[b], lights[i].bounds) : lights[i].bounds;
+                bucket_used[b] = true;
+            }
+
+            // lights in buckets [0, split) go to the first child
+            for(int split = 1; split < BUCKET_COUNT; ++split)
+            {
+                AreaLightBounds below, above;
+                bool has_below = false, has_above = false;
+                for(int b = 0; b < BUCKET_COUNT; ++b)
+                {
+                    if(!bucket_used[b])
+                        continue;
+                    auto &side = b < split ? below : above;
+                    auto &has_side = b < split ? has_below : has_above;
+                    side = has_side ? union_bounds(side, bucket_bounds[b]) : bucket_bounds[b];
+                    has_side = true;
+                }
+                if(!has_below || !has_above)
+                    continue;
+
+                const float kr = max_extent / extent[axis];
+                const float split_cost = kr * (cost(below) + cost(above));
+                if(split_cost < best_cost)
+                {
+                    best_cost = split_cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+    }
+
+    size_t mid;
+    if(best_axis >= 0)
+    {
+        auto it = std::partition(
+            lights.begin() + begin, lights.begin() + end,
+            [&](const BuildLight &light) { return get_bucket(light, best_axis) < best_split; });
+        mid = static_cast<size_t>(it - lights.begin());
+    }
+    else
+    {
+        int axis = 0;
+        if(centroid_extent.y > centroid_extent[axis])
+            axis = 1;
+        if(centroid_extent.z > centroid_extent[axis])
+            axis = 2;
+        mid = (begin + end) / 2;
+        std::nth_element(
+            lights.begin() + begin, lights.begin() + mid, lights.begin() + end,
+            [&](const BuildLight &a, const BuildLight &b) { return a.centroid[axis] < b.centroid[axis]; });
+    }
+
+    build(lights, begin, mid, depth + 1);
+    const int second = build(lights, mid, end, depth + 1);
+    make_node(bounds, second, false);
+    return node_index;
+}
+
+BTRC_END
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <btrc/core/light_sampler.h>
+#include <btrc/utils/cmath/calias.h>
+#include <btrc/utils/cuda/buffer.h>
+
+BTRC_BEGIN
+
+namespace bvh_light_sampler_detail
+{
+
+    // the first child of an interior node directly follows it
+    struct Node
+    {
+        Vec3f   lower;
+        float   power;
+        Vec3f   upper;
+        float   cos_theta_o;
+        Vec3f   axis;
+        float   cos_theta_e;
+        int32_t child_or_light; // second child of interior nodes, or light index of leaves
+        int32_t is_leaf;
+    };
+
+    CUJ_PROXY_CLASS(
+        CNode, Node,
+        lower, power, upper, cos_theta_o, axis, cos_theta_e, child_or_light, is_leaf);
+
+} // namespace bvh_light_sampler_detail
+
+// light bvh (Conty Estevez and Kulla 2018, as in pbrt-v4).
+// area lights are selected by traversing the bvh with probabilities proportional to
+// estimated contributions of child nodes to ref. the environment light is selected with
+// a fixed probability. emission sampling is proportional to light power
+class BVHLightSampler : public LightSampler
+{
+public:
+
+    void clear() override;
+
+    void add_light(RC<Light> light) override;
+
+    void commit(const AABB3f &scene_bbox) override;
+
+    SampleResult sample(const CVec3f &ref, f32 sam) const override;
+
+    f32 pdf(const CVec3f &ref, i32 light_index) const override;
+
+    SampleEmitResult sample_emit(f32 sam) const override;
+
+    f32 pdf_emit(i32 light_index) const override;
+
+    int get_light_count() const override;
+
+    RC<const Light> get_light(int index) const override;
+
+    RC<const EnvirLight> get_envir_light() const override;
+
+    int get_envir_light_index() const override;
+
+private:
+
+    using Node = bvh_light_sampler_detail::Node;
+    using CNode = bvh_light_sampler_detail::CNode;
+
+    struct BuildLight;
+
+    int build(std::vector<BuildLight> &lights, size_t begin, size_t end, int depth);
+
+    std::vector<RC<Light>> lights_;
+
+    int envir_light_index_ = -1;
+    RC<EnvirLight> envir_light_;
+
+    float envir_light_prob_ = 0;
+
+    std::vector<Node>      host_nodes_;
+    cuda::Buffer<Node>     nodes_;
+    cuda::Buffer<uint64_t> trails_; // path from the root to each light. one bit per level
+
+    CAliasTable         emit_table_;
+    cuda::Buffer<float> emit_pdfs_;
+};
+
+BTRC_END
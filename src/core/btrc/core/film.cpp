@@ -31,6 +31,7 @@ void Film::swap(Film &other) noexcept
     std::swap(width_, other.width_);
     std::swap(height_, other.height_);
     buffers_.swap(other.buffers_);
+    half_flag_.swap(other.half_flag_);
 }
 
 Film::operator bool() const
@@ -77,6 +78,22 @@ bool Film::has_output(std::string_view name) const
     return buffers_.contains(name);
 }
 
+void Film::add_half_outputs()
+{
+    assert(!half_flag_);
+    add_output(OUTPUT_RADIANCE_HALF, Float3);
+    add_output(OUTPUT_WEIGHT_HALF, Float);
+    half_flag_.initialize(1);
+    set_half_flag(false);
+}
+
+void Film::set_half_flag(bool flag)
+{
+    assert(half_flag_);
+    const int32_t value = flag ? 1 : 0;
+    half_flag_.from_cpu(&value);
+}
+
 void Film::splat(
     const CVec2u &pixel_coord,
     std::span<std::pair<std::string_view, CValue>> values)
@@ -126,6 +143,14 @@ void Film::splat(
             };
         }
     };
+
+    if(auto half_name = get_half_output_name(name); !half_name.empty())
+    {
+        $if(cuj::import_pointer(half_flag_.get())[0] != 0)
+        {
+            splat(pixel_coord, half_name, value);
+        };
+    }
 }
 
 void Film::splat_atomic(
@@ -162,6 +187,14 @@ void Film::splat_atomic(
             };
         }
     };
+
+    if(auto half_name = get_half_output_name(name); !half_name.empty())
+    {
+        $if(cuj::import_pointer(half_flag_.get())[0] != 0)
+        {
+            splat_atomic(pixel_coord, half_name, value);
+        };
+    }
 }
 
 void Film::clear_output(std::string_view name)
@@ -192,4 +225,15 @@ const cuda::Buffer<float> &Film::get_float3_output(std::string_view name) const
     return it->second.buffer;
 }
 
+std::string_view Film::get_half_output_name(std::string_view name) const
+{
+    if(!half_flag_)
+        return {};
+    if(name == OUTPUT_RADIANCE)
+        return OUTPUT_RADIANCE_HALF;
+    if(name == OUTPUT_WEIGHT)
+        return OUTPUT_WEIGHT_HALF;
+    return {};
+}
+
 BTRC_END
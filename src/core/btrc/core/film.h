@@ -26,6 +26,9 @@ public:
     static constexpr char OUTPUT_NORMAL[]   = "normal";
     static constexpr char OUTPUT_ALBEDO[]   = "albedo";
 
+    static constexpr char OUTPUT_RADIANCE_HALF[] = "radiance_half";
+    static constexpr char OUTPUT_WEIGHT_HALF[]   = "weight_half";
+
     Film();
 
     Film(int width, int height);
@@ -48,6 +51,14 @@ public:
 
     bool has_output(std::string_view name) const;
 
+    // adds radiance_half and weight_half outputs. while the half flag is set, values splatted to
+    // radiance and weight are also accumulated into them, so that samples taken with the flag set
+    // and the rest form two independent estimates
+    void add_half_outputs();
+
+    // takes effect in subsequent kernel launches
+    void set_half_flag(bool flag);
+
     void splat(
         const CVec2u &pixel_coord,
         std::span<std::pair<std::string_view, CValue>> values);
@@ -80,9 +91,14 @@ private:
         cuda::Buffer<float> buffer;
     };
 
+    // returns name of the half output mirroring 'name', or empty
+    std::string_view get_half_output_name(std::string_view name) const;
+
     int width_;
     int height_;
     std::map<std::string, FilmBuffer, std::less<>> buffers_;
+
+    cuda::Buffer<int32_t> half_flag_;
 };
 
 BTRC_END
@@ -10,7 +10,13 @@ class FilmFilter : public Object
 {
 public:
 
-    virtual CVec2f sample(Sampler &sampler) const = 0;
+    struct SampleResult
+    {
+        CVec2f offset; // relative to the pixel center
+        f32    weight; // to be multiplied with the sample radiance. its expectation is 1
+    };
+
+    virtual SampleResult sample(Sampler &sampler) const = 0;
 };
 
 BTRC_END
@@ -43,13 +43,26 @@ public:
 
     virtual AABB3f get_bounding_box() const = 0;
 
+    virtual float get_area() const = 0;
+
+    // bounds geometry normals
+    virtual DirectionCone get_normal_cone() const = 0;
+
     virtual SampleResult sample_inline(ref<Sam3> sam) const = 0;
 
     virtual f32 pdf_inline(ref<CVec3f> pos) const = 0;
 
+    // sample a point visible from dst_pos. all in local space
+
     virtual SampleResult sample_inline(ref<CVec3f> dst_pos, ref<Sam3> sam) const = 0;
 
-    virtual f32 pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos) const = 0;
+    virtual f32 pdf_inline(ref<CVec3f> dst_pos, ref<CVec3f> pos, u32 prim_id) const = 0;
+
+    // in local space, indexed by prim_id
+    virtual const std::vector<float> &get_primitive_areas() const = 0;
+
+    // uniformly on the primitive
+    virtual SampleResult sample_primitive_inline(u32 prim_id, ref<CVec2f> sam) const = 0;
 
     SampleResult sample(CompileContext &cc, ref<Sam3> sam) const
     {
@@ -69,10 +82,16 @@ public:
         return cc.record_object_action(as_shared(), "sample_dst", action, dst_pos, sam);
     }
 
-    f32 pdf(CompileContext &cc, ref<CVec3f> dst_pos, ref<CVec3f> pos) const
+    f32 pdf(CompileContext &cc, ref<CVec3f> dst_pos, ref<CVec3f> pos, u32 prim_id) const
+    {
+        auto action = [this](ref<CVec3f> dst_pos, ref<CVec3f> pos, u32 prim_id) { return pdf_inline(dst_pos, pos, prim_id); };
+        return cc.record_object_action(as_shared(), "pdf_dst", action, dst_pos, pos, prim_id);
+    }
+
+    SampleResult sample_primitive(CompileContext &cc, u32 prim_id, ref<CVec2f> sam) const
     {
-        auto action = [this](ref<CVec3f> dst_pos, ref<CVec3f> pos) { return pdf_inline(dst_pos, pos); };
-        return cc.record_object_action(as_shared(), "pdf_dst", action, dst_pos, pos);
+        auto action = [this](u32 prim_id, ref<CVec2f> sam) { return sample_primitive_inline(prim_id, sam); };
+        return cc.record_object_action(as_shared(), "sample_primitive", action, prim_id, sam);
     }
 };
 
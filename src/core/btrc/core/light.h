@@ -21,6 +21,15 @@ public:
     virtual const EnvirLight *as_envir() const { return nullptr; }
 };
 
+// spatial and directional extent of the emission of an area light
+struct AreaLightBounds
+{
+    AABB3f        bbox;
+    DirectionCone normal;          // of emitting surfaces
+    float         cos_theta_e = 0; // emission spread around each normal
+    float         power = 0;
+};
+
 class AreaLight : public Light
 {
 public:
@@ -51,11 +60,14 @@ public:
 
     virtual void set_geometry(RC<Geometry> geometry, const Transform3D &local_to_world) = 0;
 
+    // in world space
+    virtual AreaLightBounds get_bounds() const = 0;
+
     virtual CSpectrum eval_le_inline(CompileContext &cc, ref<SurfacePoint> spt, ref<CVec3f> wr) const = 0;
 
     virtual SampleLiResult sample_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<Sam3> sam) const = 0;
 
-    virtual f32 pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<CVec3f> pos, ref<CVec3f> nor) const = 0;
+    virtual f32 pdf_li_inline(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const = 0;
 
     virtual SampleEmitResult sample_emit_inline(CompileContext &cc, ref<Sam5> sam) const = 0;
 
@@ -71,9 +83,9 @@ public:
         return record(cc, &AreaLight::sample_li_inline, "sample_li", ref_pos, sam);
     }
 
-    f32 pdf_li(CompileContext &cc, ref<CVec3f> ref_pos, ref<CVec3f> pos, ref<CVec3f> nor) const
+    f32 pdf_li(CompileContext &cc, ref<CVec3f> ref_pos, ref<SurfacePoint> spt) const
     {
-        return record(cc, &AreaLight::pdf_li_inline, "pdf_li", ref_pos, pos, nor);
+        return record(cc, &AreaLight::pdf_li_inline, "pdf_li", ref_pos, spt);
     }
 
     SampleEmitResult sample_emit(CompileContext &cc, ref<Sam5> sam) const
@@ -107,6 +119,9 @@ public:
 
     const EnvirLight *as_envir() const final { return this; }
 
+    // average luminance of le over all directions
+    virtual float get_average_luminance() const = 0;
+
     virtual CSpectrum eval_le_inline(CompileContext &cc, ref<CVec3f> to_light) const = 0;
 
     virtual SampleLiResult sample_li_inline(CompileContext &cc, ref<Sam3> sam) const = 0;
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <cmath>
+
 #include <btrc/core/light_sampler.h>
 
 BTRC_BEGIN
@@ -92,4 +95,116 @@ int UniformLightSampler::get_envir_light_index() const
     return envir_light_index_;
 }
 
+void PowerLightSampler::clear()
+{
+    lights_ = {};
+    envir_light_index_ = -1;
+    envir_light_ = {};
+    table_ = {};
+    pdfs_ = {};
+}
+
+void PowerLightSampler::add_light(RC<Light> light)
+{
+    if(!light->is_area())
+    {
+        assert(!envir_light_);
+        envir_light_ = std::dynamic_pointer_cast<EnvirLight>(light);
+        envir_light_index_ = static_cast<int>(lights_.size());
+    }
+    lights_.push_back(std::move(light));
+}
+
+void PowerLightSampler::commit(const AABB3f &scene_bbox)
+{
+    table_ = {};
+    pdfs_ = {};
+    if(lights_.empty())
+        return;
+
+    // flat scenes have valid but empty boxes
+    float scene_radius = 0;
+    if(scene_bbox.lower.x <= scene_bbox.upper.x)
+        scene_radius = 0.5f * length(scene_bbox.upper - scene_bbox.lower);
+
+    std::vector<float> powers(lights_.size());
+    float total_power = 0;
+    for(size_t i = 0; i < lights_.size(); ++i)
+    {
+        float power;
+        if(auto area = lights_[i]->as_area())
+            power = area->get_bounds().power;
+        else
+        {
+            const float avg_lum = lights_[i]->as_envir()->get_average_luminance();
+            power = 4 * btrc_pi * btrc_pi * scene_radius * scene_radius * avg_lum;
+        }
+        powers[i] = std::isfinite(power) ? (std::max)(power, 0.0f) : 0.0f;
+        total_power += powers[i];
+    }
+
+    if(total_power > 0)
+    {
+        for(auto &p : powers)
+            p /= total_power;
+    }
+    else
+        std::fill(powers.begin(), powers.end(), 1.0f / static_cast<float>(lights_.size()));
+
+    table_ = CAliasTable(AliasTable(powers));
+    pdfs_ = cuda::Buffer<float>(powers);
+}
+
+PowerLightSampler::SampleResult PowerLightSampler::sample(const CVec3f &ref, f32 sam) const
+{
+    return sample_emit(sam);
+}
+
+f32 PowerLightSampler::pdf(const CVec3f &ref, i32 light_index) const
+{
+    return pdf_emit(light_index);
+}
+
+LightSampler::SampleEmitResult PowerLightSampler::sample_emit(f32 sam) const
+{
+    SampleEmitResult result;
+    if(lights_.empty())
+    {
+        result.light_idx = -1;
+        result.pdf = 0;
+        return result;
+    }
+    var idx = i32(table_.sample(sam));
+    result.light_idx = idx;
+    result.pdf = cuj::import_pointer(pdfs_.get())[idx];
+    return result;
+}
+
+f32 PowerLightSampler::pdf_emit(i32 light_index) const
+{
+    if(lights_.empty())
+        return 0;
+    return cuj::import_pointer(pdfs_.get())[light_index];
+}
+
+int PowerLightSampler::get_light_count() const
+{
+    return static_cast<int>(lights_.size());
+}
+
+RC<const Light> PowerLightSampler::get_light(int index) const
+{
+    return lights_[index];
+}
+
+RC<const EnvirLight> PowerLightSampler::get_envir_light() const
+{
+    return envir_light_;
+}
+
+int PowerLightSampler::get_envir_light_index() const
+{
+    return envir_light_index_;
+}
+
 BTRC_END
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <btrc/core/light.h>
+#include <btrc/utils/cmath/calias.h>
 
 BTRC_BEGIN
 
@@ -23,6 +24,9 @@ public:
 
     virtual void add_light(RC<Light> light) = 0;
 
+    // called after all lights are added
+    virtual void commit(const AABB3f &scene_bbox) { }
+
     // sample li
 
     virtual SampleResult sample(const CVec3f &ref, f32 sam) const = 0;
@@ -80,4 +84,43 @@ private:
     RC<EnvirLight> envir_light_;
 };
 
+// selects lights proportionally to their total emitted power.
+// environment lights are treated as disks covering the scene bounding sphere
+class PowerLightSampler : public LightSampler
+{
+public:
+
+    void clear() override;
+
+    void add_light(RC<Light> light) override;
+
+    void commit(const AABB3f &scene_bbox) override;
+
+    SampleResult sample(const CVec3f &ref, f32 sam) const override;
+
+    f32 pdf(const CVec3f &ref, i32 light_index) const override;
+
+    SampleEmitResult sample_emit(f32 sam) const override;
+
+    f32 pdf_emit(i32 light_index) const override;
+
+    int get_light_count() const override;
+
+    RC<const Light> get_light(int index) const override;
+
+    RC<const EnvirLight> get_envir_light() const override;
+
+    int get_envir_light_index() const override;
+
+private:
+
+    std::vector<RC<Light>> lights_;
+
+    int envir_light_index_ = -1;
+    RC<EnvirLight> envir_light_;
+
+    CAliasTable         table_;
+    cuda::Buffer<float> pdfs_;
+};
+
 BTRC_END
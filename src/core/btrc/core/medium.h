@@ -98,6 +98,15 @@ public:
         Sampler        &sampler) const;
 
     virtual float get_priority() const = 0;
+
+    // scattered radiance at a position, precomputed for terminating long scattering chains.
+    // paths scattered at depth >= get_lighting_cache_depth() are terminated with it. -1 when there is no cache
+    virtual int get_lighting_cache_depth() const { return -1; }
+
+    virtual CSpectrum eval_lighting_cache(CompileContext &cc, ref<CVec3f> position) const
+    {
+        return CSpectrum::zero();
+    }
 };
 
 class TransformMedium : public Medium
@@ -19,6 +19,8 @@ public:
         cuda::Buffer<Vec4f> color;
         cuda::Buffer<Vec4f> albedo;
         cuda::Buffer<Vec4f> normal;
+        float               average_spp = 0;
+        int64_t             dropped_guiding_records = 0; // path guiding records that did not fit in the buffer
     };
 
     virtual ~Renderer() = default;
@@ -59,6 +59,7 @@ SurfacePoint get_hitinfo(
     material_inct.interp_z = interp_normal;
     material_inct.uv = uv;
     material_inct.tex_coord = tex_coord;
+    material_inct.prim_id = prim_id;
 
     return material_inct;
 }
@@ -79,6 +80,21 @@ void Scene::add_volume(RC<VolumePrimitive> vol)
     vol_prim_medium_->add_volume(std::move(vol));
 }
 
+const std::vector<RC<VolumePrimitive>> &Scene::get_volumes() const
+{
+    return vol_prim_medium_->get_prims();
+}
+
+void Scene::set_volume_bvh_options(const VolumeBVHOptions &options)
+{
+    vol_prim_medium_->set_bvh_options(options);
+}
+
+void Scene::set_volume_lighting_cache_options(const VolumeLightingCacheOptions &options)
+{
+    vol_prim_medium_->set_lighting_cache_options(options);
+}
+
 void Scene::set_envir_light(RC<EnvirLight> env)
 {
     env_light_ = std::move(env);
@@ -235,6 +251,59 @@ void Scene::commit()
         auto vol_bbox = vol->get_bounding_box();
         bbox_ = union_aabb(bbox_, vol_bbox);
     }
+
+    // lights and the volume primitive medium are committed before the scene
+    light_sampler_->commit(bbox_);
+    vol_prim_medium_->build_lighting_cache(*light_sampler_);
+}
+
+bool Scene::update_volume_geometry()
+{
+    bool kernels_valid = vol_prim_medium_->update_geometry();
+
+    // scene bounding box is baked into kernels (e.g. world diagonal in renderers),
+    // so it is only updated when volumes leave it
+    bool bbox_changed = false;
+    for(auto &vol : vol_prim_medium_->get_prims())
+    {
+        const AABB3f vol_bbox = vol->get_bounding_box();
+        const bool inside =
+            bbox_.lower.x <= vol_bbox.lower.x && vol_bbox.upper.x <= bbox_.upper.x &&
+            bbox_.lower.y <= vol_bbox.lower.y && vol_bbox.upper.y <= bbox_.upper.y &&
+            bbox_.lower.z <= vol_bbox.lower.z && vol_bbox.upper.z <= bbox_.upper.z;
+        if(!inside)
+        {
+            bbox_ = union_aabb(bbox_, vol_bbox);
+            bbox_changed = true;
+        }
+    }
+
+    // light sampler depends on the scene bounding box (e.g. radius of envir light)
+    if(bbox_changed)
+    {
+        light_sampler_->commit(bbox_);
+        kernels_valid = false;
+    }
+
+    if(!vol_prim_medium_->update_lighting_cache(*light_sampler_))
+        kernels_valid = false;
+
+    return kernels_valid;
+}
+
+VolumeBVHStats Scene::get_volume_bvh_stats() const
+{
+    return vol_prim_medium_->get_bvh_stats();
+}
+
+VolumeMacroCellStats Scene::get_volume_macro_cell_stats() const
+{
+    return vol_prim_medium_->get_macro_cell_stats();
+}
+
+VolumeLightingCacheStats Scene::get_volume_lighting_cache_stats() const
+{
+    return vol_prim_medium_->get_lighting_cache_stats();
 }
 
 std::vector<RC<Object>> Scene::get_dependent_objects()
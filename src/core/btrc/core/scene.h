@@ -78,12 +78,28 @@ public:
 
     void add_volume(RC<VolumePrimitive> vol);
 
+    const std::vector<RC<VolumePrimitive>> &get_volumes() const;
+
+    void set_volume_bvh_options(const VolumeBVHOptions &options);
+
+    void set_volume_lighting_cache_options(const VolumeLightingCacheOptions &options);
+
     void set_envir_light(RC<EnvirLight> env);
 
     void set_light_sampler(RC<LightSampler> light_sampler);
 
     void commit() override;
 
+    // apply geometry changes of volume primitives without a full commit.
+    // returns false when compiled kernels are invalidated and must be regenerated
+    bool update_volume_geometry();
+
+    VolumeBVHStats get_volume_bvh_stats() const;
+
+    VolumeMacroCellStats get_volume_macro_cell_stats() const;
+
+    VolumeLightingCacheStats get_volume_lighting_cache_stats() const;
+
     std::vector<RC<Object>> get_dependent_objects() override;
 
     OptixTraversableHandle get_tlas() const;
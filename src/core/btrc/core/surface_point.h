@@ -10,6 +10,7 @@ CUJ_CLASS_BEGIN(SurfacePoint)
     CUJ_MEMBER_VARIABLE(CVec3f, interp_z)
     CUJ_MEMBER_VARIABLE(CVec2f, uv)
     CUJ_MEMBER_VARIABLE(CVec2f, tex_coord)
+    CUJ_MEMBER_VARIABLE(u32,    prim_id)
 CUJ_CLASS_END
 
 inline void apply(const CTransform3D &transform, ref<SurfacePoint> spt)
@@ -4,6 +4,7 @@
 #include <btrc/core/surface_point.h>
 #include <btrc/core/spectrum.h>
 #include <btrc/utils/cmath/cmath.h>
+#include <btrc/utils/math/aabb.h>
 
 BTRC_BEGIN
 
@@ -62,6 +63,28 @@ public:
     {
         return get_min_spectrum().r;
     }
+
+    // bounds of float values in a uvw range. global bounds are used by default
+
+    virtual float get_max_float_in(const AABB3f &uvw_range) const
+    {
+        return get_max_float();
+    }
+
+    virtual float get_min_float_in(const AABB3f &uvw_range) const
+    {
+        return get_min_float();
+    }
+
+    virtual Spectrum get_max_spectrum_in(const AABB3f &uvw_range) const
+    {
+        return get_max_spectrum();
+    }
+
+    virtual Spectrum get_min_spectrum_in(const AABB3f &uvw_range) const
+    {
+        return get_min_spectrum();
+    }
 };
 
 class Constant3D : public Texture3D
@@ -1,5 +1,6 @@
 #include <btrc/core/volume/aggregate.h>
 #include <btrc/core/volume/bvh.h>
+#include <btrc/core/volume/lighting_cache.h>
 
 BTRC_BEGIN
 
@@ -79,8 +80,14 @@ RC<Texture3D> VolumePrimitive::get_albedo() const
 struct VolumePrimitiveMedium::Impl
 {
     std::vector<RC<VolumePrimitive>> vols;
+    VolumeBVHOptions bvh_options;
     Box<volume::Aggregate> aggregate;
     Box<volume::BVH> bvh;
+    VolumeLightingCacheOptions lighting_cache_options;
+    Box<volume::LightingCache> lighting_cache;
+
+    // volume geometry the lighting cache was built with
+    std::vector<VolumePrimitive::VolumeGeometryInfo> lighting_cache_geometry;
 };
 
 VolumePrimitiveMedium::VolumePrimitiveMedium()
@@ -98,6 +105,11 @@ void VolumePrimitiveMedium::add_volume(RC<VolumePrimitive> vol)
     impl_->vols.push_back(std::move(vol));
 }
 
+void VolumePrimitiveMedium::set_bvh_options(const VolumeBVHOptions &options)
+{
+    impl_->bvh_options = options;
+}
+
 const std::vector<RC<VolumePrimitive>> &VolumePrimitiveMedium::get_prims() const
 {
     return impl_->vols;
@@ -105,8 +117,89 @@ const std::vector<RC<VolumePrimitive>> &VolumePrimitiveMedium::get_prims() const
 
 void VolumePrimitiveMedium::commit()
 {
-    impl_->aggregate = newBox<volume::Aggregate>(impl_->vols);
-    impl_->bvh = newBox<volume::BVH>(impl_->vols);
+    impl_->aggregate = newBox<volume::Aggregate>(impl_->vols, impl_->bvh_options.span_stats);
+    impl_->bvh = newBox<volume::BVH>(
+        impl_->vols, impl_->aggregate->get_overlap_key_seed(), impl_->bvh_options);
+}
+
+bool VolumePrimitiveMedium::update_geometry()
+{
+    if(impl_->aggregate &&
+       impl_->aggregate->update_geometry() &&
+       impl_->bvh->update_geometry())
+        return true;
+    commit();
+    return false;
+}
+
+VolumeBVHStats VolumePrimitiveMedium::get_bvh_stats() const
+{
+    return impl_->bvh ? impl_->bvh->get_stats() : VolumeBVHStats{};
+}
+
+VolumeMacroCellStats VolumePrimitiveMedium::get_macro_cell_stats() const
+{
+    return impl_->aggregate ? impl_->aggregate->get_macro_cell_stats() : VolumeMacroCellStats{};
+}
+
+void VolumePrimitiveMedium::set_lighting_cache_options(const VolumeLightingCacheOptions &options)
+{
+    impl_->lighting_cache_options = options;
+    impl_->lighting_cache = {};
+}
+
+bool VolumePrimitiveMedium::build_lighting_cache(const LightSampler &light_sampler)
+{
+    if(!impl_->lighting_cache_options.enabled || impl_->vols.empty())
+    {
+        const bool had_cache = impl_->lighting_cache != nullptr;
+        impl_->lighting_cache = {};
+        return !had_cache;
+    }
+
+    AABB3f bbox;
+    impl_->lighting_cache_geometry.clear();
+    for(auto &vol : impl_->vols)
+    {
+        bbox = union_aabb(bbox, vol->get_bounding_box());
+        impl_->lighting_cache_geometry.push_back(vol->get_geometry_info());
+    }
+
+    if(!impl_->lighting_cache)
+    {
+        impl_->lighting_cache = newBox<volume::LightingCache>(impl_->lighting_cache_options);
+        impl_->lighting_cache->build(*this, light_sampler, bbox);
+        return false;
+    }
+    return impl_->lighting_cache->build(*this, light_sampler, bbox);
+}
+
+bool VolumePrimitiveMedium::update_lighting_cache(const LightSampler &light_sampler)
+{
+    if(impl_->lighting_cache && impl_->lighting_cache_geometry.size() == impl_->vols.size())
+    {
+        auto differ = [](const Vec3f &a, const Vec3f &b)
+        {
+            return a.x != b.x || a.y != b.y || a.z != b.z;
+        };
+
+        bool changed = false;
+        for(size_t i = 0; i < impl_->vols.size(); ++i)
+        {
+            const auto geo = impl_->vols[i]->get_geometry_info();
+            const auto &cached = impl_->lighting_cache_geometry[i];
+            changed |= differ(geo.o, cached.o) || differ(geo.x, cached.x) ||
+                       differ(geo.y, cached.y) || differ(geo.z, cached.z);
+        }
+        if(!changed)
+            return true;
+    }
+    return build_lighting_cache(light_sampler);
+}
+
+VolumeLightingCacheStats VolumePrimitiveMedium::get_lighting_cache_stats() const
+{
+    return impl_->lighting_cache ? impl_->lighting_cache->get_stats() : VolumeLightingCacheStats{};
 }
 
 Medium::SampleResult VolumePrimitiveMedium::sample(
@@ -201,6 +294,18 @@ float VolumePrimitiveMedium::get_priority() const
     return std::numeric_limits<float>::lowest();
 }
 
+int VolumePrimitiveMedium::get_lighting_cache_depth() const
+{
+    return impl_->lighting_cache ? impl_->lighting_cache->get_depth() : -1;
+}
+
+CSpectrum VolumePrimitiveMedium::eval_lighting_cache(CompileContext &cc, ref<CVec3f> position) const
+{
+    if(!impl_->lighting_cache)
+        return CSpectrum::zero();
+    return impl_->lighting_cache->eval(position);
+}
+
 std::vector<RC<Object>> VolumePrimitiveMedium::get_dependent_objects()
 {
     std::vector<RC<Object>> result;
@@ -6,6 +6,105 @@
 
 BTRC_BEGIN
 
+enum class VolumeBVHBuilder
+{
+    LocallyOrderedClustering,
+    BinnedSAH,
+    SweepSAH,
+    Linear, // lbvh from morton codes
+};
+
+struct VolumeBVHOptions
+{
+    VolumeBVHBuilder builder = VolumeBVHBuilder::LocallyOrderedClustering;
+
+    // run parallel reinsertion on the built tree
+    bool reinsertion = true;
+
+    // 2 for binary nodes. 4 for wide nodes with soa child bounds
+    int node_width = 2;
+
+    // refitted tree is rebuilt when its sah cost exceeds this times the cost of the last build
+    float rebuild_threshold = 1.5f;
+
+    // count the macro cell spans traversed by tracking (see VolumeMacroCellStats).
+    // off by default, as every tracking call then does two global atomics
+    bool span_stats = false;
+};
+
+struct VolumeBVHStats
+{
+    float build_time_ms = 0; // of the last build
+    float sah_cost = 0;      // of the current tree
+    int   node_count = 0;
+    int   max_depth = 0;
+    int   wide_node_count = 0;
+    int   wide_max_depth = 0;
+};
+
+// each volume primitive is divided into res^3 macro cells in its uvw space,
+// whose sigma_t bounds are used as local majorants and for skipping empty space
+constexpr int VOLUME_MACRO_CELL_RES = 16;
+
+struct VolumeMacroCellStats
+{
+    int cell_count = 0;
+    int empty_cell_count = 0;
+
+    // macro cell spans traversed by tracking since the cells were built,
+    // and those skipped without sampling because all overlapping cells are empty.
+    // only counted with VolumeBVHOptions::span_stats
+    uint32_t span_count = 0;
+    uint32_t skipped_span_count = 0;
+};
+
+// world-space grid of scattered radiance over the bounding box of all volume primitives.
+// direct lighting is estimated per cell, and multiple scattering is propagated between cells
+// with discrete ordinates along the 6 axis directions.
+// phase functions are assumed to be isotropic, and surfaces are ignored in the estimate
+struct VolumeLightingCacheOptions
+{
+    bool enabled = false;
+
+    int resolution = 32;
+
+    // scattering vertices at this path depth or deeper are replaced by cache lookups
+    int depth = 4;
+
+    int light_samples = 64;
+    int tr_samples = 8;
+
+    // source iteration stops when the relative change is below tolerance
+    int   max_iterations = 64;
+    float tolerance = 1e-3f;
+
+    // cells compared against path traced references after building. 0 to skip the comparison
+    int reference_probes = 0;
+    int reference_paths = 1024;
+};
+
+struct VolumeLightingCacheStats
+{
+    int   resolution = 0;
+    float build_time_ms = 0;
+    int   iterations = 0;
+    float residual = 0; // relative change in the last iteration
+    float direct_lum = 0; // average over cells
+    float scattered_lum = 0;
+
+    int   anisotropic_samples = 0; // scattering samples whose phase function is not isotropic
+    float reference_error = -1;    // see VolumeLightingCacheOptions::reference_probes. -1 when not compared
+};
+
+class LightSampler;
+
+namespace volume
+{
+
+    class LightingCache;
+
+} // namespace volume
+
 class VolumePrimitive : public Object
 {
 public:
@@ -52,10 +151,32 @@ public:
 
     void add_volume(RC<VolumePrimitive> vol);
 
+    void set_bvh_options(const VolumeBVHOptions &options);
+
     const std::vector<RC<VolumePrimitive>> &get_prims() const;
 
     void commit() override;
 
+    // apply geometry changes of committed volumes (see VolumePrimitive::set_geometry).
+    // returns false when compiled kernels are invalidated and must be regenerated
+    bool update_geometry();
+
+    VolumeBVHStats get_bvh_stats() const;
+
+    VolumeMacroCellStats get_macro_cell_stats() const;
+
+    void set_lighting_cache_options(const VolumeLightingCacheOptions &options);
+
+    // must be called after committing the medium and the lights.
+    // returns false when compiled kernels are invalidated and must be regenerated
+    bool build_lighting_cache(const LightSampler &light_sampler);
+
+    // rebuild the lighting cache only when the geometry of a volume has changed since it was built.
+    // returns false when compiled kernels are invalidated and must be regenerated
+    bool update_lighting_cache(const LightSampler &light_sampler);
+
+    VolumeLightingCacheStats get_lighting_cache_stats() const;
+
     SampleResult sample(
         CompileContext &cc,
         ref<CVec3f>     a,
@@ -74,6 +195,10 @@ public:
 
     float get_priority() const override;
 
+    int get_lighting_cache_depth() const override;
+
+    CSpectrum eval_lighting_cache(CompileContext &cc, ref<CVec3f> position) const override;
+
     std::vector<RC<Object>> get_dependent_objects() override;
 
 private:
@@ -5,28 +5,143 @@
 
 BTRC_BEGIN
 
-volume::Aggregate::Aggregate(const std::vector<RC<VolumePrimitive>> &vols)
+namespace
+{
+
+    // overlap buffers are allocated larger than needed so that moving volumes
+    // rarely requires reallocation (and thus a recompilation)
+    constexpr size_t OVERLAP_BUFFER_HEADROOM = 2;
+
+    constexpr int MACRO_CELLS_PER_VOLUME =
+        VOLUME_MACRO_CELL_RES * VOLUME_MACRO_CELL_RES * VOLUME_MACRO_CELL_RES;
+
+
+} // namespace anonymous
+
+volume::Aggregate::Aggregate(const std::vector<RC<VolumePrimitive>> &vols, bool span_stats)
 {
     if(vols.empty())
         return;
 
+    span_stats_ = span_stats;
+    vols_ = vols;
+    vol_geometry_.initialize(vols_.size());
+    upload_vol_geometry();
+    build_macro_cells();
+
+    auto overlaps = index_overlaps(0, 0);
+    overlap_key_seed_ = overlaps.key_seed;
+
+    const size_t table_size = OVERLAP_BUFFER_HEADROOM * overlaps.table.size();
+    overlaps = index_overlaps(overlap_key_seed_, table_size);
+    assert(overlaps.key_seed == overlap_key_seed_);
+
+    overlap_table_ = cuda::Buffer<OverlapTableEntry>(overlaps.table);
+    overlap_records_.initialize((std::max<size_t>)(OVERLAP_BUFFER_HEADROOM * overlaps.records.size(), 1));
+    overlap_vol_ids_.initialize((std::max<size_t>)(OVERLAP_BUFFER_HEADROOM * overlaps.vol_ids.size(), 1));
+    if(!overlaps.records.empty())
+    {
+        overlap_records_.from_cpu(overlaps.records.data(), 0, overlaps.records.size());
+        overlap_vol_ids_.from_cpu(overlaps.vol_ids.data(), 0, overlaps.vol_ids.size());
+    }
+}
+
+bool volume::Aggregate::update_geometry()
+{
+    if(vols_.empty())
+        return true;
+
+    upload_vol_geometry();
+
+    const auto overlaps = index_overlaps(overlap_key_seed_, overlap_table_.get_size());
+    if(overlaps.key_seed != overlap_key_seed_ ||
+       overlaps.table.size() != overlap_table_.get_size() ||
+       overlaps.records.size() > overlap_records_.get_size() ||
+       overlaps.vol_ids.size() > overlap_vol_ids_.get_size())
+        return false;
+
+    overlap_table_.from_cpu(overlaps.table.data());
+    if(!overlaps.records.empty())
+    {
+        overlap_records_.from_cpu(overlaps.records.data(), 0, overlaps.records.size());
+        overlap_vol_ids_.from_cpu(overlaps.vol_ids.data(), 0, overlaps.vol_ids.size());
+    }
+    return true;
+}
+
+volume::Aggregate::IndexedOverlaps volume::Aggregate::index_overlaps(
+    uint64_t first_seed, size_t min_table_size) const
+{
     // find all overlap areas
 
     VolumeOverlapResolver overlap_resolver;
-    for(auto &vol : vols)
+    for(auto &vol : vols_)
         overlap_resolver.add_volume(vol);
 
-    // build overlap trie
+    // build overlap hash table
 
     std::map<RC<VolumePrimitive>, int> vol_to_id;
-    for(auto &&[i, vol] : enumerate(vols))
+    for(auto &&[i, vol] : enumerate(vols_))
         vol_to_id[vol] = static_cast<int>(i);
 
-    overlaps_ = overlap_resolver.get_overlaps();
-    OverlapIndexer indexer(overlaps_, vols, vol_to_id);
+    const auto overlaps = overlap_resolver.get_overlaps();
+    OverlapIndexer indexer(overlaps, vol_to_id, first_seed, min_table_size);
+
+    IndexedOverlaps result;
+    result.key_seed = indexer.get_key_seed();
+    result.table = indexer.get_table();
+    result.records = indexer.get_records();
+    result.vol_ids = indexer.get_vol_ids();
+    return result;
+}
 
-    auto &trie_indices = indexer.get_indices();
-    overlap_trie_ = cuda::Buffer<int32_t>(trie_indices);
+void volume::Aggregate::upload_vol_geometry()
+{
+    std::vector<BVHPrimitive> geometry;
+    geometry.reserve(vols_.size());
+    for(auto &&[i, vol] : enumerate(vols_))
+        geometry.push_back(make_bvh_primitive(*vol, static_cast<uint32_t>(i)));
+    vol_geometry_.from_cpu(geometry.data());
+}
+
+void volume::Aggregate::build_macro_cells()
+{
+    const float cell_size = 1.0f / VOLUME_MACRO_CELL_RES;
+
+    std::vector<float> majorants;
+    majorants.reserve(vols_.size() * MACRO_CELLS_PER_VOLUME);
+    macro_cell_stats_ = {};
+
+    for(auto &vol : vols_)
+    {
+        auto sigma_t = vol->get_sigma_t();
+        for(int z = 0; z < VOLUME_MACRO_CELL_RES; ++z)
+        {
+            for(int y = 0; y < VOLUME_MACRO_CELL_RES; ++y)
+            {
+                for(int x = 0; x < VOLUME_MACRO_CELL_RES; ++x)
+                {
+                    const Vec3f lower = cell_size * Vec3f(
+                        static_cast<float>(x), static_cast<float>(y), static_cast<float>(z));
+                    const AABB3f cell = { lower, lower + Vec3f(cell_size) };
+                    const float majorant = (std::max)(sigma_t->get_max_float_in(cell), 0.0f);
+                    majorants.push_back(majorant);
+
+                    ++macro_cell_stats_.cell_count;
+                    if(majorant <= 0)
+                        ++macro_cell_stats_.empty_cell_count;
+                }
+            }
+        }
+    }
+
+    macro_cell_majorants_ = cuda::Buffer<float>(majorants);
+
+    if(span_stats_)
+    {
+        span_counters_.initialize(2);
+        span_counters_.clear(0);
+    }
 }
 
 volume::Aggregate::Aggregate(Aggregate &&other) noexcept
@@ -43,7 +158,34 @@ volume::Aggregate &volume::Aggregate::operator=(Aggregate &&other) noexcept
 
 void volume::Aggregate::swap(Aggregate &other) noexcept
 {
-    overlap_trie_.swap(other.overlap_trie_);
+    vols_.swap(other.vols_);
+    vol_geometry_.swap(other.vol_geometry_);
+    macro_cell_majorants_.swap(other.macro_cell_majorants_);
+    std::swap(macro_cell_stats_, other.macro_cell_stats_);
+    std::swap(span_stats_, other.span_stats_);
+    span_counters_.swap(other.span_counters_);
+    std::swap(overlap_key_seed_, other.overlap_key_seed_);
+    overlap_table_.swap(other.overlap_table_);
+    overlap_records_.swap(other.overlap_records_);
+    overlap_vol_ids_.swap(other.overlap_vol_ids_);
+}
+
+uint64_t volume::Aggregate::get_overlap_key_seed() const
+{
+    return overlap_key_seed_;
+}
+
+VolumeMacroCellStats volume::Aggregate::get_macro_cell_stats() const
+{
+    VolumeMacroCellStats result = macro_cell_stats_;
+    if(span_counters_)
+    {
+        uint32_t counters[2];
+        span_counters_.to_cpu(counters);
+        result.span_count = counters[0];
+        result.skipped_span_count = counters[1];
+    }
+    return result;
 }
 
 void volume::Aggregate::sample_scattering(
@@ -57,32 +199,78 @@ void volume::Aggregate::sample_scattering(
     ref<CVec3f>                  output_position,
     HenyeyGreensteinPhaseShader &output_shader) const
 {
-    $if(overlap.count == i32(0))
-    {
-        output_scattered = false;
-        output_throughput = CSpectrum::one();
-    }
-    $else
+    output_scattered = false;
+    output_throughput = CSpectrum::one();
+
+    $scope
     {
+        $if(overlap.count == i32(0))
+        {
+            $exit_scope;
+        };
+
         var overlap_index = find_overlap_index(overlap);
-        $switch(overlap_index)
+        $if(overlap_index < 0)
         {
-            for(size_t i = 0; i < overlaps_.size(); ++i)
+            $exit_scope;
+        };
+
+        var vol_ids = cuj::import_pointer(overlap_vol_ids_.get());
+        ref record = cuj::import_pointer(overlap_records_.get())[overlap_index];
+
+        // delta tracking with macro cell majorants. empty cells are skipped without sampling
+
+        var t_max = length(b - a), t = 0.0f;
+        var dir = (b - a) / t_max;
+        var span_count = u32(0), skipped_span_count = u32(0);
+        $while(t < t_max & !output_scattered)
+        {
+            f32 majorant, t_end;
+            find_local_majorant(record, a, dir, t, majorant, t_end);
+            t_end = cstd::min(t_end, t_max);
+            span_count = span_count + 1;
+
+            $if(majorant <= 0.0f)
             {
-                $case(i)
-                {
-                    sample_scattering_in_overlap(
-                        cc, overlaps_[i], a, b, sampler,
-                        output_scattered, output_throughput,
-                        output_position, output_shader);
-                };
+                skipped_span_count = skipped_span_count + 1;
             }
-            $default
+            $else
             {
-                output_scattered = false;
-                output_throughput = CSpectrum::one();
+                var inv_majorant = 1.0f / majorant;
+                $loop
+                {
+                    var dt = -cstd::log(1.0f - sampler.get1d()) * inv_majorant;
+                    t = t + dt;
+                    $if(t >= t_end)
+                    {
+                        $break;
+                    };
+                    var position = a + t * dir;
+
+                    var density_sum = sample_density_sum(cc, record, position);
+                    $if(sampler.get1d() < density_sum * inv_majorant)
+                    {
+                        var albedo = CSpectrum::zero();
+                        $forrange(i, record.vol_beg, record.vol_end)
+                        {
+                            var vol_id = vol_ids[i];
+                            var weight = sample_sigma_t(cc, vol_id, position) / density_sum;
+                            var lobe_albedo = sample_albedo(cc, vol_id, position);
+                            albedo = albedo + weight * lobe_albedo;
+                        };
+
+                        output_scattered = true;
+                        output_position = position;
+                        output_shader.set_g(0.0f);
+                        output_shader.set_color(albedo);
+
+                        $break;
+                    };
+                };
             };
+            t = t_end;
         };
+        add_span_counts(span_count, skipped_span_count);
     };
 }
 
@@ -90,167 +278,219 @@ CSpectrum volume::Aggregate::tr(
     CompileContext &cc, ref<Overlap> overlap,
     ref<CVec3f> a, ref<CVec3f> b, Sampler &sampler) const
 {
-    CSpectrum result;
-    $if(overlap.count == i32(0))
-    {
-        result = CSpectrum::one();
-    }
-    $else
+    var result = 1.0f;
+    $scope
     {
+        $if(overlap.count == i32(0))
+        {
+            $exit_scope;
+        };
+
         var overlap_index = find_overlap_index(overlap);
-        $switch(overlap_index)
+        $if(overlap_index < 0)
+        {
+            $exit_scope;
+        };
+
+        ref record = cuj::import_pointer(overlap_records_.get())[overlap_index];
+
+        // ratio tracking with macro cell majorants
+
+        var t_max = length(b - a), t = 0.0f;
+        var dir = (b - a) / t_max;
+        var span_count = u32(0), skipped_span_count = u32(0);
+        $while(t < t_max)
         {
-            for(size_t i = 0; i < overlaps_.size(); ++i)
+            f32 majorant, t_end;
+            find_local_majorant(record, a, dir, t, majorant, t_end);
+            t_end = cstd::min(t_end, t_max);
+            span_count = span_count + 1;
+
+            $if(majorant <= 0.0f)
             {
-                $case(i)
-                {
-                    result = tr_in_overlap(cc, overlaps_[i], a, b, sampler);
-                };
+                skipped_span_count = skipped_span_count + 1;
             }
-            $default
+            $else
             {
-                result = CSpectrum::one();
+                var inv_majorant = 1.0f / majorant;
+                $loop
+                {
+                    var dt = -cstd::log(1.0f - sampler.get1d()) * inv_majorant;
+                    t = t + dt;
+                    $if(t >= t_end)
+                    {
+                        $break;
+                    };
+                    var position = a + t * dir;
+
+                    var density_sum = sample_density_sum(cc, record, position);
+                    result = result * (1.0f - density_sum * inv_majorant);
+                };
             };
+            t = t_end;
         };
+        add_span_counts(span_count, skipped_span_count);
     };
-    return result;
+    return CSpectrum::from_rgb(result, result, result);
 }
 
 i32 volume::Aggregate::find_overlap_index(ref<Overlap> overlap) const
 {
-    var overlap_index = 0;
-    var trie = cuj::import_pointer(overlap_trie_.get());
-    $forrange(i, 0, overlap.count)
+    const uint64_t mask = overlap_table_.get_size() - 1;
+    var table = cuj::import_pointer(overlap_table_.get());
+    var slot = overlap.key & mask;
+    i32 result;
+    $loop
     {
-        var vol_idx = overlap.data[i];
-        overlap_index = trie[overlap_index + 1 + i32(vol_idx)];
-        CUJ_ASSERT(overlap_index >= 0);
+        ref entry = table[slot];
+        $if(entry.record < 0)
+        {
+            result = -1;
+            $break;
+        };
+        $if(entry.key == overlap.key)
+        {
+            result = entry.record;
+            $break;
+        };
+        slot = (slot + 1) & mask;
     };
-    overlap_index = trie[overlap_index];
-    CUJ_ASSERT(0 <= overlap_index & overlap_index < static_cast<int>(overlaps_.size()));
-    return overlap_index;
+    return result;
 }
 
-float volume::Aggregate::get_max_density(const std::set<RC<VolumePrimitive>> &vols) const
+void volume::Aggregate::find_local_majorant(
+    ref<COverlapRecord> record,
+    ref<CVec3f>         a,
+    ref<CVec3f>         dir,
+    f32                 t,
+    ref<f32>            output_majorant,
+    ref<f32>            output_t_end) const
 {
-    float max_density = 0.0f;
-    for(auto &vol : vols)
-        max_density += vol->get_sigma_t()->get_max_float();
-    return (std::max)(max_density, 0.01f);
-}
+    constexpr float res = static_cast<float>(VOLUME_MACRO_CELL_RES);
 
-void volume::Aggregate::sample_scattering_in_overlap(
-    CompileContext                      &cc,
-    const std::set<RC<VolumePrimitive>> &vols,
-    ref<CVec3f>                          a,
-    ref<CVec3f>                          b,
-    Sampler                             &sampler,
-    ref<boolean>                         output_scattered,
-    ref<CSpectrum>                       output_throughput,
-    ref<CVec3f>                          output_position,
-    HenyeyGreensteinPhaseShader         &output_shader) const
-{
-    const float max_density = get_max_density(vols);
-    const float inv_max_density = 1.0f / max_density;
+    var vol_ids = cuj::import_pointer(overlap_vol_ids_.get());
+    var geometry = cuj::import_pointer(vol_geometry_.get());
+    var majorants = cuj::import_pointer(macro_cell_majorants_.get());
 
-    std::vector<CVec3f> local_uvw_a(vols.size());
-    std::vector<CVec3f> local_uvw_b(vols.size());
-    for(auto [i, vol] : enumerate(vols))
-    {
-        local_uvw_a[i] = vol->world_pos_to_uvw(a);
-        local_uvw_b[i] = vol->world_pos_to_uvw(b);
-    }
+    // cell index along an axis, picking the cell being entered when on a boundary.
+    // also updates output_t_end with the distance to the cell exit.
+    // when g is rounded to just before the exit boundary of its cell, the exit would not be
+    // ahead of t, so the position is taken to be on the boundary and the next cell is used.
+    // the returned span [t, exit) then always lies in the returned cell
 
-    var t_max = length(b - a), t = 0.0f;
-    $loop
+    auto process_axis = [&](f32 g, f32 dg)
     {
-        var dt = -cstd::log(1.0f - sampler.get1d()) * inv_max_density;
-        t = t + dt;
-        $if(t >= t_max)
+        var cell = cstd::floor(g);
+        $if(dg > 0.0f)
         {
-            output_scattered = false;
-            output_throughput = CSpectrum::one();
-            $break;
-        };
-        var tf = t / t_max;
-
-        std::vector<CVec3f> uvws(vols.size());
-        std::vector<f32> densities(vols.size());
-        var density_sum = 0.0f;
-        for(auto [i, vol] : enumerate(vols))
-        {
-            var uvw = local_uvw_a[i] * (1.0f - tf) + local_uvw_b[i] * tf;
-            uvws[i] = uvw;
-            var density = vol->get_sigma_t()->sample_float(cc, uvw);
-            densities[i] = density;
-            density_sum = density_sum + density;
+            var t_exit = t + (cell + 1.0f - g) / dg;
+            $if(t_exit <= t)
+            {
+                cell = cell + 1.0f;
+                t_exit = t + (cell + 1.0f - g) / dg;
+            };
+            output_t_end = cstd::min(output_t_end, t_exit);
         }
-
-        $if(sampler.get1d() < density_sum * inv_max_density)
+        $elif(dg < 0.0f)
         {
-            output_scattered = true;
-            output_throughput = CSpectrum::one();
-            output_position = a * (1.0f - tf) + b * tf;
-
-            var albedo = CSpectrum::zero();
-
-            for(auto [i, vol] : enumerate(vols))
+            cell = -cstd::floor(-g) - 1.0f;
+            var t_exit = t + (cell - g) / dg;
+            $if(t_exit <= t)
             {
-                var uvw = uvws[i];
-                var weight = densities[i] / density_sum;
-                var lobe_albedo = vol->get_albedo()->sample_spectrum(cc, uvw);
-                albedo = albedo + weight * lobe_albedo;
-            }
-
-            output_shader.set_g(0.0f);
-            output_shader.set_color(albedo);
-
-            $break;
+                cell = cell - 1.0f;
+                t_exit = t + (cell - g) / dg;
+            };
+            output_t_end = cstd::min(output_t_end, t_exit);
         };
+        return i32(cstd::clamp(cell, 0.0f, res - 1.0f));
+    };
+
+    var position = a + t * dir;
+    output_majorant = 0.0f;
+    output_t_end = btrc_max_float;
+    $forrange(i, record.vol_beg, record.vol_end)
+    {
+        var vol_id = vol_ids[i];
+        ref geo = geometry[vol_id];
+        var op = position - geo.o;
+        var x = process_axis(res * dot(op, geo.x_div_x2), res * dot(dir, geo.x_div_x2));
+        var y = process_axis(res * dot(op, geo.y_div_y2), res * dot(dir, geo.y_div_y2));
+        var z = process_axis(res * dot(op, geo.z_div_z2), res * dot(dir, geo.z_div_z2));
+        var cell_idx = vol_id * u32(MACRO_CELLS_PER_VOLUME)
+                     + u32((z * VOLUME_MACRO_CELL_RES + y) * VOLUME_MACRO_CELL_RES + x);
+        output_majorant = output_majorant + majorants[cell_idx];
     };
 }
 
-CSpectrum volume::Aggregate::tr_in_overlap(
-    CompileContext                      &cc,
-    const std::set<RC<VolumePrimitive>> &vols,
-    ref<CVec3f>                          a,
-    ref<CVec3f>                          b,
-    Sampler                             &sampler) const
+void volume::Aggregate::add_span_counts(u32 span_count, u32 skipped_span_count) const
 {
-    const float max_density = get_max_density(vols);
-    const float inv_max_density = 1.0f / max_density;
+    if(!span_stats_)
+        return;
+    var counters = cuj::import_pointer(span_counters_.get());
+    cstd::atomic_add(counters, span_count);
+    cstd::atomic_add(counters[1].address(), skipped_span_count);
+}
 
-    std::vector<CVec3f> local_uvw_a(vols.size());
-    std::vector<CVec3f> local_uvw_b(vols.size());
-    for(auto [i, vol] : enumerate(vols))
-    {
-        local_uvw_a[i] = vol->world_pos_to_uvw(a);
-        local_uvw_b[i] = vol->world_pos_to_uvw(b);
-    }
+CVec3f volume::Aggregate::world_pos_to_uvw(u32 vol_id, ref<CVec3f> position) const
+{
+    ref geo = cuj::import_pointer(vol_geometry_.get())[vol_id];
+    var op = position - geo.o;
+    return CVec3f(dot(op, geo.x_div_x2), dot(op, geo.y_div_y2), dot(op, geo.z_div_z2));
+}
 
-    var result = 1.0f, t_max = length(b - a), t = 0.0f;
-    $loop
+f32 volume::Aggregate::sample_sigma_t(CompileContext &cc, u32 vol_id, ref<CVec3f> position) const
+{
+    var uvw = world_pos_to_uvw(vol_id, position);
+    f32 result;
+    $switch(vol_id)
     {
-        var dt = -cstd::log(1.0f - sampler.get1d()) * inv_max_density;
-        t = t + dt;
-        $if(t >= t_max)
+        for(size_t i = 0; i < vols_.size(); ++i)
         {
-            $break;
+            $case(static_cast<uint32_t>(i))
+            {
+                result = vols_[i]->get_sigma_t()->sample_float(cc, uvw);
+            };
+        }
+        $default
+        {
+            result = 0.0f;
         };
-        var tf = t / t_max;
+    };
+    return result;
+}
 
-        var density_sum = 0.0f;
-        for(auto [i, vol] : enumerate(vols))
+CSpectrum volume::Aggregate::sample_albedo(CompileContext &cc, u32 vol_id, ref<CVec3f> position) const
+{
+    var uvw = world_pos_to_uvw(vol_id, position);
+    CSpectrum result;
+    $switch(vol_id)
+    {
+        for(size_t i = 0; i < vols_.size(); ++i)
         {
-            var uvw = local_uvw_a[i] * (1.0f - tf) + local_uvw_b[i] * tf;
-            var density = vol->get_sigma_t()->sample_float(cc, uvw);
-            density_sum = density_sum + density;
+            $case(static_cast<uint32_t>(i))
+            {
+                result = vols_[i]->get_albedo()->sample_spectrum(cc, uvw);
+            };
         }
-
-        result = result * (1.0f - density_sum * inv_max_density);
+        $default
+        {
+            result = CSpectrum::zero();
+        };
     };
+    return result;
+}
 
-    return CSpectrum::from_rgb(result, result, result);
+f32 volume::Aggregate::sample_density_sum(
+    CompileContext &cc, ref<COverlapRecord> record, ref<CVec3f> position) const
+{
+    var vol_ids = cuj::import_pointer(overlap_vol_ids_.get());
+    var density_sum = 0.0f;
+    $forrange(i, record.vol_beg, record.vol_end)
+    {
+        var density = sample_sigma_t(cc, vol_ids[i], position);
+        density_sum = density_sum + density;
+    };
+    return density_sum;
 }
 
 BTRC_END
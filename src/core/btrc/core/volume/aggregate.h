@@ -1,6 +1,7 @@
 #pragma once
 
 #include <btrc/core/volume/bvh.h>
+#include <btrc/core/volume/indexing.h>
 #include <btrc/core/medium.h>
 
 BTRC_BEGIN
@@ -16,7 +17,8 @@ namespace volume
 
         Aggregate() = default;
 
-        explicit Aggregate(const std::vector<RC<VolumePrimitive>> &vols);
+        // span_stats enables the span counts of get_macro_cell_stats
+        explicit Aggregate(const std::vector<RC<VolumePrimitive>> &vols, bool span_stats = false);
 
         Aggregate(Aggregate &&other) noexcept;
 
@@ -24,6 +26,14 @@ namespace volume
 
         void swap(Aggregate &other) noexcept;
 
+        uint64_t get_overlap_key_seed() const;
+
+        // re-resolve overlaps for current geometry of volumes and update device buffers in place.
+        // returns false when the new overlaps don't fit in existing buffers or need a different key seed
+        bool update_geometry();
+
+        VolumeMacroCellStats get_macro_cell_stats() const;
+
         void sample_scattering(
             CompileContext              &cc,
             ref<Overlap>                 overlap,
@@ -44,30 +54,56 @@ namespace volume
 
     private:
 
+        struct IndexedOverlaps
+        {
+            uint64_t                       key_seed = 0;
+            std::vector<OverlapTableEntry> table;
+            std::vector<OverlapRecord>     records;
+            std::vector<uint32_t>          vol_ids;
+        };
+
+        IndexedOverlaps index_overlaps(uint64_t first_seed, size_t min_table_size) const;
+
+        void upload_vol_geometry();
+
+        // returns -1 when the overlap is not found
         i32 find_overlap_index(ref<Overlap> overlap) const;
 
-        float get_max_density(const std::set<RC<VolumePrimitive>> &vols) const;
-
-        void sample_scattering_in_overlap(
-            CompileContext                      &cc,
-            const std::set<RC<VolumePrimitive>> &vols,
-            ref<CVec3f>                          a,
-            ref<CVec3f>                          b,
-            Sampler                             &sampler,
-            ref<boolean>                         output_scattered,
-            ref<CSpectrum>                       output_throughput,
-            ref<CVec3f>                          output_position,
-            HenyeyGreensteinPhaseShader         &output_shader) const;
-        
-        CSpectrum tr_in_overlap(
-            CompileContext                      &cc,
-            const std::set<RC<VolumePrimitive>> &vols,
-            ref<CVec3f>                          a,
-            ref<CVec3f>                          b,
-            Sampler                             &sampler) const;
-
-        std::vector<std::set<RC<VolumePrimitive>>> overlaps_;
-        cuda::Buffer<int32_t> overlap_trie_;
+        void build_macro_cells();
+
+        // sum of macro cell majorants of volumes in the record at a + t * dir,
+        // and the distance along dir at which any of these cells is left
+        void find_local_majorant(
+            ref<COverlapRecord> record,
+            ref<CVec3f>         a,
+            ref<CVec3f>         dir,
+            f32                 t,
+            ref<f32>            output_majorant,
+            ref<f32>            output_t_end) const;
+
+        // accumulated once per tracking call to keep atomics off the inner loop. no-op without span stats
+        void add_span_counts(u32 span_count, u32 skipped_span_count) const;
+
+        CVec3f world_pos_to_uvw(u32 vol_id, ref<CVec3f> position) const;
+
+        f32 sample_sigma_t(CompileContext &cc, u32 vol_id, ref<CVec3f> position) const;
+
+        CSpectrum sample_albedo(CompileContext &cc, u32 vol_id, ref<CVec3f> position) const;
+
+        f32 sample_density_sum(CompileContext &cc, ref<COverlapRecord> record, ref<CVec3f> position) const;
+
+        std::vector<RC<VolumePrimitive>> vols_;
+        cuda::Buffer<BVHPrimitive>       vol_geometry_; // indexed by volume id
+
+        cuda::Buffer<float>    macro_cell_majorants_; // VOLUME_MACRO_CELL_RES^3 cells per volume
+        VolumeMacroCellStats   macro_cell_stats_;
+        bool                   span_stats_ = false;
+        cuda::Buffer<uint32_t> span_counters_;        // traversed and skipped spans since the cells were built
+
+        uint64_t                          overlap_key_seed_ = 0;
+        cuda::Buffer<OverlapTableEntry>   overlap_table_;
+        cuda::Buffer<OverlapRecord>       overlap_records_;
+        cuda::Buffer<uint32_t>            overlap_vol_ids_;
     };
 
 } // namespace volume
@@ -1,9 +1,25 @@
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BTRC_VOLUME_BVH_HOST_SSE
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BTRC_VOLUME_BVH_HOST_NEON
+#include <arm_neon.h>
+#endif
+
+#include <bvh/binned_sah_builder.hpp>
 #include <bvh/bvh.hpp>
+#include <bvh/hierarchy_refitter.hpp>
 #include <bvh/leaf_collapser.hpp>
+#include <bvh/linear_bvh_builder.hpp>
 #include <bvh/locally_ordered_clustering_builder.hpp>
 #include <bvh/parallel_reinsertion_optimizer.hpp>
+#include <bvh/sweep_sah_builder.hpp>
 
 #include <btrc/core/volume/bvh.h>
+#include <btrc/core/volume/indexing.h>
 #include <btrc/utils/enumerate.h>
 
 BTRC_BEGIN
@@ -11,7 +27,13 @@ BTRC_BEGIN
 namespace
 {
 
-    constexpr int TRAVERSAL_STACK_SIZE = 16;
+    // near-first traversal pushes at most one node per level
+    constexpr int TRAVERSAL_STACK_SIZE = 32;
+
+    // wide traversal pushes at most (width - 1) nodes per level
+    constexpr int WIDE_TRAVERSAL_STACK_SIZE = 64;
+
+    constexpr size_t BINNED_SAH_BIN_COUNT = 16;
 
     bvh::Vector3<float> convert(const Vec3f &v)
     {
@@ -33,17 +55,355 @@ namespace
         return cstd::min(cstd::min(a, b), cstd::min(c, d));
     }
 
+    CVec4f min4(const CVec4f &a, const CVec4f &b)
+    {
+        return CVec4f(cstd::min(a.x, b.x), cstd::min(a.y, b.y), cstd::min(a.z, b.z), cstd::min(a.w, b.w));
+    }
+
+    CVec4f max4(const CVec4f &a, const CVec4f &b)
+    {
+        return CVec4f(cstd::max(a.x, b.x), cstd::max(a.y, b.y), cstd::max(a.z, b.z), cstd::max(a.w, b.w));
+    }
+
+    // host versions of BVH::intersect_ray_aabb, BVH::is_in_prim and BVH::find_closest_intersection
+
+    bool intersect_ray_aabb_host(
+        const Vec3f &lower, const Vec3f &upper, const Vec3f &o, const Vec3f &inv_d, float t_max, float &t_enter)
+    {
+        const Vec3f n = inv_d * (lower - o);
+        const Vec3f f = inv_d * (upper - o);
+        const float t0 = (std::max)({ 0.0f, (std::min)(n.x, f.x), (std::min)(n.y, f.y), (std::min)(n.z, f.z) });
+        const float t1 = (std::min)({ t_max, (std::max)(n.x, f.x), (std::max)(n.y, f.y), (std::max)(n.z, f.z) });
+        t_enter = t0;
+        return t0 <= t1;
+    }
+
+    bool is_in_prim_host(const Vec3f &pos, const volume::BVHPrimitive &prim)
+    {
+        const Vec3f op = pos - prim.o;
+        const float u = dot(op, prim.x_div_x2);
+        const float v = dot(op, prim.y_div_y2);
+        const float w = dot(op, prim.z_div_z2);
+        return 0.0f <= u && u <= 1.0f &&
+               0.0f <= v && v <= 1.0f &&
+               0.0f <= w && w <= 1.0f;
+    }
+
+    float find_closest_intersection_host(
+        const Vec3f &p, const Vec3f &d, float t_max, const volume::BVHPrimitive &prim)
+    {
+        const Vec3f op = p - prim.o;
+        float t0 = 0, t1 = t_max;
+        for(const Vec3f &d_div_d2 : { prim.x_div_x2, prim.y_div_y2, prim.z_div_z2 })
+        {
+            const float opd = dot(op, d_div_d2);
+            const float dd = dot(d, d_div_d2);
+            const float nd = (0.0f - opd) / dd;
+            const float fd = (1.0f - opd) / dd;
+            t0 = (std::max)(t0, (std::min)(nd, fd));
+            t1 = (std::min)(t1, (std::max)(nd, fd));
+        }
+        if(t0 > t1)
+            return -1;
+        if(t0 > 0)
+            return t0;
+        if(t1 < t_max)
+            return t1;
+        return -1;
+    }
+
+    // slab test of a ray against the four child boxes of a wide node, one lane per child.
+    // writes the entry distances to t_enter and returns a bit mask of the hit children
+    int intersect_wide_node_host(
+        const volume::BVHWideNode &node, const Vec3f &o, const Vec3f &inv_d, float t_max, float *t_enter)
+    {
+        using volume::BVH_WIDE_NODE_WIDTH;
+#if defined(BTRC_VOLUME_BVH_HOST_SSE)
+        // the minimum / maximum of a nan and a number is the number, as with fminf / fmaxf on the device
+        auto slab = [](const float *lower, const float *upper, float o, float inv_d, __m128 &t0, __m128 &t1)
+        {
+            const __m128 vo = _mm_set1_ps(o), vd = _mm_set1_ps(inv_d);
+            const __m128 n = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lower), vo), vd);
+            const __m128 f = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(upper), vo), vd);
+            t0 = _mm_max_ps(_mm_min_ps(n, f), t0);
+            t1 = _mm_min_ps(_mm_max_ps(n, f), t1);
+        };
+        __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(t_max);
+        slab(&node.lower_x.x, &node.upper_x.x, o.x, inv_d.x, t0, t1);
+        slab(&node.lower_y.x, &node.upper_y.x, o.y, inv_d.y, t0, t1);
+        slab(&node.lower_z.x, &node.upper_z.x, o.z, inv_d.z, t0, t1);
+        _mm_storeu_ps(t_enter, t0);
+        return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+#elif defined(BTRC_VOLUME_BVH_HOST_NEON)
+        auto slab = [](const float *lower, const float *upper, float o, float inv_d, float32x4_t &t0, float32x4_t &t1)
+        {
+            const float32x4_t vo = vdupq_n_f32(o), vd = vdupq_n_f32(inv_d);
+            const float32x4_t n = vmulq_f32(vsubq_f32(vld1q_f32(lower), vo), vd);
+            const float32x4_t f = vmulq_f32(vsubq_f32(vld1q_f32(upper), vo), vd);
+            t0 = vmaxnmq_f32(vminnmq_f32(n, f), t0);
+            t1 = vminnmq_f32(vmaxnmq_f32(n, f), t1);
+        };
+        float32x4_t t0 = vdupq_n_f32(0), t1 = vdupq_n_f32(t_max);
+        slab(&node.lower_x.x, &node.upper_x.x, o.x, inv_d.x, t0, t1);
+        slab(&node.lower_y.x, &node.upper_y.x, o.y, inv_d.y, t0, t1);
+        slab(&node.lower_z.x, &node.upper_z.x, o.z, inv_d.z, t0, t1);
+        vst1q_f32(t_enter, t0);
+        alignas(16) uint32_t hit[BVH_WIDE_NODE_WIDTH];
+        vst1q_u32(hit, vcleq_f32(t0, t1));
+        int mask = 0;
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+            mask |= (hit[i] & 1) << i;
+        return mask;
+#else
+        int mask = 0;
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            const Vec3f lower(node.lower_x[i], node.lower_y[i], node.lower_z[i]);
+            const Vec3f upper(node.upper_x[i], node.upper_y[i], node.upper_z[i]);
+            if(intersect_ray_aabb_host(lower, upper, o, inv_d, t_max, t_enter[i]))
+                mask |= 1 << i;
+        }
+        return mask;
+#endif
+    }
+
+    float half_area(const volume::BVHNode &node)
+    {
+        const Vec3f e = node.upper - node.lower;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    // returns max depth of the subtree
+    int flatten(
+        const bvh::Bvh<float>                  &tree,
+        size_t                                  src_node_idx,
+        int                                     depth,
+        const std::vector<RC<VolumePrimitive>> &vols,
+        std::vector<volume::BVHNode>           &nodes,
+        std::vector<volume::BVHPrimitive>      &prims)
+    {
+        auto &src_node = tree.nodes[src_node_idx];
+        const size_t dst_node_idx = nodes.size();
+        nodes.emplace_back();
+
+        {
+            auto &dst_node = nodes[dst_node_idx];
+            dst_node.lower.x = src_node.bounds[0];
+            dst_node.lower.y = src_node.bounds[2];
+            dst_node.lower.z = src_node.bounds[4];
+            dst_node.upper.x = src_node.bounds[1];
+            dst_node.upper.y = src_node.bounds[3];
+            dst_node.upper.z = src_node.bounds[5];
+        }
+
+        int max_depth = depth;
+        if(src_node.is_leaf())
+        {
+            const size_t prim_beg = prims.size();
+
+            const size_t i_end = src_node.first_child_or_primitive + src_node.primitive_count;
+            for(size_t i = src_node.first_child_or_primitive; i < i_end; ++i)
+            {
+                const size_t pi = tree.primitive_indices[i];
+                prims.push_back(volume::make_bvh_primitive(*vols[pi], static_cast<uint32_t>(pi)));
+            }
+
+            const size_t prim_end = prims.size();
+            assert(prim_end > prim_beg);
+
+            nodes[dst_node_idx].prim_beg = static_cast<int32_t>(prim_beg);
+            nodes[dst_node_idx].prim_end = static_cast<int32_t>(prim_end);
+        }
+        else
+        {
+            const size_t left = src_node.first_child_or_primitive;
+            const int left_depth = flatten(tree, left, depth + 1, vols, nodes, prims);
+
+            const size_t dst_right_idx = nodes.size();
+            const int right_depth = flatten(tree, left + 1, depth + 1, vols, nodes, prims);
+
+            nodes[dst_node_idx].prim_beg = -1;
+            nodes[dst_node_idx].prim_end = static_cast<int32_t>(dst_right_idx);
+            max_depth = (std::max)(left_depth, right_depth);
+        }
+
+        nodes[dst_node_idx].skip = static_cast<int32_t>(nodes.size());
+        return max_depth;
+    }
+
+    template<typename Builder>
+    void build_tree_with(
+        bvh::Bvh<float>                            &tree,
+        const bvh::BoundingBox<float>              &global_bbox,
+        const std::vector<bvh::BoundingBox<float>> &aabbs,
+        const std::vector<bvh::Vector3<float>>     &centers)
+    {
+        Builder builder(tree);
+        builder.build(global_bbox, aabbs.data(), centers.data(), aabbs.size());
+    }
+
+    float compute_sah_cost(const bvh::Bvh<float> &tree)
+    {
+        float cost = 0;
+        for(size_t i = 0; i < tree.node_count; ++i)
+        {
+            auto &node = tree.nodes[i];
+            const float area = node.bounding_box_proxy().half_area();
+            cost += area * (node.is_leaf() ? static_cast<float>(node.primitive_count) : 1.0f);
+        }
+        const float root_area = tree.nodes[0].bounding_box_proxy().half_area();
+        return root_area > 0 ? cost / root_area : 0.0f;
+    }
+
+    // collapse the binary subtree at node_idx into a wide node. returns index of the wide node
+    int32_t collapse_to_wide(
+        const std::vector<volume::BVHNode> &nodes,
+        int32_t                             node_idx,
+        int                                 depth,
+        std::vector<volume::BVHWideNode>   &wide_nodes,
+        int                                &max_depth)
+    {
+        using volume::BVH_WIDE_NODE_WIDTH;
+
+        // open interior children with the largest area until all slots are used
+
+        std::vector<int32_t> children;
+        if(nodes[node_idx].prim_beg < 0)
+            children = { node_idx + 1, nodes[node_idx].prim_end };
+        else
+            children = { node_idx };
+
+        while(children.size() < BVH_WIDE_NODE_WIDTH)
+        {
+            int best = -1;
+            float best_area = -1;
+            for(int i = 0; i < static_cast<int>(children.size()); ++i)
+            {
+                auto &child = nodes[children[i]];
+                if(child.prim_beg < 0 && half_area(child) > best_area)
+                {
+                    best = i;
+                    best_area = half_area(child);
+                }
+            }
+            if(best < 0)
+                break;
+            const int32_t opened = children[best];
+            children[best] = opened + 1;
+            children.push_back(nodes[opened].prim_end);
+        }
+
+        const size_t wide_node_idx = wide_nodes.size();
+        wide_nodes.emplace_back();
+        max_depth = (std::max)(max_depth, depth);
+
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            if(i >= static_cast<int>(children.size()))
+            {
+                auto &wide_node = wide_nodes[wide_node_idx];
+                wide_node.lower_x[i] = wide_node.upper_x[i] = 0;
+                wide_node.lower_y[i] = wide_node.upper_y[i] = 0;
+                wide_node.lower_z[i] = wide_node.upper_z[i] = 0;
+                wide_node.child[i] = 0;
+                wide_node.prim_count[i] = -1;
+                continue;
+            }
+
+            auto &child = nodes[children[i]];
+            {
+                auto &wide_node = wide_nodes[wide_node_idx];
+                wide_node.lower_x[i] = child.lower.x;
+                wide_node.lower_y[i] = child.lower.y;
+                wide_node.lower_z[i] = child.lower.z;
+                wide_node.upper_x[i] = child.upper.x;
+                wide_node.upper_y[i] = child.upper.y;
+                wide_node.upper_z[i] = child.upper.z;
+            }
+
+            if(child.prim_beg >= 0)
+            {
+                wide_nodes[wide_node_idx].child[i] = child.prim_beg;
+                wide_nodes[wide_node_idx].prim_count[i] = child.prim_end - child.prim_beg;
+            }
+            else
+            {
+                const int32_t wide_child = collapse_to_wide(nodes, children[i], depth + 1, wide_nodes, max_depth);
+                wide_nodes[wide_node_idx].child[i] = wide_child;
+                wide_nodes[wide_node_idx].prim_count[i] = 0;
+            }
+        }
+
+        return static_cast<int32_t>(wide_node_idx);
+    }
+
 } // namespace anonymous
 
-volume::BVH::BVH(const std::vector<RC<VolumePrimitive>> &vols)
+volume::BVHPrimitive volume::make_bvh_primitive(const VolumePrimitive &vol, uint32_t vol_id)
+{
+    const VolumePrimitive::VolumeGeometryInfo geo = vol.get_geometry_info();
+    return BVHPrimitive{
+        .o        = geo.o,
+        .vol_id   = vol_id,
+        .x_div_x2 = geo.x / length_square(geo.x),
+        .y_div_y2 = geo.y / length_square(geo.y),
+        .z_div_z2 = geo.z / length_square(geo.z)
+    };
+}
+
+volume::BVH::BVH(
+    const std::vector<RC<VolumePrimitive>> &vols,
+    uint64_t                                overlap_key_seed,
+    const VolumeBVHOptions                 &options)
+    : vols_(vols), options_(options), overlap_key_seed_(overlap_key_seed)
 {
     if(vols.empty())
         return;
 
+    // a binary tree with at least one primitive per leaf has at most 2n-1 nodes,
+    // and each wide node consumes at least one binary interior node
+
+    nodes_.initialize(2 * vols.size() - 1);
+    prims_.initialize(vols.size());
+    if(options_.node_width == BVH_WIDE_NODE_WIDTH)
+        wide_nodes_.initialize((std::max<size_t>)(vols.size() - 1, 1));
+
+    tree_ = newBox<bvh::Bvh<float>>();
+    build_tree();
+    upload_tree();
+    traversal_ = select_traversal();
+}
+
+volume::BVH::~BVH() = default;
+
+bool volume::BVH::update_geometry()
+{
+    if(vols_.empty())
+        return true;
+
+    bvh::HierarchyRefitter refitter(*tree_);
+    refitter.refit([&](bvh::Bvh<float>::Node &leaf)
+    {
+        auto bbox = bvh::BoundingBox<float>::empty();
+        const size_t i_end = leaf.first_child_or_primitive + leaf.primitive_count;
+        for(size_t i = leaf.first_child_or_primitive; i < i_end; ++i)
+            bbox.extend(convert(vols_[tree_->primitive_indices[i]]->get_bounding_box()));
+        leaf.bounding_box_proxy() = bbox;
+    });
+
+    if(compute_sah_cost(*tree_) > options_.rebuild_threshold * built_sah_cost_)
+        build_tree();
+    upload_tree();
+
+    return select_traversal() == traversal_;
+}
+
+void volume::BVH::build_tree()
+{
     AABB3f global_bbox;
-    std::vector<bvh::BoundingBox<float>> aabbs(vols.size());
-    std::vector<bvh::Vector3<float>> centers(vols.size());
-    for(auto &&[i, vol] : enumerate(vols))
+    std::vector<bvh::BoundingBox<float>> aabbs(vols_.size());
+    std::vector<bvh::Vector3<float>> centers(vols_.size());
+    for(auto &&[i, vol] : enumerate(vols_))
     {
         const AABB3f aabb = vol->get_bounding_box();
         aabbs[i] = convert(aabb);
@@ -51,98 +411,462 @@ volume::BVH::BVH(const std::vector<RC<VolumePrimitive>> &vols)
         global_bbox = union_aabb(global_bbox, aabb);
     }
 
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+
     bvh::Bvh<float> tree;
 
-    bvh::LocallyOrderedClusteringBuilder<bvh::Bvh<float>, uint64_t> builder(tree);
-    builder.build(convert(global_bbox), aabbs.data(), centers.data(), vols.size());
+    using Tree = bvh::Bvh<float>;
+    switch(options_.builder)
+    {
+    case VolumeBVHBuilder::LocallyOrderedClustering:
+        build_tree_with<bvh::LocallyOrderedClusteringBuilder<Tree, uint64_t>>(
+            tree, convert(global_bbox), aabbs, centers);
+        break;
+    case VolumeBVHBuilder::BinnedSAH:
+        build_tree_with<bvh::BinnedSahBuilder<Tree, BINNED_SAH_BIN_COUNT>>(
+            tree, convert(global_bbox), aabbs, centers);
+        break;
+    case VolumeBVHBuilder::SweepSAH:
+        build_tree_with<bvh::SweepSahBuilder<Tree>>(
+            tree, convert(global_bbox), aabbs, centers);
+        break;
+    case VolumeBVHBuilder::Linear:
+        build_tree_with<bvh::LinearBvhBuilder<Tree, uint64_t>>(
+            tree, convert(global_bbox), aabbs, centers);
+        break;
+    }
 
-    bvh::ParallelReinsertionOptimizer bvh_optimizer(tree);
-    bvh_optimizer.optimize();
+    if(options_.reinsertion)
+    {
+        bvh::ParallelReinsertionOptimizer bvh_optimizer(tree);
+        bvh_optimizer.optimize();
+    }
 
     bvh::LeafCollapser leaf_collapser(tree);
     leaf_collapser.collapse();
 
-    std::vector<BVHNode> nodes(tree.node_count);
-    std::vector<BVHPrimitive> prims;
+    *tree_ = std::move(tree);
+    built_sah_cost_ = compute_sah_cost(*tree_);
 
-    for(size_t ni = 0; ni < tree.node_count; ++ni)
+    const auto build_time = Clock::now() - start;
+    build_time_ms_ = std::chrono::duration<float, std::milli>(build_time).count();
+}
+
+void volume::BVH::upload_tree()
+{
+    auto &nodes = host_nodes_;
+    auto &prims = host_prims_;
+    nodes.clear();
+    prims.clear();
+    nodes.reserve(tree_->node_count);
+    max_depth_ = flatten(*tree_, 0, 0, vols_, nodes, prims);
+    assert(nodes.size() == tree_->node_count);
+    assert(nodes.size() <= nodes_.get_size());
+    assert(prims.size() == prims_.get_size());
+
+    for(auto &node : nodes)
     {
-        auto &src_node = tree.nodes[ni];
-        auto &dst_node = nodes[ni];
+        if(node.skip == static_cast<int32_t>(nodes.size()))
+            node.skip = -1;
+    }
 
-        dst_node.lower.x = src_node.bounds[0];
-        dst_node.lower.y = src_node.bounds[2];
-        dst_node.lower.z = src_node.bounds[4];
-        dst_node.upper.x = src_node.bounds[1];
-        dst_node.upper.y = src_node.bounds[3];
-        dst_node.upper.z = src_node.bounds[5];
+    nodes_.from_cpu(nodes.data(), 0, nodes.size());
+    prims_.from_cpu(prims.data(), 0, prims.size());
 
-        if(src_node.is_leaf())
+    if(!wide_nodes_.is_empty())
+    {
+        auto &wide_nodes = host_wide_nodes_;
+        wide_nodes.clear();
+        wide_max_depth_ = 0;
+        collapse_to_wide(nodes, 0, 0, wide_nodes, wide_max_depth_);
+        wide_node_count_ = static_cast<int>(wide_nodes.size());
+        assert(wide_nodes.size() <= wide_nodes_.get_size());
+        wide_nodes_.from_cpu(wide_nodes.data(), 0, wide_nodes.size());
+    }
+}
+
+volume::BVH::Traversal volume::BVH::select_traversal() const
+{
+    if(!wide_nodes_.is_empty() && 3 * wide_max_depth_ + BVH_WIDE_NODE_WIDTH <= WIDE_TRAVERSAL_STACK_SIZE)
+        return Traversal::Wide;
+    if(max_depth_ <= TRAVERSAL_STACK_SIZE)
+        return Traversal::Ordered;
+    return Traversal::Stackless;
+}
+
+volume::BVH::Traversal volume::BVH::get_traversal() const
+{
+    return traversal_;
+}
+
+float volume::BVH::find_closest_intersection_host(Traversal traversal, const Vec3f &a, const Vec3f &b) const
+{
+    if(vols_.empty())
+        return btrc_max_float;
+
+    const Vec3f dir = b - a;
+    const Vec3f inv_dir = 1.0f / dir;
+    float final_t = btrc_max_float, t_max = 1.0f;
+
+    auto intersect_prims = [&](int32_t prim_beg, int32_t prim_end)
+    {
+        for(int32_t i = prim_beg; i < prim_end; ++i)
         {
-            const size_t prim_beg = prims.size();
+            const float t = volume::find_closest_intersection_host(a, dir, t_max, host_prims_[i]);
+            if(t >= 0.0f)
+            {
+                final_t = (std::min)(final_t, t);
+                t_max = final_t;
+            }
+        }
+    };
 
-            const size_t i_end = src_node.first_child_or_primitive + src_node.primitive_count;
-            for(size_t i = src_node.first_child_or_primitive; i < i_end; ++i)
+    if(traversal == Traversal::Ordered)
+    {
+        float root_t;
+        if(!intersect_ray_aabb_host(host_nodes_[0].lower, host_nodes_[0].upper, a, inv_dir, t_max, root_t))
+            return final_t;
+
+        std::vector<std::pair<int32_t, float>> stack;
+        int32_t node_idx = 0;
+        for(;;)
+        {
+            auto &node = host_nodes_[node_idx];
+            bool has_next = false;
+            if(node.prim_beg >= 0)
+                intersect_prims(node.prim_beg, node.prim_end);
+            else
             {
-                const size_t pi = tree.primitive_indices[i];
-                auto &vol = vols[pi];
-                const VolumePrimitive::VolumeGeometryInfo geo = vol->get_geometry_info();
-                const BVHPrimitive prim_info = {
-                    .o        = geo.o,
-                    .vol_id   = static_cast<uint32_t>(pi),
-                    .x_div_x2 = geo.x / length_square(geo.x),
-                    .y_div_y2 = geo.y / length_square(geo.y),
-                    .z_div_z2 = geo.z / length_square(geo.z)
-                };
-                prims.push_back(prim_info);
+                const int32_t left_idx = node_idx + 1, right_idx = node.prim_end;
+                auto &left = host_nodes_[left_idx];
+                auto &right = host_nodes_[right_idx];
+                float left_t, right_t;
+                const bool hit_left = intersect_ray_aabb_host(left.lower, left.upper, a, inv_dir, t_max, left_t);
+                const bool hit_right = intersect_ray_aabb_host(right.lower, right.upper, a, inv_dir, t_max, right_t);
+                if(hit_left && hit_right)
+                {
+                    if(stack.size() >= TRAVERSAL_STACK_SIZE)
+                        throw BtrcException("volume bvh traversal stack overflow");
+                    if(left_t <= right_t)
+                    {
+                        stack.push_back({ right_idx, right_t });
+                        node_idx = left_idx;
+                    }
+                    else
+                    {
+                        stack.push_back({ left_idx, left_t });
+                        node_idx = right_idx;
+                    }
+                    has_next = true;
+                }
+                else if(hit_left || hit_right)
+                {
+                    node_idx = hit_left ? left_idx : right_idx;
+                    has_next = true;
+                }
             }
 
-            const size_t prim_end = prims.size();
-            assert(prim_end > prim_beg);
+            while(!has_next && !stack.empty())
+            {
+                auto [idx, t] = stack.back();
+                stack.pop_back();
+                if(t <= t_max)
+                {
+                    node_idx = idx;
+                    has_next = true;
+                }
+            }
 
-            dst_node.prim_beg = static_cast<int32_t>(prim_beg);
-            dst_node.prim_end = static_cast<int32_t>(prim_end);
+            if(!has_next)
+                break;
         }
-        else
+        return final_t;
+    }
+
+    if(traversal == Traversal::Stackless)
+    {
+        int32_t node_idx = 0;
+        while(node_idx >= 0)
         {
-            dst_node.prim_beg = -1;
-            dst_node.prim_end = static_cast<int32_t>(src_node.first_child_or_primitive);
+            auto &node = host_nodes_[node_idx];
+            float node_t;
+            if(!intersect_ray_aabb_host(node.lower, node.upper, a, inv_dir, t_max, node_t))
+                node_idx = node.skip;
+            else if(node.prim_beg >= 0)
+            {
+                intersect_prims(node.prim_beg, node.prim_end);
+                node_idx = node.skip;
+            }
+            else
+                node_idx = node_idx + 1;
         }
+        return final_t;
     }
 
-    nodes_.swap(nodes);
-    prims_.swap(prims);
+    if(host_wide_nodes_.empty())
+        throw BtrcException("volume bvh has no wide nodes");
+
+    std::vector<std::pair<int32_t, float>> stack;
+    auto push = [&](int32_t idx, float t)
+    {
+        if(stack.size() >= WIDE_TRAVERSAL_STACK_SIZE)
+            throw BtrcException("volume bvh traversal stack overflow");
+        stack.push_back({ idx, t });
+    };
+
+    int32_t node_idx = 0;
+    for(;;)
+    {
+        auto &node = host_wide_nodes_[node_idx];
+
+        float t0[BVH_WIDE_NODE_WIDTH];
+        const int hit_mask = intersect_wide_node_host(node, a, inv_dir, t_max, t0);
+
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            if(node.prim_count[i] > 0 && (hit_mask & (1 << i)))
+                intersect_prims(node.child[i], node.child[i] + node.prim_count[i]);
+        }
+
+        int32_t next_idx = -1;
+        float next_t = btrc_max_float;
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            if(node.prim_count[i] == 0 && (hit_mask & (1 << i)) && t0[i] <= t_max)
+            {
+                if(t0[i] < next_t)
+                {
+                    if(next_idx >= 0)
+                        push(next_idx, next_t);
+                    next_idx = node.child[i];
+                    next_t = t0[i];
+                }
+                else
+                    push(node.child[i], t0[i]);
+            }
+        }
+
+        while(next_idx < 0 && !stack.empty())
+        {
+            auto [idx, t] = stack.back();
+            stack.pop_back();
+            if(t <= t_max)
+                next_idx = idx;
+        }
+
+        if(next_idx < 0)
+            break;
+        node_idx = next_idx;
+    }
+    return final_t;
+}
+
+volume::BVH::HostOverlap volume::BVH::get_overlap_host(Traversal traversal, const Vec3f &position) const
+{
+    HostOverlap result;
+    if(vols_.empty())
+        return result;
+
+    auto add_prims = [&](int32_t prim_beg, int32_t prim_end)
+    {
+        for(int32_t i = prim_beg; i < prim_end; ++i)
+        {
+            if(is_in_prim_host(position, host_prims_[i]))
+            {
+                result.key ^= get_volume_key(overlap_key_seed_, host_prims_[i].vol_id);
+                ++result.count;
+            }
+        }
+    };
+
+    auto is_in_aabb = [&](const Vec3f &lower, const Vec3f &upper)
+    {
+        return lower.x <= position.x && position.x <= upper.x &&
+               lower.y <= position.y && position.y <= upper.y &&
+               lower.z <= position.z && position.z <= upper.z;
+    };
+
+    if(traversal != Traversal::Wide)
+    {
+        int32_t node_idx = 0;
+        while(node_idx >= 0)
+        {
+            auto &node = host_nodes_[node_idx];
+            if(!is_in_aabb(node.lower, node.upper))
+                node_idx = node.skip;
+            else if(node.prim_beg >= 0)
+            {
+                add_prims(node.prim_beg, node.prim_end);
+                node_idx = node.skip;
+            }
+            else
+                node_idx = node_idx + 1;
+        }
+        return result;
+    }
+
+    if(host_wide_nodes_.empty())
+        throw BtrcException("volume bvh has no wide nodes");
+
+    std::vector<int32_t> stack = { 0 };
+    while(!stack.empty())
+    {
+        auto &node = host_wide_nodes_[stack.back()];
+        stack.pop_back();
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            const Vec3f lower(node.lower_x[i], node.lower_y[i], node.lower_z[i]);
+            const Vec3f upper(node.upper_x[i], node.upper_y[i], node.upper_z[i]);
+            if(node.prim_count[i] < 0 || !is_in_aabb(lower, upper))
+                continue;
+            if(node.prim_count[i] > 0)
+                add_prims(node.child[i], node.child[i] + node.prim_count[i]);
+            else
+            {
+                if(stack.size() >= WIDE_TRAVERSAL_STACK_SIZE)
+                    throw BtrcException("volume bvh traversal stack overflow");
+                stack.push_back(node.child[i]);
+            }
+        }
+    }
+    return result;
+}
+
+const char *volume::BVH::get_host_slab_test_name()
+{
+#if defined(BTRC_VOLUME_BVH_HOST_SSE)
+    return "sse2";
+#elif defined(BTRC_VOLUME_BVH_HOST_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
 }
 
 bool volume::BVH::is_empty() const
 {
-    return nodes_.empty();
+    return vols_.empty();
+}
+
+VolumeBVHStats volume::BVH::get_stats() const
+{
+    if(vols_.empty())
+        return {};
+    return VolumeBVHStats{
+        .build_time_ms   = build_time_ms_,
+        .sah_cost        = compute_sah_cost(*tree_),
+        .node_count      = static_cast<int>(tree_->node_count),
+        .max_depth       = max_depth_,
+        .wide_node_count = wide_node_count_,
+        .wide_max_depth  = wide_max_depth_
+    };
 }
 
 boolean volume::BVH::find_closest_intersection(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> output_position) const
 {
-    if(nodes_.empty())
+    if(vols_.empty())
         return false;
 
     boolean result;
     $scope
     {
-        var nodes = cuj::const_data(nodes_);
-        var prims = cuj::const_data(prims_);
+        f32 final_t;
+        if(traversal_ == Traversal::Wide)
+            final_t = find_closest_intersection_wide(a, b);
+        else if(traversal_ == Traversal::Ordered)
+            final_t = find_closest_intersection_ordered(a, b);
+        else
+            final_t = find_closest_intersection_stackless(a, b);
+
+        $if(final_t > 10)
+        {
+            result = false;
+            $exit_scope;
+        };
+
+        CUJ_ASSERT(final_t >= 0.0f);
+        CUJ_ASSERT(final_t <= 1.0f);
+        output_position = a * (1.0f - final_t) + b * final_t;
+
+        result = true;
+    };
+    return result;
+}
+
+volume::BVH::Overlap volume::BVH::get_overlap(ref<CVec3f> position) const
+{
+    Overlap result;
+    result.key = 0;
+    result.count = 0;
+    if(vols_.empty())
+        return result;
+    if(traversal_ == Traversal::Wide)
+        return get_overlap_wide(position);
+
+    // point queries visit every node containing the position regardless of order,
+    // so skip links give the same node visits as a stack without its size limit
+
+    var nodes = cuj::import_pointer(nodes_.get());
+    var prims = cuj::import_pointer(prims_.get());
+
+    var node_idx = 0;
+    $while(node_idx >= 0)
+    {
+        ref node = nodes[node_idx];
+        $if(!is_in_aabb(position, node.lower, node.upper))
+        {
+            node_idx = node.skip;
+        }
+        $elif(is_leaf_node(node))
+        {
+            $forrange(i, node.prim_beg, node.prim_end)
+            {
+                ref prim = prims[i];
+                $if(is_in_prim(position, prim))
+                {
+                    result.key = result.key ^ get_volume_key(overlap_key_seed_, prim.vol_id);
+                    result.count = result.count + 1;
+                };
+            };
+            node_idx = node.skip;
+        }
+        $else
+        {
+            node_idx = node_idx + 1;
+        };
+    };
+    return result;
+}
+
+f32 volume::BVH::find_closest_intersection_ordered(ref<CVec3f> a, ref<CVec3f> b) const
+{
+    var nodes = cuj::import_pointer(nodes_.get());
+    var prims = cuj::import_pointer(prims_.get());
+
+    var dir = b - a;
+    var inv_dir = 1.0f / dir;
+    var final_t = btrc_max_float, t_max = 1.0f;
 
-        var dir = b - a;
-        var inv_dir = 1.0f / dir;
-        var final_t = btrc_max_float, t_max = 1.0f;
+    $scope
+    {
+        f32 root_t;
+        ref root = nodes[0];
+        $if(!intersect_ray_aabb(root.lower, root.upper, a, inv_dir, t_max, root_t))
+        {
+            $exit_scope;
+        };
 
-        cuj::arr<u32, TRAVERSAL_STACK_SIZE> traversal_stack;
-        traversal_stack[0] = 0;
+        // pending far children and their entry distances
+        cuj::arr<u32, TRAVERSAL_STACK_SIZE> node_stack;
+        cuj::arr<f32, TRAVERSAL_STACK_SIZE> t_stack;
 
-        var top = 1;
-        $while(top > 0)
+        var top = 0;
+        var node_idx = u32(0);
+        $loop
         {
-            top = top - 1;
-            var task_node_idx = traversal_stack[top];
-            ref<CBVHNode> node = nodes[task_node_idx];
+            ref node = nodes[node_idx];
+            var has_next = false;
 
             $if(is_leaf_node(node))
             {
@@ -158,92 +882,260 @@ boolean volume::BVH::find_closest_intersection(ref<CVec3f> a, ref<CVec3f> b, ref
             }
             $else
             {
-                var left = nodes[node.prim_end];
-                $if(intersect_ray_aabb(left.lower, left.upper, a, inv_dir, t_max))
+                var left_idx = node_idx + 1;
+                var right_idx = u32(node.prim_end);
+                ref left = nodes[left_idx];
+                ref right = nodes[right_idx];
+
+                f32 left_t, right_t;
+                var hit_left = intersect_ray_aabb(left.lower, left.upper, a, inv_dir, t_max, left_t);
+                var hit_right = intersect_ray_aabb(right.lower, right.upper, a, inv_dir, t_max, right_t);
+
+                $if(hit_left & hit_right)
                 {
-                    traversal_stack[top] = u32(node.prim_end);
+                    CUJ_ASSERT(top < TRAVERSAL_STACK_SIZE);
+                    $if(left_t <= right_t)
+                    {
+                        node_stack[top] = right_idx;
+                        t_stack[top] = right_t;
+                        node_idx = left_idx;
+                    }
+                    $else
+                    {
+                        node_stack[top] = left_idx;
+                        t_stack[top] = left_t;
+                        node_idx = right_idx;
+                    };
                     top = top + 1;
+                    has_next = true;
+                }
+                $elif(hit_left)
+                {
+                    node_idx = left_idx;
+                    has_next = true;
+                }
+                $elif(hit_right)
+                {
+                    node_idx = right_idx;
+                    has_next = true;
                 };
+            };
+
+            // pop pending nodes, skipping those entered beyond the closest intersection
 
-                var right = nodes[node.prim_end + 1];
-                $if(intersect_ray_aabb(right.lower, right.upper, a, inv_dir, t_max))
+            $while(!has_next & top > 0)
+            {
+                top = top - 1;
+                $if(t_stack[top] <= t_max)
                 {
-                    traversal_stack[top] = u32(node.prim_end + 1);
-                    top = top + 1;
+                    node_idx = node_stack[top];
+                    has_next = true;
                 };
             };
-        };
 
-        $if(final_t > 10)
-        {
-            result = false;
-            $exit_scope;
+            $if(!has_next)
+            {
+                $break;
+            };
         };
+    };
 
-        CUJ_ASSERT(final_t >= 0.0f);
-        CUJ_ASSERT(final_t <= 1.0f);
-        output_position = a * (1.0f - final_t) + b * final_t;
+    return final_t;
+}
 
-        result = true;
+f32 volume::BVH::find_closest_intersection_stackless(ref<CVec3f> a, ref<CVec3f> b) const
+{
+    var nodes = cuj::import_pointer(nodes_.get());
+    var prims = cuj::import_pointer(prims_.get());
+
+    var dir = b - a;
+    var inv_dir = 1.0f / dir;
+    var final_t = btrc_max_float, t_max = 1.0f;
+
+    var node_idx = 0;
+    $while(node_idx >= 0)
+    {
+        ref node = nodes[node_idx];
+        f32 node_t;
+        $if(!intersect_ray_aabb(node.lower, node.upper, a, inv_dir, t_max, node_t))
+        {
+            node_idx = node.skip;
+        }
+        $elif(is_leaf_node(node))
+        {
+            $forrange(i, node.prim_beg, node.prim_end)
+            {
+                var t = find_closest_intersection(a, dir, t_max, prims[i]);
+                $if(t >= 0.0f)
+                {
+                    final_t = cstd::min(final_t, t);
+                    t_max = final_t;
+                };
+            };
+            node_idx = node.skip;
+        }
+        $else
+        {
+            node_idx = node_idx + 1;
+        };
     };
-    return result;
+
+    return final_t;
 }
 
-volume::BVH::Overlap volume::BVH::get_overlap(ref<CVec3f> position) const
+f32 volume::BVH::find_closest_intersection_wide(ref<CVec3f> a, ref<CVec3f> b) const
 {
-    Overlap result;
-    result.count = 0;
-    if(nodes_.empty())
-        return result;
+    var nodes = cuj::import_pointer(wide_nodes_.get());
+    var prims = cuj::import_pointer(prims_.get());
 
-    $scope
+    var dir = b - a;
+    var inv_dir = 1.0f / dir;
+    var final_t = btrc_max_float, t_max = 1.0f;
+
+    cuj::arr<i32, WIDE_TRAVERSAL_STACK_SIZE> node_stack;
+    cuj::arr<f32, WIDE_TRAVERSAL_STACK_SIZE> t_stack;
+    var top = 0;
+
+    auto push = [&](i32 idx, f32 t)
     {
-        var nodes = cuj::const_data(nodes_);
-        var prims = cuj::const_data(prims_);
+        CUJ_ASSERT(top < WIDE_TRAVERSAL_STACK_SIZE);
+        node_stack[top] = idx;
+        t_stack[top] = t;
+        top = top + 1;
+    };
 
-        cuj::arr<u32, TRAVERSAL_STACK_SIZE> traversal_stack;
-        traversal_stack[0] = 0;
+    var node_idx = 0;
+    $loop
+    {
+        ref node = nodes[node_idx];
 
-        var top = 1;
-        $while(top > 0)
-        {
-            top = top - 1;
-            ref node = nodes[traversal_stack[top]];
+        // slab test of all children at once
 
-            $if(is_leaf_node(node))
+        var nx = (node.lower_x - a.x) * inv_dir.x;
+        var fx = (node.upper_x - a.x) * inv_dir.x;
+        var ny = (node.lower_y - a.y) * inv_dir.y;
+        var fy = (node.upper_y - a.y) * inv_dir.y;
+        var nz = (node.lower_z - a.z) * inv_dir.z;
+        var fz = (node.upper_z - a.z) * inv_dir.z;
+        var t0 = max4(max4(min4(nx, fx), min4(ny, fy)), max4(min4(nz, fz), CVec4f(0.0f)));
+        var t1 = min4(min4(max4(nx, fx), max4(ny, fy)), min4(max4(nz, fz), CVec4f(t_max)));
+
+        // leaf children are processed immediately
+
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            $if(node.prim_count[i] > 0 & t0[i] <= t1[i])
             {
-                $forrange(i, node.prim_beg, node.prim_end)
+                var prim_beg = node.child[i];
+                $forrange(j, prim_beg, prim_beg + node.prim_count[i])
                 {
-                    ref prim = prims[i];
-                    $if(is_in_prim(position, prim))
+                    var t = find_closest_intersection(a, dir, t_max, prims[j]);
+                    $if(t >= 0.0f)
                     {
-                        result.data[result.count] = prim.vol_id;
-                        result.count = result.count + 1;
-                        $if(result.count >= MAX_OVERLAP_COUNT)
-                        {
-                            $exit_scope;
-                        };
+                        final_t = cstd::min(final_t, t);
+                        t_max = final_t;
                     };
                 };
-            }
-            $else
+            };
+        }
+
+        // descend into the nearest interior child and push the others
+
+        var next_idx = -1;
+        var next_t = btrc_max_float;
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            $if(node.prim_count[i] == 0 & t0[i] <= t1[i] & t0[i] <= t_max)
             {
-                var left = nodes[node.prim_end];
-                $if(is_in_aabb(position, left.lower, left.upper))
+                $if(t0[i] < next_t)
                 {
-                    traversal_stack[top] = u32(node.prim_end);
-                    top = top + 1;
+                    $if(next_idx >= 0)
+                    {
+                        push(next_idx, next_t);
+                    };
+                    next_idx = node.child[i];
+                    next_t = t0[i];
+                }
+                $else
+                {
+                    push(node.child[i], t0[i]);
                 };
+            };
+        }
+
+        $while(next_idx < 0 & top > 0)
+        {
+            top = top - 1;
+            $if(t_stack[top] <= t_max)
+            {
+                next_idx = node_stack[top];
+            };
+        };
+
+        $if(next_idx < 0)
+        {
+            $break;
+        };
+        node_idx = next_idx;
+    };
+
+    return final_t;
+}
+
+volume::BVH::Overlap volume::BVH::get_overlap_wide(ref<CVec3f> position) const
+{
+    Overlap result;
+    result.key = 0;
+    result.count = 0;
 
-                var right = nodes[node.prim_end + 1];
-                $if(is_in_aabb(position, right.lower, right.upper))
+    var nodes = cuj::import_pointer(wide_nodes_.get());
+    var prims = cuj::import_pointer(prims_.get());
+
+    cuj::arr<i32, WIDE_TRAVERSAL_STACK_SIZE> node_stack;
+    var top = 0;
+
+    var node_idx = 0;
+    $loop
+    {
+        ref node = nodes[node_idx];
+        for(int i = 0; i < BVH_WIDE_NODE_WIDTH; ++i)
+        {
+            var in_child = node.prim_count[i] >= 0 &
+                           node.lower_x[i] <= position.x & position.x <= node.upper_x[i] &
+                           node.lower_y[i] <= position.y & position.y <= node.upper_y[i] &
+                           node.lower_z[i] <= position.z & position.z <= node.upper_z[i];
+            $if(in_child)
+            {
+                $if(node.prim_count[i] > 0)
                 {
-                    traversal_stack[top] = u32(node.prim_end + 1);
+                    var prim_beg = node.child[i];
+                    $forrange(j, prim_beg, prim_beg + node.prim_count[i])
+                    {
+                        ref prim = prims[j];
+                        $if(is_in_prim(position, prim))
+                        {
+                            result.key = result.key ^ get_volume_key(overlap_key_seed_, prim.vol_id);
+                            result.count = result.count + 1;
+                        };
+                    };
+                }
+                $else
+                {
+                    CUJ_ASSERT(top < WIDE_TRAVERSAL_STACK_SIZE);
+                    node_stack[top] = node.child[i];
                     top = top + 1;
                 };
             };
+        }
+
+        $if(top == 0)
+        {
+            $break;
         };
+        top = top - 1;
+        node_idx = node_stack[top];
     };
+
     return result;
 }
 
@@ -270,12 +1162,14 @@ boolean volume::BVH::is_in_aabb(ref<CVec3f> pos, ref<CVec3f> lower, ref<CVec3f>
            lower.z <= pos.z & pos.z <= upper.z;
 }
 
-boolean volume::BVH::intersect_ray_aabb(ref<CVec3f> lower, ref<CVec3f> upper, ref<CVec3f> o, ref<CVec3f> inv_d, f32 t_max) const
+boolean volume::BVH::intersect_ray_aabb(
+    ref<CVec3f> lower, ref<CVec3f> upper, ref<CVec3f> o, ref<CVec3f> inv_d, f32 t_max, ref<f32> t_enter) const
 {
     var n = inv_d * (lower - o);
     var f = inv_d * (upper - o);
     var t0 = max(0.0f, cstd::min(n.x, f.x), cstd::min(n.y, f.y), cstd::min(n.z, f.z));
     var t1 = min(t_max, cstd::max(n.x, f.x), cstd::max(n.y, f.y), cstd::max(n.z, f.z));
+    t_enter = t0;
     return t0 <= t1;
 }
 
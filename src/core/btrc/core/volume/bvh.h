@@ -1,21 +1,44 @@
 #pragma once
 
 #include <btrc/core/volume.h>
+#include <btrc/utils/cuda/buffer.h>
+
+namespace bvh
+{
+    template<typename Scalar>
+    struct Bvh;
+}
 
 BTRC_BEGIN
 
 namespace volume
 {
 
-    constexpr int MAX_OVERLAP_COUNT = 4;
-
+    // nodes are stored in depth-first order. left child of an interior node is always the next node
     struct BVHNode
     {
         Vec3f lower; int32_t prim_beg; // -1 for interior node
-        Vec3f upper; int32_t prim_end; // left child index for interior node
+        Vec3f upper; int32_t prim_end; // right child index for interior node
+        int32_t skip;                  // next node to visit when this subtree is skipped. -1 for end of traversal
+    };
+
+    CUJ_PROXY_CLASS(CBVHNode, BVHNode, lower, prim_beg, upper, prim_end, skip);
+
+    constexpr int BVH_WIDE_NODE_WIDTH = 4;
+
+    // 4-wide node with soa child bounds
+    struct BVHWideNode
+    {
+        Vec4f lower_x, upper_x;
+        Vec4f lower_y, upper_y;
+        Vec4f lower_z, upper_z;
+        int32_t child[BVH_WIDE_NODE_WIDTH];      // wide node index for interior child, first primitive for leaf child
+        int32_t prim_count[BVH_WIDE_NODE_WIDTH]; // 0 for interior child, -1 for empty slot
     };
 
-    CUJ_PROXY_CLASS(CBVHNode, BVHNode, lower, prim_beg, upper, prim_end);
+    CUJ_PROXY_CLASS(
+        CBVHWideNode, BVHWideNode,
+        lower_x, upper_x, lower_y, upper_y, lower_z, upper_z, child, prim_count);
 
     struct BVHPrimitive
     {
@@ -27,39 +50,118 @@ namespace volume
 
     CUJ_PROXY_CLASS(CBVHPrimitive, BVHPrimitive, o, vol_id, x_div_x2, y_div_y2, z_div_z2);
 
-    class BVH
+    BVHPrimitive make_bvh_primitive(const VolumePrimitive &vol, uint32_t vol_id);
+
+    // nodes and primitives live in device buffers whose sizes only depend on the number of volumes,
+    // so that geometry changes can be applied without regenerating kernels
+    class BVH : public Uncopyable
     {
     public:
 
+        // key is the xor of volume keys (see volume::get_volume_key)
         CUJ_CLASS_BEGIN(Overlap)
-            using OverlapData = cuj::arr<u32, MAX_OVERLAP_COUNT>;
-            CUJ_MEMBER_VARIABLE(OverlapData, data)
+            CUJ_MEMBER_VARIABLE(u64, key)
             CUJ_MEMBER_VARIABLE(i32, count)
         CUJ_CLASS_END
 
-        explicit BVH(const std::vector<RC<VolumePrimitive>> &vols);
+        struct HostOverlap
+        {
+            uint64_t key = 0;
+            int      count = 0;
+        };
+
+        enum class Traversal
+        {
+            Ordered,
+            Stackless,
+            Wide
+        };
+
+        BVH(
+            const std::vector<RC<VolumePrimitive>> &vols,
+            uint64_t                                overlap_key_seed,
+            const VolumeBVHOptions                 &options = {});
+
+        ~BVH();
+
+        // refit the tree to current geometry of volumes. the tree is rebuilt when its sah cost
+        // exceeds options.rebuild_threshold times the cost of the last build.
+        // returns false when compiled kernels are invalidated and must be regenerated
+        bool update_geometry();
 
         bool is_empty() const;
 
+        VolumeBVHStats get_stats() const;
+
         boolean find_closest_intersection(ref<CVec3f> a, ref<CVec3f> b, ref<CVec3f> output_position) const;
 
         Overlap get_overlap(ref<CVec3f> position) const;
 
+        // traversal used by device queries
+        Traversal get_traversal() const;
+
+        // host versions of the device traversals over the same flattened tree, for validation.
+        // throw when the traversal is not available for the tree or its stack overflows
+
+        // returns btrc_max_float when there is no intersection
+        float find_closest_intersection_host(Traversal traversal, const Vec3f &a, const Vec3f &b) const;
+
+        HostOverlap get_overlap_host(Traversal traversal, const Vec3f &position) const;
+
+        // instruction set of the 4-lane slab test in the host wide traversal: "sse2", "neon" or "scalar"
+        static const char *get_host_slab_test_name();
+
     private:
 
+        void build_tree();
+
+        // flatten the tree and upload it to device buffers
+        void upload_tree();
+
+        Traversal select_traversal() const;
+
         boolean is_leaf_node(ref<CBVHNode> node) const;
 
         boolean is_in_prim(ref<CVec3f> pos, ref<CBVHPrimitive> prim) const;
 
         boolean is_in_aabb(ref<CVec3f> pos, ref<CVec3f> lower, ref<CVec3f> upper) const;
 
-        boolean intersect_ray_aabb(ref<CVec3f> lower, ref<CVec3f> upper, ref<CVec3f> o, ref<CVec3f> inv_d, f32 t_max) const;
+        boolean intersect_ray_aabb(
+            ref<CVec3f> lower, ref<CVec3f> upper, ref<CVec3f> o, ref<CVec3f> inv_d, f32 t_max, ref<f32> t_enter) const;
 
         // returns -1 when there is no intersection
         f32 find_closest_intersection(ref<CVec3f> o, ref<CVec3f> inv_d, f32 t_max, ref<CBVHPrimitive> prim) const;
 
-        std::vector<BVHNode>      nodes_;
-        std::vector<BVHPrimitive> prims_;
+        // near-first traversal with a bounded stack. returns btrc_max_float when there is no intersection
+        f32 find_closest_intersection_ordered(ref<CVec3f> a, ref<CVec3f> b) const;
+
+        // skip-link traversal. used when the tree is too deep for the traversal stack
+        f32 find_closest_intersection_stackless(ref<CVec3f> a, ref<CVec3f> b) const;
+
+        // 4-wide traversals. pending children are kept on a bounded stack
+        f32 find_closest_intersection_wide(ref<CVec3f> a, ref<CVec3f> b) const;
+
+        Overlap get_overlap_wide(ref<CVec3f> position) const;
+
+        std::vector<RC<VolumePrimitive>> vols_;
+        VolumeBVHOptions                 options_;
+        uint64_t                         overlap_key_seed_ = 0;
+
+        Box<bvh::Bvh<float>> tree_;
+        float                built_sah_cost_ = 0;
+        float                build_time_ms_ = 0;
+        int                  max_depth_ = 0;
+        int                  wide_node_count_ = 0;
+        int                  wide_max_depth_ = 0;
+        Traversal            traversal_ = Traversal::Ordered;
+
+        std::vector<BVHNode>      host_nodes_;
+        std::vector<BVHWideNode>  host_wide_nodes_;
+        std::vector<BVHPrimitive> host_prims_;
+
+        cuda::Buffer<BVHNode>      nodes_;
+        cuda::Buffer<BVHWideNode>  wide_nodes_;
+        cuda::Buffer<BVHPrimitive> prims_;
     };
 
 } // namespace volume
@@ -1,75 +1,126 @@
-#include <algorithm>
+#include <bit>
+#include <unordered_set>
 
 #include <btrc/core/volume/indexing.h>
+#include <btrc/utils/low_discrepancy.h>
 
 BTRC_BEGIN
 
 namespace
 {
 
-    struct Node
+    constexpr uint64_t VOLUME_KEY_MULTIPLIER = 0x9e3779b97f4a7c15ull;
+
+    // host version of mix_bits in low_discrepancy.h
+    uint64_t mix_bits_host(uint64_t v)
     {
-        int overlap_index = -2;
-        std::map<RC<VolumePrimitive>, Box<Node>> children;
-    };
-
-    // returns index where node begins
-    int32_t fill_indices(
-        const Node *node, std::vector<int32_t> &indices,
-        const std::vector<RC<VolumePrimitive>> &all_vols)
+        v = v ^ (v >> 31);
+        v = v * 0x7fb5d329728ea185ull;
+        v = v ^ (v >> 27);
+        v = v * 0x81dadef4bc2dd44dull;
+        v = v ^ (v >> 33);
+        return v;
+    }
+
+    uint64_t compute_overlap_key(
+        uint64_t seed,
+        const std::set<RC<VolumePrimitive>> &overlap,
+        const std::map<RC<VolumePrimitive>, int> &vol_to_id)
     {
-        const int32_t result = static_cast<int32_t>(indices.size());
-        indices.resize(indices.size() + 1 + all_vols.size(), -1);
-        indices[result] = node->overlap_index;
-        for(size_t i = 0; i < all_vols.size(); ++i)
-        {
-            auto &vol = all_vols[i];
-            if(auto it = node->children.find(vol); it != node->children.end())
-                indices[result + i + 1] = fill_indices(it->second.get(), indices, all_vols);
-        }
-        return result;
+        uint64_t key = 0;
+        for(auto &vol : overlap)
+            key ^= volume::get_volume_key(seed, static_cast<uint32_t>(vol_to_id.at(vol)));
+        return key;
     }
 
 } // namespace anonymous
 
+uint64_t volume::get_volume_key(uint64_t seed, uint32_t vol_id)
+{
+    return mix_bits_host(seed ^ (VOLUME_KEY_MULTIPLIER * (uint64_t(vol_id) + 1)));
+}
+
+u64 volume::get_volume_key(uint64_t seed, u32 vol_id)
+{
+    return mix_bits(u64(seed) ^ (u64(VOLUME_KEY_MULTIPLIER) * (u64(vol_id) + 1)));
+}
+
 volume::OverlapIndexer::OverlapIndexer(
     const std::vector<std::set<RC<VolumePrimitive>>> &overlaps,
-    const std::vector<RC<VolumePrimitive>> &all_vols,
-    const std::map<RC<VolumePrimitive>, int> &vol_to_id)
+    const std::map<RC<VolumePrimitive>, int>         &vol_to_id,
+    uint64_t                                          first_seed,
+    size_t                                            min_table_size)
 {
-    // build trie
+    // find a seed making keys of all overlaps distinct.
+    // almost always succeeds at the first try
 
-    Node root_node = { -1, {} };
-    for(size_t i = 0; i < overlaps.size(); ++i)
+    std::vector<uint64_t> keys(overlaps.size());
+    for(uint64_t seed = first_seed;; ++seed)
     {
-        std::vector<RC<VolumePrimitive>> vols{ overlaps[i].begin(), overlaps[i].end() };
-
-        auto cmp = [&](const auto &l, const auto &r) { return vol_to_id.at(l) < vol_to_id.at(r); };
-        std::sort(vols.begin(), vols.end(), cmp);
-
-        do
+        std::unordered_set<uint64_t> used_keys;
+        bool conflict = false;
+        for(size_t i = 0; i < overlaps.size(); ++i)
         {
-            Node *node = &root_node;
-            for(auto &vol : vols)
+            keys[i] = compute_overlap_key(seed, overlaps[i], vol_to_id);
+            if(!used_keys.insert(keys[i]).second)
             {
-                auto it = node->children.find(vol);
-                if(it == node->children.end())
-                    it = node->children.insert({ vol, newBox<Node>() }).first;
-                node = it->second.get();
+                conflict = true;
+                break;
             }
-            assert(node->overlap_index == -2);
-            node->overlap_index = static_cast<int>(i);
-        } while(std::next_permutation(vols.begin(), vols.end(), cmp));
+        }
+        if(!conflict)
+        {
+            key_seed_ = seed;
+            break;
+        }
     }
 
-    // create indices
+    // flatten volume ids
 
-    fill_indices(&root_node, indices_, all_vols);
+    records_.resize(overlaps.size());
+    for(size_t i = 0; i < overlaps.size(); ++i)
+    {
+        records_[i].vol_beg = static_cast<uint32_t>(vol_ids_.size());
+        for(auto &vol : overlaps[i])
+            vol_ids_.push_back(static_cast<uint32_t>(vol_to_id.at(vol)));
+        records_[i].vol_end = static_cast<uint32_t>(vol_ids_.size());
+    }
+
+    // build hash table. load factor is kept below 0.5
+
+    assert(!min_table_size || std::has_single_bit(min_table_size));
+    const size_t table_size = (std::max)(
+        std::bit_ceil((std::max<size_t>)(2 * overlaps.size(), 2)), min_table_size);
+    const uint64_t mask = table_size - 1;
+    table_.resize(table_size, OverlapTableEntry{ .key = 0, .record = -1 });
+    for(size_t i = 0; i < overlaps.size(); ++i)
+    {
+        uint64_t slot = keys[i] & mask;
+        while(table_[slot].record >= 0)
+            slot = (slot + 1) & mask;
+        table_[slot].key = keys[i];
+        table_[slot].record = static_cast<int32_t>(i);
+    }
+}
+
+uint64_t volume::OverlapIndexer::get_key_seed() const
+{
+    return key_seed_;
+}
+
+const std::vector<volume::OverlapTableEntry> &volume::OverlapIndexer::get_table() const
+{
+    return table_;
+}
+
+const std::vector<volume::OverlapRecord> &volume::OverlapIndexer::get_records() const
+{
+    return records_;
 }
 
-const std::vector<int32_t> &volume::OverlapIndexer::get_indices() const
+const std::vector<uint32_t> &volume::OverlapIndexer::get_vol_ids() const
 {
-    return indices_;
+    return vol_ids_;
 }
 
 BTRC_END
@@ -7,20 +7,58 @@ BTRC_BEGIN
 namespace volume
 {
 
+    struct OverlapRecord
+    {
+        uint32_t vol_beg; // range in the flattened volume id array
+        uint32_t vol_end;
+    };
+
+    CUJ_PROXY_CLASS(COverlapRecord, OverlapRecord, vol_beg, vol_end);
+
+    struct OverlapTableEntry
+    {
+        uint64_t key;
+        int32_t  record; // -1 for empty entry
+    };
+
+    CUJ_PROXY_CLASS(COverlapTableEntry, OverlapTableEntry, key, record);
+
+    // key of a set of volumes is the xor of keys of its elements,
+    // so that it can be accumulated in any order during bvh traversal
+
+    uint64_t get_volume_key(uint64_t seed, uint32_t vol_id);
+
+    u64 get_volume_key(uint64_t seed, u32 vol_id);
+
     class OverlapIndexer
     {
     public:
 
+        // seeds are searched from first_seed.
+        // table size is at least min_table_size, which must be zero or a power of 2
         OverlapIndexer(
             const std::vector<std::set<RC<VolumePrimitive>>> &overlaps,
-            const std::vector<RC<VolumePrimitive>> &all_vols,
-            const std::map<RC<VolumePrimitive>, int> &vol_to_id);
+            const std::map<RC<VolumePrimitive>, int>         &vol_to_id,
+            uint64_t                                          first_seed = 0,
+            size_t                                            min_table_size = 0);
+
+        uint64_t get_key_seed() const;
 
-        const std::vector<int32_t> &get_indices() const;
+        // open addressing table with power-of-2 size. use linear probing
+        const std::vector<OverlapTableEntry> &get_table() const;
+
+        // records[i] corresponds to overlaps[i]
+        const std::vector<OverlapRecord> &get_records() const;
+
+        const std::vector<uint32_t> &get_vol_ids() const;
 
     private:
 
-        std::vector<int32_t> indices_;
+        uint64_t key_seed_ = 0;
+
+        std::vector<OverlapTableEntry> table_;
+        std::vector<OverlapRecord>     records_;
+        std::vector<uint32_t>          vol_ids_;
     };
 
 } // namespace volume
@@ -0,0 +1,570 @@
+#include <chrono>
+
+#include <btrc/core/volume/lighting_cache.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/hash.h>
+
+BTRC_BEGIN
+
+namespace
+{
+
+    const char KERNEL[] = "estimate_volume_lighting_cache";
+    const char REFERENCE_KERNEL[] = "estimate_volume_lighting_cache_reference";
+
+    constexpr int BLOCK_SIZE = 64;
+
+    // reference paths are terminated by russian roulette after this depth
+    constexpr int REFERENCE_RR_DEPTH = 8;
+    constexpr int REFERENCE_MAX_DEPTH = 1024;
+
+    class CellSampler : public Sampler
+    {
+    public:
+
+        explicit CellSampler(i32 cell)
+            : rng_(hash::hash(cell))
+        {
+
+        }
+
+        f32 get1d() override
+        {
+            return rng_.uniform_float();
+        }
+
+    private:
+
+        cstd::PCG rng_;
+    };
+
+    CVec3f axis_offset(i32 axis, const Vec3f &cell_size)
+    {
+        return CVec3f(
+            cstd::select(axis == 0, f32(cell_size.x), f32(0)),
+            cstd::select(axis == 1, f32(cell_size.y), f32(0)),
+            cstd::select(axis == 2, f32(cell_size.z), f32(0)));
+    }
+
+    void store(ptr<f32> output, i32 index, const CSpectrum &value)
+    {
+        output[index + 0] = value.r;
+        output[index + 1] = value.g;
+        output[index + 2] = value.b;
+    }
+
+    template<typename DefineKernel>
+    cuda::Module compile_kernel(const DefineKernel &define_kernel)
+    {
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+            define_kernel();
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+        return cuda_module;
+    }
+
+    struct LightSample
+    {
+        CSpectrum li; // radiance attenuated by the medium, divided by the pdf
+        CVec3f    dir;
+    };
+
+    // surfaces are not considered as occluders
+    LightSample sample_light(
+        CompileContext     &cc,
+        const Medium       &medium,
+        const LightSampler &light_sampler,
+        ref<CVec3f>         p,
+        float               diagonal,
+        Sampler            &sampler)
+    {
+        LightSample result;
+        result.li = CSpectrum::zero();
+        result.dir = CVec3f(0, 0, 1);
+
+        var select_light = light_sampler.sample(p, sampler.get1d());
+        $if(select_light.light_idx >= 0)
+        {
+            light_sampler.access_light(select_light.light_idx, [&](const Light *light)
+            {
+                if(auto area = light->as_area())
+                {
+                    var sample = area->sample_li(cc, p, sampler.get3d());
+                    $if(sample.pdf > 0)
+                    {
+                        var tr = medium.tr(cc, p, sample.position, sampler);
+                        result.li = tr * sample.radiance / (sample.pdf * select_light.pdf);
+                        result.dir = normalize(sample.position - p);
+                    };
+                }
+                else
+                {
+                    auto envir = light->as_envir();
+                    var sample = envir->sample_li(cc, sampler.get3d());
+                    $if(sample.pdf > 0)
+                    {
+                        var dir = normalize(sample.direction_to_light);
+                        var tr = medium.tr(cc, p, p + diagonal * dir, sampler);
+                        result.li = tr * sample.radiance / (sample.pdf * select_light.pdf);
+                        result.dir = dir;
+                    };
+                }
+            });
+        };
+        return result;
+    }
+
+    std::vector<Spectrum> to_spectrums(const cuda::Buffer<float> &buffer, int stride, int offset)
+    {
+        std::vector<float> data(buffer.get_size());
+        buffer.to_cpu(data.data());
+        std::vector<Spectrum> result(data.size() / stride);
+        for(size_t i = 0; i < result.size(); ++i)
+        {
+            const float *v = &data[i * stride + offset];
+            result[i] = Spectrum::from_rgb(v[0], v[1], v[2]);
+        }
+        return result;
+    }
+
+} // namespace anonymous
+
+volume::LightingCache::LightingCache(const VolumeLightingCacheOptions &options)
+    : options_(options)
+{
+    if(options_.resolution < 2)
+        throw BtrcException("volume lighting cache resolution must be at least 2");
+}
+
+bool volume::LightingCache::build(const Medium &medium, const LightSampler &light_sampler, const AABB3f &bbox)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+
+    const bool same_grid =
+        radiance_ &&
+        bbox_.lower.x == bbox.lower.x && bbox_.lower.y == bbox.lower.y && bbox_.lower.z == bbox.lower.z &&
+        bbox_.upper.x == bbox.upper.x && bbox_.upper.y == bbox.upper.y && bbox_.upper.z == bbox.upper.z;
+
+    bbox_ = bbox;
+    cell_size_ = (bbox.upper - bbox.lower) / static_cast<float>(options_.resolution);
+
+    const CellEstimates estimates = estimate_cells(medium, light_sampler);
+    const std::vector<Spectrum> radiance = propagate(estimates);
+
+    std::vector<float> data;
+    data.reserve(radiance.size() * 3);
+    for(auto &r : radiance)
+    {
+        data.push_back(r.r);
+        data.push_back(r.g);
+        data.push_back(r.b);
+    }
+    if(same_grid)
+        radiance_.from_cpu(data.data());
+    else
+        radiance_ = cuda::Buffer<float>(data);
+
+    float direct_lum = 0;
+    for(auto &d : estimates.direct)
+        direct_lum += d.get_lum();
+    stats_.resolution = options_.resolution;
+    stats_.direct_lum = direct_lum / static_cast<float>(estimates.direct.size());
+    stats_.anisotropic_samples = estimates.anisotropic_count;
+    stats_.build_time_ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+    stats_.reference_error = -1;
+    if(options_.reference_probes > 0)
+        stats_.reference_error = estimate_reference_error(medium, light_sampler, radiance);
+
+    return same_grid;
+}
+
+int volume::LightingCache::get_depth() const
+{
+    return options_.depth;
+}
+
+VolumeLightingCacheStats volume::LightingCache::get_stats() const
+{
+    return stats_;
+}
+
+CSpectrum volume::LightingCache::eval(ref<CVec3f> position) const
+{
+    const int res = options_.resolution;
+    var data = cuj::import_pointer(radiance_.get());
+
+    // cell values are stored at cell centers
+    var gx = cstd::clamp((position.x - bbox_.lower.x) / cell_size_.x - 0.5f, f32(0), f32(res - 1));
+    var gy = cstd::clamp((position.y - bbox_.lower.y) / cell_size_.y - 0.5f, f32(0), f32(res - 1));
+    var gz = cstd::clamp((position.z - bbox_.lower.z) / cell_size_.z - 0.5f, f32(0), f32(res - 1));
+
+    var x0 = i32(gx), y0 = i32(gy), z0 = i32(gz);
+    var x1 = cstd::min(x0 + 1, i32(res - 1));
+    var y1 = cstd::min(y0 + 1, i32(res - 1));
+    var z1 = cstd::min(z0 + 1, i32(res - 1));
+    var fx = gx - f32(x0), fy = gy - f32(y0), fz = gz - f32(z0);
+
+    auto load = [&](i32 x, i32 y, i32 z)
+    {
+        var i = 3 * (x + res * (y + res * z));
+        return CSpectrum::from_rgb(data[i], data[i + 1], data[i + 2]);
+    };
+
+    var v00 = load(x0, y0, z0) * (1.0f - fx) + load(x1, y0, z0) * fx;
+    var v10 = load(x0, y1, z0) * (1.0f - fx) + load(x1, y1, z0) * fx;
+    var v01 = load(x0, y0, z1) * (1.0f - fx) + load(x1, y0, z1) * fx;
+    var v11 = load(x0, y1, z1) * (1.0f - fx) + load(x1, y1, z1) * fx;
+    var v0 = v00 * (1.0f - fy) + v10 * fy;
+    var v1 = v01 * (1.0f - fy) + v11 * fy;
+    return v0 * (1.0f - fz) + v1 * fz;
+}
+
+volume::LightingCache::CellEstimates volume::LightingCache::estimate_cells(
+    const Medium &medium, const LightSampler &light_sampler) const
+{
+    const int res = options_.resolution;
+    const int cell_count = res * res * res;
+    const int light_samples = options_.light_samples;
+    const int tr_samples = options_.tr_samples;
+    const Vec3f lower = bbox_.lower;
+    const Vec3f cell_size = cell_size_;
+    const float diagonal = 2 * length(bbox_.upper - bbox_.lower);
+
+    auto cuda_module = compile_kernel([&]
+    {
+        CompileContext cc;
+        cuj::kernel(KERNEL, [&](
+            ptr<f32> direct_output, ptr<f32> albedo_output, ptr<f32> tr_output, ptr<i32> anisotropic_count)
+        {
+            var cell = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+            $if(cell >= cell_count)
+            {
+                $return();
+            };
+
+            var xi = cell % res;
+            var yi = (cell / res) % res;
+            var zi = cell / (res * res);
+            var p = CVec3f(
+                lower.x + (f32(xi) + 0.5f) * cell_size.x,
+                lower.y + (f32(yi) + 0.5f) * cell_size.y,
+                lower.z + (f32(zi) + 0.5f) * cell_size.z);
+
+            CellSampler sampler(cell);
+
+            // average radiance from lights, attenuated by the medium
+
+            var direct = CSpectrum::zero();
+            $forrange(i, 0, light_samples)
+            {
+                auto light_sample = sample_light(cc, medium, light_sampler, p, diagonal, sampler);
+                direct = direct + light_sample.li;
+            };
+            store(direct_output, 3 * cell, direct * (1.0f / (4 * btrc_pi * light_samples)));
+
+            // albedo at scattering events sampled along the 6 axis directions in the cell
+
+            var albedo_sum = CSpectrum::zero();
+            var scatter_count = 0;
+            $forrange(i, 0, tr_samples)
+            {
+                $forrange(d, 0, 6)
+                {
+                    var e = axis_offset(d / 2, cell_size) * cstd::select(d % 2 == 0, f32(0.5f), f32(-0.5f));
+                    auto sample = medium.sample(cc, p - e, p + e, sampler);
+                    $if(sample.scattered)
+                    {
+                        var dir = normalize(e);
+                        var pdf = sample.shader->pdf(cc, dir, -dir);
+                        $if(pdf > 0)
+                        {
+                            albedo_sum = albedo_sum + sample.throughput * sample.shader->eval(cc, dir, -dir) / pdf;
+                            scatter_count = scatter_count + 1;
+                        };
+
+                        // forward and backward scattering differ for anisotropic phase functions
+                        var back_pdf = sample.shader->pdf(cc, dir, dir);
+                        $if(cstd::abs(pdf - back_pdf) > 1e-3f * (pdf + back_pdf))
+                        {
+                            cstd::atomic_add(anisotropic_count, 1);
+                        };
+                    };
+                };
+            };
+            var albedo = CSpectrum::zero();
+            $if(scatter_count > 0)
+            {
+                albedo = albedo_sum / f32(scatter_count);
+            };
+            store(albedo_output, 3 * cell, albedo);
+
+            // transmittance to neighbour cell centers
+
+            $forrange(axis, 0, 3)
+            {
+                var q = p + axis_offset(axis, cell_size);
+                var tr_sum = CSpectrum::zero();
+                $forrange(i, 0, tr_samples)
+                {
+                    tr_sum = tr_sum + medium.tr(cc, p, q, sampler);
+                };
+                store(tr_output, 9 * cell + 3 * axis, tr_sum / f32(tr_samples));
+            };
+        });
+    });
+
+    cuda::Buffer<float> device_direct(cell_count * 3);
+    cuda::Buffer<float> device_albedo(cell_count * 3);
+    cuda::Buffer<float> device_tr(cell_count * 9);
+    cuda::Buffer<int32_t> device_anisotropic_count(1);
+    device_anisotropic_count.clear(0);
+
+    const int block_cnt = up_align(cell_count, BLOCK_SIZE) / BLOCK_SIZE;
+    cuda_module.launch(
+        KERNEL,
+        { block_cnt, 1, 1 },
+        { BLOCK_SIZE, 1, 1 },
+        device_direct.get(),
+        device_albedo.get(),
+        device_tr.get(),
+        device_anisotropic_count.get());
+    throw_on_error(cudaStreamSynchronize(nullptr));
+
+    CellEstimates result;
+    device_anisotropic_count.to_cpu(&result.anisotropic_count);
+    result.direct = to_spectrums(device_direct, 3, 0);
+    result.albedo = to_spectrums(device_albedo, 3, 0);
+    for(int axis = 0; axis < 3; ++axis)
+        result.tr[axis] = to_spectrums(device_tr, 9, 3 * axis);
+    return result;
+}
+
+float volume::LightingCache::estimate_reference_error(
+    const Medium &medium, const LightSampler &light_sampler, const std::vector<Spectrum> &radiance) const
+{
+    const int res = options_.resolution;
+    const int cell_count = res * res * res;
+    const int probe_count = (std::min)(options_.reference_probes, cell_count);
+    const int paths = options_.reference_paths;
+    const Vec3f lower = bbox_.lower;
+    const Vec3f cell_size = cell_size_;
+    const float diagonal = 2 * length(bbox_.upper - bbox_.lower);
+
+    // probes are spread evenly over cell indices
+    std::vector<int32_t> probe_cells(probe_count);
+    for(int i = 0; i < probe_count; ++i)
+        probe_cells[i] = static_cast<int32_t>(static_cast<int64_t>(i) * cell_count / probe_count);
+
+    // radiance scattered out of scattering events sampled in the cell the same way as the albedo
+    // estimate, path traced with light sampling at each event and the exact phase functions.
+    // surfaces are ignored as in the cache, so only the propagation is measured
+
+    auto cuda_module = compile_kernel([&]
+    {
+        CompileContext cc;
+        cuj::kernel(REFERENCE_KERNEL, [&](ptr<i32> probe_cells_input, ptr<f32> reference_output)
+        {
+            var probe = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+            $if(probe >= probe_count)
+            {
+                $return();
+            };
+
+            var cell = probe_cells_input[probe];
+            var xi = cell % res;
+            var yi = (cell / res) % res;
+            var zi = cell / (res * res);
+            var p = CVec3f(
+                lower.x + (f32(xi) + 0.5f) * cell_size.x,
+                lower.y + (f32(yi) + 0.5f) * cell_size.y,
+                lower.z + (f32(zi) + 0.5f) * cell_size.z);
+
+            // decorrelated from the samples of the cache estimate
+            CellSampler sampler(cell + cell_count);
+
+            var radiance_sum = CSpectrum::zero();
+            var event_count = 0;
+            $forrange(i, 0, paths)
+            {
+                var d = cstd::min(i32(sampler.get1d() * 6.0f), i32(5));
+                var e = axis_offset(d / 2, cell_size) * cstd::select(d % 2 == 0, f32(0.5f), f32(-0.5f));
+                var o = p - e, end = p + e;
+                var beta = CSpectrum::one();
+                var depth = 0;
+                $loop
+                {
+                    auto sample = medium.sample(cc, o, end, sampler);
+                    $if(!sample.scattered)
+                    {
+                        $break;
+                    };
+                    $if(depth == 0)
+                    {
+                        event_count = event_count + 1;
+                    };
+
+                    beta = beta * sample.throughput;
+                    var dir = normalize(end - o);
+
+                    auto light_sample = sample_light(cc, medium, light_sampler, sample.position, diagonal, sampler);
+                    radiance_sum = radiance_sum + beta * light_sample.li * sample.shader->eval(cc, light_sample.dir, -dir);
+
+                    var phase_sample = sample.shader->sample(cc, -dir, sampler.get3d());
+                    $if(phase_sample.pdf <= 0.0f)
+                    {
+                        $break;
+                    };
+                    beta = beta * phase_sample.phase / phase_sample.pdf;
+
+                    depth = depth + 1;
+                    $if(depth >= REFERENCE_MAX_DEPTH)
+                    {
+                        $break;
+                    };
+                    $if(depth >= REFERENCE_RR_DEPTH)
+                    {
+                        var cont_prob = cstd::min(beta.get_lum(), 0.95f);
+                        $if(sampler.get1d() >= cont_prob)
+                        {
+                            $break;
+                        };
+                        beta = beta / cont_prob;
+                    };
+
+                    o = sample.position;
+                    end = o + diagonal * normalize(phase_sample.dir);
+                };
+            };
+
+            var reference = CSpectrum::zero();
+            $if(event_count > 0)
+            {
+                reference = radiance_sum / f32(event_count);
+            };
+            store(reference_output, 3 * probe, reference);
+        });
+    });
+
+    cuda::Buffer<int32_t> device_probe_cells(probe_cells);
+    cuda::Buffer<float> device_reference(probe_count * 3);
+
+    const int block_cnt = up_align(probe_count, BLOCK_SIZE) / BLOCK_SIZE;
+    cuda_module.launch(
+        REFERENCE_KERNEL,
+        { block_cnt, 1, 1 },
+        { BLOCK_SIZE, 1, 1 },
+        device_probe_cells.get(),
+        device_reference.get());
+    throw_on_error(cudaStreamSynchronize(nullptr));
+
+    const std::vector<Spectrum> reference = to_spectrums(device_reference, 3, 0);
+
+    double error_sum = 0, reference_sum = 0;
+    for(int i = 0; i < probe_count; ++i)
+    {
+        error_sum += std::abs(radiance[probe_cells[i]].get_lum() - reference[i].get_lum());
+        reference_sum += reference[i].get_lum();
+    }
+    return reference_sum > 0 ? static_cast<float>(error_sum / reference_sum) : 0.0f;
+}
+
+std::vector<Spectrum> volume::LightingCache::propagate(const CellEstimates &estimates)
+{
+    const int res = options_.resolution;
+    const size_t cell_count = estimates.direct.size();
+
+    // radiance scattered out of each cell, starting from single scattering
+    std::vector<Spectrum> source(cell_count);
+    for(size_t i = 0; i < cell_count; ++i)
+        source[i] = estimates.albedo[i] * estimates.direct[i];
+
+    std::vector<Spectrum> in_scattered(cell_count); // sum of radiance arriving along the 6 ordinates
+    std::vector<Spectrum> ordinate(cell_count);
+
+    stats_.iterations = 0;
+    stats_.residual = 0;
+    for(int iter = 0; iter < options_.max_iterations; ++iter)
+    {
+        std::fill(in_scattered.begin(), in_scattered.end(), Spectrum::zero());
+
+        for(int axis = 0; axis < 3; ++axis)
+        {
+            for(int sign : { 1, -1 })
+            {
+                // march along the ordinate so that the upwind neighbour is always updated first
+                for(int k = 0; k < res; ++k)
+                {
+                    const int a = sign > 0 ? k : res - 1 - k;
+                    for(int v = 0; v < res; ++v)
+                    {
+                        for(int u = 0; u < res; ++u)
+                        {
+                            int c[3];
+                            c[axis] = a;
+                            c[(axis + 1) % 3] = u;
+                            c[(axis + 2) % 3] = v;
+                            const int cell = cell_index(c[0], c[1], c[2]);
+
+                            Spectrum radiance = Spectrum::zero();
+                            if(0 <= a - sign && a - sign < res)
+                            {
+                                c[axis] = a - sign;
+                                const int upwind = cell_index(c[0], c[1], c[2]);
+                                const Spectrum &tr = estimates.tr[axis][sign > 0 ? upwind : cell];
+                                radiance = tr * ordinate[upwind] + (Spectrum::one() - tr) * source[upwind];
+                            }
+                            ordinate[cell] = radiance;
+                            in_scattered[cell] = in_scattered[cell] + radiance;
+                        }
+                    }
+                }
+            }
+        }
+
+        float diff = 0, sum = 0;
+        for(size_t i = 0; i < cell_count; ++i)
+        {
+            const Spectrum new_source =
+                estimates.albedo[i] * (estimates.direct[i] + in_scattered[i] / 6.0f);
+            diff += std::abs(new_source.get_lum() - source[i].get_lum());
+            sum += new_source.get_lum();
+            source[i] = new_source;
+        }
+
+        ++stats_.iterations;
+        stats_.residual = sum > 0 ? diff / sum : 0.0f;
+        if(stats_.residual < options_.tolerance)
+            break;
+    }
+
+    float scattered_lum = 0;
+    for(auto &s : in_scattered)
+        scattered_lum += s.get_lum() / 6.0f;
+    stats_.scattered_lum = scattered_lum / static_cast<float>(cell_count);
+
+    return source;
+}
+
+int volume::LightingCache::cell_index(int x, int y, int z) const
+{
+    const int res = options_.resolution;
+    return x + res * (y + res * z);
+}
+
+BTRC_END
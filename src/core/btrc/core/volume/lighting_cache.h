@@ -0,0 +1,67 @@
+#pragma once
+
+#include <btrc/core/light_sampler.h>
+#include <btrc/core/volume.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/uncopyable.h>
+
+BTRC_BEGIN
+
+namespace volume
+{
+
+    // radiance scattered out of each cell (albedo times average in-scattered radiance).
+    // the estimate assumes that:
+    //   phase functions are isotropic. samples with anisotropic phase functions are counted in
+    //   VolumeLightingCacheStats::anisotropic_samples and treated as isotropic
+    //   surfaces neither occlude lights nor reflect light into the medium
+    class LightingCache : public Uncopyable
+    {
+    public:
+
+        explicit LightingCache(const VolumeLightingCacheOptions &options);
+
+        // returns false when the device data is reallocated or the grid bounds change,
+        // which invalidates compiled kernels
+        bool build(const Medium &medium, const LightSampler &light_sampler, const AABB3f &bbox);
+
+        int get_depth() const;
+
+        VolumeLightingCacheStats get_stats() const;
+
+        CSpectrum eval(ref<CVec3f> position) const;
+
+    private:
+
+        struct CellEstimates
+        {
+            std::vector<Spectrum> direct; // average in-scattered radiance from lights
+            std::vector<Spectrum> albedo;
+            std::vector<Spectrum> tr[3];  // between a cell and its neighbour along +x, +y, +z
+            int32_t               anisotropic_count = 0;
+        };
+
+        CellEstimates estimate_cells(const Medium &medium, const LightSampler &light_sampler) const;
+
+        // discrete ordinates source iteration. returns radiance scattered out of each cell
+        std::vector<Spectrum> propagate(const CellEstimates &estimates);
+
+        // relative mean absolute luminance error of radiance against path traced references
+        // at options_.reference_probes cells
+        float estimate_reference_error(
+            const Medium &medium, const LightSampler &light_sampler, const std::vector<Spectrum> &radiance) const;
+
+        int cell_index(int x, int y, int z) const;
+
+        VolumeLightingCacheOptions options_;
+
+        AABB3f bbox_;
+        Vec3f  cell_size_;
+
+        cuda::Buffer<float>      radiance_; // 3 floats per cell
+        VolumeLightingCacheStats stats_;
+    };
+
+} // namespace volume
+
+BTRC_END
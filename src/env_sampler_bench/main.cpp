@@ -0,0 +1,246 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include <btrc/builtin/light/env_sampler.h>
+#include <btrc/builtin/texture2d/array2d.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/cuda/context.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/local_angle.h>
+
+namespace
+{
+
+    using namespace btrc;
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int SAMPLE_COUNT = 1 << 22;
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    // same as the defaults of ibl
+    const Vec2i LUT_RES = { 400, 200 };
+    constexpr int LUT_SAMPLES = 256;
+
+    const char SAMPLE_KERNEL[] = "sample_envir";
+    const char ESTIMATE_KERNEL[] = "estimate_envir";
+
+    float lum(const Vec3f &rgb)
+    {
+        return 0.2126f * rgb.x + 0.7152f * rgb.y + 0.0722f * rgb.z;
+    }
+
+    // sky gradient over a dim ground, with a small sun holding most of the energy
+    Image<Vec3f> generate_sun_sky(int width, int height)
+    {
+        constexpr float SUN_RADIUS = 0.01f;
+        const Vec3f sun_dir(std::sin(0.35f * btrc_pi) * std::cos(0.6f * btrc_pi),
+                            std::sin(0.35f * btrc_pi) * std::sin(0.6f * btrc_pi),
+                            std::cos(0.35f * btrc_pi));
+
+        Image<Vec3f> result(width, height);
+        for(int y = 0; y < height; ++y)
+        {
+            const float theta = btrc_pi * (y + 0.5f) / height;
+            for(int x = 0; x < width; ++x)
+            {
+                const float phi = 2 * btrc_pi * (x + 0.5f) / width;
+                const Vec3f dir(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+                Vec3f value = dir.z > 0 ? (0.5f + 0.5f * dir.z) * Vec3f(0.6f, 0.8f, 1.0f) : Vec3f(0.1f);
+                if(dot(dir, sun_dir) > std::cos(SUN_RADIUS))
+                    value = value + Vec3f(1e5f, 0.9e5f, 0.8e5f);
+                result(x, y) = value;
+            }
+        }
+        return result;
+    }
+
+    // integral of luminance over the sphere. texels are constant with point filtering
+    double integrate_luminance(const Image<Vec3f> &image)
+    {
+        double result = 0;
+        for(int y = 0; y < image.height(); ++y)
+        {
+            const double solid_angle = 2 * btrc_pi / image.width() *
+                (std::cos(btrc_pi * y / image.height()) - std::cos(btrc_pi * (y + 1) / image.height()));
+            for(int x = 0; x < image.width(); ++x)
+                result += solid_angle * lum(image(x, y));
+        }
+        return result;
+    }
+
+    RC<builtin::Array2D> create_texture(const Image<Vec3f> &image)
+    {
+        auto arr = newRC<cuda::Array>();
+        arr->load_from_memory(image);
+        cuda::Texture::Description desc;
+        desc.address_modes[0] = cuda::Texture::AddressMode::Wrap;
+        desc.address_modes[1] = cuda::Texture::AddressMode::Clamp;
+        desc.filter_mode = cuda::Texture::FilterMode::Point;
+        auto cuda_tex = newRC<cuda::Texture>();
+        cuda_tex->initialize(std::move(arr), desc);
+        auto result = newRC<builtin::Array2D>();
+        result->initialize(std::move(cuda_tex));
+        return result;
+    }
+
+    // SAMPLE_KERNEL only samples directions, and ESTIMATE_KERNEL writes luminance / pdf of each sample
+    cuda::Module build_kernels(
+        const builtin::EnvirLightSampler &sampler, const builtin::Array2D &tex,
+        const cuda::Buffer<Vec3f> &samples, const cuda::Buffer<float> &output)
+    {
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+
+            auto sample_direction = [&](i32 i)
+            {
+                var s = cuj::import_pointer(samples.get())[i];
+                var sam = make_sample(f32(s.x), f32(s.y), f32(s.z));
+                return sampler.sample(sam);
+            };
+
+            cuj::kernel(SAMPLE_KERNEL, [&]
+            {
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < SAMPLE_COUNT)
+                {
+                    var result = sample_direction(i);
+                    cuj::import_pointer(output.get())[i] =
+                        result.to_light.x + result.to_light.y + result.to_light.z + result.pdf;
+                };
+            });
+
+            cuj::kernel(ESTIMATE_KERNEL, [&]
+            {
+                CompileContext cc;
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < SAMPLE_COUNT)
+                {
+                    var result = sample_direction(i);
+                    var dir = normalize(result.to_light);
+                    var u = cstd::saturate(local_angle::phi(dir) / (2 * btrc_pi));
+                    var v = cstd::saturate(local_angle::theta(dir) / btrc_pi);
+                    var value = tex.sample_spectrum_inline(cc, CVec2f(u, v)).get_lum();
+                    cuj::import_pointer(output.get())[i] = cstd::select(result.pdf > 0.0f, value / result.pdf, 0.0f);
+                };
+            });
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module result;
+        result.load_ptx_from_memory(ptx.data(), ptx.size());
+        result.link();
+        return result;
+    }
+
+    void run_sampler(
+        const std::string &name, builtin::EnvirLightSampler &sampler, const RC<builtin::Array2D> &tex,
+        const cuda::Buffer<Vec3f> &samples, double reference)
+    {
+        auto start = Clock::now();
+        sampler.preprocess(tex, LUT_RES, LUT_SAMPLES);
+        const double preprocess_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        cuda::Buffer<float> output(SAMPLE_COUNT);
+        cuda::Module cuda_module = build_kernels(sampler, *tex, samples, output);
+
+        const int block_cnt = up_align(SAMPLE_COUNT, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+        auto launch = [&](const char *kernel)
+        {
+            cuda_module.launch(kernel, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 });
+            throw_on_error(cudaStreamSynchronize(nullptr));
+        };
+
+        // the first launch warms up caches
+        launch(SAMPLE_KERNEL);
+        start = Clock::now();
+        launch(SAMPLE_KERNEL);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        launch(ESTIMATE_KERNEL);
+        std::vector<float> estimates(SAMPLE_COUNT);
+        output.to_cpu(estimates.data());
+        double sum = 0, sum2 = 0;
+        for(float e : estimates)
+        {
+            sum += e;
+            sum2 += static_cast<double>(e) * e;
+        }
+        const double mean = sum / SAMPLE_COUNT;
+        const double variance = (std::max)(sum2 / SAMPLE_COUNT - mean * mean, 0.0);
+
+        std::cout << "    " << std::left << std::setw(20) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(14) << preprocess_ms << " "
+                  << std::setw(10) << SAMPLE_COUNT / seconds * 1e-6 << " "
+                  << std::setprecision(4) << std::setw(9) << mean / reference << " "
+                  << std::defaultfloat << std::setprecision(4) << std::setw(12) << variance / (reference * reference)
+                  << std::setprecision(6) << std::endl;
+    }
+
+    void run()
+    {
+        cuda::Context cuda_context(0);
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> dis(0, 1);
+        std::vector<Vec3f> host_samples(SAMPLE_COUNT);
+        for(auto &s : host_samples)
+            s = Vec3f(dis(rng), dis(rng), dis(rng));
+        const cuda::Buffer<Vec3f> samples(host_samples);
+
+        for(const Vec2i &res : { Vec2i(2048, 1024), Vec2i(8192, 4096) })
+        {
+            const Image<Vec3f> image = generate_sun_sky(res.x, res.y);
+            const double reference = integrate_luminance(image);
+            const auto tex = create_texture(image);
+
+            std::cout << "sun and sky, " << res.x << "x" << res.y << std::endl;
+            std::cout << "    sampler             preprocess(ms) Msample/s  mean/ref  rel. variance" << std::endl;
+
+            builtin::TileEnvirLightSampler tile;
+            run_sampler("tile", tile, tex, samples, reference);
+
+            builtin::HierarchicalEnvirLightSampler hierarchical;
+            run_sampler("hierarchical", hierarchical, tex, samples, reference);
+
+            builtin::HierarchicalEnvirLightSampler compensated;
+            compensated.set_compensation(true);
+            run_sampler("hierarchical (comp)", compensated, tex, samples, reference);
+        }
+    }
+
+} // namespace anonymous
+
+// usage: BtrcEnvSamplerBench
+// compares TileEnvirLightSampler with HierarchicalEnvirLightSampler on synthetic sun-and-sky maps: preprocessing
+// time, directions sampled per second by a jit kernel, and the mean and variance of luminance / pdf per sample,
+// relative to the exact integral of luminance. samplers with compensation do not sample dim directions,
+// so their mean is below 1 by design
+int main()
+{
+    try
+    {
+        run();
+    }
+    catch(const std::exception &err)
+    {
+        std::vector<std::string> err_msgs;
+        btrc::extract_hierarchy_exceptions(err, std::back_inserter(err_msgs));
+        for(auto &s : err_msgs)
+            std::cerr << s << std::endl;
+        return -1;
+    }
+}
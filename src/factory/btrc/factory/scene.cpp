@@ -1,3 +1,4 @@
+#include <btrc/core/bvh_light_sampler.h>
 #include <btrc/factory/scene.h>
 
 BTRC_FACTORY_BEGIN
@@ -79,6 +80,52 @@ RC<Scene> create_scene(const RC<const Node> &scene_root, Context &context)
         }
     }
 
+    if(auto bvh_node = scene_root->find_child_node("volume_bvh"))
+    {
+        VolumeBVHOptions options;
+
+        const std::string builder = bvh_node->parse_child_or("builder", std::string("ploc"));
+        if(builder == "ploc")
+            options.builder = VolumeBVHBuilder::LocallyOrderedClustering;
+        else if(builder == "binned_sah")
+            options.builder = VolumeBVHBuilder::BinnedSAH;
+        else if(builder == "sweep_sah")
+            options.builder = VolumeBVHBuilder::SweepSAH;
+        else if(builder == "lbvh")
+            options.builder = VolumeBVHBuilder::Linear;
+        else
+            throw BtrcException("unknown volume bvh builder: " + builder);
+        options.reinsertion = bvh_node->parse_child_or("reinsertion", options.reinsertion);
+
+        options.node_width = bvh_node->parse_child_or("node_width", options.node_width);
+        if(options.node_width != 2 && options.node_width != 4)
+            throw BtrcException("volume bvh node width must be 2 or 4");
+        options.rebuild_threshold = bvh_node->parse_child_or("rebuild_threshold", options.rebuild_threshold);
+        if(options.rebuild_threshold < 1)
+            throw BtrcException("volume bvh rebuild threshold must be no less than 1");
+        options.span_stats = bvh_node->parse_child_or("span_stats", options.span_stats);
+        result->set_volume_bvh_options(options);
+    }
+
+    if(auto cache_node = scene_root->find_child_node("volume_lighting_cache"))
+    {
+        VolumeLightingCacheOptions options;
+        options.enabled = cache_node->parse_child_or("enabled", true);
+        options.resolution = cache_node->parse_child_or("resolution", options.resolution);
+        if(options.resolution < 2)
+            throw BtrcException("volume lighting cache resolution must be at least 2");
+        options.depth = cache_node->parse_child_or("depth", options.depth);
+        if(options.depth < 1)
+            throw BtrcException("volume lighting cache depth must be positive");
+        options.light_samples = cache_node->parse_child_or("light_samples", options.light_samples);
+        options.tr_samples = cache_node->parse_child_or("tr_samples", options.tr_samples);
+        options.max_iterations = cache_node->parse_child_or("max_iterations", options.max_iterations);
+        options.tolerance = cache_node->parse_child_or("tolerance", options.tolerance);
+        options.reference_probes = cache_node->parse_child_or("reference_probes", options.reference_probes);
+        options.reference_paths = cache_node->parse_child_or("reference_paths", options.reference_paths);
+        result->set_volume_lighting_cache_options(options);
+    }
+
     if(auto env_node = scene_root->find_child_node("envir_light"))
     {
         auto light = context.create<Light>(env_node);
@@ -88,7 +135,15 @@ RC<Scene> create_scene(const RC<const Node> &scene_root, Context &context)
         result->set_envir_light(std::move(env_light));
     }
 
-    result->set_light_sampler(newRC<UniformLightSampler>());
+    const auto light_sampler = scene_root->parse_child_or<std::string>("light_sampler", "uniform");
+    if(light_sampler == "uniform")
+        result->set_light_sampler(newRC<UniformLightSampler>());
+    else if(light_sampler == "power")
+        result->set_light_sampler(newRC<PowerLightSampler>());
+    else if(light_sampler == "bvh")
+        result->set_light_sampler(newRC<BVHLightSampler>());
+    else
+        throw BtrcException("unknown light sampler: " + light_sampler);
 
     return result;
 }
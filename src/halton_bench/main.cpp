@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include <btrc/builtin/sampler/halton.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/cuda/context.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/low_discrepancy.h>
+
+namespace
+{
+
+    using namespace btrc;
+
+    using Clock = std::chrono::steady_clock;
+
+    using Randomization = builtin::HaltonSampler::Randomization;
+
+    // one halton index per device thread. the host computes the first HOST_INDEX_COUNT of them
+    constexpr int DEVICE_INDEX_COUNT = 1 << 22;
+    constexpr int HOST_INDEX_COUNT = 1 << 16;
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    const char KERNEL[] = "sample_halton";
+
+    const char *get_name(Randomization randomization)
+    {
+        return randomization == Randomization::Owen ? "owen" : "permute digits";
+    }
+
+    // same as HaltonSampler::sample_dimension
+    float sample_dimension_host(Randomization randomization, int dim, uint64_t halton_index)
+    {
+        if(randomization == Randomization::PermuteDigits && dim < DIGIT_PERMUTATION_DIMENSIONS)
+            return digit_permuted_radical_inverse_host(dim, halton_index);
+        return owen_scrambled_radical_inverse_host(dim, halton_index, mix_bits_host(1u + (static_cast<uint64_t>(dim) << 4)));
+    }
+
+    // sums of the first dimension_count dimensions of each index
+    std::vector<float> sample_on_host(Randomization randomization, int dimension_count, double &samples_per_second)
+    {
+        std::vector<float> result(HOST_INDEX_COUNT);
+        const auto start = Clock::now();
+        for(int i = 0; i < HOST_INDEX_COUNT; ++i)
+        {
+            float sum = 0;
+            for(int d = 0; d < dimension_count; ++d)
+                sum += sample_dimension_host(randomization, d, static_cast<uint64_t>(i));
+            result[i] = sum;
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        samples_per_second = static_cast<double>(HOST_INDEX_COUNT) * dimension_count / seconds;
+        return result;
+    }
+
+    // same sums with HaltonSampler in a jit kernel
+    std::vector<float> sample_on_device(Randomization randomization, int dimension_count, double &samples_per_second)
+    {
+        cuda::Buffer<float> device_sums(DEVICE_INDEX_COUNT);
+
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+            cuj::kernel(KERNEL, [&]
+            {
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < DEVICE_INDEX_COUNT)
+                {
+                    builtin::HaltonSampler::CState state;
+                    state.dimension = 0;
+                    state.halton_index = u64(i);
+                    builtin::HaltonSampler sampler({ 1, 1 }, randomization, state);
+                    var sum = 0.0f;
+                    $forrange(d, 0, dimension_count)
+                    {
+                        (void)d;
+                        sum = sum + sampler.get1d();
+                    };
+                    cuj::import_pointer(device_sums.get())[i] = sum;
+                };
+            });
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+
+        const int block_cnt = up_align(DEVICE_INDEX_COUNT, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+        auto launch = [&]
+        {
+            cuda_module.launch(KERNEL, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 });
+            throw_on_error(cudaStreamSynchronize(nullptr));
+        };
+
+        // the first launch warms up caches
+        launch();
+        const auto start = Clock::now();
+        launch();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        samples_per_second = static_cast<double>(DEVICE_INDEX_COUNT) * dimension_count / seconds;
+
+        std::vector<float> result(DEVICE_INDEX_COUNT);
+        device_sums.to_cpu(result.data());
+        return result;
+    }
+
+    void run_randomization(Randomization randomization, int dimension_count)
+    {
+        double host_rate, device_rate;
+        const auto host_sums = sample_on_host(randomization, dimension_count, host_rate);
+        const auto device_sums = sample_on_device(randomization, dimension_count, device_rate);
+
+        // fast math on the device may round differently
+        float max_diff = 0;
+        for(int i = 0; i < HOST_INDEX_COUNT; ++i)
+            max_diff = (std::max)(max_diff, std::abs(host_sums[i] - device_sums[i]));
+
+        std::cout << "    " << std::left << std::setw(16) << get_name(randomization)
+                  << std::right << std::setw(4) << dimension_count << " " << std::fixed << std::setprecision(2)
+                  << std::setw(13) << host_rate * 1e-6 << " "
+                  << std::setw(13) << device_rate * 1e-6 << " "
+                  << std::defaultfloat << std::setprecision(3) << std::setw(10) << max_diff
+                  << std::setprecision(6) << std::endl;
+    }
+
+    void run()
+    {
+        cuda::Context cuda_context(0);
+
+        std::cout << "    randomization   dims host(Msample/s) dev(Msample/s) max diff" << std::endl;
+
+        // permutation tables cover the first DIGIT_PERMUTATION_DIMENSIONS dimensions. later ones use owen
+        for(int dimension_count : { DIGIT_PERMUTATION_DIMENSIONS, 2 * DIGIT_PERMUTATION_DIMENSIONS })
+        {
+            run_randomization(Randomization::Owen, dimension_count);
+            run_randomization(Randomization::PermuteDigits, dimension_count);
+        }
+    }
+
+} // namespace anonymous
+
+// usage: BtrcHaltonBench
+// compares the two randomizations of HaltonSampler: hashed owen scrambling and precomputed digit permutations.
+// prints samples (dimensions of an index) per second of host radical inverses on a single thread and of
+// HaltonSampler in a jit kernel, and the largest difference between their per-index sums
+int main()
+{
+    try
+    {
+        run();
+    }
+    catch(const std::exception &err)
+    {
+        std::vector<std::string> err_msgs;
+        btrc::extract_hierarchy_exceptions(err, std::back_inserter(err_msgs));
+        for(auto &s : err_msgs)
+            std::cerr << s << std::endl;
+        return -1;
+    }
+}
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include <btrc/builtin/texture3d/array3d.h>
+#include <btrc/builtin/texture3d/sparse3d.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/cuda/context.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/exception.h>
+
+namespace
+{
+
+    using namespace btrc;
+
+    using Clock = std::chrono::steady_clock;
+
+    constexpr int HOST_LOOKUP_COUNT = 1 << 22;
+
+    // each device thread marches a short ray from its point
+    constexpr int DEVICE_RAY_COUNT = 1 << 20;
+    constexpr int DEVICE_STEPS_PER_RAY = 32;
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    const char KERNEL[] = "march_volume";
+
+    struct Volume
+    {
+        std::string        name;
+        int                res;
+        std::vector<float> data;
+    };
+
+    // gaussian blobs cut off at a small density, so that empty space is exactly zero
+    Volume generate_blobs(std::mt19937 &rng, const std::string &name, int res, int blob_count, float max_radius)
+    {
+        constexpr float CUTOFF = 0.01f;
+
+        std::uniform_real_distribution<float> pos_dis(0.1f, 0.9f);
+        std::uniform_real_distribution<float> radius_dis(0.3f * max_radius, max_radius);
+
+        Volume result{ name, res, std::vector<float>(static_cast<size_t>(res) * res * res) };
+        for(int i = 0; i < blob_count; ++i)
+        {
+            const Vec3f center(pos_dis(rng), pos_dis(rng), pos_dis(rng));
+            const float radius = radius_dis(rng);
+            const float extent = radius * std::sqrt(-std::log(CUTOFF));
+
+            auto texel_range = [&](float c, int &beg, int &end)
+            {
+                beg = (std::max)(static_cast<int>((c - extent) * res), 0);
+                end = (std::min)(static_cast<int>((c + extent) * res) + 1, res);
+            };
+            int x0, x1, y0, y1, z0, z1;
+            texel_range(center.x, x0, x1);
+            texel_range(center.y, y0, y1);
+            texel_range(center.z, z0, z1);
+
+            for(int z = z0; z < z1; ++z)
+            {
+                for(int y = y0; y < y1; ++y)
+                {
+                    for(int x = x0; x < x1; ++x)
+                    {
+                        const Vec3f p((x + 0.5f) / res, (y + 0.5f) / res, (z + 0.5f) / res);
+                        const float d = std::exp(-length_square(p - center) / (radius * radius));
+                        if(d >= CUTOFF)
+                            result.data[(static_cast<size_t>(z) * res + y) * res + x] += d;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // same addressing as SparseBrickGrid::sample
+    float sample_dense(const Volume &vol, const Vec3f &uvw)
+    {
+        const int res = vol.res;
+        auto to_texel = [&](float u, int &texel, float &frac)
+        {
+            const float p = std::clamp(u * res - 0.5f, 0.0f, static_cast<float>(res - 1));
+            texel = (std::min)(static_cast<int>(std::floor(p)), res - 2);
+            frac = p - static_cast<float>(texel);
+        };
+        int x, y, z; float fx, fy, fz;
+        to_texel(uvw.x, x, fx);
+        to_texel(uvw.y, y, fy);
+        to_texel(uvw.z, z, fz);
+
+        auto texel = [&](int dx, int dy, int dz)
+        {
+            return vol.data[(static_cast<size_t>(z + dz) * res + y + dy) * res + x + dx];
+        };
+        const float v00 = texel(0, 0, 0) * (1 - fx) + texel(1, 0, 0) * fx;
+        const float v10 = texel(0, 1, 0) * (1 - fx) + texel(1, 1, 0) * fx;
+        const float v01 = texel(0, 0, 1) * (1 - fx) + texel(1, 0, 1) * fx;
+        const float v11 = texel(0, 1, 1) * (1 - fx) + texel(1, 1, 1) * fx;
+        const float v0 = v00 * (1 - fy) + v10 * fy;
+        const float v1 = v01 * (1 - fy) + v11 * fy;
+        return v0 * (1 - fz) + v1 * fz;
+    }
+
+    template<typename F>
+    double host_lookups_per_second(const std::vector<Vec3f> &points, const F &lookup, double &checksum)
+    {
+        const auto start = Clock::now();
+        for(auto &p : points)
+            checksum += lookup(p);
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return points.size() / seconds;
+    }
+
+    // lookups per second of a jit ray marching kernel through tex
+    double device_lookups_per_second(
+        const Texture3D &tex, const cuda::Buffer<Vec3f> &origins, const cuda::Buffer<Vec3f> &dirs, double &checksum)
+    {
+        cuda::Buffer<float> sums(DEVICE_RAY_COUNT);
+
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+            cuj::kernel(KERNEL, [&]
+            {
+                CompileContext cc;
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < DEVICE_RAY_COUNT)
+                {
+                    var o = cuj::import_pointer(origins.get())[i];
+                    var d = cuj::import_pointer(dirs.get())[i];
+                    var sum = 0.0f;
+                    $forrange(j, 0, DEVICE_STEPS_PER_RAY)
+                    {
+                        var uvw = o + f32(j) * d;
+                        sum = sum + tex.sample_float_inline(cc, uvw);
+                    };
+                    cuj::import_pointer(sums.get())[i] = sum;
+                };
+            });
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+
+        const int block_cnt = up_align(DEVICE_RAY_COUNT, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+        auto launch = [&]
+        {
+            cuda_module.launch(KERNEL, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 });
+            throw_on_error(cudaStreamSynchronize(nullptr));
+        };
+
+        // the first launch warms up caches and the texture path
+        launch();
+        const auto start = Clock::now();
+        launch();
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<float> host_sums(DEVICE_RAY_COUNT);
+        sums.to_cpu(host_sums.data());
+        for(float s : host_sums)
+            checksum += s;
+        return static_cast<double>(DEVICE_RAY_COUNT) * DEVICE_STEPS_PER_RAY / seconds;
+    }
+
+    void run_volume(const Volume &vol)
+    {
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> dis(0, 1);
+
+        // host: brick building, memory and lookups
+
+        auto start = Clock::now();
+        auto grid = builtin::SparseBrickGrid::from_dense(vol.res, vol.res, vol.res, 1, vol.data.data());
+        const double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::vector<Vec3f> points(HOST_LOOKUP_COUNT);
+        for(auto &p : points)
+            p = Vec3f(dis(rng), dis(rng), dis(rng));
+
+        double sparse_host_checksum = 0, dense_host_checksum = 0;
+        const double sparse_host_rate = host_lookups_per_second(
+            points, [&](const Vec3f &p) { return grid.sample(p).x; }, sparse_host_checksum);
+        const double dense_host_rate = host_lookups_per_second(
+            points, [&](const Vec3f &p) { return sample_dense(vol, p); }, dense_host_checksum);
+
+        const size_t sparse_bytes = grid.get_memory_bytes();
+        const size_t dense_bytes = grid.get_dense_memory_bytes();
+        const int allocated_bricks = grid.get_allocated_brick_count();
+        const size_t total_bricks = grid.get_bricks().size();
+
+        // device: the same volume as a sparse texture and as a dense cuda texture
+
+        builtin::SparseArray3D sparse_tex;
+        sparse_tex.initialize(std::move(grid));
+
+        auto arr = newRC<cuda::Array>();
+        arr->load_from_memory(vol.res, vol.res, vol.res, cuda::Array::Format::F32x1, vol.data.data());
+        cuda::Texture::Description desc;
+        desc.address_modes[0] = desc.address_modes[1] = desc.address_modes[2] = cuda::Texture::AddressMode::Clamp;
+        desc.filter_mode = cuda::Texture::FilterMode::Linear;
+        auto cuda_tex = newRC<cuda::Texture>();
+        cuda_tex->initialize(std::move(arr), desc);
+        builtin::Array3D dense_tex;
+        dense_tex.initialize(std::move(cuda_tex));
+
+        std::vector<Vec3f> origins(DEVICE_RAY_COUNT), dirs(DEVICE_RAY_COUNT);
+        for(int i = 0; i < DEVICE_RAY_COUNT; ++i)
+        {
+            origins[i] = Vec3f(dis(rng), dis(rng), dis(rng));
+            const Vec3f d = Vec3f(dis(rng), dis(rng), dis(rng)) - Vec3f(0.5f);
+            dirs[i] = 0.5f / (DEVICE_STEPS_PER_RAY * vol.res) * normalize(d);
+        }
+        const cuda::Buffer<Vec3f> device_origins(origins), device_dirs(dirs);
+
+        double sparse_device_checksum = 0, dense_device_checksum = 0;
+        const double sparse_device_rate = device_lookups_per_second(
+            sparse_tex, device_origins, device_dirs, sparse_device_checksum);
+        const double dense_device_rate = device_lookups_per_second(
+            dense_tex, device_origins, device_dirs, dense_device_checksum);
+
+        std::cout << "    " << std::left << std::setw(14) << vol.name << " "
+                  << std::right << std::setw(4) << vol.res << "^3 "
+                  << std::setw(6) << allocated_bricks << "/" << std::left << std::setw(7) << total_bricks
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << dense_bytes / (1024.0 * 1024.0) << " "
+                  << std::setw(10) << sparse_bytes / (1024.0 * 1024.0) << " "
+                  << std::setw(9) << build_ms << " "
+                  << std::setw(11) << dense_host_rate * 1e-6 << " "
+                  << std::setw(11) << sparse_host_rate * 1e-6 << " "
+                  << std::setw(11) << dense_device_rate * 1e-9 << " "
+                  << std::setw(11) << sparse_device_rate * 1e-9
+                  << std::defaultfloat << std::setprecision(6)
+                  << "  (" << dense_host_checksum << ", " << sparse_host_checksum << ", "
+                  << dense_device_checksum << ", " << sparse_device_checksum << ")" << std::endl;
+    }
+
+    void run()
+    {
+        cuda::Context cuda_context(0);
+
+        std::cout << "    volume          res    bricks        dense(MB)  sparse(MB) build(ms) "
+                     "host dense  host sparse dev dense   dev sparse" << std::endl;
+        std::cout << "                                                                       "
+                     "(Mlookup/s) (Mlookup/s) (Glookup/s) (Glookup/s)" << std::endl;
+
+        std::mt19937 rng(42);
+        for(int res : { 64, 128, 256 })
+        {
+            run_volume(generate_blobs(rng, "few plumes", res, 4, 0.08f));
+            run_volume(generate_blobs(rng, "cloud", res, 32, 0.12f));
+            run_volume(generate_blobs(rng, "dense", res, 64, 0.5f));
+        }
+    }
+
+} // namespace anonymous
+
+// usage: BtrcSparseVolumeBench
+// compares SparseArray3D with a dense Array3D of the same volumes: memory of the textures, single-threaded
+// host lookups (SparseBrickGrid::sample against a dense trilinear lookup), and jit kernel lookups
+int main()
+{
+    try
+    {
+        run();
+    }
+    catch(const std::exception &err)
+    {
+        std::vector<std::string> err_msgs;
+        btrc::extract_hierarchy_exceptions(err, std::back_inserter(err_msgs));
+        for(auto &s : err_msgs)
+            std::cerr << s << std::endl;
+        return -1;
+    }
+}
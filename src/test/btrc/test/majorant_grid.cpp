@@ -0,0 +1,195 @@
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include <btrc/builtin/medium/majorant_grid.h>
+#include <btrc/test/test.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/cuda/module.h>
+
+BTRC_TEST_BEGIN
+
+namespace
+{
+
+    const char KERNEL[] = "traverse_majorant_grid";
+
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    constexpr int GRID_RES = 8;
+
+    constexpr float OUTSIDE_MAJORANT = 3.0f;
+
+    struct Segment
+    {
+        Vec3f a, b;
+    };
+
+    // accumulated over the pieces of a segment
+    struct TraversalResult
+    {
+        float covered_length; // sum of t_end - t_beg
+        float majorant_depth; // sum of majorant * (t_end - t_beg)
+        float max_gap;        // largest |t_beg - previous t_end|
+        float last_t_end;
+    };
+
+    constexpr int RESULT_FLOATS = sizeof(TraversalResult) / sizeof(float);
+
+    std::vector<TraversalResult> traverse_on_device(
+        const std::vector<float> &majorants, float outside_majorant, const std::vector<Segment> &segments)
+    {
+        const int segment_count = static_cast<int>(segments.size());
+        cuda::Buffer<float> device_majorants(majorants);
+        std::vector<Vec3f> endpoints;
+        for(auto &segment : segments)
+        {
+            endpoints.push_back(segment.a);
+            endpoints.push_back(segment.b);
+        }
+        cuda::Buffer<Vec3f> device_endpoints(endpoints);
+        cuda::Buffer<float> device_output(segment_count * RESULT_FLOATS);
+
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+            cuj::kernel(KERNEL, [&]
+            {
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < segment_count)
+                {
+                    var endpoint_ptr = cuj::import_pointer(device_endpoints.get());
+                    var output_ptr = cuj::import_pointer(device_output.get());
+                    var a = endpoint_ptr[2 * i];
+                    var b = endpoint_ptr[2 * i + 1];
+                    var t_max = length(b - a);
+                    var dir = (b - a) / t_max;
+
+                    const builtin::MajorantGridView grid = {
+                        .res              = GRID_RES,
+                        .majorants        = cuj::import_pointer(device_majorants.get()),
+                        .controls         = cuj::import_pointer(device_majorants.get()),
+                        .outside_majorant = outside_majorant,
+                        .outside_control  = outside_majorant
+                    };
+
+                    var covered_length = 0.0f, majorant_depth = 0.0f, max_gap = 0.0f, last_t_end = 0.0f;
+                    builtin::traverse_majorant_grid(grid, a, dir, t_max, [&](f32 t_beg, f32 t_end, f32 majorant, f32)
+                    {
+                        covered_length = covered_length + (t_end - t_beg);
+                        majorant_depth = majorant_depth + majorant * (t_end - t_beg);
+                        max_gap = cstd::max(max_gap, cstd::abs(t_beg - last_t_end));
+                        last_t_end = t_end;
+                        return boolean(false);
+                    });
+
+                    output_ptr[RESULT_FLOATS * i + 0] = covered_length;
+                    output_ptr[RESULT_FLOATS * i + 1] = majorant_depth;
+                    output_ptr[RESULT_FLOATS * i + 2] = max_gap;
+                    output_ptr[RESULT_FLOATS * i + 3] = last_t_end;
+                };
+            });
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+
+        const int block_cnt = up_align(segment_count, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+        cuda_module.launch(KERNEL, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 });
+        throw_on_error(cudaStreamSynchronize(nullptr));
+
+        std::vector<float> output(segment_count * RESULT_FLOATS);
+        device_output.to_cpu(output.data());
+        std::vector<TraversalResult> result(segment_count);
+        std::memcpy(result.data(), output.data(), output.size() * sizeof(float));
+        return result;
+    }
+
+    // midpoint rule along the segment. the error comes from the steps containing a cell boundary
+    double integrate_majorant(const std::vector<float> &majorants, float outside_majorant, const Segment &segment)
+    {
+        constexpr int STEP_COUNT = 1 << 16;
+        const double t_max = length(segment.b - segment.a);
+        double sum = 0;
+        for(int i = 0; i < STEP_COUNT; ++i)
+        {
+            const Vec3f p = segment.a + (i + 0.5f) / STEP_COUNT * (segment.b - segment.a);
+            const bool inside = 0 <= p.x && p.x < 1 && 0 <= p.y && p.y < 1 && 0 <= p.z && p.z < 1;
+            if(!inside)
+            {
+                sum += outside_majorant;
+                continue;
+            }
+            const int x = static_cast<int>(p.x * GRID_RES);
+            const int y = static_cast<int>(p.y * GRID_RES);
+            const int z = static_cast<int>(p.z * GRID_RES);
+            sum += majorants[(z * GRID_RES + y) * GRID_RES + x];
+        }
+        return sum * t_max / STEP_COUNT;
+    }
+
+    std::vector<Segment> generate_segments(std::mt19937 &rng)
+    {
+        // segments leaving the box through a face, starting outside it, missing it, and with zero direction components
+        std::vector<Segment> result = {
+            { Vec3f(0.5f, 0.5f, 0.5f), Vec3f(2.0f, 0.6f, 0.4f) },
+            { Vec3f(-1.0f, 0.3f, 0.7f), Vec3f(2.0f, 0.3f, 0.7f) },
+            { Vec3f(-0.5f, -0.5f, -0.5f), Vec3f(0.5f, 0.5f, 0.5f) },
+            { Vec3f(-1.0f, 2.0f, 0.5f), Vec3f(2.0f, 2.0f, 0.5f) },
+            { Vec3f(0.25f, 0.25f, -1.0f), Vec3f(0.25f, 0.25f, 2.0f) },
+            { Vec3f(0.1f, 0.2f, 0.3f), Vec3f(0.9f, 0.8f, 0.7f) }
+        };
+        std::uniform_real_distribution<float> dis(-1, 2);
+        for(int i = 0; i < 2000; ++i)
+            result.push_back({ Vec3f(dis(rng), dis(rng), dis(rng)), Vec3f(dis(rng), dis(rng), dis(rng)) });
+        return result;
+    }
+
+} // namespace anonymous
+
+BTRC_TEST(majorant_grid_traversal)
+{
+    std::mt19937 rng(42);
+    const auto segments = generate_segments(rng);
+
+    // with every cell at the outside majorant, the pieces must add up to the global-majorant result
+    const std::vector<float> uniform_majorants(GRID_RES * GRID_RES * GRID_RES, OUTSIDE_MAJORANT);
+    const auto uniform_results = traverse_on_device(uniform_majorants, OUTSIDE_MAJORANT, segments);
+    for(size_t i = 0; i < segments.size(); ++i)
+    {
+        const float t_max = length(segments[i].b - segments[i].a);
+        const auto &r = uniform_results[i];
+        BTRC_CHECK_NEAR(r.covered_length, t_max, 1e-4f * t_max);
+        BTRC_CHECK_NEAR(r.last_t_end, t_max, 1e-4f * t_max);
+        BTRC_CHECK_NEAR(r.max_gap, 0, 1e-5f);
+        BTRC_CHECK_NEAR(r.majorant_depth, OUTSIDE_MAJORANT * t_max, 1e-4f * OUTSIDE_MAJORANT * t_max);
+    }
+
+    // varying cells inside the box
+    std::uniform_real_distribution<float> majorant_dis(0, 2);
+    std::vector<float> majorants(GRID_RES * GRID_RES * GRID_RES);
+    for(auto &m : majorants)
+        m = majorant_dis(rng);
+    const auto results = traverse_on_device(majorants, OUTSIDE_MAJORANT, segments);
+    for(size_t i = 0; i < segments.size(); ++i)
+    {
+        const float t_max = length(segments[i].b - segments[i].a);
+        const auto &r = results[i];
+        BTRC_CHECK_NEAR(r.covered_length, t_max, 1e-4f * t_max);
+        BTRC_CHECK_NEAR(r.max_gap, 0, 1e-5f);
+        const double expected = integrate_majorant(majorants, OUTSIDE_MAJORANT, segments[i]);
+        BTRC_CHECK_NEAR(r.majorant_depth, expected, 2e-3 * (expected + 1));
+    }
+}
+
+BTRC_TEST_END
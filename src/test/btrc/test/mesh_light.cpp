@@ -0,0 +1,193 @@
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <btrc/builtin/light/mesh_light.h>
+#include <btrc/test/test.h>
+#include <btrc/utils/math/alias.h>
+
+BTRC_TEST_BEGIN
+
+namespace
+{
+
+    struct Triangle
+    {
+        Vec3f a, b, c;
+    };
+
+    // jittered grid on the z = 0 plane, facing +z
+    std::vector<Triangle> generate_triangles(std::mt19937 &rng, int res)
+    {
+        std::uniform_real_distribution<float> jitter_dis(-0.3f, 0.3f);
+        std::vector<Vec3f> vertices((res + 1) * (res + 1));
+        for(int y = 0; y <= res; ++y)
+        {
+            for(int x = 0; x <= res; ++x)
+            {
+                const bool border = x == 0 || y == 0 || x == res || y == res;
+                const float jx = border ? 0.0f : jitter_dis(rng);
+                const float jy = border ? 0.0f : jitter_dis(rng);
+                vertices[x + y * (res + 1)] = Vec3f(
+                    2 * (x + jx) / res - 1, 2 * (y + jy) / res - 1, 0);
+            }
+        }
+
+        std::vector<Triangle> result;
+        for(int y = 0; y < res; ++y)
+        {
+            for(int x = 0; x < res; ++x)
+            {
+                const Vec3f &v00 = vertices[x + y * (res + 1)];
+                const Vec3f &v10 = vertices[x + 1 + y * (res + 1)];
+                const Vec3f &v01 = vertices[x + (y + 1) * (res + 1)];
+                const Vec3f &v11 = vertices[x + 1 + (y + 1) * (res + 1)];
+                result.push_back({ v00, v10, v11 });
+                result.push_back({ v00, v11, v01 });
+            }
+        }
+        return result;
+    }
+
+    // distance along dir to the triangle, or a negative value
+    float intersect_triangle(const Vec3f &o, const Vec3f &dir, const Triangle &tri)
+    {
+        const Vec3f ab = tri.b - tri.a, ac = tri.c - tri.a;
+        const Vec3f s1 = cross(dir, ac);
+        const float div = dot(s1, ab);
+        if(div == 0)
+            return -1;
+        const Vec3f ao = o - tri.a;
+        const float u = dot(ao, s1) / div;
+        const Vec3f s2 = cross(ao, ab);
+        const float v = dot(dir, s2) / div;
+        if(u < 0 || v < 0 || u + v > 1)
+            return -1;
+        return dot(ac, s2) / div;
+    }
+
+    std::vector<float> generate_lums(std::mt19937 &rng, size_t count)
+    {
+        std::uniform_real_distribution<float> lum_dis(0, 10);
+        std::vector<float> result(count);
+        for(auto &lum : result)
+            lum = lum_dis(rng);
+        // unlit and invalid triangles must never be selected
+        result[0] = 0;
+        result[1] = -1;
+        result[2] = std::numeric_limits<float>::quiet_NaN();
+        result[3] = std::numeric_limits<float>::infinity();
+        return result;
+    }
+
+    std::vector<float> get_areas(const std::vector<Triangle> &triangles)
+    {
+        std::vector<float> result;
+        for(auto &tri : triangles)
+            result.push_back(0.5f * length(cross(tri.b - tri.a, tri.c - tri.a)));
+        return result;
+    }
+
+} // namespace anonymous
+
+BTRC_TEST(mesh_light_alias_table)
+{
+    std::mt19937 rng(42);
+    const auto triangles = generate_triangles(rng, 6);
+    const auto areas = get_areas(triangles);
+    const auto lums = generate_lums(rng, triangles.size());
+
+    auto table = builtin::MeshLight::build_emission_table(areas, lums);
+    BTRC_CHECK(table.total_weight > 0);
+    for(int i = 0; i < 4; ++i)
+    {
+        BTRC_CHECK(table.weights[i] == 0);
+        BTRC_CHECK(table.pdfs[i] == 0);
+    }
+
+    // selection probabilities of the alias table, from its units
+    const AliasTable alias_table(table.weights);
+    const auto units = alias_table.get_table();
+    const size_t n = units.size();
+    std::vector<double> probs(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+        probs[i] += units[i].accept_prob / n;
+        if(units[i].another_idx != i)
+            probs[units[i].another_idx] += (1.0 - units[i].accept_prob) / n;
+    }
+    for(size_t i = 0; i < n; ++i)
+    {
+        BTRC_CHECK_NEAR(probs[i], table.weights[i] / table.total_weight, 1e-5);
+        BTRC_CHECK_NEAR(table.pdfs[i] * areas[i], table.weights[i] / table.total_weight, 1e-6);
+    }
+
+    // sampled frequencies
+    constexpr int SAMPLE_COUNT = 1000000;
+    std::vector<double> freqs(n);
+    std::uniform_real_distribution<float> dis(0, 1);
+    for(int i = 0; i < SAMPLE_COUNT; ++i)
+        freqs[alias_table.sample(dis(rng))] += 1.0 / SAMPLE_COUNT;
+    for(size_t i = 0; i < n; ++i)
+    {
+        const double p = table.weights[i] / table.total_weight;
+        BTRC_CHECK_NEAR(freqs[i], p, 4 * std::sqrt(p * (1 - p) / SAMPLE_COUNT) + 1e-6);
+    }
+
+    // nothing to sample
+    const std::vector<float> zeros(areas.size());
+    table = builtin::MeshLight::build_emission_table(areas, zeros);
+    BTRC_CHECK(table.total_weight == 0);
+}
+
+BTRC_TEST(mesh_light_pdf_li)
+{
+    // pdf_li is the area density pdfs[i] converted to solid angle: pdf * dist^3 / |dot(n, ref_pos - pos)|.
+    // it is integrated over directions in a cone containing the mesh, seen from a point above its front
+    std::mt19937 rng(7);
+    const auto triangles = generate_triangles(rng, 6);
+    const auto areas = get_areas(triangles);
+    const auto table = builtin::MeshLight::build_emission_table(areas, generate_lums(rng, triangles.size()));
+
+    for(const Vec3f &ref_pos : { Vec3f(0.3f, 0.2f, 2), Vec3f(-1.5f, 0.5f, 0.7f), Vec3f(0, 0, 0.2f) })
+    {
+        float cos_max = 1;
+        const Vec3f axis = normalize(Vec3f(0) - ref_pos);
+        for(const Vec3f &corner : { Vec3f(-1, -1, 0), Vec3f(1, -1, 0), Vec3f(-1, 1, 0), Vec3f(1, 1, 0) })
+            cos_max = (std::min)(cos_max, dot(axis, normalize(corner - ref_pos)));
+        cos_max = (std::max)(cos_max - 0.01f, -1.0f);
+
+        // local frame of the cone
+        const Vec3f t = normalize(cross(axis, std::abs(axis.x) < 0.9f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0)));
+        const Vec3f b = cross(axis, t);
+
+        constexpr int SAMPLE_COUNT = 1000000;
+        const double cone_pdf = 1 / (2 * btrc_pi * (1 - static_cast<double>(cos_max)));
+        std::uniform_real_distribution<float> dis(0, 1);
+        double integral = 0;
+        for(int i = 0; i < SAMPLE_COUNT; ++i)
+        {
+            const float cos_theta = 1 - dis(rng) * (1 - cos_max);
+            const float sin_theta = std::sqrt((std::max)(0.0f, 1 - cos_theta * cos_theta));
+            const float phi = 2 * btrc_pi * dis(rng);
+            const Vec3f dir = cos_theta * axis + sin_theta * (std::cos(phi) * t + std::sin(phi) * b);
+
+            for(size_t j = 0; j < triangles.size(); ++j)
+            {
+                const float dist = intersect_triangle(ref_pos, dir, triangles[j]);
+                if(dist <= 0)
+                    continue;
+                const Vec3f pos = ref_pos + dist * dir;
+                const Vec3f spt_to_ref = ref_pos - pos;
+                const float dist2 = length_square(spt_to_ref);
+                const float dist3 = std::sqrt(dist2) * dist2;
+                const float pdf_li = table.pdfs[j] * dist3 / std::abs(dot(Vec3f(0, 0, 1), spt_to_ref));
+                integral += pdf_li / cone_pdf / SAMPLE_COUNT;
+                break;
+            }
+        }
+        BTRC_CHECK_NEAR(integral, 1, 0.02);
+    }
+}
+
+BTRC_TEST_END
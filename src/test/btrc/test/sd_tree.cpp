@@ -0,0 +1,290 @@
+#include <cmath>
+#include <random>
+
+#include <btrc/builtin/renderer/wavefront/sd_tree.h>
+#include <btrc/test/test.h>
+
+BTRC_TEST_BEGIN
+
+namespace
+{
+
+    using builtin::wfpt::DTree;
+    using builtin::wfpt::SDTree;
+
+    // pdfs are constant in quadtree cells no deeper than this
+    constexpr int MAX_DEPTH = 8;
+    constexpr int GRID_RES = 1 << (MAX_DEPTH + 1);
+
+    // radiance concentrated around a few directions on top of a dim background
+    float eval_radiance(const Vec2f &p)
+    {
+        auto lobe = [&](float x, float y, float s)
+        {
+            const float dx = p.x - x, dy = p.y - y;
+            return std::exp(-(dx * dx + dy * dy) / (s * s));
+        };
+        return 0.05f + 20 * lobe(0.3f, 0.7f, 0.02f) + 5 * lobe(0.8f, 0.2f, 0.1f);
+    }
+
+    void record_samples(DTree &dtree, std::mt19937 &rng, int count)
+    {
+        std::uniform_real_distribution<float> dis(0, 1);
+        for(int i = 0; i < count; ++i)
+        {
+            const Vec2f p(dis(rng), dis(rng));
+            dtree.record(p, eval_radiance(p));
+        }
+    }
+
+    // midpoint rule over cells finer than any quadtree leaf, so exact up to rounding
+    template<typename F>
+    double integrate_square(const F &f)
+    {
+        double sum = 0;
+        for(int y = 0; y < GRID_RES; ++y)
+        {
+            for(int x = 0; x < GRID_RES; ++x)
+            {
+                const Vec2f p((x + 0.5f) / GRID_RES, (y + 0.5f) / GRID_RES);
+                sum += f(p);
+            }
+        }
+        return sum / (static_cast<double>(GRID_RES) * GRID_RES);
+    }
+
+    DTree make_trained_dtree(std::mt19937 &rng)
+    {
+        // two rounds of recording and refinement, as in training iterations
+        DTree dtree;
+        record_samples(dtree, rng, 20000);
+        DTree refined = dtree.refine(0.01f, MAX_DEPTH);
+        record_samples(refined, rng, 50000);
+        DTree result = refined.refine(0.005f, MAX_DEPTH);
+        record_samples(result, rng, 100000);
+        return result;
+    }
+
+} // namespace anonymous
+
+BTRC_TEST(dtree_pdf)
+{
+    std::mt19937 rng(42);
+
+    // empty trees are uniform
+    const DTree empty;
+    BTRC_CHECK_NEAR(empty.pdf(Vec2f(0.3f, 0.6f)), 1, 1e-6);
+
+    const DTree dtree = make_trained_dtree(rng);
+    BTRC_CHECK(dtree.get_node_count() > 1);
+    BTRC_CHECK_NEAR(integrate_square([&](const Vec2f &p) { return dtree.pdf(p); }), 1, 1e-4);
+
+    // fractions of samples in the cells of a coarse grid match the pdf integrated over them
+    constexpr int BIN_RES = 8;
+    constexpr int SAMPLE_COUNT = 400000;
+    std::vector<double> bins(BIN_RES * BIN_RES), expected(BIN_RES * BIN_RES);
+    auto bin_index = [&](const Vec2f &p)
+    {
+        const int bx = (std::min)(static_cast<int>(p.x * BIN_RES), BIN_RES - 1);
+        const int by = (std::min)(static_cast<int>(p.y * BIN_RES), BIN_RES - 1);
+        return bx + by * BIN_RES;
+    };
+    integrate_square([&](const Vec2f &p)
+    {
+        expected[bin_index(p)] += static_cast<double>(dtree.pdf(p)) / (static_cast<double>(GRID_RES) * GRID_RES);
+        return 0.0f;
+    });
+
+    std::uniform_real_distribution<float> dis(0, 1);
+    for(int i = 0; i < SAMPLE_COUNT; ++i)
+    {
+        const Vec2f p = dtree.sample(Vec2f(dis(rng), dis(rng)));
+        BTRC_CHECK(0 <= p.x && p.x <= 1 && 0 <= p.y && p.y <= 1);
+        bins[bin_index(p)] += 1.0 / SAMPLE_COUNT;
+    }
+    for(size_t i = 0; i < bins.size(); ++i)
+        BTRC_CHECK_NEAR(bins[i], expected[i], 4 * std::sqrt(expected[i] / SAMPLE_COUNT) + 1e-5);
+}
+
+BTRC_TEST(dtree_refine)
+{
+    // all energy at one point
+    DTree dtree;
+    for(int i = 0; i < 100; ++i)
+        dtree.record(Vec2f(0.1f, 0.1f), 1);
+
+    // the root has a single old leaf, so only max_depth stops the subdivision
+    BTRC_CHECK(dtree.refine(0.01f, 1).get_node_count() == 1);
+
+    // the quadrant holding all energy is split, and below the old leaf energy is assumed uniform:
+    // depth 2 has fraction 1 / 4, depth 3 has 1 / 16 and depth 4 has 1 / 64, all above the threshold,
+    // so the tree has 1 + 1 + 4 + 16 + 64 nodes
+    BTRC_CHECK(dtree.refine(0.01f, 5).get_node_count() == 86);
+
+    // depth 4 is now below the threshold
+    BTRC_CHECK(dtree.refine(0.02f, 5).get_node_count() == 22);
+
+    // refined trees are empty and keep the structure
+    const DTree refined = dtree.refine(0.01f, 5);
+    BTRC_CHECK(refined.get_energy() == 0);
+    BTRC_CHECK(refined.get_sample_count() == 0);
+}
+
+BTRC_TEST(sd_tree_refine)
+{
+    const AABB3f bbox(Vec3f(0), Vec3f(1));
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dis(0, 1);
+    auto record = [&](SDTree &tree, int count)
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            const Vec3f position(dis(rng), dis(rng), dis(rng));
+            tree.record(position, Vec3f(0, 0, 1), 1);
+        }
+    };
+
+    // 1000 samples are halved by each split until they are no more than the threshold:
+    // 1000 -> 500 -> 250 -> 125 -> 62, so every leaf is split 4 times
+    SDTree::Params params;
+    params.spatial_threshold = 100;
+    SDTree tree(bbox, params);
+    record(tree, 1000);
+    tree.update();
+    BTRC_CHECK(tree.get_iteration_count() == 1);
+    BTRC_CHECK(tree.get_leaf_count() == 16);
+
+    // the threshold grows with sqrt(2^iteration), so 120 samples in each leaf split none of them.
+    // leaves are split along x, y, z and x again, making a 4 x 2 x 2 grid
+    for(int x = 0; x < 4; ++x)
+    {
+        for(int y = 0; y < 2; ++y)
+        {
+            for(int z = 0; z < 2; ++z)
+            {
+                const Vec3f center((x + 0.5f) / 4, (y + 0.5f) / 2, (z + 0.5f) / 2);
+                for(int i = 0; i < 120; ++i)
+                    tree.record(center, Vec3f(0, 0, 1), 1);
+            }
+        }
+    }
+    tree.update();
+    BTRC_CHECK(tree.get_leaf_count() == 16);
+
+    // splits stop at the spatial node budget. each split adds two nodes
+    params.max_spatial_nodes = 7;
+    SDTree limited(bbox, params);
+    record(limited, 1000);
+    limited.update();
+    BTRC_CHECK(limited.get_leaf_count() == 4);
+
+    // clear restores a single leaf
+    limited.clear();
+    BTRC_CHECK(limited.get_leaf_count() == 1);
+    BTRC_CHECK(limited.get_iteration_count() == 0);
+}
+
+BTRC_TEST(sd_tree_pdf)
+{
+    // the square mapping is equal-area, so the sphere integral of pdf is 4pi times its mean over the square
+    const AABB3f bbox(Vec3f(-1), Vec3f(1));
+    SDTree::Params params;
+    params.spatial_threshold = 2000;
+    params.directional_max_depth = MAX_DEPTH;
+    SDTree tree(bbox, params);
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> dis(0, 1);
+    for(int iteration = 0; iteration < 3; ++iteration)
+    {
+        for(int i = 0; i < 20000; ++i)
+        {
+            const Vec3f position(2 * dis(rng) - 1, 2 * dis(rng) - 1, 2 * dis(rng) - 1);
+            const Vec2f square(dis(rng), dis(rng));
+            const float position_scale = position.x > 0 ? 1.0f : 0.1f;
+            tree.record(position, builtin::wfpt::square_to_direction(square), position_scale * eval_radiance(square));
+        }
+        tree.update();
+    }
+    BTRC_CHECK(tree.get_leaf_count() > 1);
+    BTRC_CHECK(tree.get_directional_node_count() > tree.get_leaf_count());
+
+    for(const Vec3f &position : { Vec3f(0.5f, 0.5f, 0.5f), Vec3f(-0.5f, 0.2f, -0.9f), Vec3f(0.01f, -0.7f, 0.3f) })
+    {
+        const double integral = 4 * btrc_pi * integrate_square([&](const Vec2f &p)
+        {
+            return tree.pdf(position, builtin::wfpt::square_to_direction(p));
+        });
+        BTRC_CHECK_NEAR(integral, 1, 1e-3);
+    }
+
+    // mapping round trip, away from the poles where phi is undefined
+    for(int i = 0; i < 1000; ++i)
+    {
+        const Vec2f square(0.01f + 0.98f * dis(rng), dis(rng) * 0.999f);
+        const Vec2f round_trip = builtin::wfpt::direction_to_square(builtin::wfpt::square_to_direction(square));
+        BTRC_CHECK_NEAR(round_trip.x, square.x, 1e-4);
+        BTRC_CHECK_NEAR(round_trip.y, square.y, 1e-4);
+    }
+}
+
+BTRC_TEST(sd_tree_variance_reduction)
+{
+    // relative mse of n-sample estimates of the radiance integrated over the sphere at a point,
+    // with uniform directions as the bsdf sampling, against the one-sample mixture of it and the trained tree
+    // that the path tracer uses with a bsdf fraction of 0.5. both use the same number of samples
+    constexpr int SPP = 16;
+    constexpr int ESTIMATE_COUNT = 4000;
+    constexpr float BSDF_FRACTION = 0.5f;
+    constexpr float UNIFORM_PDF = 1 / (4 * btrc_pi);
+
+    const Vec3f position(0.2f, 0.3f, 0.4f);
+    SDTree::Params params;
+    params.directional_max_depth = MAX_DEPTH;
+    SDTree tree(AABB3f(Vec3f(-1), Vec3f(1)), params);
+
+    // training iterations with doubling sample counts
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> dis(0, 1);
+    for(int iteration = 0; iteration < 4; ++iteration)
+    {
+        for(int i = 0; i < (1 << 14) << iteration; ++i)
+        {
+            const Vec2f square(dis(rng), dis(rng));
+            tree.record(position, builtin::wfpt::square_to_direction(square), eval_radiance(square));
+        }
+        tree.update();
+    }
+
+    const double reference = 4 * btrc_pi * integrate_square(eval_radiance);
+    auto relative_mse = [&](const auto &sample_once)
+    {
+        double sum = 0;
+        for(int e = 0; e < ESTIMATE_COUNT; ++e)
+        {
+            double estimate = 0;
+            for(int s = 0; s < SPP; ++s)
+                estimate += sample_once() / SPP;
+            sum += (estimate - reference) * (estimate - reference);
+        }
+        return sum / ESTIMATE_COUNT / (reference * reference);
+    };
+
+    const double unguided_mse = relative_mse([&]
+    {
+        return eval_radiance(Vec2f(dis(rng), dis(rng))) / UNIFORM_PDF;
+    });
+    const double guided_mse = relative_mse([&]
+    {
+        const Vec2f u(dis(rng), dis(rng));
+        const Vec3f dir = dis(rng) < BSDF_FRACTION ?
+            builtin::wfpt::square_to_direction(u) : tree.sample(position, u);
+        const float pdf = BSDF_FRACTION * UNIFORM_PDF + (1 - BSDF_FRACTION) * tree.pdf(position, dir);
+        return eval_radiance(builtin::wfpt::direction_to_square(dir)) / pdf;
+    });
+
+    // about 17x lower in practice. the margin covers the noise of the unguided estimate
+    BTRC_CHECK(guided_mse < unguided_mse / 4);
+}
+
+BTRC_TEST_END
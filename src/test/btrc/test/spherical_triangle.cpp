@@ -0,0 +1,181 @@
+#include <cmath>
+
+#include <btrc/test/test.h>
+#include <btrc/utils/cmath/cdistribution.h>
+#include <btrc/utils/cuda/buffer.h>
+#include <btrc/utils/cuda/module.h>
+#include <btrc/utils/math/hammersley.h>
+
+BTRC_TEST_BEGIN
+
+namespace
+{
+
+    const char KERNEL[] = "sample_spherical_triangles";
+
+    constexpr int KERNEL_BLOCK_SIZE = 256;
+
+    constexpr int SAMPLE_COUNT = 1 << 20;
+
+    struct SphericalTriangle
+    {
+        Vec3f a, b, c;
+    };
+
+    SphericalTriangle make_triangle(const Vec3f &a, const Vec3f &b, const Vec3f &c)
+    {
+        return { normalize(a), normalize(b), normalize(c) };
+    }
+
+    double area(const SphericalTriangle &tri)
+    {
+        const double det = dot(tri.a, cross(tri.b, tri.c));
+        const double denom = 1.0 + dot(tri.a, tri.b) + dot(tri.a, tri.c) + dot(tri.b, tri.c);
+        return std::abs(2 * std::atan2(det, denom));
+    }
+
+    bool contains(const SphericalTriangle &tri, const Vec3f &p)
+    {
+        const float s = dot(tri.a, cross(tri.b, tri.c)) > 0 ? 1.0f : -1.0f;
+        return s * dot(p, cross(tri.a, tri.b)) >= 0 &&
+               s * dot(p, cross(tri.b, tri.c)) >= 0 &&
+               s * dot(p, cross(tri.c, tri.a)) >= 0;
+    }
+
+    // split at the midpoints of arcs, level times
+    void subdivide(const SphericalTriangle &tri, int level, std::vector<SphericalTriangle> &output)
+    {
+        if(!level)
+        {
+            output.push_back(tri);
+            return;
+        }
+        const Vec3f ab = normalize(tri.a + tri.b);
+        const Vec3f bc = normalize(tri.b + tri.c);
+        const Vec3f ca = normalize(tri.c + tri.a);
+        subdivide({ tri.a, ab, ca }, level - 1, output);
+        subdivide({ ab, tri.b, bc }, level - 1, output);
+        subdivide({ ca, bc, tri.c }, level - 1, output);
+        subdivide({ ab, bc, ca }, level - 1, output);
+    }
+
+    // SAMPLE_COUNT directions on each triangle, sampled on the device
+    std::vector<Vec3f> sample_on_device(const std::vector<SphericalTriangle> &triangles)
+    {
+        const int triangle_count = static_cast<int>(triangles.size());
+        const int total_count = triangle_count * SAMPLE_COUNT;
+
+        std::vector<Vec3f> vertices;
+        for(auto &tri : triangles)
+        {
+            vertices.push_back(tri.a);
+            vertices.push_back(tri.b);
+            vertices.push_back(tri.c);
+        }
+        cuda::Buffer<Vec3f> device_vertices(vertices);
+
+        std::vector<Vec2f> samples(SAMPLE_COUNT);
+        for(int i = 0; i < SAMPLE_COUNT; ++i)
+            samples[i] = hammersley2d(i, SAMPLE_COUNT);
+        cuda::Buffer<Vec2f> device_samples(samples);
+
+        cuda::Buffer<Vec3f> device_output(total_count);
+
+        std::string ptx;
+        {
+            cuj::ScopedModule cuj_module;
+            cuj::kernel(KERNEL, [&]
+            {
+                var i = i32(cstd::block_dim_x() * cstd::block_idx_x() + cstd::thread_idx_x());
+                $if(i < total_count)
+                {
+                    var vertex_ptr = cuj::import_pointer(device_vertices.get());
+                    var output_ptr = cuj::import_pointer(device_output.get());
+                    var sample_ptr = cuj::import_pointer(device_samples.get());
+                    var tri = i / SAMPLE_COUNT;
+                    var u = sample_ptr[i % SAMPLE_COUNT];
+                    output_ptr[i] = sample_spherical_triangle(
+                        vertex_ptr[3 * tri], vertex_ptr[3 * tri + 1], vertex_ptr[3 * tri + 2], u.x, u.y);
+                };
+            });
+
+            cuj::PTXGenerator gen;
+            gen.set_options(cuj::Options{
+                .opt_level = cuj::OptimizationLevel::O3,
+                .fast_math = true,
+                .approx_math_func = true
+            });
+            gen.generate(cuj_module);
+            ptx = gen.get_ptx();
+        }
+
+        cuda::Module cuda_module;
+        cuda_module.load_ptx_from_memory(ptx.data(), ptx.size());
+        cuda_module.link();
+
+        const int block_cnt = up_align(total_count, KERNEL_BLOCK_SIZE) / KERNEL_BLOCK_SIZE;
+        cuda_module.launch(KERNEL, { block_cnt, 1, 1 }, { KERNEL_BLOCK_SIZE, 1, 1 });
+        throw_on_error(cudaStreamSynchronize(nullptr));
+
+        std::vector<Vec3f> result(total_count);
+        device_output.to_cpu(result.data());
+        return result;
+    }
+
+} // namespace anonymous
+
+BTRC_TEST(spherical_triangle_sampling)
+{
+    // samples must be uniform in solid angle: the fraction of them in each sub-triangle
+    // is its area divided by the area of the whole triangle
+    const std::vector<SphericalTriangle> triangles = {
+        make_triangle(Vec3f(1, 0, 0), Vec3f(0, 1, 0), Vec3f(0, 0, 1)),
+        make_triangle(Vec3f(1, 0, 0), Vec3f(0, 0, 1), Vec3f(0, 1, 0)),
+        make_triangle(Vec3f(0.1f, 0, 1), Vec3f(0, 0.1f, 1), Vec3f(-0.05f, -0.05f, 1)),
+        make_triangle(Vec3f(1, 0, 0.2f), Vec3f(0, 1, 0.2f), Vec3f(-1, 0.1f, 0.2f)),
+        make_triangle(Vec3f(1, 0, 0), Vec3f(0.2f, 1, 0), Vec3f(0, 0.02f, 1))
+    };
+    const auto samples = sample_on_device(triangles);
+
+    for(size_t t = 0; t < triangles.size(); ++t)
+    {
+        const auto &tri = triangles[t];
+        const double tri_area = area(tri);
+        BTRC_CHECK(tri_area > 0);
+
+        std::vector<SphericalTriangle> sub_triangles;
+        subdivide(tri, 2, sub_triangles);
+
+        std::vector<int> counts(sub_triangles.size());
+        int outside_count = 0;
+        for(int i = 0; i < SAMPLE_COUNT; ++i)
+        {
+            const Vec3f &dir = samples[t * SAMPLE_COUNT + i];
+            BTRC_CHECK_NEAR(length(dir), 1, 1e-3);
+
+            bool found = false;
+            for(size_t s = 0; s < sub_triangles.size(); ++s)
+            {
+                if(contains(sub_triangles[s], dir))
+                {
+                    ++counts[s];
+                    found = true;
+                    break;
+                }
+            }
+            if(!found)
+                ++outside_count;
+        }
+
+        // only rounding puts samples outside, on the edges
+        BTRC_CHECK(outside_count <= SAMPLE_COUNT / 10000);
+        for(size_t s = 0; s < sub_triangles.size(); ++s)
+        {
+            const double expected = area(sub_triangles[s]) / tri_area;
+            const double actual = static_cast<double>(counts[s]) / SAMPLE_COUNT;
+            BTRC_CHECK_NEAR(actual, expected, 4 * std::sqrt(expected * (1 - expected) / SAMPLE_COUNT) + 1e-3);
+        }
+    }
+}
+
+BTRC_TEST_END
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <btrc/common.h>
+
+#define BTRC_TEST_BEGIN BTRC_BEGIN namespace test {
+#define BTRC_TEST_END   } BTRC_END
+
+BTRC_TEST_BEGIN
+
+struct TestCase
+{
+    const char *name;
+    void      (*func)();
+};
+
+std::vector<TestCase> &get_test_cases();
+
+struct TestRegistrar
+{
+    TestRegistrar(const char *name, void (*func)());
+};
+
+class TestFailure : public BtrcException
+{
+public:
+
+    using BtrcException::BtrcException;
+};
+
+[[noreturn]] void fail(const std::string &msg, const char *file, int line);
+
+BTRC_TEST_END
+
+#define BTRC_TEST(NAME)                                                                  \
+    static void btrc_test_##NAME();                                                      \
+    static ::btrc::test::TestRegistrar btrc_test_registrar_##NAME(#NAME, &btrc_test_##NAME); \
+    static void btrc_test_##NAME()
+
+#define BTRC_CHECK(COND)                                                  \
+    do                                                                    \
+    {                                                                     \
+        if(!(COND))                                                       \
+            ::btrc::test::fail("check failed: " #COND, __FILE__, __LINE__); \
+    } while(false)
+
+// |a - b| <= tol
+#define BTRC_CHECK_NEAR(A, B, TOL)                                              \
+    do                                                                          \
+    {                                                                           \
+        const double btrc_check_a = static_cast<double>(A);                     \
+        const double btrc_check_b = static_cast<double>(B);                     \
+        if(!(std::abs(btrc_check_a - btrc_check_b) <= static_cast<double>(TOL))) \
+        {                                                                       \
+            std::ostringstream btrc_check_msg;                                  \
+            btrc_check_msg << "check failed: " #A " ~= " #B " ("                \
+                           << btrc_check_a << " vs " << btrc_check_b            \
+                           << ", tolerance " << (TOL) << ")";                   \
+            ::btrc::test::fail(btrc_check_msg.str(), __FILE__, __LINE__);       \
+        }                                                                       \
+    } while(false)
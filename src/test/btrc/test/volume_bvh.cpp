@@ -0,0 +1,164 @@
+#include <random>
+
+#include <btrc/core/volume/bvh.h>
+#include <btrc/core/volume/indexing.h>
+#include <btrc/test/test.h>
+#include <btrc/utils/math/quaterion.h>
+
+BTRC_TEST_BEGIN
+
+namespace
+{
+
+    constexpr uint64_t OVERLAP_KEY_SEED = 0x1234abcd;
+
+    constexpr int QUERY_COUNT = 2000;
+
+    std::vector<RC<VolumePrimitive>> generate_volumes(std::mt19937 &rng, int count)
+    {
+        std::uniform_real_distribution<float> pos_dis(-10, 10);
+        std::uniform_real_distribution<float> size_dis(0.05f, 3);
+        std::uniform_real_distribution<float> angle_dis(0, 2 * btrc_pi);
+
+        std::vector<RC<VolumePrimitive>> result;
+        for(int i = 0; i < count; ++i)
+        {
+            const Quaterion rot(normalize(Vec3f(pos_dis(rng), pos_dis(rng), pos_dis(rng)) + Vec3f(0, 0, 1e-3f)), angle_dis(rng));
+            const Vec3f x = rot.apply_to_vector(Vec3f(size_dis(rng), 0, 0));
+            const Vec3f y = rot.apply_to_vector(Vec3f(0, size_dis(rng), 0));
+            const Vec3f z = rot.apply_to_vector(Vec3f(0, 0, size_dis(rng)));
+            auto vol = newRC<VolumePrimitive>();
+            vol->set_geometry(Vec3f(pos_dis(rng), pos_dis(rng), pos_dis(rng)), x, y, z);
+            result.push_back(std::move(vol));
+        }
+        return result;
+    }
+
+    // closest t in [0, 1] where segment a -> b enters or leaves a volume, in double precision
+    double brute_force_intersection(const std::vector<RC<VolumePrimitive>> &vols, const Vec3f &a, const Vec3f &b)
+    {
+        double result = btrc_max_float;
+        for(auto &vol : vols)
+        {
+            const auto geo = vol->get_geometry_info();
+            double t0 = 0, t1 = 1;
+            for(const Vec3f &axis : { geo.x, geo.y, geo.z })
+            {
+                const double axis_len2 = static_cast<double>(dot(axis, axis));
+                const double opd = static_cast<double>(dot(a - geo.o, axis)) / axis_len2;
+                const double dd = static_cast<double>(dot(b - a, axis)) / axis_len2;
+                const double nd = -opd / dd, fd = (1 - opd) / dd;
+                t0 = (std::max)(t0, (std::min)(nd, fd));
+                t1 = (std::min)(t1, (std::max)(nd, fd));
+            }
+            if(t0 > t1)
+                continue;
+            if(t0 > 0)
+                result = (std::min)(result, t0);
+            else if(t1 < 1)
+                result = (std::min)(result, t1);
+        }
+        return result;
+    }
+
+    volume::BVH::HostOverlap brute_force_overlap(const std::vector<RC<VolumePrimitive>> &vols, const Vec3f &p)
+    {
+        volume::BVH::HostOverlap result;
+        for(uint32_t i = 0; i < vols.size(); ++i)
+        {
+            // same float containment test as the bvh, so that boundary points agree
+            const auto prim = volume::make_bvh_primitive(*vols[i], i);
+            const Vec3f op = p - prim.o;
+            const float u = dot(op, prim.x_div_x2);
+            const float v = dot(op, prim.y_div_y2);
+            const float w = dot(op, prim.z_div_z2);
+            if(0 <= u && u <= 1 && 0 <= v && v <= 1 && 0 <= w && w <= 1)
+            {
+                result.key ^= volume::get_volume_key(OVERLAP_KEY_SEED, i);
+                ++result.count;
+            }
+        }
+        return result;
+    }
+
+    void check_traversal(
+        const volume::BVH                      &bvh,
+        volume::BVH::Traversal                  traversal,
+        const std::vector<RC<VolumePrimitive>> &vols,
+        std::mt19937                           &rng)
+    {
+        std::uniform_real_distribution<float> pos_dis(-12, 12);
+        for(int i = 0; i < QUERY_COUNT; ++i)
+        {
+            const Vec3f a(pos_dis(rng), pos_dis(rng), pos_dis(rng));
+            const Vec3f b(pos_dis(rng), pos_dis(rng), pos_dis(rng));
+            const double expected = brute_force_intersection(vols, a, b);
+            const float t = bvh.find_closest_intersection_host(traversal, a, b);
+            if(expected > 1)
+                BTRC_CHECK(t > 1);
+            else
+                BTRC_CHECK_NEAR(t, expected, 1e-4);
+
+            const auto overlap = bvh.get_overlap_host(traversal, a);
+            const auto expected_overlap = brute_force_overlap(vols, a);
+            BTRC_CHECK(overlap.count == expected_overlap.count);
+            BTRC_CHECK(overlap.key == expected_overlap.key);
+        }
+    }
+
+} // namespace anonymous
+
+BTRC_TEST(volume_bvh_traversal)
+{
+    std::mt19937 rng(42);
+    for(int vol_count : { 1, 2, 17, 200 })
+    {
+        const auto vols = generate_volumes(rng, vol_count);
+        for(auto builder : {
+            VolumeBVHBuilder::LocallyOrderedClustering, VolumeBVHBuilder::BinnedSAH,
+            VolumeBVHBuilder::SweepSAH, VolumeBVHBuilder::Linear })
+        {
+            for(bool reinsertion : { false, true })
+            {
+                for(int node_width : { 2, 4 })
+                {
+                    VolumeBVHOptions options;
+                    options.builder = builder;
+                    options.reinsertion = reinsertion;
+                    options.node_width = node_width;
+                    const volume::BVH bvh(vols, OVERLAP_KEY_SEED, options);
+                    const auto stats = bvh.get_stats();
+
+                    check_traversal(bvh, volume::BVH::Traversal::Stackless, vols, rng);
+                    if(stats.max_depth <= 32)
+                        check_traversal(bvh, volume::BVH::Traversal::Ordered, vols, rng);
+                    if(stats.wide_node_count > 0)
+                        check_traversal(bvh, volume::BVH::Traversal::Wide, vols, rng);
+                }
+            }
+        }
+    }
+}
+
+BTRC_TEST(volume_bvh_refit)
+{
+    // moved volumes must be found after update_geometry, whether it refits or rebuilds
+    std::mt19937 rng(7);
+    auto vols = generate_volumes(rng, 50);
+    volume::BVH bvh(vols, OVERLAP_KEY_SEED);
+
+    std::uniform_real_distribution<float> offset_dis(-4, 4);
+    for(int frame = 0; frame < 4; ++frame)
+    {
+        for(auto &vol : vols)
+        {
+            const auto geo = vol->get_geometry_info();
+            const Vec3f offset(offset_dis(rng), offset_dis(rng), offset_dis(rng));
+            vol->set_geometry(geo.o + offset, geo.x, geo.y, geo.z);
+        }
+        bvh.update_geometry();
+        check_traversal(bvh, bvh.get_traversal(), vols, rng);
+    }
+}
+
+BTRC_TEST_END
@@ -0,0 +1,58 @@
+#include <cmath>
+#include <iostream>
+#include <string_view>
+
+#include <btrc/test/test.h>
+#include <btrc/utils/cuda/context.h>
+
+BTRC_TEST_BEGIN
+
+std::vector<TestCase> &get_test_cases()
+{
+    static std::vector<TestCase> result;
+    return result;
+}
+
+TestRegistrar::TestRegistrar(const char *name, void (*func)())
+{
+    get_test_cases().push_back({ name, func });
+}
+
+void fail(const std::string &msg, const char *file, int line)
+{
+    throw TestFailure(std::string(file) + ":" + std::to_string(line) + ": " + msg);
+}
+
+BTRC_TEST_END
+
+// usage: BtrcTest [name filter]
+int main(int argc, char *argv[])
+{
+    using namespace btrc;
+
+    const std::string_view filter = argc > 1 ? argv[1] : "";
+
+    cuda::Context cuda_context(0);
+
+    int run_count = 0, fail_count = 0;
+    for(auto &test_case : test::get_test_cases())
+    {
+        if(std::string_view(test_case.name).find(filter) == std::string_view::npos)
+            continue;
+        ++run_count;
+        std::cout << "[ run  ] " << test_case.name << std::endl;
+        try
+        {
+            test_case.func();
+            std::cout << "[ pass ] " << test_case.name << std::endl;
+        }
+        catch(const std::exception &err)
+        {
+            ++fail_count;
+            std::cout << "[ fail ] " << test_case.name << std::endl << err.what() << std::endl;
+        }
+    }
+
+    std::cout << run_count - fail_count << "/" << run_count << " tests passed" << std::endl;
+    return fail_count ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include <btrc/builtin/register.h>
+#include <btrc/core/scene.h>
+#include <btrc/core/volume/bvh.h>
+#include <btrc/factory/context.h>
+#include <btrc/factory/node/parser.h>
+#include <btrc/factory/scene.h>
+#include <btrc/utils/cuda/context.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/file.h>
+#include <btrc/utils/math/quaterion.h>
+#include <btrc/utils/optix/context.h>
+#include <btrc/utils/unreachable.h>
+
+namespace
+{
+
+    using namespace btrc;
+
+    constexpr int QUERY_COUNT = 200000;
+
+    struct Layout
+    {
+        std::string                      name;
+        std::vector<RC<VolumePrimitive>> vols;
+    };
+
+    RC<VolumePrimitive> make_volume(const Vec3f &o, const Vec3f &size, const Quaterion &rot)
+    {
+        auto vol = newRC<VolumePrimitive>();
+        vol->set_geometry(
+            o,
+            rot.apply_to_vector(Vec3f(size.x, 0, 0)),
+            rot.apply_to_vector(Vec3f(0, size.y, 0)),
+            rot.apply_to_vector(Vec3f(0, 0, size.z)));
+        return vol;
+    }
+
+    Quaterion random_rotation(std::mt19937 &rng)
+    {
+        std::uniform_real_distribution<float> dis(-1, 1);
+        std::uniform_real_distribution<float> angle_dis(0, 2 * btrc_pi);
+        return Quaterion(normalize(Vec3f(dis(rng), dis(rng), dis(rng) + 1e-3f)), angle_dis(rng));
+    }
+
+    // uniformly scattered boxes of similar sizes
+    Layout generate_uniform(std::mt19937 &rng, int count)
+    {
+        std::uniform_real_distribution<float> pos_dis(-50, 50);
+        std::uniform_real_distribution<float> size_dis(0.5f, 4);
+        Layout result{ "uniform " + std::to_string(count) };
+        for(int i = 0; i < count; ++i)
+        {
+            const Vec3f o(pos_dis(rng), pos_dis(rng), pos_dis(rng));
+            const Vec3f size(size_dis(rng), size_dis(rng), size_dis(rng));
+            result.vols.push_back(make_volume(o, size, random_rotation(rng)));
+        }
+        return result;
+    }
+
+    // a few dense clusters of overlapping boxes, like smoke plumes made of many sources
+    Layout generate_clustered(std::mt19937 &rng, int count)
+    {
+        std::uniform_real_distribution<float> center_dis(-50, 50);
+        std::normal_distribution<float> offset_dis(0, 3);
+        std::uniform_real_distribution<float> size_dis(1, 6);
+        constexpr int CLUSTER_COUNT = 8;
+
+        std::vector<Vec3f> centers;
+        for(int i = 0; i < CLUSTER_COUNT; ++i)
+            centers.push_back(Vec3f(center_dis(rng), center_dis(rng), center_dis(rng)));
+
+        Layout result{ "clustered " + std::to_string(count) };
+        for(int i = 0; i < count; ++i)
+        {
+            const Vec3f o = centers[i % CLUSTER_COUNT] + Vec3f(offset_dis(rng), offset_dis(rng), offset_dis(rng));
+            const Vec3f size(size_dis(rng), size_dis(rng), size_dis(rng));
+            result.vols.push_back(make_volume(o, size, random_rotation(rng)));
+        }
+        return result;
+    }
+
+    // thin axis-aligned slabs of very different sizes, like layered fog and small clouds
+    Layout generate_mixed_scale(std::mt19937 &rng, int count)
+    {
+        std::uniform_real_distribution<float> pos_dis(-50, 50);
+        std::uniform_real_distribution<float> log_size_dis(-2, 4);
+        Layout result{ "mixed scale " + std::to_string(count) };
+        for(int i = 0; i < count; ++i)
+        {
+            const Vec3f o(pos_dis(rng), pos_dis(rng), pos_dis(rng));
+            const Vec3f size(std::exp(log_size_dis(rng)), 0.2f, std::exp(log_size_dis(rng)));
+            result.vols.push_back(make_volume(o, size, Quaterion()));
+        }
+        return result;
+    }
+
+    Layout load_scene_layout(const std::string &scene_filename)
+    {
+        optix::Context optix_context(nullptr);
+        factory::Context btrc_context(optix_context);
+        builtin::register_builtin_creators(btrc_context);
+
+        const auto scene_dir = std::filesystem::path(scene_filename).parent_path();
+        btrc_context.add_path_mapping("scene_directory", scene_dir.string());
+
+        factory::JSONParser parser;
+        parser.set_source(read_txt_file(scene_filename));
+        parser.add_include_directory(scene_dir);
+        parser.parse();
+        auto root_node = parser.get_result();
+
+        auto scene = create_scene(root_node->child_node("scene"), btrc_context);
+        return Layout{ scene_filename, scene->get_volumes() };
+    }
+
+    const char *builder_name(VolumeBVHBuilder builder)
+    {
+        switch(builder)
+        {
+        case VolumeBVHBuilder::LocallyOrderedClustering: return "ploc";
+        case VolumeBVHBuilder::BinnedSAH:                return "binned_sah";
+        case VolumeBVHBuilder::SweepSAH:                 return "sweep_sah";
+        case VolumeBVHBuilder::Linear:                   return "lbvh";
+        }
+        unreachable();
+    }
+
+    const char *traversal_name(volume::BVH::Traversal traversal)
+    {
+        switch(traversal)
+        {
+        case volume::BVH::Traversal::Ordered:   return "ordered";
+        case volume::BVH::Traversal::Stackless: return "stackless";
+        case volume::BVH::Traversal::Wide:      return "wide";
+        }
+        unreachable();
+    }
+
+    void run_layout(const Layout &layout)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        std::cout << layout.name << " (" << layout.vols.size() << " volumes)" << std::endl;
+        if(layout.vols.empty())
+            return;
+
+        // queries are spread over the bounding box of all volumes
+        AABB3f bbox;
+        for(auto &vol : layout.vols)
+            bbox = union_aabb(bbox, vol->get_bounding_box());
+
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> dis(0, 1);
+        auto random_point = [&]
+        {
+            return bbox.lower + (bbox.upper - bbox.lower) * Vec3f(dis(rng), dis(rng), dis(rng));
+        };
+        std::vector<Vec3f> points(2 * QUERY_COUNT);
+        for(auto &p : points)
+            p = random_point();
+
+        std::cout << "    builder     reins width  build(ms)   sah cost  depth  traversal  "
+                     "segment(Mq/s)  overlap(Mq/s)" << std::endl;
+
+        for(auto builder : {
+            VolumeBVHBuilder::LocallyOrderedClustering, VolumeBVHBuilder::BinnedSAH,
+            VolumeBVHBuilder::SweepSAH, VolumeBVHBuilder::Linear })
+        {
+            for(bool reinsertion : { false, true })
+            {
+                for(int node_width : { 2, 4 })
+                {
+                    VolumeBVHOptions options;
+                    options.builder = builder;
+                    options.reinsertion = reinsertion;
+                    options.node_width = node_width;
+                    const volume::BVH bvh(layout.vols, 0, options);
+                    const auto stats = bvh.get_stats();
+                    const auto traversal = bvh.get_traversal();
+
+                    // checksums keep the queries from being optimized away
+                    float t_sum = 0;
+                    auto start = Clock::now();
+                    for(int i = 0; i < QUERY_COUNT; ++i)
+                    {
+                        const float t = bvh.find_closest_intersection_host(traversal, points[2 * i], points[2 * i + 1]);
+                        t_sum += t <= 1 ? t : 0.0f;
+                    }
+                    const double segment_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+                    int count_sum = 0;
+                    start = Clock::now();
+                    for(int i = 0; i < QUERY_COUNT; ++i)
+                        count_sum += bvh.get_overlap_host(traversal, points[i]).count;
+                    const double overlap_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+                    const int depth = node_width == 2 ? stats.max_depth : stats.wide_max_depth;
+                    std::cout << "    " << std::left
+                              << std::setw(11) << builder_name(builder) << " "
+                              << std::setw(5) << (reinsertion ? "on" : "off") << " "
+                              << std::setw(5) << node_width << " "
+                              << std::right << std::fixed << std::setprecision(3)
+                              << std::setw(10) << stats.build_time_ms << " "
+                              << std::setw(10) << stats.sah_cost << " "
+                              << std::setw(6) << depth << "  "
+                              << std::left << std::setw(10) << traversal_name(traversal) << " "
+                              << std::right << std::setprecision(2)
+                              << std::setw(14) << QUERY_COUNT / segment_s * 1e-6 << " "
+                              << std::setw(14) << QUERY_COUNT / overlap_s * 1e-6
+                              << std::defaultfloat << std::setprecision(6)
+                              << "  (" << t_sum << ", " << count_sum << ")" << std::endl;
+                }
+            }
+        }
+    }
+
+    void run(const std::vector<std::string> &scene_filenames)
+    {
+        cuda::Context cuda_context(0);
+
+        std::cout << "host wide slab test: " << volume::BVH::get_host_slab_test_name() << std::endl;
+
+        std::vector<Layout> layouts;
+        std::mt19937 rng(42);
+        for(int count : { 64, 1024, 16384 })
+        {
+            layouts.push_back(generate_uniform(rng, count));
+            layouts.push_back(generate_clustered(rng, count));
+            layouts.push_back(generate_mixed_scale(rng, count));
+        }
+        for(auto &filename : scene_filenames)
+            layouts.push_back(load_scene_layout(filename));
+
+        for(auto &layout : layouts)
+            run_layout(layout);
+    }
+
+} // namespace anonymous
+
+// usage: BtrcVolumeBvhBench [config.json...]
+// throughputs are of the single-threaded host versions of the traversals the device would use.
+// the wide traversal tests the four child boxes of a node with one sse2 / neon instruction per slab
+int main(int argc, char *argv[])
+{
+    try
+    {
+        run(std::vector<std::string>(argv + 1, argv + argc));
+    }
+    catch(const std::exception &err)
+    {
+        std::vector<std::string> err_msgs;
+        btrc::extract_hierarchy_exceptions(err, std::back_inserter(err_msgs));
+        for(auto &s : err_msgs)
+            std::cerr << s << std::endl;
+        return -1;
+    }
+}
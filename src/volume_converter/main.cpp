@@ -0,0 +1,109 @@
+#include <chrono>
+#include <iostream>
+
+#include <btrc/utils/cuda/array.h>
+#include <btrc/utils/cuda/context.h>
+#include <btrc/utils/cuda/error.h>
+#include <btrc/utils/exception.h>
+#include <btrc/utils/volume_file.h>
+
+namespace
+{
+
+    double elapsed_ms(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run(const std::string &input_filename, const std::string &output_filename, bool half)
+    {
+        using namespace btrc;
+        using clock = std::chrono::steady_clock;
+
+        std::cout << "parse " << input_filename << std::endl;
+
+        auto start = clock::now();
+        int width, height, depth, channels;
+        auto data = load_text_volume(input_filename, width, height, depth, channels);
+        const double text_ms = elapsed_ms(start);
+
+        std::cout << width << "x" << height << "x" << depth << ", " << channels << " channels" << std::endl;
+
+        // cuda arrays have no 3-channel formats
+        if(channels == 3)
+        {
+            std::vector<float> padded;
+            padded.reserve(data.size() / 3 * 4);
+            for(size_t i = 0; i < data.size(); i += 3)
+            {
+                padded.push_back(data[i + 0]);
+                padded.push_back(data[i + 1]);
+                padded.push_back(data[i + 2]);
+                padded.push_back(1.0f);
+            }
+            data.swap(padded);
+            channels = 4;
+        }
+
+        std::cout << "write " << output_filename << std::endl;
+
+        start = clock::now();
+        const auto component = half ? VolumeFileComponent::F16 : VolumeFileComponent::F32;
+        save_volume_file(output_filename, width, height, depth, channels, component, data.data());
+        const double write_ms = elapsed_ms(start);
+
+        // loading time of both files into the cuda array a texture would use.
+        // the context is created first so that its initialization is not timed
+        cuda::Context cuda_context(0);
+
+        auto time_array_load = [&](auto &&load)
+        {
+            const auto load_start = clock::now();
+            cuda::Array arr;
+            load(arr);
+            throw_on_error(cudaDeviceSynchronize());
+            return elapsed_ms(load_start);
+        };
+        const double text_load_ms = time_array_load([&](cuda::Array &arr) { arr.load_from_text(input_filename); });
+        const double binary_load_ms = time_array_load([&](cuda::Array &arr) { arr.load_from_binary(output_filename); });
+
+        std::cout << "text parsing:   " << text_ms << "ms" << std::endl;
+        std::cout << "binary writing: " << write_ms << "ms" << std::endl;
+        std::cout << "text loading:   " << text_load_ms << "ms (cuda::Array::load_from_text)" << std::endl;
+        std::cout << "binary loading: " << binary_load_ms << "ms (cuda::Array::load_from_binary)" << std::endl;
+    }
+
+} // namespace anonymous
+
+int main(int argc, char *argv[])
+{
+    bool half = false;
+    std::vector<std::string> filenames;
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if(arg == "--half")
+            half = true;
+        else
+            filenames.push_back(arg);
+    }
+
+    if(filenames.size() != 2)
+    {
+        std::cerr << "usage: BtrcVolumeConverter input.txt output.vol [--half]" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        run(filenames[0], filenames[1], half);
+    }
+    catch(const std::exception &err)
+    {
+        std::vector<std::string> err_msgs;
+        btrc::extract_hierarchy_exceptions(err, std::back_inserter(err_msgs));
+        for(auto &s : err_msgs)
+            std::cerr << s << std::endl;
+        return -1;
+    }
+}